@@ -31,6 +31,7 @@
 #include <vmm_host_irq.h>
 #include <vmm_vcpu_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_exitstat.h>
 #include <emulate_arm.h>
 #include <emulate_thumb.h>
 #include <cpu_inline_asm.h>
@@ -44,6 +45,7 @@
 void do_undef_inst(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
 	struct vmm_vcpu *vcpu;
 
 	if ((regs->cpsr & CPSR_MODE_MASK) != CPSR_MODE_USER) {
@@ -54,6 +56,8 @@ void do_undef_inst(arch_regs_t *regs)
 
 	vcpu = vmm_scheduler_current_vcpu();
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	/* If vcpu priviledge is user then generate exception
 	 * and return without emulating instruction
 	 */
@@ -73,12 +77,15 @@ void do_undef_inst(arch_regs_t *regs)
 		vmm_printf("%s: error %d\n", __func__, rc);
 	}
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_INSN, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_soft_irq(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
 	struct vmm_vcpu * vcpu;
 
 	if ((regs->cpsr & CPSR_MODE_MASK) == CPSR_MODE_SUPERVISOR) {
@@ -93,6 +100,8 @@ void do_soft_irq(arch_regs_t *regs)
 
 	vcpu = vmm_scheduler_current_vcpu();
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	/* If vcpu priviledge is user then generate exception
 	 * and return without emulating instruction
 	 */
@@ -112,12 +121,15 @@ void do_soft_irq(arch_regs_t *regs)
 		vmm_printf("%s: error %d\n", __func__, rc);
 	}
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_HVC, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_prefetch_abort(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
 	bool crash_dump = FALSE;
 	u32 ifsr, ifar, fs;
 	struct vmm_vcpu *vcpu;
@@ -172,6 +184,8 @@ void do_prefetch_abort(arch_regs_t *regs)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	switch(fs) {
 	case IFSR_FS_TTBL_WALK_SYNC_EXT_ABORT_1:
 	case IFSR_FS_TTBL_WALK_SYNC_EXT_ABORT_2:
@@ -250,12 +264,15 @@ void do_prefetch_abort(arch_regs_t *regs)
 		cpu_vcpu_dump_user_reg(vcpu, regs);
 	}
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_PAGEFAULT, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_data_abort(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
 	bool crash_dump = FALSE;
 	u32 dfsr, dfar, fs, dom, wnr;
 	struct vmm_vcpu *vcpu;
@@ -324,6 +341,8 @@ void do_data_abort(arch_regs_t *regs)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	switch(fs) {
 	case DFSR_FS_ALIGN_FAULT:
 		rc = VMM_EFAIL;
@@ -415,6 +434,8 @@ void do_data_abort(arch_regs_t *regs)
 		cpu_vcpu_dump_user_reg(vcpu, regs);
 	}
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_PAGEFAULT, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
@@ -425,10 +446,20 @@ void do_not_used(arch_regs_t *regs)
 
 void do_irq(arch_regs_t *regs)
 {
+	u64 tstamp = 0;
+	struct vmm_vcpu *vcpu = NULL;
+
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	if ((regs->cpsr & CPSR_MODE_MASK) == CPSR_MODE_USER) {
+		vcpu = vmm_scheduler_current_vcpu();
+		tstamp = vmm_exitstat_begin(vcpu);
+	}
+
 	vmm_host_active_irq_exec(CPU_EXTERNAL_IRQ);
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_IRQ, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
@@ -77,7 +77,7 @@ static int cpu_vcpu_cp15_vtlb_update(struct arm_priv_cp15 *cp15,
 				     bool is_virtual)
 {
 	int rc;
-	u32 entry, victim, zone;
+	u32 i, start, len, entry, victim, zone;
 	struct arm_vtlb_entry *e = NULL;
 
 	/* Find appropriate zone */
@@ -97,9 +97,32 @@ static int cpu_vcpu_cp15_vtlb_update(struct arm_priv_cp15 *cp15,
 		}
 	}
 
-	/* Find out next victim entry from TLB */
+	/* Find out next victim entry from TLB
+	 * Free entries (left behind by VA based flushes) are used first.
+	 * Otherwise entries are evicted in round-robin order but entries
+	 * mapping section or bigger pages get a second chance because
+	 * evicting them causes many more faults.
+	 */
+	start = CPU_VCPU_VTLB_ZONE_START(zone);
+	len = CPU_VCPU_VTLB_ZONE_LEN(zone);
 	victim = cp15->vtlb.victim[zone];
-	entry = victim + CPU_VCPU_VTLB_ZONE_START(zone);
+	for (i = 0; i < len; i++) {
+		if (!cp15->vtlb.table[start + victim].l2) {
+			break;
+		}
+		victim = (victim + 1 < len) ? victim + 1 : 0;
+	}
+	if (i == len) {
+		for (i = 0; i < len; i++) {
+			e = &cp15->vtlb.table[start + victim];
+			if ((e->psz < TTBL_L1TBL_SECTION_PAGE_SIZE) || e->sc) {
+				break;
+			}
+			e->sc = 1;
+			victim = (victim + 1 < len) ? victim + 1 : 0;
+		}
+	}
+	entry = victim + start;
 	e = &cp15->vtlb.table[entry];
 	if (e->l2) {
 		/* Remove valid victim page from L2 Page Table */
@@ -113,6 +136,7 @@ static int cpu_vcpu_cp15_vtlb_update(struct arm_priv_cp15 *cp15,
 
 	/* Save original domain */
 	e->dom = domain;
+	e->sc = 0;
 
 	/* Ensure pages for normal vcpu are non-global */
 	p->ng = 1;
@@ -151,6 +175,180 @@ static int cpu_vcpu_cp15_vtlb_update(struct arm_priv_cp15 *cp15,
 	return VMM_OK;
 }
 
+/* Find ASID cache of given guest ASID */
+static struct arm_vtlb_asid_cache *cpu_vcpu_cp15_asid_cache_find(
+					struct arm_priv_cp15 *cp15, u32 asid)
+{
+	u32 i;
+
+	for (i = 0; i < CPU_VCPU_VTLB_ASID_CACHE_COUNT; i++) {
+		if (cp15->asid_cache[i].valid &&
+		    (cp15->asid_cache[i].asid == asid)) {
+			return &cp15->asid_cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Get ASID cache for saving pages of given guest ASID. If no free
+ * ASID cache is available then least recently saved one is reused.
+ */
+static struct arm_vtlb_asid_cache *cpu_vcpu_cp15_asid_cache_get(
+					struct arm_priv_cp15 *cp15, u32 asid)
+{
+	u32 i;
+	struct arm_vtlb_asid_cache *c, *ret;
+
+	ret = cpu_vcpu_cp15_asid_cache_find(cp15, asid);
+	if (ret) {
+		return ret;
+	}
+
+	ret = &cp15->asid_cache[0];
+	for (i = 0; i < CPU_VCPU_VTLB_ASID_CACHE_COUNT; i++) {
+		c = &cp15->asid_cache[i];
+		if (!c->valid) {
+			ret = c;
+			break;
+		}
+		if (c->stamp < ret->stamp) {
+			ret = c;
+		}
+	}
+
+	ret->valid = FALSE;
+	ret->asid = asid;
+	ret->count = 0;
+
+	return ret;
+}
+
+/* Drop pages from ASID caches
+ * Note: va == 0xFFFFFFFF means all pages
+ * Note: asid == 0xFFFFFFFF means all ASIDs
+ */
+static void cpu_vcpu_cp15_asid_cache_flush(struct arm_priv_cp15 *cp15,
+					   virtual_addr_t va, u32 asid,
+					   u32 dacr_xor_diff)
+{
+	u32 i, p;
+	struct arm_vtlb_asid_page *ap;
+	struct arm_vtlb_asid_cache *c;
+
+	for (i = 0; i < CPU_VCPU_VTLB_ASID_CACHE_COUNT; i++) {
+		c = &cp15->asid_cache[i];
+		if (!c->valid) {
+			continue;
+		}
+		if ((asid != 0xFFFFFFFF) && (c->asid != asid)) {
+			continue;
+		}
+		if ((va == 0xFFFFFFFF) && !dacr_xor_diff) {
+			c->valid = FALSE;
+			c->count = 0;
+			continue;
+		}
+
+		p = 0;
+		while (p < c->count) {
+			ap = &c->page[p];
+			if (dacr_xor_diff ?
+			    ((dacr_xor_diff >> ((ap->dom & 0xF) << 1)) & 0x3) :
+			    ((ap->pg.va <= va) &&
+			     (va < (ap->pg.va + ap->pg.sz)))) {
+				c->count--;
+				c->page[p] = c->page[c->count];
+			} else {
+				p++;
+			}
+		}
+		if (!c->count) {
+			c->valid = FALSE;
+		}
+	}
+}
+
+/* Switch non-global VTLB entries from one guest ASID to another.
+ * Non-global pages of old ASID are saved in ASID cache and removed
+ * from shadow page table. Non-global pages of new ASID are restored
+ * from ASID cache so that guest does not take shadow faults for them
+ * after context switch.
+ */
+static int cpu_vcpu_cp15_vtlb_switch_asid(struct arm_priv_cp15 *cp15,
+					  u32 old_asid, u32 new_asid)
+{
+	int rc;
+	register u32 vtlb, vtlb_last, i;
+	register struct arm_vtlb_entry *e;
+	struct arm_vtlb_asid_cache *c = NULL;
+	struct arm_vtlb_asid_page *ap;
+	struct cpu_page pg;
+
+	/* Save and remove non-global pages of old ASID */
+	vtlb = CPU_VCPU_VTLB_ZONE_START(CPU_VCPU_VTLB_ZONE_NG);
+	vtlb_last = vtlb + CPU_VCPU_VTLB_ZONE_LEN(CPU_VCPU_VTLB_ZONE_NG);
+	for (; vtlb < vtlb_last; vtlb++) {
+		e = &cp15->vtlb.table[vtlb];
+		if (!e->l2) {
+			continue;
+		}
+
+		if (!c) {
+			c = cpu_vcpu_cp15_asid_cache_get(cp15, old_asid);
+		}
+		if (!cpu_mmu_get_page(cp15->l1, e->pva, &pg)) {
+			ap = &c->page[c->count];
+			ap->pg = pg;
+			ap->dom = e->dom;
+			c->count++;
+		}
+
+		rc = cpu_mmu_unmap_l2tbl_page(e->l2,
+					      e->pva, e->psz,
+					      FALSE);
+		if (rc) {
+			return rc;
+		}
+		e->l2 = NULL;
+		e->dom = 0;
+	}
+	if (c && c->count) {
+		c->valid = TRUE;
+		c->stamp = ++cp15->asid_stamp;
+	}
+	cp15->vtlb.victim[CPU_VCPU_VTLB_ZONE_NG] = 0;
+
+	/* Restore non-global pages of new ASID */
+	c = cpu_vcpu_cp15_asid_cache_find(cp15, new_asid);
+	if (c) {
+		vtlb = CPU_VCPU_VTLB_ZONE_START(CPU_VCPU_VTLB_ZONE_NG);
+		for (i = 0; i < c->count; i++) {
+			e = &cp15->vtlb.table[vtlb + i];
+			pg = c->page[i].pg;
+			if (cpu_mmu_map_page(cp15->l1, &pg)) {
+				break;
+			}
+			e->dom = c->page[i].dom;
+			e->sc = 0;
+			e->pva = pg.va;
+			e->psz = pg.sz;
+			if (cpu_mmu_get_l2tbl(cp15->l1, pg.va, &e->l2)) {
+				cpu_mmu_unmap_page(cp15->l1, &pg);
+				e->l2 = NULL;
+				e->dom = 0;
+				break;
+			}
+		}
+		cp15->vtlb.victim[CPU_VCPU_VTLB_ZONE_NG] =
+				i % CPU_VCPU_VTLB_ZONE_LEN(CPU_VCPU_VTLB_ZONE_NG);
+		c->valid = FALSE;
+		c->count = 0;
+	}
+
+	return cpu_mmu_sync_ttbr(cp15->l1);
+}
+
 int cpu_vcpu_cp15_vtlb_flush(struct arm_priv_cp15 *cp15)
 {
 	int rc;
@@ -175,6 +373,8 @@ int cpu_vcpu_cp15_vtlb_flush(struct arm_priv_cp15 *cp15)
 		cp15->vtlb.victim[zone] = 0;
 	}
 
+	cpu_vcpu_cp15_asid_cache_flush(cp15, 0xFFFFFFFF, 0xFFFFFFFF, 0);
+
 	return cpu_mmu_sync_ttbr(cp15->l1);
 }
 
@@ -204,6 +404,8 @@ int cpu_vcpu_cp15_vtlb_flush_va(struct arm_priv_cp15 *cp15,
 		}
 	}
 
+	cpu_vcpu_cp15_asid_cache_flush(cp15, va, 0xFFFFFFFF, 0);
+
 	return cpu_mmu_sync_ttbr_va(cp15->l1, va);
 }
 
@@ -289,6 +491,9 @@ int cpu_vcpu_cp15_vtlb_flush_domain(struct arm_priv_cp15 *cp15,
 		}
 	}
 
+	cpu_vcpu_cp15_asid_cache_flush(cp15, 0xFFFFFFFF, 0xFFFFFFFF,
+				       dacr_xor_diff);
+
 	return cpu_mmu_sync_ttbr(cp15->l1);
 }
 
@@ -1982,9 +2187,13 @@ bool cpu_vcpu_cp15_write(struct vmm_vcpu *vcpu,
 			cpu_vcpu_cp15_vtlb_flush(cp15);
 			break;
 		case 1:	/* Invalidate single TLB entry. */
+			cpu_vcpu_cp15_asid_cache_flush(cp15,
+					data & ~0xFFF, data & 0xFF, 0);
 			cpu_vcpu_cp15_vtlb_flush_ng_va(cp15, data);
 			break;
 		case 2: /* Invalidate on ASID. */
+			cpu_vcpu_cp15_asid_cache_flush(cp15,
+					0xFFFFFFFF, data & 0xFF, 0);
 			cpu_vcpu_cp15_vtlb_flush_ng(cp15);
 			break;
 		case 3:	/* Invalidate single entry on MVA. */
@@ -2151,12 +2360,18 @@ bool cpu_vcpu_cp15_write(struct vmm_vcpu *vcpu,
 			cp15->c13_fcse = data;
 			break;
 		case 1:
-			/* This changes the ASID,
-			 * so flush non-global pages from vTLB.
+			/* This changes the ASID, so switch non-global
+			 * pages in vTLB to the new ASID. Pages of old
+			 * ASID are preserved in ASID cache.
 			 */
-			if (cp15->c13_context != data &&
-			    !arm_feature(vcpu, ARM_FEATURE_MPU)) {
-				cpu_vcpu_cp15_vtlb_flush_ng(cp15);
+			if (((cp15->c13_context & 0xFF) != (data & 0xFF)) &&
+			    !arm_feature(vcpu, ARM_FEATURE_MPU) &&
+			    cpu_vcpu_cp15_vtlb_switch_asid(cp15,
+						cp15->c13_context & 0xFF,
+						data & 0xFF)) {
+				vmm_printf("%s: vcpu=%d failed to switch "
+					   "vTLB ASID\n", __func__, vcpu->id);
+				return FALSE;
 			}
 			cp15->c13_context = data;
 			break;
@@ -771,6 +771,28 @@ int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region)
 	return VMM_OK;
 }
 
+bool arch_guest_can_trap_memory(struct vmm_guest *guest)
+{
+	/* Shadow TTBLs map guest virtual addresses so guest physical
+	 * ranges cannot be write protected or unmapped.
+	 */
+	return FALSE;
+}
+
+int arch_guest_write_protect(struct vmm_guest *guest,
+			     physical_addr_t gphys_addr,
+			     physical_size_t gphys_size)
+{
+	return VMM_ENOTSUPP;
+}
+
+int arch_guest_unmap(struct vmm_guest *guest,
+		     physical_addr_t gphys_addr,
+		     physical_size_t gphys_size)
+{
+	return VMM_ENOTSUPP;
+}
+
 int arch_vcpu_init(struct vmm_vcpu *vcpu)
 {
 	int rc;
@@ -1185,3 +1207,20 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 {
 	/* For now no arch specific stats */
 }
+
+bool arch_vcpu_regs_sample(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *caller)
+{
+	*pc = regs->pc;
+
+	/* Guest is always executed in USR mode */
+	if (vcpu && vcpu->is_normal &&
+	    ((regs->cpsr & CPSR_MODE_MASK) == CPSR_MODE_USER)) {
+		*caller = 0;
+		return TRUE;
+	}
+
+	*caller = regs->lr;
+
+	return FALSE;
+}
@@ -59,6 +59,7 @@ struct arm_priv_cp14 {
 
 struct arm_vtlb_entry {
 	u32 dom;
+	u32 sc; /* Second chance before eviction */
 	virtual_addr_t pva;
 	virtual_size_t psz;
 	struct cpu_l2tbl *l2;
@@ -69,6 +70,19 @@ struct arm_vtlb {
 	u32 victim[CPU_VCPU_VTLB_ZONE_COUNT];
 } __packed;
 
+struct arm_vtlb_asid_page {
+	u32 dom;
+	struct cpu_page pg;
+} __packed;
+
+struct arm_vtlb_asid_cache {
+	bool valid;
+	u32 asid;
+	u32 stamp;
+	u32 count;
+	struct arm_vtlb_asid_page page[CPU_VCPU_VTLB_ZONE_NG_LEN];
+} __packed;
+
 struct arm_priv_cp15 {
 	/* Shadow L1 */
 	struct cpu_l1tbl *l1;
@@ -76,6 +90,9 @@ struct arm_priv_cp15 {
 	u32 dacr;
 	/* Virtual TLB */
 	struct arm_vtlb vtlb;
+	/* Non-global VTLB pages of inactive guest ASIDs */
+	struct arm_vtlb_asid_cache asid_cache[CPU_VCPU_VTLB_ASID_CACHE_COUNT];
+	u32 asid_stamp;
 	/* Overlapping vector page base */
 	u32 ovect_base;
 	/* Virtual IO */
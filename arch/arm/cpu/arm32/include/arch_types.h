@@ -46,8 +46,23 @@ typedef struct {
 	volatile long long counter;
 } atomic64_t;
 
+#define __ARCH_SPIN_TICKET_SHIFT	16
+
+/* Ticket spinlock: lower half of slock is owner ticket and upper half
+ * is next ticket irrespective of endianness. */
 typedef struct {
-	volatile long lock;
+	union {
+		volatile unsigned int slock;
+		struct {
+#if defined(__ARMEB__)
+			volatile unsigned short next;
+			volatile unsigned short owner;
+#else
+			volatile unsigned short owner;
+			volatile unsigned short next;
+#endif
+		} tickets;
+	};
 } arch_spinlock_t;
 
 #define ARCH_ATOMIC_INIT(_lptr, val)		\
@@ -62,28 +77,40 @@ typedef struct {
 #define ARCH_ATOMIC64_INITIALIZER(val)		\
 	{ .counter = (val), }
 
-#define __ARCH_SPIN_UNLOCKED		0xffffffff
+#define __ARCH_SPIN_UNLOCKED		0
 
 /* FIXME: Need memory barrier for this. */
 #define ARCH_SPIN_LOCK_INIT(_lptr)		\
-	(_lptr)->lock = __ARCH_SPIN_UNLOCKED
+	(_lptr)->slock = __ARCH_SPIN_UNLOCKED
 
 #define ARCH_SPIN_LOCK_INITIALIZER		\
-	{ .lock = __ARCH_SPIN_UNLOCKED, }
+	{ .slock = __ARCH_SPIN_UNLOCKED, }
 
 typedef struct {
-	volatile long lock;
+	volatile unsigned int lock;
+	arch_spinlock_t wait;
 } arch_rwlock_t;
 
-#define __ARCH_RW_LOCKED		0x80000000
+/* Read/write lock: bit[0] is writer owner, bit[1] is set by writer
+ * waiting at head of wait queue and bits[31:2] count readers. Readers
+ * and writers which cannot take the lock right away queue up in FIFO
+ * order on the wait ticket lock. */
+#define __ARCH_RW_LOCKED		0x00000001
+#define __ARCH_RW_WAITING		0x00000002
+#define __ARCH_RW_WRITER_MASK		0x00000003
+#define __ARCH_RW_READER		0x00000004
+#define __ARCH_RW_READERS_MASK		0xfffffffc
 #define __ARCH_RW_UNLOCKED		0
 
 /* FIXME: Need memory barrier for this. */
-#define ARCH_RW_LOCK_INIT(_lptr)		\
-	(_lptr)->lock = __ARCH_RW_UNLOCKED
+#define ARCH_RW_LOCK_INIT(_lptr)		do { \
+	(_lptr)->lock = __ARCH_RW_UNLOCKED; \
+	ARCH_SPIN_LOCK_INIT(&(_lptr)->wait); \
+	} while (0)
 
 #define ARCH_RW_LOCK_INITIALIZER		\
-	{ .lock = __ARCH_RW_UNLOCKED, }
+	{ .lock = __ARCH_RW_UNLOCKED, \
+	  .wait = ARCH_SPIN_LOCK_INITIALIZER, }
 
 #define ARCH_BITS_PER_LONG		32
 
@@ -42,6 +42,11 @@
 				 CPU_VCPU_VTLB_ZONE_G_LEN + \
 				 CPU_VCPU_VTLB_ZONE_NG_LEN)
 
+/* Number of inactive guest ASIDs for which non-global VTLB entries
+ * are preserved across guest context switches
+ */
+#define CPU_VCPU_VTLB_ASID_CACHE_COUNT			4
+
 /* Coprocessor related macros & defines */
 #define CPU_COPROC_COUNT				16
 
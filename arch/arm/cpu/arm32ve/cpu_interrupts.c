@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_host_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_exitstat.h>
 #include <cpu_inline_asm.h>
 #include <cpu_vcpu_excep.h>
 #include <cpu_vcpu_emulate.h>
@@ -109,6 +110,8 @@ void do_data_abort(arch_regs_t *regs)
 void do_hyp_trap(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
+	u32 exit_class = VMM_EXIT_OTHER;
 	u32 hsr, ec, il, iss;
 	virtual_addr_t far;
 	physical_addr_t fipa = 0;
@@ -139,6 +142,8 @@ void do_hyp_trap(arch_regs_t *regs)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	switch (ec) {
 	case EC_UNKNOWN:
 		/* We dont expect to get this trap so error */
@@ -146,42 +151,52 @@ void do_hyp_trap(arch_regs_t *regs)
 		break;
 	case EC_TRAP_WFI_WFE:
 		/* WFI emulation */
+		exit_class = VMM_EXIT_WFI;
 		rc = cpu_vcpu_emulate_wfi_wfe(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCR_MRC_CP15:
 		/* MCR/MRC CP15 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcr_mrc_cp15(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCRR_MRRC_CP15:
 		/* MCRR/MRRC CP15 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcrr_mrrc_cp15(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCR_MRC_CP14:
 		/* MCR/MRC CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcr_mrc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_LDC_STC_CP14:
 		/* LDC/STC CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_ldc_stc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_CP0_TO_CP13:
 		/* CP0 to CP13 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_cp0_cp13(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_VMRS:
 		/* MRC (or VMRS) to CP10 for MVFR0, MVFR1 or FPSID */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_vmrs(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_JAZELLE:
 		/* Jazelle emulation */
+		exit_class = VMM_EXIT_INSN;
 		rc = cpu_vcpu_emulate_jazelle(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_BXJ:
 		/* BXJ emulation */
+		exit_class = VMM_EXIT_INSN;
 		rc = cpu_vcpu_emulate_bxj(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MRRC_CP14:
 		/* MRRC to CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mrrc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_SVC:
@@ -190,10 +205,12 @@ void do_hyp_trap(arch_regs_t *regs)
 		break;
 	case EC_TRAP_HVC:
 		/* Hypercall or HVC emulation */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_hvc(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_SMC:
 		/* System Monitor Call or SMC emulation */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_smc(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_STAGE2_INST_ABORT:
@@ -202,6 +219,7 @@ void do_hyp_trap(arch_regs_t *regs)
 		fipa = (read_hpfar() & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
 		fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
 		fipa = fipa | (far & HPFAR_FIPA_PAGE_MASK);
+		exit_class = VMM_EXIT_PAGEFAULT;
 		rc = cpu_vcpu_inst_abort(vcpu, regs, il, iss, far, fipa);
 		break;
 	case EC_TRAP_STAGE1_INST_ABORT:
@@ -214,6 +232,7 @@ void do_hyp_trap(arch_regs_t *regs)
 		fipa = (read_hpfar() & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
 		fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
 		fipa = fipa | (far & HPFAR_FIPA_PAGE_MASK);
+		exit_class = VMM_EXIT_PAGEFAULT;
 		rc = cpu_vcpu_data_abort(vcpu, regs, il, iss, far, fipa);
 		break;
 	case EC_TRAP_STAGE1_DATA_ABORT:
@@ -235,15 +254,27 @@ void do_hyp_trap(arch_regs_t *regs)
 		}
 	}
 
+	vmm_exitstat_end(vcpu, exit_class, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_irq(arch_regs_t *regs)
 {
+	u64 tstamp = 0;
+	struct vmm_vcpu *vcpu = NULL;
+
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	if ((regs->cpsr & CPSR_MODE_MASK) != CPSR_MODE_HYPERVISOR) {
+		vcpu = vmm_scheduler_current_vcpu();
+		tstamp = vmm_exitstat_begin(vcpu);
+	}
+
 	vmm_host_active_irq_exec(CPU_EXTERNAL_IRQ);
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_IRQ, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
@@ -50,8 +50,8 @@ static int cpu_vcpu_stage2_map(struct vmm_vcpu *vcpu,
 	inaddr = fipa & TTBL_L3_MAP_MASK;
 	size = TTBL_L3_BLOCK_SIZE;
 
-	rc = vmm_guest_physical_map(vcpu->guest, inaddr, size,
-				    &outaddr, &availsz, &reg_flags);
+	rc = vmm_guest_physical_map_shared(vcpu->guest, inaddr, size,
+					   &outaddr, &availsz, &reg_flags);
 	if (rc) {
 		return rc;
 	}
@@ -65,10 +65,14 @@ static int cpu_vcpu_stage2_map(struct vmm_vcpu *vcpu,
 	pg.oa = outaddr;
 	pg_reg_flags = reg_flags;
 
-	if (reg_flags & (VMM_REGION_ISRAM | VMM_REGION_ISROM)) {
+	/* Dirty page logging requires page granularity mappings */
+	if ((reg_flags & (VMM_REGION_ISRAM | VMM_REGION_ISROM)) &&
+	    !vmm_guest_dirty_log_overlap(vcpu->guest,
+					 fipa & TTBL_L1_MAP_MASK,
+					 TTBL_L1_BLOCK_SIZE)) {
 		inaddr = fipa & TTBL_L2_MAP_MASK;
 		size = TTBL_L2_BLOCK_SIZE;
-		rc = vmm_guest_physical_map(vcpu->guest, inaddr, size,
+		rc = vmm_guest_physical_map_shared(vcpu->guest, inaddr, size,
 				    &outaddr, &availsz, &reg_flags);
 		if (!rc && (availsz >= TTBL_L2_BLOCK_SIZE)) {
 			pg.ia = inaddr;
@@ -76,9 +80,16 @@ static int cpu_vcpu_stage2_map(struct vmm_vcpu *vcpu,
 			pg.oa = outaddr;
 			pg_reg_flags = reg_flags;
 		}
+	}
+
+	/* On-demand RAM is populated in L2 sized blocks so probing
+	 * for L1 mapping would populate blocks not touched by guest.
+	 */
+	if ((pg.sz == TTBL_L2_BLOCK_SIZE) &&
+	    !(pg_reg_flags & VMM_REGION_ISONDEMAND)) {
 		inaddr = fipa & TTBL_L1_MAP_MASK;
 		size = TTBL_L1_BLOCK_SIZE;
-		rc = vmm_guest_physical_map(vcpu->guest, inaddr, size,
+		rc = vmm_guest_physical_map_shared(vcpu->guest, inaddr, size,
 				    &outaddr, &availsz, &reg_flags);
 		if (!rc && (availsz >= TTBL_L1_BLOCK_SIZE)) {
 			pg.ia = inaddr;
@@ -91,7 +102,9 @@ static int cpu_vcpu_stage2_map(struct vmm_vcpu *vcpu,
 	if (pg_reg_flags & VMM_REGION_VIRTUAL) {
 		pg.af = 0;
 		pg.ap = TTBL_HAP_NOACCESS;
-	} else if (pg_reg_flags & VMM_REGION_READONLY) {
+	} else if ((pg_reg_flags & (VMM_REGION_READONLY |
+				    VMM_REGION_ISSHARED)) ||
+		   vmm_guest_dirty_log_clean(vcpu->guest, pg.ia)) {
 		pg.af = 1;
 		pg.ap = TTBL_HAP_READONLY;
 	} else {
@@ -131,6 +144,54 @@ static int cpu_vcpu_stage2_map(struct vmm_vcpu *vcpu,
 	return rc;
 }
 
+static int cpu_vcpu_stage2_write_fault(struct vmm_vcpu *vcpu,
+				       arch_regs_t *regs,
+				       physical_addr_t fipa)
+{
+	int rc;
+	u32 reg_flags = 0x0;
+	struct cpu_page pg;
+	physical_addr_t outaddr;
+	physical_size_t availsz;
+	struct cpu_ttbl *ttbl = arm_guest_priv(vcpu->guest)->ttbl;
+
+	/* Only writeable RAM pages are write protected by us */
+	rc = vmm_guest_physical_map_shared(vcpu->guest,
+					   fipa & TTBL_L3_MAP_MASK,
+					   TTBL_L3_BLOCK_SIZE,
+					   &outaddr, &availsz, &reg_flags);
+	if (rc) {
+		return rc;
+	}
+	if (!(reg_flags & VMM_REGION_ISRAM) ||
+	    (reg_flags & (VMM_REGION_READONLY | VMM_REGION_VIRTUAL))) {
+		return VMM_EFAIL;
+	}
+
+	/* Merged pages get private copy upon first write */
+	if (reg_flags & VMM_REGION_ISSHARED) {
+		rc = vmm_guest_ram_unshare(vcpu->guest,
+					   fipa & TTBL_L3_MAP_MASK);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	/* Mark the page dirty and map it again as writeable */
+	vmm_guest_dirty_log_mark(vcpu->guest, fipa);
+
+	memset(&pg, 0, sizeof(pg));
+	if (!mmu_lpae_get_page(ttbl, fipa, &pg)) {
+		if (pg.ap == TTBL_HAP_READWRITE) {
+			/* Some other VCPU already did it */
+			return VMM_OK;
+		}
+		mmu_lpae_unmap_page(ttbl, &pg);
+	}
+
+	return cpu_vcpu_stage2_map(vcpu, regs, fipa);
+}
+
 int cpu_vcpu_inst_abort(struct vmm_vcpu *vcpu,
 			arch_regs_t *regs,
 			u32 il, u32 iss,
@@ -163,6 +224,13 @@ int cpu_vcpu_data_abort(struct vmm_vcpu *vcpu,
 	case FSR_TRANS_FAULT_LEVEL2:
 	case FSR_TRANS_FAULT_LEVEL3:
 		return cpu_vcpu_stage2_map(vcpu, regs, fipa);
+	case FSR_PERM_FAULT_LEVEL1:
+	case FSR_PERM_FAULT_LEVEL2:
+	case FSR_PERM_FAULT_LEVEL3:
+		if (iss & ISS_ABORT_WNR_MASK) {
+			return cpu_vcpu_stage2_write_fault(vcpu, regs, fipa);
+		}
+		break;
 	case FSR_ACCESS_FAULT_LEVEL1:
 	case FSR_ACCESS_FAULT_LEVEL2:
 	case FSR_ACCESS_FAULT_LEVEL3:
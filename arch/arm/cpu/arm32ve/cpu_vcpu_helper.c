@@ -489,6 +489,27 @@ int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region)
 	return VMM_OK;
 }
 
+bool arch_guest_can_trap_memory(struct vmm_guest *guest)
+{
+	return TRUE;
+}
+
+int arch_guest_write_protect(struct vmm_guest *guest,
+			     physical_addr_t gphys_addr,
+			     physical_size_t gphys_size)
+{
+	return mmu_lpae_write_protect(arm_guest_priv(guest)->ttbl,
+				      gphys_addr, gphys_size);
+}
+
+int arch_guest_unmap(struct vmm_guest *guest,
+		     physical_addr_t gphys_addr,
+		     physical_size_t gphys_size)
+{
+	return mmu_lpae_unmap_range(arm_guest_priv(guest)->ttbl,
+				    gphys_addr, gphys_size);
+}
+
 int arch_vcpu_init(struct vmm_vcpu *vcpu)
 {
 	int rc = VMM_OK, ite;
@@ -1070,3 +1091,20 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 {
 	/* For now no arch specific stats */
 }
+
+bool arch_vcpu_regs_sample(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *caller)
+{
+	*pc = regs->pc;
+
+	/* Any mode other than HYP mode is guest */
+	if (vcpu && vcpu->is_normal &&
+	    ((regs->cpsr & CPSR_MODE_MASK) != CPSR_MODE_HYPERVISOR)) {
+		*caller = 0;
+		return TRUE;
+	}
+
+	*caller = regs->lr;
+
+	return FALSE;
+}
@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_host_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_exitstat.h>
 #include <cpu_inline_asm.h>
 #include <cpu_vcpu_excep.h>
 #include <cpu_vcpu_emulate.h>
@@ -62,6 +63,8 @@ void do_bad_mode(arch_regs_t *regs, unsigned long mode)
 void do_sync(arch_regs_t *regs, unsigned long mode)
 {
 	int rc = VMM_OK;
+	u64 tstamp;
+	u32 exit_class = VMM_EXIT_OTHER;
 	u32 ec, il, iss;
 	u64 esr, far, elr;
 	physical_addr_t fipa = 0;
@@ -99,6 +102,8 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	tstamp = vmm_exitstat_begin(vcpu);
+
 	switch (ec) {
 	case EC_UNKNOWN:
 		/* We dont expect to get this trap so error */
@@ -106,42 +111,52 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		break;
 	case EC_TRAP_WFI_WFE:
 		/* WFI emulation */
+		exit_class = VMM_EXIT_WFI;
 		rc = cpu_vcpu_emulate_wfi_wfe(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCR_MRC_CP15_A32:
 		/* MCR/MRC CP15 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcr_mrc_cp15(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCRR_MRRC_CP15_A32:
 		/* MCRR/MRRC CP15 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcrr_mrrc_cp15(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCR_MRC_CP14_A32:
 		/* MCR/MRC CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcr_mrc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_LDC_STC_CP14_A32:
 		/* LDC/STC CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_ldc_stc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_SIMD_FPU:
 		/* Advanced SIMD and FPU emulation */
+		exit_class = VMM_EXIT_FPU;
 		rc = cpu_vcpu_emulate_simd_fp_regs(vcpu, regs, il, iss);
 		break;
 	case EC_FPEXC_A32:
 		/* FPU execution faults from Aarch32 */
+		exit_class = VMM_EXIT_FPU;
 		rc = cpu_vcpu_emulate_fpexec_a32(vcpu, regs, il, iss);
 		break;
 	case EC_FPEXC_A64:
 		/* FPU execution faults from Aarch64 */
+		exit_class = VMM_EXIT_FPU;
 		rc = cpu_vcpu_emulate_fpexec_a64(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MRC_VMRS_CP10_A32:
 		/* MRC (or VMRS) to CP10 for MVFR0, MVFR1 or FPSID */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_vmrs(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MCRR_MRRC_CP14_A32:
 		/* MRRC to CP14 emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_mcrr_mrrc_cp14(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_SVC_A32:
@@ -151,22 +166,27 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		break;
 	case EC_TRAP_SMC_A32:
 		/* SMC emulation for A32 guest */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_smc32(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_SMC_A64:
 		/* SMC emulation for A64 guest */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_smc64(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_HVC_A32:
 		/* HVC emulation for A32 guest */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_hvc32(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_HVC_A64:
 		/* HVC emulation for A64 guest */
+		exit_class = VMM_EXIT_HVC;
 		rc = cpu_vcpu_emulate_hvc64(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_MSR_MRS_SYSTEM:
 		/* MSR/MRS/SystemRegs emulation */
+		exit_class = VMM_EXIT_SYSREG;
 		rc = cpu_vcpu_emulate_msr_mrs_system(vcpu, regs, il, iss);
 		break;
 	case EC_TRAP_LWREL_INST_ABORT:
@@ -174,6 +194,7 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		fipa = (mrs(hpfar_el2) & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
 		fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
 		fipa = fipa | (mrs(far_el2) & HPFAR_FIPA_PAGE_MASK);
+		exit_class = VMM_EXIT_PAGEFAULT;
 		rc = cpu_vcpu_inst_abort(vcpu, regs, il, iss, fipa);
 		break;
 	case EC_TRAP_LWREL_DATA_ABORT:
@@ -181,6 +202,7 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		fipa = (mrs(hpfar_el2) & HPFAR_FIPA_MASK) >> HPFAR_FIPA_SHIFT;
 		fipa = fipa << HPFAR_FIPA_PAGE_SHIFT;
 		fipa = fipa | (mrs(far_el2) & HPFAR_FIPA_PAGE_MASK);
+		exit_class = VMM_EXIT_PAGEFAULT;
 		rc = cpu_vcpu_data_abort(vcpu, regs, il, iss, fipa);
 		break;
 	case EC_CUREL_INST_ABORT:
@@ -213,15 +235,27 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		}
 	}
 
+	vmm_exitstat_end(vcpu, exit_class, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_irq(arch_regs_t *regs)
 {
+	u64 tstamp = 0;
+	struct vmm_vcpu *vcpu = NULL;
+
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	if ((regs->pstate & PSR_EL_MASK) != PSR_EL_2) {
+		vcpu = vmm_scheduler_current_vcpu();
+		tstamp = vmm_exitstat_begin(vcpu);
+	}
+
 	vmm_host_active_irq_exec(EXC_HYP_IRQ_SPx);
 
+	vmm_exitstat_end(vcpu, VMM_EXIT_IRQ, tstamp);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
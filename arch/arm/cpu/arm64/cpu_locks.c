@@ -24,50 +24,65 @@
 #include <vmm_error.h>
 #include <vmm_types.h>
 #include <vmm_smp.h>
+#include <vmm_scheduler.h>
 #include <vmm_compiler.h>
 #include <arch_barrier.h>
 
 bool __lock arch_spin_lock_check(arch_spinlock_t *lock)
 {
-	return (lock->lock == __ARCH_SPIN_UNLOCKED) ? FALSE : TRUE;
+	u32 slock = lock->slock;
+
+	return ((slock >> __ARCH_SPIN_TICKET_SHIFT) == (slock & 0xffff)) ?
+								FALSE : TRUE;
 }
 
 void __lock arch_spin_lock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
-	unsigned long tmp;
+	unsigned int slock, newval, tmp;
 
 	__asm__ __volatile__(
+	/* Atomically take next ticket */
+"	prfm	pstl1strm, %3\n"
+"1:	ldaxr	%w0, %3\n"
+"	add	%w1, %w0, %5\n"
+"	stxr	%w2, %w1, %3\n"
+"	cbnz	%w2, 1b\n"
+	/* Did we get the lock ? */
+"	eor	%w1, %w0, %w0, ror #16\n"
+"	cbz	%w1, 3f\n"
+	/* If not then sleep until owner reaches our ticket. The local
+	 * event makes sure that we don't miss an unlock before the
+	 * exclusive load.
+	 */
 "	sevl\n"
-"1:	wfe\n"
-"2:	ldaxr	%w0, %1\n"
-"	cmp	%w0, %w3\n"
-"	b.ne	1b\n"
-"	stxr	%w0, %w2, %1\n"
-"	cbnz	%w0, 2b\n"
-	: "=&r" (tmp), "+Q" (lock->lock)
-	: "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
-	: "cc", "memory");
+"2:	wfe\n"
+"	ldaxrh	%w2, %4\n"
+"	eor	%w1, %w2, %w0, lsr #16\n"
+"	cbnz	%w1, 2b\n"
+"3:"
+	: "=&r" (slock), "=&r" (newval), "=&r" (tmp), "+Q" (lock->slock)
+	: "Q" (lock->tickets.owner), "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+	: "memory");
 
 	arch_smp_mb();
 }
 
-int arch_spin_trylock(arch_spinlock_t *lock)
+int __lock arch_spin_trylock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
-	unsigned int tmp;
-
-	asm volatile(
-"	ldaxr	%w0, %1\n"
-"	cmp	%w0, %w3\n"
-"	b.ne	1f\n"
-"	stxr	%w0, %w2, %1\n"
-"	b	2f\n"
-"1:	mov	%w0, #1\n"
-"2:\n"
-	: "=&r" (tmp), "+Q" (lock->lock)
-	: "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
-	: "cc", "memory");
+	unsigned int slock, tmp;
+
+	__asm__ __volatile__(
+"	prfm	pstl1strm, %2\n"
+"1:	ldaxr	%w0, %2\n"
+"	eor	%w1, %w0, %w0, ror #16\n"
+"	cbnz	%w1, 2f\n"
+"	add	%w0, %w0, %3\n"
+"	stxr	%w1, %w0, %2\n"
+"	cbnz	%w1, 1b\n"
+"2:"
+	: "=&r" (slock), "=&r" (tmp), "+Q" (lock->slock)
+	: "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+	: "memory");
 
 	if (tmp == 0) {
 		arch_smp_mb();	/* do mb if we succeeded */
@@ -81,10 +96,48 @@ void __lock arch_spin_unlock(arch_spinlock_t *lock)
 {
 	arch_smp_mb();
 
+	/* Store to owner clears exclusive monitor of waiters hence
+	 * wakes them up from wfe.
+	 */
+	__asm__ __volatile__(
+"	stlrh	%w1, %0\n"
+	: "=Q" (lock->tickets.owner)
+	: "r" (lock->tickets.owner + 1)
+	: "memory");
+}
+
+static inline u32 arch_rw_cmpxchg(arch_rwlock_t *lock, u32 old, u32 new)
+{
+	unsigned int oldval, res;
+
+	__asm__ __volatile__(
+"1:	ldaxr	%w1, %2\n"
+"	cmp	%w1, %w3\n"
+"	b.ne	2f\n"
+"	stxr	%w0, %w4, %2\n"
+"	cbnz	%w0, 1b\n"
+"2:"
+	: "=&r" (res), "=&r" (oldval), "+Q" (lock->lock)
+	: "r" (old), "r" (new)
+	: "cc", "memory");
+
+	return oldval;
+}
+
+static inline u32 arch_rw_add_return(arch_rwlock_t *lock, u32 val)
+{
+	unsigned int tmp, tmp2;
+
 	__asm__ __volatile__(
-"	stlr	%w1, %0\n"
-	: "=Q" (lock->lock) : "r" (__ARCH_SPIN_UNLOCKED)
+"1:	ldxr	%w0, %2\n"
+"	add	%w0, %w0, %w3\n"
+"	stlxr	%w1, %w0, %2\n"
+"	cbnz	%w1, 1b\n"
+	: "=&r" (tmp), "=&r" (tmp2), "+Q" (lock->lock)
+	: "r" (val)
 	: "memory");
+
+	return tmp;
 }
 
 bool __lock arch_write_lock_check(arch_rwlock_t *lock)
@@ -93,91 +146,109 @@ bool __lock arch_write_lock_check(arch_rwlock_t *lock)
 }
 
 /*
- * To take a write lock we set bit 31 to 1
+ * Writer which cannot take the lock right away queues up on the wait
+ * lock. At the head of the queue it sets waiting bit so that no new
+ * reader gets in and then takes the lock once readers drain.
  */
 void __lock arch_write_lock(arch_rwlock_t *lock)
 {
-	unsigned int tmp;
+	if (arch_rw_cmpxchg(lock, __ARCH_RW_UNLOCKED,
+			    __ARCH_RW_LOCKED) == __ARCH_RW_UNLOCKED) {
+		goto done;
+	}
 
-	__asm__ __volatile__(
-	"	sevl\n"
-	"1:	wfe\n"
-	"2:	ldaxr	%w0, [%1]\n"
-	"	cbnz	%w0, 1b\n"
-	"	stxr	%w0, %w2, [%1]\n"
-	"	cbnz	%w0, 2b\n"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "memory");
+	arch_spin_lock(&lock->wait);
+
+	arch_rw_add_return(lock, __ARCH_RW_WAITING);
+	while (1) {
+		if ((lock->lock == __ARCH_RW_WAITING) &&
+		    (arch_rw_cmpxchg(lock, __ARCH_RW_WAITING,
+				     __ARCH_RW_LOCKED) == __ARCH_RW_WAITING)) {
+			break;
+		}
+		wfe();
+	}
+
+	arch_spin_unlock(&lock->wait);
 
+done:
 	arch_smp_mb();
 }
 
 int __lock arch_write_trylock(arch_rwlock_t *lock)
 {
-	unsigned int tmp;
-
-	asm volatile(
-	"	ldaxr	%w0, [%1]\n"
-	"	cbnz	%w0, 1f\n"
-	"	stxr	%w0, %w2, [%1]\n"
-	"1:\n"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "memory");
+	if (lock->lock != __ARCH_RW_UNLOCKED) {
+		return 0;
+	}
 
-	if (tmp == 0) {
-		 arch_smp_mb();
-		 return 1;
+	if (arch_rw_cmpxchg(lock, __ARCH_RW_UNLOCKED,
+			    __ARCH_RW_LOCKED) == __ARCH_RW_UNLOCKED) {
+		arch_smp_mb();
+		return 1;
 	} else {
-		 return 0;
+		return 0;
 	}
 }
 
 void __lock arch_write_unlock(arch_rwlock_t *lock)
 {
-	asm volatile(
-	"	stlr	%w1, [%0]\n"
-	: : "r" (&lock->lock), "r" (0) : "memory");
+	arch_smp_mb();
+	arch_rw_add_return(lock, (u32)-__ARCH_RW_LOCKED);
+	dsb();
+	sev();
 }
 
 bool __lock arch_read_lock_check(arch_rwlock_t *lock)
 {
-	return (lock->lock == __ARCH_RW_UNLOCKED) ? FALSE : TRUE;
+	return (lock->lock & (__ARCH_RW_LOCKED | __ARCH_RW_READERS_MASK)) ?
+								TRUE : FALSE;
 }
 
+/*
+ * Reader which finds a writer owning or waiting for the lock queues
+ * up on the wait lock so readers and writers get the lock in FIFO
+ * order. Read lock taken from interrupt handler cannot queue behind a
+ * writer which waits for the interrupted reader, so it only waits for
+ * the writer owning the lock.
+ */
 void __lock arch_read_lock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2;
+	if (!(arch_rw_add_return(lock, __ARCH_RW_READER) &
+					__ARCH_RW_WRITER_MASK)) {
+		goto done;
+	}
 
-	asm volatile(
-	"	sevl\n"
-	"1:	wfe\n"
-	"2:	ldaxr	%w0, [%2]\n"
-	"	add	%w0, %w0, #1\n"
-	"	tbnz	%w0, #31, 1b\n"
-	"	stxr	%w1, %w0, [%2]\n"
-	"	cbnz	%w1, 2b\n"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	if (vmm_scheduler_irq_context()) {
+		while (lock->lock & __ARCH_RW_LOCKED) {
+			wfe();
+		}
+		goto done;
+	}
+
+	arch_read_unlock(lock);
+
+	arch_spin_lock(&lock->wait);
+
+	arch_rw_add_return(lock, __ARCH_RW_READER);
+	while (lock->lock & __ARCH_RW_LOCKED) {
+		wfe();
+	}
+
+	arch_spin_unlock(&lock->wait);
+
+done:
+	arch_smp_mb();
 }
 
 int __lock arch_read_trylock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2 = 1;
-
-	asm volatile(
-	"	ldaxr	%w0, [%2]\n"
-	"	add	%w0, %w0, #1\n"
-	"	tbnz	%w0, #31, 1f\n"
-	"	stxr	%w1, %w0, [%2]\n"
-	"1:\n"
-	: "=&r" (tmp), "+r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	u32 val = lock->lock;
 
-	if (tmp2 == 0) {
+	if (val & __ARCH_RW_WRITER_MASK) {
+		return 0;
+	}
+
+	if (arch_rw_cmpxchg(lock, val, val + __ARCH_RW_READER) == val) {
 		arch_smp_mb();	/* do mb if we succeeded */
 		return 1;
 	} else {
@@ -187,16 +258,11 @@ int __lock arch_read_trylock(arch_rwlock_t *lock)
 
 void __lock arch_read_unlock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2;
-
 	arch_smp_mb();
 
-	asm volatile(
-	"1:	ldxr	%w0, [%2]\n"
-	"	sub	%w0, %w0, #1\n"
-	"	stlxr	%w1, %w0, [%2]\n"
-	"	cbnz	%w1, 1b\n"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	if (!(arch_rw_add_return(lock, (u32)-__ARCH_RW_READER) &
+					__ARCH_RW_READERS_MASK)) {
+		dsb();
+		sev();
+	}
 }
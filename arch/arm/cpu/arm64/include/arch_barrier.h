@@ -27,6 +27,9 @@
 #define dsb() 			asm volatile ("dsb sy" : : : "memory")
 #define dmb() 			asm volatile ("dmb sy" : : : "memory")
 
+#define sev()			asm volatile ("sev" : : : "memory")
+#define wfe()			asm volatile ("wfe" : : : "memory")
+
 /* Read & Write Memory barrier */
 #define arch_mb()			dmb()
 
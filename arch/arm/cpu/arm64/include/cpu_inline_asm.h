@@ -77,6 +77,19 @@ asm(
 		     : : "r" (__val));				\
 } while (0)
 
+/* Access system registers not known to assembler (see sys_reg()) */
+#define read_sysreg_s(r) ({					\
+	u64 __val;						\
+	asm volatile("mrs_s %0, " stringify(r) : "=r" (__val));	\
+	__val;							\
+})
+
+#define write_sysreg_s(v, r)	do {				\
+	u64 __val = (u64)(v);					\
+	asm volatile("msr_s " stringify(r) ", %0"		\
+		     : : "r" (__val));				\
+} while (0)
+
 #define mrs(spr)		({				\
 	u64 __val;						\
 	asm volatile("mrs %0," stringify(spr) :"=r"(__val));	\
@@ -31,46 +31,58 @@
 #include <vmm_compiler.h>
 #include <arch_barrier.h>
 #include <vmm_smp.h>
+#include <vmm_scheduler.h>
 
 bool __lock arch_spin_lock_check(arch_spinlock_t *lock)
 {
-	return (lock->lock == __ARCH_SPIN_UNLOCKED) ? FALSE : TRUE;
+	u32 slock = lock->slock;
+
+	return ((slock >> __ARCH_SPIN_TICKET_SHIFT) == (slock & 0xffff)) ?
+								FALSE : TRUE;
 }
 
 void __lock arch_spin_lock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
-	unsigned long tmp;
+	unsigned long slock, newval, tmp;
+	u16 ticket;
 
 	__asm__ __volatile__(
-"1:	ldrex	%0, [%1]\n"	/* load the lock value */
-"	teq	%0, %3\n"	/* is the lock free */
-"	wfene\n"		/* if not, we sleep until some other core wake us up */
-"	strexeq	%0, %2, [%1]\n" /* store (cpu) as a lock value */
-"	teqeq	%0, #0\n"	/* did we succeed */
+"1:	ldrex	%0, [%3]\n"	/* load the lock value */
+"	add	%1, %0, %4\n"	/* take next ticket */
+"	strex	%2, %1, [%3]\n"	/* store new lock value */
+"	teq	%2, #0\n"	/* did we succeed */
 "	bne	1b"		/* if not try again */
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
+	: "=&r" (slock), "=&r" (newval), "=&r" (tmp)
+	: "r" (&lock->slock), "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
 	: "cc");
 
+	/* Sleep until owner reaches our ticket */
+	ticket = slock >> __ARCH_SPIN_TICKET_SHIFT;
+	while (ticket != (u16)slock) {
+		wfe();
+		slock = lock->tickets.owner;
+	}
+
 	arch_smp_mb();		/* do a mb to sync everything */
 }
 
 int __lock arch_spin_trylock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
-	unsigned long tmp;
+	unsigned long slock, contended, res;
 
-	__asm__ __volatile__(
-"	ldrex	%0, [%1]\n"	/* load the lock value */
-"	teq	%0, %3\n"	/* is the lock free */
-"	movne	%0, #1\n"	/* assume failure if lock not free */
-"	strexeq	%0, %2, [%1]"	/* store cpu as a lock value */
-	: "=&r" (tmp) 
-	: "r" (&lock->lock), "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
-	: "cc");
+	do {
+		__asm__ __volatile__(
+"	ldrex	%0, [%3]\n"	/* load the lock value */
+"	mov	%2, #0\n"
+"	subs	%1, %0, %0, ror #16\n" /* is owner same as next */
+"	addeq	%0, %0, %4\n"	/* if yes, take next ticket */
+"	strexeq	%2, %0, [%3]"	/* store new lock value */
+		: "=&r" (slock), "=&r" (contended), "=&r" (res)
+		: "r" (&lock->slock), "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+		: "cc");
+	} while (res);
 
-	if (tmp == 0) {
+	if (!contended) {
 		arch_smp_mb();	/* do mb if we succeeded */
 		return 1;
 	} else {
@@ -82,101 +94,155 @@ void __lock arch_spin_unlock(arch_spinlock_t *lock)
 {
 	arch_smp_mb();		/* sync everything */
 
-	lock->lock = __ARCH_SPIN_UNLOCKED;	/* free the lock */
+	lock->tickets.owner++;	/* hand over to next ticket */
 	dsb();			/* sync again */
 	sev();			/* notify all cores */
 }
 
+static inline u32 arch_rw_cmpxchg(arch_rwlock_t *lock, u32 old, u32 new)
+{
+	unsigned long oldval, res;
+
+	do {
+		__asm__ __volatile__(
+"	ldrex	%1, [%2]\n"
+"	mov	%0, #0\n"
+"	teq	%1, %3\n"
+"	strexeq	%0, %4, [%2]\n"
+		: "=&r" (res), "=&r" (oldval)
+		: "r" (&lock->lock), "r" (old), "r" (new)
+		: "cc");
+	} while (res);
+
+	return oldval;
+}
+
+static inline u32 arch_rw_add_return(arch_rwlock_t *lock, u32 val)
+{
+	unsigned long tmp, tmp2;
+
+	__asm__ __volatile__(
+"1:	ldrex	%0, [%2]\n"
+"	add	%0, %0, %3\n"
+"	strex	%1, %0, [%2]\n"
+"	teq	%1, #0\n"
+"	bne	1b"
+	: "=&r" (tmp), "=&r" (tmp2)
+	: "r" (&lock->lock), "r" (val)
+	: "cc");
+
+	return tmp;
+}
+
 bool __lock arch_write_lock_check(arch_rwlock_t *lock)
 {
 	return (lock->lock & __ARCH_RW_LOCKED) ? TRUE : FALSE;
 }
 
 /*
- * To take a write lock we set bit 31 to 1
+ * Writer which cannot take the lock right away queues up on the wait
+ * lock. At the head of the queue it sets waiting bit so that no new
+ * reader gets in and then takes the lock once readers drain.
  */
 void __lock arch_write_lock(arch_rwlock_t *lock)
 {
-	unsigned long tmp;
+	if (arch_rw_cmpxchg(lock, __ARCH_RW_UNLOCKED,
+			    __ARCH_RW_LOCKED) == __ARCH_RW_UNLOCKED) {
+		goto done;
+	}
 
-	__asm__ __volatile__(
-"1:	ldrex   %0, [%1]\n"
-"	teq     %0, #0\n"
-"	wfene	\n"
-"	strexeq %0, %2, [%1]\n"
-"	teq     %0, #0\n"
-"	bne     1b"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "cc");
+	arch_spin_lock(&lock->wait);
+
+	arch_rw_add_return(lock, __ARCH_RW_WAITING);
+	while (1) {
+		if ((lock->lock == __ARCH_RW_WAITING) &&
+		    (arch_rw_cmpxchg(lock, __ARCH_RW_WAITING,
+				     __ARCH_RW_LOCKED) == __ARCH_RW_WAITING)) {
+			break;
+		}
+		wfe();
+	}
+
+	arch_spin_unlock(&lock->wait);
 
+done:
 	arch_smp_mb();
 }
 
 int __lock arch_write_trylock(arch_rwlock_t *lock)
 {
-	unsigned long tmp;
-
-	__asm__ __volatile__(
-"	ldrex   %0, [%1]\n"
-"	teq     %0, #0\n"
-"	strexeq %0, %2, [%1]"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "cc");
+	if (lock->lock != __ARCH_RW_UNLOCKED) {
+		return 0;
+	}
 
-	if (tmp == 0) {
-		 arch_smp_mb();
-		 return 1;
+	if (arch_rw_cmpxchg(lock, __ARCH_RW_UNLOCKED,
+			    __ARCH_RW_LOCKED) == __ARCH_RW_UNLOCKED) {
+		arch_smp_mb();
+		return 1;
 	} else {
-		 return 0;
+		return 0;
 	}
 }
 
 void __lock arch_write_unlock(arch_rwlock_t *lock)
 {
 	arch_smp_mb();
-	lock->lock = __ARCH_RW_UNLOCKED;
+	arch_rw_add_return(lock, -__ARCH_RW_LOCKED);
 	dsb();
 	sev();
 }
 
 bool __lock arch_read_lock_check(arch_rwlock_t *lock)
 {
-	return (lock->lock == __ARCH_RW_UNLOCKED) ? FALSE : TRUE;
+	return (lock->lock & (__ARCH_RW_LOCKED | __ARCH_RW_READERS_MASK)) ?
+								TRUE : FALSE;
 }
 
+/*
+ * Reader which finds a writer owning or waiting for the lock queues
+ * up on the wait lock so readers and writers get the lock in FIFO
+ * order. Read lock taken from interrupt handler cannot queue behind a
+ * writer which waits for the interrupted reader, so it only waits for
+ * the writer owning the lock.
+ */
 void __lock arch_read_lock(arch_rwlock_t *lock)
 {
-	unsigned long tmp, tmp2;
+	if (!(arch_rw_add_return(lock, __ARCH_RW_READER) &
+					__ARCH_RW_WRITER_MASK)) {
+		goto done;
+	}
 
-	__asm__ __volatile__(
-"1:	ldrex   %0, [%2]\n"
-"	adds    %0, %0, #1\n"
-"	strexpl %1, %0, [%2]\n"
-"	wfemi	\n"
-"	rsbpls  %0, %1, #0\n"
-"	bmi     1b"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "cc");
+	if (vmm_scheduler_irq_context()) {
+		while (lock->lock & __ARCH_RW_LOCKED) {
+			wfe();
+		}
+		goto done;
+	}
+
+	arch_read_unlock(lock);
+
+	arch_spin_lock(&lock->wait);
 
+	arch_rw_add_return(lock, __ARCH_RW_READER);
+	while (lock->lock & __ARCH_RW_LOCKED) {
+		wfe();
+	}
+
+	arch_spin_unlock(&lock->wait);
+
+done:
 	arch_smp_mb();
 }
 
 int __lock arch_read_trylock(arch_rwlock_t *lock)
 {
-	unsigned long tmp, tmp2 = 1;
+	u32 val = lock->lock;
 
-	__asm__ __volatile__(
-"	ldrex   %0, [%2]\n"
-"	adds    %0, %0, #1\n"
-"	strexpl %1, %0, [%2]\n"
-	: "=&r" (tmp), "+r" (tmp2)
-	: "r" (&lock->lock)
-	: "cc");
+	if (val & __ARCH_RW_WRITER_MASK) {
+		return 0;
+	}
 
-	if (tmp2 == 0) {
+	if (arch_rw_cmpxchg(lock, val, val + __ARCH_RW_READER) == val) {
 		arch_smp_mb();	/* do mb if we succeeded */
 		return 1;
 	} else {
@@ -186,21 +252,10 @@ int __lock arch_read_trylock(arch_rwlock_t *lock)
 
 void __lock arch_read_unlock(arch_rwlock_t *lock)
 {
-	unsigned long tmp, tmp2;
-
 	arch_smp_mb();
 
-	__asm__ __volatile__(
-"1:	ldrex   %0, [%2]\n"
-"	sub     %0, %0, #1\n"
-"	strex   %1, %0, [%2]\n"
-"	teq     %1, #0\n"
-"	bne     1b"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "cc");
-
-	if (tmp == 0) {
+	if (!(arch_rw_add_return(lock, -__ARCH_RW_READER) &
+					__ARCH_RW_READERS_MASK)) {
 		dsb();
 		sev();
 	}
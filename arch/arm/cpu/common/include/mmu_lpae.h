@@ -72,6 +72,20 @@ u32 mmu_lpae_best_page_size(physical_addr_t ia,
 			   physical_addr_t oa, 
 			   u32 availsz);
 
+/** Write protect pages of given stage2 translation table
+ *  Note: Block mappings bigger than a page which are writeable
+ *  are unmapped instead.
+ */
+int mmu_lpae_write_protect(struct cpu_ttbl *ttbl,
+			   physical_addr_t ia, physical_size_t sz);
+
+/** Unmap pages of given stage2 translation table
+ *  Note: Block mappings bigger than a page which overlap
+ *  the range are unmapped completely.
+ */
+int mmu_lpae_unmap_range(struct cpu_ttbl *ttbl,
+			 physical_addr_t ia, physical_size_t sz);
+
 /** Get page from a given virtual address */
 int mmu_lpae_get_page(struct cpu_ttbl *ttbl, 
 		     physical_addr_t ia, 
@@ -25,6 +25,7 @@
 #define __VGIC_H__
 
 #include <vmm_types.h>
+#include <vmm_error.h>
 
 #define VGIC_V2_MAX_LRS		(1 << 6)
 #define VGIC_V3_MAX_LRS		16
@@ -57,9 +58,18 @@ struct vgic_v2_hw_state {
 	u32 lr[VGIC_V2_MAX_LRS];
 };
 
+struct vgic_v3_hw_state {
+	u32 hcr;
+	u32 vmcr;
+	u32 ap0r[4];
+	u32 ap1r[4];
+	u64 lr[VGIC_V3_MAX_LRS];
+};
+
 struct vgic_hw_state {
 	union {
 		struct vgic_v2_hw_state v2;
+		struct vgic_v3_hw_state v3;
 	};
 };
 
@@ -88,4 +98,19 @@ struct vgic_ops {
 int vgic_v2_probe(struct vgic_ops *ops, struct vgic_params *params);
 void vgic_v2_remove(struct vgic_ops *ops, struct vgic_params *params);
 
+#if defined(CONFIG_ARM_VGIC_V3)
+int vgic_v3_probe(struct vgic_ops *ops, struct vgic_params *params);
+void vgic_v3_remove(struct vgic_ops *ops, struct vgic_params *params);
+#else
+static inline int vgic_v3_probe(struct vgic_ops *ops,
+				struct vgic_params *params)
+{
+	return VMM_ENODEV;
+}
+static inline void vgic_v3_remove(struct vgic_ops *ops,
+				  struct vgic_params *params)
+{
+}
+#endif
+
 #endif /* __VGIC_H__ */
@@ -624,6 +624,71 @@ int mmu_lpae_map_page(struct cpu_ttbl *ttbl, struct cpu_page *pg)
 	return VMM_OK;
 }
 
+int mmu_lpae_write_protect(struct cpu_ttbl *ttbl,
+			   physical_addr_t ia, physical_size_t sz)
+{
+	struct cpu_page pg;
+	physical_addr_t end;
+
+	if (!ttbl || (ttbl->stage != TTBL_STAGE2)) {
+		return VMM_EFAIL;
+	}
+
+	end = ia + sz;
+	ia &= TTBL_L3_MAP_MASK;
+	while (ia < end) {
+		if (mmu_lpae_get_page(ttbl, ia, &pg)) {
+			ia += TTBL_L3_BLOCK_SIZE;
+			continue;
+		}
+
+		if (pg.ap == TTBL_HAP_READWRITE) {
+			mmu_lpae_unmap_page(ttbl, &pg);
+			if (pg.sz == TTBL_L3_BLOCK_SIZE) {
+				/* If some other VCPU maps this page before
+				 * us then it will map it write protected
+				 * so we ignore failures here.
+				 */
+				pg.ap = TTBL_HAP_READONLY;
+				mmu_lpae_map_page(ttbl, &pg);
+			}
+		}
+
+		ia = pg.ia + pg.sz;
+	}
+
+	return VMM_OK;
+}
+
+int mmu_lpae_unmap_range(struct cpu_ttbl *ttbl,
+			 physical_addr_t ia, physical_size_t sz)
+{
+	struct cpu_page pg;
+	physical_addr_t end;
+
+	if (!ttbl || (ttbl->stage != TTBL_STAGE2)) {
+		return VMM_EFAIL;
+	}
+
+	end = ia + sz;
+	ia &= TTBL_L3_MAP_MASK;
+	while (ia < end) {
+		if (mmu_lpae_get_page(ttbl, ia, &pg)) {
+			ia += TTBL_L3_BLOCK_SIZE;
+			continue;
+		}
+
+		/* Some other VCPU might unmap this page before
+		 * us so we ignore failures here.
+		 */
+		mmu_lpae_unmap_page(ttbl, &pg);
+
+		ia = pg.ia + pg.sz;
+	}
+
+	return VMM_OK;
+}
+
 int mmu_lpae_get_hypervisor_page(virtual_addr_t va, struct cpu_page *pg)
 {
 	return mmu_lpae_get_page(mmuctrl.hyp_ttbl, va, pg);
@@ -56,6 +56,7 @@
 
 #define VGIC_MAX_NCPU			8
 #define VGIC_MAX_NIRQ			256
+#define VGIC_NUM_PRIO			16
 #define VGIC_LR_UNKNOWN			0xFF
 
 struct vgic_host_ctrl {
@@ -88,6 +89,9 @@ struct vgic_vcpu_state {
 	u32 lr_used_count;
 	u32 lr_used[VGIC_MAX_LRS / 32];
 	u8 irq_lr[VGIC_MAX_NIRQ][VGIC_MAX_NCPU];
+
+	/* Pending interrupts sorted by priority */
+	u16 pend_order[VGIC_MAX_NIRQ];
 };
 
 struct vgic_guest_state {
@@ -171,6 +175,9 @@ static void __vgic_clear_pending(struct vgic_guest_state *s, u32 irq, u32 cm)
 	1 : (s)->irq_state[irq].trigger)
 #define VGIC_GET_PRIORITY(s, irq, cpu) \
 	(((irq) < 32) ? (s)->priority1[irq][cpu] : (s)->priority2[(irq) - 32])
+/* LR priority field holds bits [7:3] of guest priority */
+#define VGIC_GET_LR_PRIORITY(s, irq, cpu) \
+	((VGIC_GET_PRIORITY(s, irq, cpu) & 0xf) << 1)
 #define VGIC_TARGET(s, irq) (s)->irq_target[irq]
 #define VGIC_SET_HOST_IRQ(s, irq, hirq) (s)->irq_state[irq].host_irq = (hirq)
 #define VGIC_GET_HOST_IRQ(s, irq) (s)->irq_state[irq].host_irq
@@ -206,6 +213,60 @@ static void __vgic_clear_pending(struct vgic_guest_state *s, u32 irq, u32 cm)
 #define VGIC_SET_LR_MAP(vs, irq, src_id, lr) ((vs)->irq_lr[irq][src_id] = (lr))
 #define VGIC_GET_LR_MAP(vs, irq, src_id) ((vs)->irq_lr[irq][src_id])
 
+/* Evict lowest priority LR which is numerically greater than given
+ * priority and only pending (not active) so that a higher priority
+ * interrupt can be queued. The evicted interrupt is put back in
+ * distributor pending state. Returns evicted LR or LR count if
+ * there is nothing to evict.
+ * Note: Must be called only when given VCPU is current VCPU
+ * Note: Must be called with VGIC distributor lock held
+ */
+static u32 __vgic_evict_lr(struct vgic_guest_state *s,
+			   struct vgic_vcpu_state *vs, u8 prio)
+{
+	register u32 lr, irq, victim = vgich.params.lr_cnt;
+	register u32 cm = (1 << vs->vcpu->subid);
+	struct vgic_lr lrv = { .virtid = 0, .physid = 0,
+			       .cpuid = 0, .prio = 0, .flags = 0 };
+	struct vgic_lr vlrv = lrv;
+
+	for (lr = 0; lr < vgich.params.lr_cnt; lr++) {
+		if (!VGIC_TEST_LR_USED(vs, lr)) {
+			continue;
+		}
+		vgich.ops.get_lr(lr, &lrv);
+		if ((lrv.flags & VGIC_LR_STATE_MASK) !=
+						VGIC_LR_STATE_PENDING) {
+			continue;
+		}
+		if (lrv.prio > prio) {
+			prio = lrv.prio;
+			victim = lr;
+			vlrv = lrv;
+		}
+	}
+	if (victim >= vgich.params.lr_cnt) {
+		return victim;
+	}
+
+	DPRINTF("%s: LR%d evicted IRQ%d SRC_ID=0x%x VCPU=%s\n",
+		__func__, victim, vlrv.virtid, vlrv.cpuid, vs->vcpu->name);
+
+	vgich.ops.clear_lr(victim);
+	VGIC_CLEAR_LR_USED(vs, victim);
+
+	irq = vlrv.virtid;
+	VGIC_SET_LR_MAP(vs, irq, vlrv.cpuid, VGIC_LR_UNKNOWN);
+	if (irq < 16) {
+		s->sgi_source[vs->vcpu->subid][irq] |= (1 << vlrv.cpuid);
+	} else if (!VGIC_TEST_TRIGGER(s, irq)) {
+		VGIC_CLEAR_ACTIVE(s, irq, cm);
+	}
+	VGIC_SET_PENDING(s, irq, cm);
+
+	return victim;
+}
+
 /* Queue interrupt to given VCPU
  * Note: Must be called only when given VCPU is current VCPU
  * Note: Must be called with VGIC distributor lock held
@@ -215,6 +276,7 @@ static bool __vgic_queue_irq(struct vgic_guest_state *s,
 			     u8 src_id, u32 irq)
 {
 	register u32 hirq, lr;
+	register u8 prio = VGIC_GET_LR_PRIORITY(s, irq, vs->vcpu->subid);
 	struct vgic_lr lrv = { .virtid = 0, .physid = 0,
 			       .cpuid = 0, .prio = 0, .flags = 0 };
 
@@ -242,8 +304,11 @@ static bool __vgic_queue_irq(struct vgic_guest_state *s,
 		}
 	}
 	if (lr >= vgich.params.lr_cnt) {
-		vmm_printf("%s: LR overflow IRQ=%d SRC_ID=%d VCPU=%s\n",
-			   __func__, irq, src_id, vs->vcpu->name);
+		lr = __vgic_evict_lr(s, vs, prio);
+	}
+	if (lr >= vgich.params.lr_cnt) {
+		DPRINTF("%s: LR overflow IRQ=%d SRC_ID=%d VCPU=%s\n",
+			__func__, irq, src_id, vs->vcpu->name);
 		return FALSE;
 	}
 
@@ -254,7 +319,7 @@ static bool __vgic_queue_irq(struct vgic_guest_state *s,
 
 	lrv.virtid = irq;
 	lrv.physid = 0;
-	lrv.prio = 0;
+	lrv.prio = prio;
 	lrv.cpuid = 0;
 	lrv.flags = VGIC_LR_STATE_PENDING;
 	hirq = VGIC_GET_HOST_IRQ(s, irq);
@@ -334,7 +399,9 @@ static void __vgic_flush_vcpu_hwstate(struct vgic_guest_state *s,
 				      struct vgic_vcpu_state *vs)
 {
 	bool overflow = FALSE;
-	u32 i, irq, irq_pending;
+	u32 i, irq, prio, count, irq_pending;
+	u32 prio_start[VGIC_NUM_PRIO + 1];
+	u32 cpu = vs->vcpu->subid;
 
 	if (!s->enabled) {
 		return;
@@ -342,32 +409,59 @@ static void __vgic_flush_vcpu_hwstate(struct vgic_guest_state *s,
 
 	DPRINTF("%s: vcpu=%s\n", __func__, vs->vcpu->name);
 
+	/* Count pending interrupts at each priority level */
+	for (prio = 0; prio <= VGIC_NUM_PRIO; prio++) {
+		prio_start[prio] = 0;
+	}
+	count = 0;
 	for (i = 0; i < VGIC_MAX_NIRQ / 32; i++) {
-		irq_pending = s->irq_pending[vs->vcpu->subid][i];
-		if (!irq_pending) {
-			continue;
+		irq_pending = s->irq_pending[cpu][i];
+		for (irq = i * 32; irq_pending; irq++, irq_pending >>= 1) {
+			if (!(irq_pending & 0x1)) {
+				continue;
+			}
+			prio = VGIC_GET_PRIORITY(s, irq, cpu) & 0xf;
+			prio_start[prio + 1]++;
+			count++;
 		}
+	}
+	if (!count) {
+		return;
+	}
 
-		for (irq = 0; irq < 32; irq++) {
-			if (!(irq_pending & (0x1 << irq))) {
+	/* Sort pending interrupts by priority so that LRs are
+	 * filled with highest priority interrupts first. Within
+	 * same priority level lower interrupt number comes first.
+	 */
+	for (prio = 1; prio <= VGIC_NUM_PRIO; prio++) {
+		prio_start[prio] += prio_start[prio - 1];
+	}
+	for (i = 0; i < VGIC_MAX_NIRQ / 32; i++) {
+		irq_pending = s->irq_pending[cpu][i];
+		for (irq = i * 32; irq_pending; irq++, irq_pending >>= 1) {
+			if (!(irq_pending & 0x1)) {
 				continue;
 			}
+			prio = VGIC_GET_PRIORITY(s, irq, cpu) & 0xf;
+			vs->pend_order[prio_start[prio]++] = irq;
+		}
+	}
 
-			if (i == 0 && irq < 16) {
-				if (!__vgic_queue_sgi(s, vs, i*32 + irq)) {
-					overflow = TRUE;
-					goto done;
-				}
-			} else {
-				if (!__vgic_queue_hwirq(s, vs, i*32 + irq)) {
-					overflow = TRUE;
-					goto done;
-				}
+	for (i = 0; i < count; i++) {
+		irq = vs->pend_order[i];
+		if (irq < 16) {
+			if (!__vgic_queue_sgi(s, vs, irq)) {
+				overflow = TRUE;
+				break;
+			}
+		} else {
+			if (!__vgic_queue_hwirq(s, vs, irq)) {
+				overflow = TRUE;
+				break;
 			}
 		}
 	}
 
-done:
 	if (overflow) {
 		vgich.ops.enable_underflow();
 	}
@@ -1450,6 +1544,15 @@ static void vgic_enable_maint_irq(void *arg0, void *arg1, void *arg3)
 	}
 }
 
+static void vgic_remove(struct vgic_ops *ops, struct vgic_params *params)
+{
+	if (params->type == VGIC_V3) {
+		vgic_v3_remove(ops, params);
+	} else {
+		vgic_v2_remove(ops, params);
+	}
+}
+
 static int __init vgic_emulator_init(void)
 {
 	int rc;
@@ -1458,11 +1561,18 @@ static int __init vgic_emulator_init(void)
 
 	rc = vgic_v2_probe(&vgich.ops, &vgich.params);
 	if (rc == VMM_ENODEV) {
-		vmm_printf("vgic: GIC node not found\n");
-		rc = VMM_OK;
-		goto fail;
-	}
-	if (rc != VMM_OK) {
+		rc = vgic_v3_probe(&vgich.ops, &vgich.params);
+		if (rc == VMM_ENODEV) {
+			vmm_printf("vgic: GIC node not found\n");
+			rc = VMM_OK;
+			goto fail;
+		}
+		if (rc != VMM_OK) {
+			vmm_printf("vgic: vgic_v3_probe() return error %d\n",
+				   rc);
+			goto fail;
+		}
+	} else if (rc != VMM_OK) {
 		vmm_printf("vgic: vgic_v2_probe() return error %d\n", rc);
 		goto fail;
 	}
@@ -1490,7 +1600,7 @@ static int __init vgic_emulator_init(void)
 fail_unreg_dist:
 	vmm_devemu_unregister_emulator(&vgic_dist_emulator);
 fail_unprobe:
-	vgic_v2_remove(&vgich.ops, &vgich.params);
+	vgic_remove(&vgich.ops, &vgich.params);
 fail:
 	vmm_printf("vgic: emulator not available\n");
 	return rc;
@@ -1524,7 +1634,7 @@ static void __exit vgic_emulator_exit(void)
 
 	vmm_devemu_unregister_emulator(&vgic_dist_emulator);
 
-	vgic_v2_remove(&vgich.ops, &vgich.params);
+	vgic_remove(&vgich.ops, &vgich.params);
 }
 
 VMM_DECLARE_MODULE(MODULE_DESC,
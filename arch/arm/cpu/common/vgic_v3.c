@@ -0,0 +1,378 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vgic_v3.c
+ * @author agent (agent@local)
+ * @brief GICv3 ops for Hardware assisted GICv2 emulator.
+ *
+ * The GICv3 hypervisor interface is accessed using ICH_xxx_EL2
+ * system registers instead of GICH MMIO registers. Guest sees a
+ * GICv2 compatible CPU interface (GICV) so we force system register
+ * interface disabled at EL1 when restoring VCPU state.
+ */
+
+#include <vmm_error.h>
+#include <vmm_limits.h>
+#include <vmm_stdio.h>
+#include <vmm_devtree.h>
+#include <arch_regs.h>
+#include <arch_barrier.h>
+#include <arch_gicv3.h>
+#include <drv/irqchip/arm-gic-v3.h>
+
+#include <vgic.h>
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DPRINTF(msg...)			vmm_printf(msg)
+#else
+#define DPRINTF(msg...)
+#endif
+
+#define ICH_VTR_LRCNT_MASK		0x1f
+#define ICH_VTR_PRIBITS_SHIFT		29
+#define ICH_VTR_PRIBITS_MASK		0x7
+
+#define ICH_LR_VIRTID			(0x3ffULL << 0)
+#define ICH_LR_PRIORITY			(0xffULL << ICH_LR_PRIORITY_SHIFT)
+#define ICH_LR_PRIO_TO_VGIC_SHIFT	3
+
+struct vgic_v3_priv {
+	physical_addr_t vcpu_pa;
+	u32 maint_irq;
+	u32 lr_cnt;
+	u32 apr_cnt;
+};
+
+static struct vgic_v3_priv vgicp;
+
+static u64 vgic_v3_read_lr(u32 lr)
+{
+	switch (lr & 0xf) {
+	case 0: return read_sysreg_s(ICH_LR0_EL2);
+	case 1: return read_sysreg_s(ICH_LR1_EL2);
+	case 2: return read_sysreg_s(ICH_LR2_EL2);
+	case 3: return read_sysreg_s(ICH_LR3_EL2);
+	case 4: return read_sysreg_s(ICH_LR4_EL2);
+	case 5: return read_sysreg_s(ICH_LR5_EL2);
+	case 6: return read_sysreg_s(ICH_LR6_EL2);
+	case 7: return read_sysreg_s(ICH_LR7_EL2);
+	case 8: return read_sysreg_s(ICH_LR8_EL2);
+	case 9: return read_sysreg_s(ICH_LR9_EL2);
+	case 10: return read_sysreg_s(ICH_LR10_EL2);
+	case 11: return read_sysreg_s(ICH_LR11_EL2);
+	case 12: return read_sysreg_s(ICH_LR12_EL2);
+	case 13: return read_sysreg_s(ICH_LR13_EL2);
+	case 14: return read_sysreg_s(ICH_LR14_EL2);
+	default: return read_sysreg_s(ICH_LR15_EL2);
+	};
+}
+
+static void vgic_v3_write_lr(u32 lr, u64 val)
+{
+	switch (lr & 0xf) {
+	case 0: write_sysreg_s(val, ICH_LR0_EL2); break;
+	case 1: write_sysreg_s(val, ICH_LR1_EL2); break;
+	case 2: write_sysreg_s(val, ICH_LR2_EL2); break;
+	case 3: write_sysreg_s(val, ICH_LR3_EL2); break;
+	case 4: write_sysreg_s(val, ICH_LR4_EL2); break;
+	case 5: write_sysreg_s(val, ICH_LR5_EL2); break;
+	case 6: write_sysreg_s(val, ICH_LR6_EL2); break;
+	case 7: write_sysreg_s(val, ICH_LR7_EL2); break;
+	case 8: write_sysreg_s(val, ICH_LR8_EL2); break;
+	case 9: write_sysreg_s(val, ICH_LR9_EL2); break;
+	case 10: write_sysreg_s(val, ICH_LR10_EL2); break;
+	case 11: write_sysreg_s(val, ICH_LR11_EL2); break;
+	case 12: write_sysreg_s(val, ICH_LR12_EL2); break;
+	case 13: write_sysreg_s(val, ICH_LR13_EL2); break;
+	case 14: write_sysreg_s(val, ICH_LR14_EL2); break;
+	default: write_sysreg_s(val, ICH_LR15_EL2); break;
+	};
+}
+
+static u32 vgic_v3_read_apr(u32 grp, u32 n)
+{
+	if (grp) {
+		switch (n & 0x3) {
+		case 0: return read_sysreg_s(ICH_AP1R0_EL2);
+		case 1: return read_sysreg_s(ICH_AP1R1_EL2);
+		case 2: return read_sysreg_s(ICH_AP1R2_EL2);
+		default: return read_sysreg_s(ICH_AP1R3_EL2);
+		};
+	}
+
+	switch (n & 0x3) {
+	case 0: return read_sysreg_s(ICH_AP0R0_EL2);
+	case 1: return read_sysreg_s(ICH_AP0R1_EL2);
+	case 2: return read_sysreg_s(ICH_AP0R2_EL2);
+	default: return read_sysreg_s(ICH_AP0R3_EL2);
+	};
+}
+
+static void vgic_v3_write_apr(u32 grp, u32 n, u32 val)
+{
+	if (grp) {
+		switch (n & 0x3) {
+		case 0: write_sysreg_s(val, ICH_AP1R0_EL2); break;
+		case 1: write_sysreg_s(val, ICH_AP1R1_EL2); break;
+		case 2: write_sysreg_s(val, ICH_AP1R2_EL2); break;
+		default: write_sysreg_s(val, ICH_AP1R3_EL2); break;
+		};
+		return;
+	}
+
+	switch (n & 0x3) {
+	case 0: write_sysreg_s(val, ICH_AP0R0_EL2); break;
+	case 1: write_sysreg_s(val, ICH_AP0R1_EL2); break;
+	case 2: write_sysreg_s(val, ICH_AP0R2_EL2); break;
+	default: write_sysreg_s(val, ICH_AP0R3_EL2); break;
+	};
+}
+
+static void vgic_v3_reset_state(struct vgic_hw_state *hw)
+{
+	u32 i;
+
+	hw->v3.hcr = ICH_HCR_EN;
+	hw->v3.vmcr = 0;
+	for (i = 0; i < 4; i++) {
+		hw->v3.ap0r[i] = 0;
+		hw->v3.ap1r[i] = 0;
+	}
+	for (i = 0; i < vgicp.lr_cnt; i++) {
+		hw->v3.lr[i] = 0x0;
+	}
+}
+
+static void vgic_v3_save_state(struct vgic_hw_state *hw)
+{
+	u32 i;
+
+	hw->v3.hcr = read_sysreg_s(ICH_HCR_EL2);
+	hw->v3.vmcr = read_sysreg_s(ICH_VMCR_EL2);
+	for (i = 0; i < vgicp.apr_cnt; i++) {
+		hw->v3.ap0r[i] = vgic_v3_read_apr(0, i);
+		hw->v3.ap1r[i] = vgic_v3_read_apr(1, i);
+	}
+	write_sysreg_s(0x0, ICH_HCR_EL2);
+	for (i = 0; i < vgicp.lr_cnt; i++) {
+		hw->v3.lr[i] = vgic_v3_read_lr(i);
+	}
+}
+
+static void vgic_v3_restore_state(struct vgic_hw_state *hw)
+{
+	u32 i;
+
+	/* Guest uses memory mapped GICv2 CPU interface */
+	write_sysreg_s(0x0, ICC_SRE_EL1);
+	isb();
+
+	write_sysreg_s(hw->v3.hcr, ICH_HCR_EL2);
+	write_sysreg_s(hw->v3.vmcr, ICH_VMCR_EL2);
+	for (i = 0; i < vgicp.apr_cnt; i++) {
+		vgic_v3_write_apr(0, i, hw->v3.ap0r[i]);
+		vgic_v3_write_apr(1, i, hw->v3.ap1r[i]);
+	}
+	for (i = 0; i < vgicp.lr_cnt; i++) {
+		vgic_v3_write_lr(i, hw->v3.lr[i]);
+	}
+}
+
+static bool vgic_v3_check_underflow(void)
+{
+	u32 misr = read_sysreg_s(ICH_MISR_EL2);
+	return (misr & ICH_MISR_U) ? TRUE : FALSE;
+}
+
+static void vgic_v3_enable_underflow(void)
+{
+	u32 hcr = read_sysreg_s(ICH_HCR_EL2);
+	hcr |= ICH_HCR_UIE;
+	write_sysreg_s(hcr, ICH_HCR_EL2);
+}
+
+static void vgic_v3_disable_underflow(void)
+{
+	u32 hcr = read_sysreg_s(ICH_HCR_EL2);
+	hcr &= ~ICH_HCR_UIE;
+	write_sysreg_s(hcr, ICH_HCR_EL2);
+}
+
+static void vgic_v3_read_elrsr(u32 *elrsr0, u32 *elrsr1)
+{
+	*elrsr0 = read_sysreg_s(ICH_ELSR_EL2);
+	*elrsr1 = 0x0;
+}
+
+static void vgic_v3_set_lr(u32 lr, struct vgic_lr *lrv)
+{
+	u64 lrval = lrv->virtid & ICH_LR_VIRTID;
+
+	lrval |= ((u64)lrv->prio << (ICH_LR_PRIORITY_SHIFT +
+				     ICH_LR_PRIO_TO_VGIC_SHIFT)) &
+							ICH_LR_PRIORITY;
+
+	if (lrv->flags & VGIC_LR_STATE_PENDING) {
+		lrval |= ICH_LR_PENDING_BIT;
+	}
+	if (lrv->flags & VGIC_LR_STATE_ACTIVE) {
+		lrval |= ICH_LR_ACTIVE_BIT;
+	}
+	if (lrv->flags & VGIC_LR_HW) {
+		lrval |= ICH_LR_HW;
+		lrval |= ((u64)lrv->physid << ICH_LR_PHYS_ID_SHIFT) &
+							ICH_LR_PHYS_ID_MASK;
+	} else {
+		if (lrv->flags & VGIC_LR_EOI_INT) {
+			lrval |= ICH_LR_EOI;
+		}
+		lrval |= ((u64)lrv->cpuid << GICH_LR_PHYSID_CPUID_SHIFT) &
+							GICH_LR_PHYSID_CPUID;
+	}
+
+	DPRINTF("%s: LR%d = 0x%016llx\n", __func__, lr,
+		(unsigned long long)lrval);
+
+	vgic_v3_write_lr(lr, lrval);
+}
+
+static void vgic_v3_get_lr(u32 lr, struct vgic_lr *lrv)
+{
+	u64 lrval = vgic_v3_read_lr(lr);
+
+	DPRINTF("%s: LR%d = 0x%016llx\n", __func__, lr,
+		(unsigned long long)lrval);
+
+	lrv->virtid = lrval & ICH_LR_VIRTID;
+	lrv->physid = 0;
+	lrv->cpuid = 0;
+	lrv->prio = (lrval & ICH_LR_PRIORITY) >>
+			(ICH_LR_PRIORITY_SHIFT + ICH_LR_PRIO_TO_VGIC_SHIFT);
+	lrv->flags = 0;
+
+	if (lrval & ICH_LR_PENDING_BIT) {
+		lrv->flags |= VGIC_LR_STATE_PENDING;
+	}
+	if (lrval & ICH_LR_ACTIVE_BIT) {
+		lrv->flags |= VGIC_LR_STATE_ACTIVE;
+	}
+	if (lrval & ICH_LR_HW) {
+		lrv->flags |= VGIC_LR_HW;
+		lrv->physid = (lrval & ICH_LR_PHYS_ID_MASK) >>
+						ICH_LR_PHYS_ID_SHIFT;
+	} else {
+		if (lrval & ICH_LR_EOI) {
+			lrv->flags |= VGIC_LR_EOI_INT;
+		}
+		lrv->cpuid = (lrval & GICH_LR_PHYSID_CPUID) >>
+						GICH_LR_PHYSID_CPUID_SHIFT;
+	}
+}
+
+static void vgic_v3_clear_lr(u32 lr)
+{
+	DPRINTF("%s: LR%d\n", __func__, lr);
+
+	vgic_v3_write_lr(lr, 0x0);
+}
+
+static const struct vmm_devtree_nodeid vgic_host_match[] = {
+	{ .compatible	= "arm,gic-v3",	},
+	{},
+};
+
+int vgic_v3_probe(struct vgic_ops *ops, struct vgic_params *params)
+{
+	int rc;
+	u32 vtr, pribits, nr_redist_regions;
+	struct vmm_devtree_node *node;
+
+	node = vmm_devtree_find_matching(NULL, vgic_host_match);
+	if (!node) {
+		rc = VMM_ENODEV;
+		goto fail;
+	}
+
+	if (vmm_devtree_read_u32(node, "#redistributor-regions",
+				 &nr_redist_regions)) {
+		nr_redist_regions = 1;
+	}
+
+	/* Regions: GICD, GICR(s), GICC, GICH, GICV */
+	rc = vmm_devtree_regaddr(node, &vgicp.vcpu_pa,
+				 1 + nr_redist_regions + 2);
+	if (rc) {
+		vmm_printf("vgic_v3: GICV region not available\n");
+		rc = VMM_ENODEV;
+		goto fail_dref;
+	}
+
+	vgicp.maint_irq = vmm_devtree_irq_parse_map(node, 0);
+	if (!vgicp.maint_irq) {
+		rc = VMM_ENODEV;
+		goto fail_dref;
+	}
+
+	vtr = read_sysreg_s(ICH_VTR_EL2);
+	vgicp.lr_cnt = (vtr & ICH_VTR_LRCNT_MASK) + 1;
+	if (VGIC_V3_MAX_LRS < vgicp.lr_cnt) {
+		vgicp.lr_cnt = VGIC_V3_MAX_LRS;
+	}
+	pribits = ((vtr >> ICH_VTR_PRIBITS_SHIFT) & ICH_VTR_PRIBITS_MASK) + 1;
+	vgicp.apr_cnt = (pribits > 5) ? (1 << (pribits - 5)) : 1;
+	if (4 < vgicp.apr_cnt) {
+		vgicp.apr_cnt = 4;
+	}
+
+	vmm_devtree_dref_node(node);
+
+	params->type = VGIC_V3;
+	params->vcpu_pa = vgicp.vcpu_pa;
+	params->maint_irq = vgicp.maint_irq;
+	params->lr_cnt = vgicp.lr_cnt;
+
+	ops->reset_state = vgic_v3_reset_state;
+	ops->save_state = vgic_v3_save_state;
+	ops->restore_state = vgic_v3_restore_state;
+	ops->check_underflow = vgic_v3_check_underflow;
+	ops->enable_underflow = vgic_v3_enable_underflow;
+	ops->disable_underflow = vgic_v3_disable_underflow;
+	ops->read_elrsr = vgic_v3_read_elrsr;
+	ops->set_lr = vgic_v3_set_lr;
+	ops->get_lr = vgic_v3_get_lr;
+	ops->clear_lr = vgic_v3_clear_lr;
+
+	vmm_printf("vgic_v3: vcpu=0x%lx\n",
+		   (unsigned long)vgicp.vcpu_pa);
+	vmm_printf("vgic_v3: lr_cnt=%d apr_cnt=%d maint_irq=%d\n",
+		   vgicp.lr_cnt, vgicp.apr_cnt, vgicp.maint_irq);
+
+	return VMM_OK;
+
+fail_dref:
+	vmm_devtree_dref_node(node);
+fail:
+	return rc;
+}
+
+void vgic_v3_remove(struct vgic_ops *ops, struct vgic_params *params)
+{
+	/* Nothing to do here. */
+}
@@ -57,4 +57,55 @@ int arch_guest_add_region(struct vmm_guest *guest, struct vmm_region *region);
  */
 int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region);
 
+/** Architecture specific callback for checking guest memory traps
+ *
+ * Tell whether arch_guest_write_protect() and arch_guest_unmap() work
+ * for given guest. Guests using shadow page tables cannot trap guest
+ * memory accesses this way so dirty page logging and giving back guest
+ * RAM to host are rejected up front for such guests.
+ *
+ * @param guest Guest to be checked.
+ * @return TRUE if guest memory can be write protected and unmapped
+ * otherwise FALSE.
+ */
+bool arch_guest_can_trap_memory(struct vmm_guest *guest);
+
+/** Architecture specific callback for write protecting guest memory
+ *
+ * Remove write access from stage2 (or shadow) mappings of given guest
+ * physical address range so that next guest write to any page in the
+ * range traps. Bigger block mappings overlapping the range may simply
+ * be unmapped. This is used by dirty page logging.
+ *
+ * @param guest Guest whose memory is to be write protected.
+ * @param gphys_addr Page aligned guest physical address.
+ * @param gphys_size Page aligned size of guest physical range.
+ * @return This function should return VMM_OK on success or
+ * VMM_ENOTSUPP if the architecture cannot trap guest writes.
+ */
+int arch_guest_write_protect(struct vmm_guest *guest,
+			     physical_addr_t gphys_addr,
+			     physical_size_t gphys_size);
+
+/** Architecture specific callback for unmapping guest memory
+ *
+ * Remove stage2 (or shadow) mappings of given guest physical address
+ * range so that host RAM backing the range can be reused. Bigger block
+ * mappings overlapping the range are unmapped completely and get
+ * mapped again on next guest access. This is used for giving back
+ * guest RAM to host (e.g. memory ballooning).
+ *
+ * TLB entries of the range must be invalidated on all host CPUs before
+ * returning so that no VCPU can access the range afterwards.
+ *
+ * @param guest Guest whose memory is to be unmapped.
+ * @param gphys_addr Page aligned guest physical address.
+ * @param gphys_size Page aligned size of guest physical range.
+ * @return This function should return VMM_OK on success or
+ * VMM_ENOTSUPP if the architecture cannot unmap guest memory.
+ */
+int arch_guest_unmap(struct vmm_guest *guest,
+		     physical_addr_t gphys_addr,
+		     physical_size_t gphys_size);
+
 #endif
@@ -68,6 +68,16 @@ void arch_vcpu_regs_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu);
 /** Print architecture specific stats for a VCPU */
 void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu);
 
+/** Sample program counter of interrupted context
+ *  NOTE: This function is called in IRQ context by sampling profiler
+ *  with current VCPU and register state saved by interrupt handlers.
+ *  NOTE: The caller is return address of sampled function if it can
+ *  be found cheaply otherwise zero.
+ *  @returns TRUE if interrupted context was executing guest code
+ */
+bool arch_vcpu_regs_sample(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *caller);
+
 /** Get count of VCPU interrupts */
 u32 arch_vcpu_irq_count(struct vmm_vcpu *vcpu);
 
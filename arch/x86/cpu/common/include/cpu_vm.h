@@ -117,9 +117,14 @@ struct vcpu_hw_context {
 	u64 g_cr8;
 
 	unsigned int asid;
+	u32 asid_cpu; /**< Host CPU which allocated the ASID */
+	u32 asid_generation; /**< ASID generation (0 means no ASID) */
 	unsigned long n_cr3;  /* [Note] When #VMEXIT occurs with
 			       * nested paging enabled, hCR3 is not
 			       * saved back into the VMCB (vol2 p. 409)???*/
+	u64 *npt_pml4; /**< Nested page table root when NPT is enabled */
+	bool npt_enabled;
+	atomic_t npt_flush; /**< Non-zero when nested TLB flush is pending */
 	struct page_table *shadow_pgt; /**< Shadow page table when EPT/NPT is not available in chip */
 	union page32 *shadow32_pg_list; /**< Page list for 32-bit guest and paged real mode. */
 	union page32 *shadow32_pgt; /**<32-bit page table */
@@ -192,6 +197,7 @@ extern void cpu_enable_vcpu_intercept(struct vcpu_hw_context *context, int flags
 extern void enable_ioport_intercept(struct vcpu_hw_context *context, u32 ioport);
 extern void disable_ioport_intercept(struct vcpu_hw_context *context, u32 ioport);
 extern int cpu_init_vcpu_hw_context(struct cpuinfo_x86 *cpuinfo, struct vcpu_hw_context *context);
+extern void cpu_deinit_vcpu_hw_context(struct cpuinfo_x86 *cpuinfo, struct vcpu_hw_context *context);
 extern void cpu_boot_vcpu(struct vcpu_hw_context *context);
 
 extern int cpu_enable_vm_extensions(struct cpuinfo_x86 *cpuinfo);
@@ -214,6 +214,19 @@ int cpu_init_vcpu_hw_context(struct cpuinfo_x86 *cpuinfo,
 	return VMM_EFAIL;
 }
 
+void cpu_deinit_vcpu_hw_context(struct cpuinfo_x86 *cpuinfo,
+				struct vcpu_hw_context *context)
+{
+	switch (cpuinfo->vendor) {
+	case x86_VENDOR_AMD:
+		amd_deinit_vm_control(context);
+		break;
+
+	default:
+		break;
+	}
+}
+
 /*
  * Identify the CPU and enable the VM feature on it.
  * Only AMD processors are supported right now.
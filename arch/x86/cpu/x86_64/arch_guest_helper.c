@@ -24,6 +24,8 @@
 #include <vmm_error.h>
 #include <vmm_heap.h>
 #include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_cpumask.h>
 #include <vmm_manager.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_host_aspace.h>
@@ -44,6 +46,8 @@ int arch_guest_init(struct vmm_guest * guest)
 		return VMM_EFAIL;
 	}
 
+	INIT_SPIN_LOCK(&priv->npt_lock);
+
 	guest->arch_priv = (void *)priv;
 
 	VM_LOG(LVL_VERBOSE, "Guest init successful!\n");
@@ -61,6 +65,31 @@ int arch_guest_deinit(struct vmm_guest * guest)
 	return VMM_OK;
 }
 
+/* Timeout for host CPUs to acknowledge nested TLB shootdown */
+#define GUEST_NPT_SHOOTDOWN_TIMEOUT_MSECS	1000
+
+static void guest_npt_shootdown_ipi(void *arg0, void *arg1, void *arg2)
+{
+	/*
+	 * Nothing to do here. Taking this IPI already forced #VMEXIT
+	 * on target host CPU so pending nested TLB flush of VCPU is
+	 * done by svm_run() before guest runs again.
+	 */
+}
+
+/*
+ * Wait until none of the given host CPUs runs guest with stale
+ * nested translations. The nested page tables must be updated
+ * and flush must be requested before calling this.
+ */
+static int guest_npt_shootdown(const struct vmm_cpumask *cpus)
+{
+	return vmm_smp_ipi_sync_call(cpus,
+				     GUEST_NPT_SHOOTDOWN_TIMEOUT_MSECS,
+				     guest_npt_shootdown_ipi,
+				     NULL, NULL, NULL);
+}
+
 int arch_guest_add_region(struct vmm_guest *guest, struct vmm_region *region)
 {
 	struct vmm_vcpu *vcpu;
@@ -115,9 +144,140 @@ int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region)
 			priv->tot_ram_sz += region->phys_size;
 	}
 
+	/* Nested mappings of removed region get refilled on demand */
+	if (region->flags & VMM_REGION_MEMORY) {
+		int rc;
+		u32 count = 0, nr = guest->vcpu_count;
+		u64 **detached;
+		struct vcpu_hw_context *context;
+		struct vmm_cpumask cpus = VMM_CPU_MASK_NONE;
+
+		detached = vmm_zalloc(nr * sizeof(*detached));
+
+		vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+		list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+			context = x86_vcpu_priv(vcpu)->hw_context;
+			if (!context->npt_enabled) {
+				continue;
+			}
+			if (!detached || (count >= nr) ||
+			    amd_npt_flush(context, &detached[count])) {
+				/* No memory to keep tables so drop only
+				 * mappings of removed region.
+				 */
+				amd_npt_unmap(context,
+					      VMM_REGION_GPHYS_START(region),
+					      region->phys_size);
+			} else {
+				count++;
+			}
+			vmm_cpumask_set_cpu(vcpu->hcpu, &cpus);
+		}
+
+		vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+
+		rc = guest_npt_shootdown(&cpus);
+
+		/* Detached tables can be walked by host CPUs which did
+		 * not acknowledge shootdown so leak them in that case.
+		 */
+		if (detached) {
+			for (i = 0; !rc && (i < count); i++) {
+				amd_npt_free_detached(detached[i]);
+			}
+			vmm_free(detached);
+		}
+
+		return rc;
+	}
+
 	return VMM_OK;
 }
 
+bool arch_guest_can_trap_memory(struct vmm_guest *guest)
+{
+	bool ret = TRUE;
+	irq_flags_t flags;
+	struct vmm_vcpu *vcpu;
+
+	/* Shadow page tables map guest virtual addresses */
+	vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+	list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+		if (!x86_vcpu_priv(vcpu)->hw_context->npt_enabled) {
+			ret = FALSE;
+			break;
+		}
+	}
+
+	vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+
+	return ret;
+}
+
+int arch_guest_write_protect(struct vmm_guest *guest,
+			     physical_addr_t gphys_addr,
+			     physical_size_t gphys_size)
+{
+	int rc = VMM_OK;
+	irq_flags_t flags;
+	struct vmm_vcpu *vcpu;
+	struct vmm_cpumask cpus = VMM_CPU_MASK_NONE;
+
+	vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+	list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+		if (!x86_vcpu_priv(vcpu)->hw_context->npt_enabled) {
+			rc = VMM_ENOTSUPP;
+			break;
+		}
+		amd_npt_write_protect(x86_vcpu_priv(vcpu)->hw_context,
+				      gphys_addr, gphys_size);
+		vmm_cpumask_set_cpu(vcpu->hcpu, &cpus);
+	}
+
+	vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+
+	if (rc != VMM_OK) {
+		return rc;
+	}
+
+	/* Guest writes to the range must trap after this */
+	return guest_npt_shootdown(&cpus);
+}
+
+int arch_guest_unmap(struct vmm_guest *guest,
+		     physical_addr_t gphys_addr,
+		     physical_size_t gphys_size)
+{
+	int rc = VMM_OK;
+	irq_flags_t flags;
+	struct vmm_vcpu *vcpu;
+	struct vmm_cpumask cpus = VMM_CPU_MASK_NONE;
+
+	vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+	list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+		if (!x86_vcpu_priv(vcpu)->hw_context->npt_enabled) {
+			rc = VMM_ENOTSUPP;
+			break;
+		}
+		amd_npt_unmap(x86_vcpu_priv(vcpu)->hw_context,
+			      gphys_addr, gphys_size);
+		vmm_cpumask_set_cpu(vcpu->hcpu, &cpus);
+	}
+
+	vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+
+	if (rc != VMM_OK) {
+		return rc;
+	}
+
+	/* Host RAM of the range can be reused only after this */
+	return guest_npt_shootdown(&cpus);
+}
+
 static void guest_cmos_init(struct vmm_guest *guest)
 {
 	int val;
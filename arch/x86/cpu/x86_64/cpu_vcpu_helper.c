@@ -248,6 +248,15 @@ int arch_vcpu_init(struct vmm_vcpu *vcpu)
 
 int arch_vcpu_deinit(struct vmm_vcpu * vcpu)
 {
+	extern struct cpuinfo_x86 cpu_info;
+
+	if (vcpu->is_normal && vcpu->arch_priv &&
+	    x86_vcpu_priv(vcpu)->hw_context) {
+		/* Give back ASID and VM control pages of this VCPU */
+		cpu_deinit_vcpu_hw_context(&cpu_info,
+					   x86_vcpu_priv(vcpu)->hw_context);
+	}
+
 	return VMM_OK;
 }
 
@@ -305,6 +314,19 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 	/* For now no arch specific stats */
 }
 
+bool arch_vcpu_regs_sample(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *caller)
+{
+	/* Host interrupts are taken after VM exit so, the sampled
+	 * context is always hypervisor. The caller is not available
+	 * without walking the stack.
+	 */
+	*pc = regs->rip;
+	*caller = 0;
+
+	return FALSE;
+}
+
 static void dump_guest_vcpu_state(struct vcpu_hw_context *context)
 {
 	int i;
@@ -23,6 +23,7 @@
 #ifndef __ARCH_GUEST_HELPER_H_
 #define __ARCH_GUEST_HELPER_H_
 
+#include <vmm_spinlocks.h>
 #include <cpu_vm.h>
 #include <emu/rtc/mc146818rtc.h>
 #include <emu/i8259.h>
@@ -45,6 +46,8 @@ struct x86_guest_priv {
 	struct cmos_rtc_state *rtc_cmos;
 	struct i8259_state *master_pic;
 	u64 tot_ram_sz;
+	/**< Serializes updates to nested page tables of all VCPUs */
+	vmm_spinlock_t npt_lock;
 };
 
 /*!def x86_guest_priv(guest) is to access guest private information */
@@ -29,6 +29,20 @@
 #include <cpu_vm.h>
 #include <vm/amd_vmcb.h>
 
+/* VMCB TLB control values (AMD64 manual Vol. 2, p. 409) */
+#define SVM_TLB_FLUSH_NOTHING		0x0
+#define SVM_TLB_FLUSH_ALL		0x1
+#define SVM_TLB_FLUSH_ASID		0x3
+#define SVM_TLB_FLUSH_ASID_LOCAL	0x7
+
+/* Nested page fault error code in EXITINFO1 */
+#define SVM_NPF_PRESENT			(1ULL << 0)
+#define SVM_NPF_WRITE			(1ULL << 1)
+#define SVM_NPF_FINAL_GPA		(1ULL << 32)
+#define SVM_NPF_GUEST_PGTBL		(1ULL << 33)
+
+#define NPT_LARGE_PAGE_SIZE		(1UL << 21)
+
 #ifndef __ASSEMBLY__
 
 static inline void clgi(void)
@@ -42,8 +56,21 @@ static inline void stgi(void)
 }
 
 extern int amd_setup_vm_control(struct vcpu_hw_context *context);
+extern void amd_deinit_vm_control(struct vcpu_hw_context *context);
 extern int amd_init(struct cpuinfo_x86 *cpuinfo);
 
+extern int amd_npt_init(struct vcpu_hw_context *context);
+extern void amd_npt_deinit(struct vcpu_hw_context *context);
+extern int amd_npt_map(struct vcpu_hw_context *context,
+		       physical_addr_t gphys, physical_addr_t hphys,
+		       physical_size_t size, bool writeable);
+extern void amd_npt_unmap(struct vcpu_hw_context *context,
+			  physical_addr_t gphys, physical_size_t size);
+extern void amd_npt_write_protect(struct vcpu_hw_context *context,
+				  physical_addr_t gphys, physical_size_t size);
+extern int amd_npt_flush(struct vcpu_hw_context *context, u64 **detached);
+extern void amd_npt_free_detached(u64 *detached);
+
 #endif
 
 #endif /* _AMD_SVM_H__ */
@@ -49,6 +49,7 @@ cpu-objs-y+= cpu_interrupt_handlers.o
 cpu-objs-y+= arch_guest_helper.o
 cpu-objs-$(CONFIG_VEXT_AMD_SVM)+= vm/amd/amd_intercept.o
 cpu-objs-$(CONFIG_VEXT_AMD_SVM)+= vm/amd/amd_svm.o
+cpu-objs-$(CONFIG_VEXT_AMD_SVM)+= vm/amd/amd_npt.o
 cpu-objs-$(CONFIG_VEXT_INTEL_VTX)+= vm/intel/intel_vmcs.o
 cpu-objs-$(CONFIG_VEXT_INTEL_VTX)+= vm/intel/intel_vmx.o
 cpu-objs-$(CONFIG_VEXT_INTEL_VTX)+= vm/intel/ivmx_helper.o
@@ -35,6 +35,7 @@
 #include <vm/amd_svm.h>
 #include <vmm_devemu.h>
 #include <vmm_manager.h>
+#include <vmm_exitstat.h>
 #include <vmm_main.h>
 
 static char *exception_names[] = {
@@ -235,6 +236,7 @@ static inline
 void handle_guest_realmode_page_fault(struct vcpu_hw_context *context)
 {
 	physical_addr_t fault_gphys = context->vmcb->exitinfo2;
+	physical_addr_t hphys;
 	u64 fault_offset;
 	struct vmm_region *g_reg;
 	struct vmm_guest *guest = context->assoc_vcpu->guest;
@@ -248,9 +250,18 @@ void handle_guest_realmode_page_fault(struct vcpu_hw_context *context)
 	}
 
 	fault_offset = fault_gphys - g_reg->gphys_addr;
+	hphys = g_reg->hphys_addr + fault_offset;
+
+	/* On-demand RAM is not contiguous in host */
+	if ((g_reg->flags & VMM_REGION_ISONDEMAND) &&
+	    vmm_guest_physical_map(guest, fault_gphys, PAGE_SIZE,
+				   &hphys, NULL, NULL)) {
+		VM_LOG(LVL_ERR, "ERROR: Failed to populate guest "
+		       "physical: 0x%lx\n", fault_gphys);
+		goto guest_bad_fault;
+	}
 
-	if (create_guest_shadow_map(context, fault_gphys,
-				    (g_reg->hphys_addr + fault_offset),
+	if (create_guest_shadow_map(context, fault_gphys, hphys,
 				    PAGE_SIZE, 0x3, 0x3) != VMM_OK) {
 		VM_LOG(LVL_ERR, "ERROR: Failed to create map in"
 		       "guest's shadow page table.\n"
@@ -398,7 +409,7 @@ void handle_guest_protected_mem_rw(struct vcpu_hw_context *context)
 	struct vmm_guest *guest = context->assoc_vcpu->guest;
 	physical_addr_t fault_gphys = context->vmcb->exitinfo2;
 	u64 fault_offset;
-	physical_addr_t lookedup_gphys;
+	physical_addr_t lookedup_gphys, hphys;
 	struct vmm_region *g_reg;
 	union page32 pte, pde;
 	u32 prot, pdprot;
@@ -477,8 +488,18 @@ void handle_guest_protected_mem_rw(struct vcpu_hw_context *context)
 	 * Otherwise do emulate.
 	 */
 	if (g_reg->flags & (VMM_REGION_REAL | VMM_REGION_ALIAS)) {
-		if (create_guest_shadow_map(context, fault_gphys,
-					    (g_reg->hphys_addr + fault_offset),
+		hphys = g_reg->hphys_addr + fault_offset;
+
+		/* On-demand RAM is not contiguous in host */
+		if ((g_reg->flags & VMM_REGION_ISONDEMAND) &&
+		    vmm_guest_physical_map(guest, lookedup_gphys, PAGE_SIZE,
+					   &hphys, NULL, NULL)) {
+			VM_LOG(LVL_ERR, "ERROR: Failed to populate guest "
+			       "physical: 0x%lx\n", lookedup_gphys);
+			goto guest_bad_fault;
+		}
+
+		if (create_guest_shadow_map(context, fault_gphys, hphys,
 					    PAGE_SIZE, pdprot,
 					    prot) != VMM_OK) {
 			VM_LOG(LVL_ERR, "ERROR: Failed to create map in"
@@ -520,7 +541,125 @@ void __handle_vm_gdt_write(struct vcpu_hw_context *context)
 
 void __handle_vm_npf (struct vcpu_hw_context *context)
 {
-	VM_LOG(LVL_INFO, "Unhandled Intercept: nested page fault.\n");
+	physical_addr_t fault_gphys = context->vmcb->exitinfo2;
+	physical_addr_t gphys, rgphys, hphys;
+	physical_size_t hsize;
+	struct vmm_region *g_reg, *r_reg;
+	struct vmm_guest *guest = context->assoc_vcpu->guest;
+	bool writeable;
+	u32 reg_flags;
+	int rc;
+
+	VM_LOG(LVL_DEBUG, "Nested page fault: 0x%"PRIx64" (rIP: %"PRIADDR
+	       " error: 0x%"PRIx64")\n", context->vmcb->exitinfo2,
+	       context->vmcb->rip, context->vmcb->exitinfo1);
+
+	if (!context->npt_enabled) {
+		VM_LOG(LVL_ERR, "ERROR: Nested page fault without nested "
+		       "paging.\n");
+		goto guest_bad_fault;
+	}
+
+	g_reg = vmm_guest_find_region(guest, fault_gphys,
+				      VMM_REGION_MEMORY, FALSE);
+	if (!g_reg) {
+		VM_LOG(LVL_ERR, "ERROR: No region mapped to "
+		       "guest physical: 0x%lx\n", fault_gphys);
+		goto guest_bad_fault;
+	}
+
+	/* Resolve aliased regions one hop at a time */
+	r_reg = g_reg;
+	rgphys = fault_gphys;
+	while (r_reg && (r_reg->flags & VMM_REGION_ALIAS)) {
+		rgphys = VMM_REGION_GPHYS_TO_HPHYS(r_reg, rgphys);
+		r_reg = vmm_guest_find_region(guest, rgphys,
+					      VMM_REGION_MEMORY, FALSE);
+	}
+	if (!r_reg) {
+		VM_LOG(LVL_ERR, "ERROR: Unresolved alias for "
+		       "guest physical: 0x%lx\n", fault_gphys);
+		goto guest_bad_fault;
+	}
+
+	/* Device memory is never mapped so every access traps here */
+	if (r_reg->flags & VMM_REGION_VIRTUAL) {
+		handle_guest_mmio_fault(context, r_reg);
+		return;
+	}
+
+	writeable = (r_reg->flags & VMM_REGION_READONLY) ? FALSE : TRUE;
+	if (!writeable && (context->vmcb->exitinfo1 & SVM_NPF_WRITE)) {
+		VM_LOG(LVL_ERR, "ERROR: Write to read-only guest "
+		       "physical: 0x%lx\n", fault_gphys);
+		goto guest_bad_fault;
+	}
+
+	/*
+	 * Use a 2MB mapping when the whole 2MB block around the fault
+	 * lies in a non-aliased region which is not dirty logged and
+	 * host/guest addresses share the 2MB alignment. This saves
+	 * faults and nested TLB entries.
+	 */
+	gphys = fault_gphys & ~(NPT_LARGE_PAGE_SIZE - 1);
+	if ((r_reg == g_reg) &&
+	    !vmm_guest_dirty_log_overlap(guest, gphys, NPT_LARGE_PAGE_SIZE) &&
+	    (VMM_REGION_GPHYS_START(g_reg) <= gphys) &&
+	    ((gphys + NPT_LARGE_PAGE_SIZE) <= VMM_REGION_GPHYS_END(g_reg)) &&
+	    !vmm_guest_physical_map_shared(guest, gphys, NPT_LARGE_PAGE_SIZE,
+					   &hphys, &hsize, NULL) &&
+	    (hsize == NPT_LARGE_PAGE_SIZE) &&
+	    !(hphys & (NPT_LARGE_PAGE_SIZE - 1))) {
+		if (amd_npt_map(context, gphys, hphys, NPT_LARGE_PAGE_SIZE,
+				writeable) == VMM_OK)
+			return;
+		/* Smaller mappings already exist in this block */
+	}
+
+	/* Go through guest aspace so that on-demand RAM is populated */
+	gphys = fault_gphys & PAGE_MASK;
+	rc = vmm_guest_physical_map_shared(guest, gphys, PAGE_SIZE,
+					   &hphys, NULL, &reg_flags);
+
+	/* Merged pages are mapped read-only until guest writes them */
+	if (!rc && writeable && (reg_flags & VMM_REGION_ISSHARED)) {
+		if (context->vmcb->exitinfo1 & SVM_NPF_WRITE) {
+			rc = vmm_guest_ram_unshare(guest, gphys);
+			if (!rc) {
+				rc = vmm_guest_physical_map_shared(guest,
+						gphys, PAGE_SIZE,
+						&hphys, NULL, &reg_flags);
+			}
+		} else {
+			writeable = FALSE;
+		}
+	}
+
+	/* Dirty logged pages are mapped read-only until guest writes them */
+	if (!rc && writeable && vmm_guest_dirty_log_clean(guest, gphys)) {
+		if (context->vmcb->exitinfo1 & SVM_NPF_WRITE) {
+			vmm_guest_dirty_log_mark(guest, gphys);
+		} else {
+			writeable = FALSE;
+		}
+	}
+
+	/* Drop read-only mapping left behind by a merged or clean page */
+	if (!rc && writeable &&
+	    (context->vmcb->exitinfo1 & SVM_NPF_PRESENT)) {
+		amd_npt_unmap(context, gphys, PAGE_SIZE);
+	}
+
+	if (rc || (amd_npt_map(context, gphys, hphys & PAGE_MASK,
+			       PAGE_SIZE, writeable) != VMM_OK)) {
+		VM_LOG(LVL_ERR, "ERROR: Failed to create nested map "
+		       "Gphys: 0x%lx Hphys: 0x%lx\n", gphys, hphys);
+		goto guest_bad_fault;
+	}
+
+	return;
+
+ guest_bad_fault:
 	if (context->vcpu_emergency_shutdown)
 		context->vcpu_emergency_shutdown(context);
 }
@@ -1071,44 +1210,69 @@ void __handle_invalpg(struct vcpu_hw_context *context)
 
 void handle_vcpuexit(struct vcpu_hw_context *context)
 {
+	u64 tstamp;
+	u32 exit_class = VMM_EXIT_OTHER;
+
+	tstamp = vmm_exitstat_begin(context->assoc_vcpu);
+
 	VM_LOG(LVL_VERBOSE, "**** #VMEXIT - exit code: %x\n",
 	       (u32) context->vmcb->exitcode);
 
+	/*
+	 * Control registers are not intercepted with nested paging
+	 * so refresh what guest sees for guest page table walks.
+	 */
+	if (context->npt_enabled) {
+		context->g_cr0 = context->vmcb->cr0;
+		context->g_cr2 = context->vmcb->cr2;
+		context->g_cr3 = context->vmcb->cr3;
+		context->g_cr4 = context->vmcb->cr4;
+	}
+
 	switch (context->vmcb->exitcode) {
 	case VMEXIT_CR0_READ ... VMEXIT_CR15_READ:
+		exit_class = VMM_EXIT_SYSREG;
 		__handle_crN_read(context);
 		break;
 
 	case VMEXIT_CR0_WRITE ... VMEXIT_CR15_WRITE:
+		exit_class = VMM_EXIT_SYSREG;
 		__handle_crN_write(context);
 		break;
 
 	case VMEXIT_MSR:
+		exit_class = VMM_EXIT_SYSREG;
 		if (context->vmcb->exitinfo1 == 1)
 			__handle_vm_wrmsr (context);
 		break;
 
 	case VMEXIT_EXCEPTION_DE ... VMEXIT_EXCEPTION_XF:
+		exit_class = VMM_EXIT_EXCEPTION;
 		__handle_vm_exception(context);
 		break;
 
 	case VMEXIT_SWINT:
+		exit_class = VMM_EXIT_EXCEPTION;
 		__handle_vm_swint(context);
 		break;
 
 	case VMEXIT_NPF:
+		exit_class = VMM_EXIT_PAGEFAULT;
 		__handle_vm_npf (context);
 		break;
 
 	case VMEXIT_VMMCALL:
+		exit_class = VMM_EXIT_HVC;
 		__handle_vm_vmmcall(context);
 		break;
 
 	case VMEXIT_IRET:
+		exit_class = VMM_EXIT_INSN;
 		__handle_vm_iret(context);
 		break;
 
 	case VMEXIT_POPF:
+		exit_class = VMM_EXIT_INSN;
 		__handle_popf(context);
 		break;
 
@@ -1117,29 +1281,36 @@ void handle_vcpuexit(struct vcpu_hw_context *context)
 		break;
 
 	case VMEXIT_CPUID:
+		exit_class = VMM_EXIT_INSN;
 		__handle_cpuid(context);
 		break;
 
 	case VMEXIT_IOIO:
+		exit_class = VMM_EXIT_IO;
 		__handle_ioio(context);
 		break;
 
 	case VMEXIT_GDTR_WRITE:
+		exit_class = VMM_EXIT_INSN;
 		__handle_vm_gdt_write(context);
 		break;
 
 	case VMEXIT_INTR:
+		exit_class = VMM_EXIT_IRQ;
 		break; /* silently */
 
 	case VMEXIT_HLT:
+		exit_class = VMM_EXIT_WFI;
 		__handle_halt(context);
 		break;
 
 	case VMEXIT_INVLPG:
+		exit_class = VMM_EXIT_INSN;
 		__handle_invalpg(context);
 		break;
 
 	case VMEXIT_VINTR:
+		exit_class = VMM_EXIT_IRQ;
 		inject_guest_interrupt(context, 48);
 		break;
 
@@ -1150,4 +1321,6 @@ void handle_vcpuexit(struct vcpu_hw_context *context)
 		if (context->vcpu_emergency_shutdown)
 			context->vcpu_emergency_shutdown(context);
 	}
+
+	vmm_exitstat_end(context->assoc_vcpu, exit_class, tstamp);
 }
@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file amd_npt.c
+ * @author agent (agent@local)
+ * @brief AMD SVM nested page table management.
+ *
+ * Nested page tables use the long mode 4-level page table format
+ * and translate guest physical addresses to host physical addresses.
+ * The tables are filled lazily from guest regions on nested page
+ * faults so that memory not touched by guest never gets a mapping.
+ */
+
+#include <vmm_error.h>
+#include <vmm_types.h>
+#include <vmm_stdio.h>
+#include <vmm_host_aspace.h>
+#include <vmm_spinlocks.h>
+#include <arch_atomic.h>
+#include <libs/stringlib.h>
+#include <cpu_mmu.h>
+#include <cpu_vm.h>
+#include <vm/amd_svm.h>
+#include <arch_guest_helper.h>
+
+#define NPT_PTE_PRESENT			(1ULL << 0)
+#define NPT_PTE_RW			(1ULL << 1)
+#define NPT_PTE_USER			(1ULL << 2)
+#define NPT_PTE_LARGE			(1ULL << 7)
+#define NPT_PTE_ADDR_MASK		0x000FFFFFFFFFF000ULL
+
+#define NPT_LEVEL_COUNT			4
+#define NPT_TABLE_ENTCNT		512
+#define NPT_LEVEL_SHIFT(level)		(39 - ((level) * 9))
+#define NPT_LEVEL_INDEX(gpa, level)	\
+	(((gpa) >> NPT_LEVEL_SHIFT(level)) & (NPT_TABLE_ENTCNT - 1))
+
+/* Level at which 2MB large pages are described */
+#define NPT_LARGE_LEVEL			2
+
+/* Nested page tables of all VCPUs of a guest are updated under this */
+#define NPT_LOCK(context)		\
+	(&x86_guest_priv((context)->assoc_vcpu->guest)->npt_lock)
+
+static u64 *npt_alloc_table(physical_addr_t *pa)
+{
+	virtual_addr_t va;
+
+	va = vmm_host_alloc_pages(1, VMM_MEMORY_FLAGS_NORMAL);
+	if (!va) {
+		return NULL;
+	}
+
+	if (vmm_host_va2pa(va, pa) != VMM_OK) {
+		vmm_host_free_pages(va, 1);
+		return NULL;
+	}
+
+	memset((void *)va, 0, PAGE_SIZE);
+
+	return (u64 *)va;
+}
+
+static u64 *npt_next_table(u64 *table, u32 index, bool create)
+{
+	u64 *next;
+	virtual_addr_t va;
+	physical_addr_t pa;
+
+	if (table[index] & NPT_PTE_PRESENT) {
+		if (table[index] & NPT_PTE_LARGE) {
+			return NULL;
+		}
+		if (vmm_host_pa2va(table[index] & NPT_PTE_ADDR_MASK, &va)) {
+			return NULL;
+		}
+		return (u64 *)va;
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	next = npt_alloc_table(&pa);
+	if (!next) {
+		return NULL;
+	}
+
+	/* Nested walks are user accesses so intermediate
+	 * entries always allow user and write access.
+	 */
+	table[index] = (pa & NPT_PTE_ADDR_MASK) |
+			NPT_PTE_PRESENT | NPT_PTE_RW | NPT_PTE_USER;
+
+	return next;
+}
+
+static void npt_free_table(u64 *table, int level)
+{
+	u32 i;
+	virtual_addr_t va;
+
+	if (level < (NPT_LEVEL_COUNT - 1)) {
+		for (i = 0; i < NPT_TABLE_ENTCNT; i++) {
+			if (!(table[i] & NPT_PTE_PRESENT) ||
+			    (table[i] & NPT_PTE_LARGE)) {
+				continue;
+			}
+			if (vmm_host_pa2va(table[i] & NPT_PTE_ADDR_MASK, &va)) {
+				continue;
+			}
+			npt_free_table((u64 *)va, level + 1);
+		}
+	}
+
+	vmm_host_free_pages((virtual_addr_t)table, 1);
+}
+
+int amd_npt_map(struct vcpu_hw_context *context,
+		physical_addr_t gphys, physical_addr_t hphys,
+		physical_size_t size, bool writeable)
+{
+	int rc = VMM_OK, level, last;
+	u32 index;
+	u64 *table, pte;
+	irq_flags_t flags;
+
+	if (!context->npt_pml4) {
+		return VMM_EFAIL;
+	}
+
+	if (size == NPT_LARGE_PAGE_SIZE) {
+		last = NPT_LARGE_LEVEL;
+	} else if (size == PAGE_SIZE) {
+		last = NPT_LEVEL_COUNT - 1;
+	} else {
+		return VMM_EINVALID;
+	}
+
+	if ((gphys & (size - 1)) || (hphys & (size - 1))) {
+		return VMM_EINVALID;
+	}
+
+	pte = (hphys & NPT_PTE_ADDR_MASK) | NPT_PTE_PRESENT | NPT_PTE_USER;
+	if (writeable) {
+		pte |= NPT_PTE_RW;
+	}
+	if (last == NPT_LARGE_LEVEL) {
+		pte |= NPT_PTE_LARGE;
+	}
+
+	vmm_spin_lock_irqsave_lite(NPT_LOCK(context), flags);
+
+	table = context->npt_pml4;
+	for (level = 0; level < last; level++) {
+		table = npt_next_table(table, NPT_LEVEL_INDEX(gphys, level),
+				       TRUE);
+		if (!table) {
+			rc = VMM_ENOMEM;
+			goto done;
+		}
+	}
+
+	index = NPT_LEVEL_INDEX(gphys, last);
+	if (table[index] & NPT_PTE_PRESENT) {
+		/* Another fault already installed this mapping */
+		rc = (table[index] == pte) ? VMM_OK : VMM_EEXIST;
+		goto done;
+	}
+
+	table[index] = pte;
+
+done:
+	vmm_spin_unlock_irqrestore_lite(NPT_LOCK(context), flags);
+
+	return rc;
+}
+
+void amd_npt_unmap(struct vcpu_hw_context *context,
+		   physical_addr_t gphys, physical_size_t size)
+{
+	int level;
+	u32 index;
+	u64 *table, *next;
+	irq_flags_t flags;
+	physical_addr_t end = gphys + size;
+
+	if (!context->npt_pml4) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(NPT_LOCK(context), flags);
+
+	gphys &= ~((physical_addr_t)PAGE_SIZE - 1);
+	while (gphys < end) {
+		table = context->npt_pml4;
+		for (level = 0; level < (NPT_LEVEL_COUNT - 1); level++) {
+			next = npt_next_table(table,
+					NPT_LEVEL_INDEX(gphys, level), FALSE);
+			if (!next) {
+				break;
+			}
+			table = next;
+		}
+
+		/* Clear leaf entry and skip whatever it covers. Large
+		 * entries overlapping the range are cleared completely.
+		 */
+		index = NPT_LEVEL_INDEX(gphys, level);
+		if ((level == (NPT_LEVEL_COUNT - 1)) ||
+		    (table[index] & NPT_PTE_LARGE)) {
+			table[index] = 0;
+		}
+		gphys &= ~((1ULL << NPT_LEVEL_SHIFT(level)) - 1);
+		gphys += 1ULL << NPT_LEVEL_SHIFT(level);
+	}
+
+	/* Stale translations are tagged with our ASID. Flush them
+	 * before next VMRUN whatever happens to tlb_control meanwhile.
+	 */
+	arch_atomic_write(&context->npt_flush, 1);
+
+	vmm_spin_unlock_irqrestore_lite(NPT_LOCK(context), flags);
+}
+
+void amd_npt_write_protect(struct vcpu_hw_context *context,
+			   physical_addr_t gphys, physical_size_t size)
+{
+	int level;
+	u32 index;
+	u64 *table, *next;
+	irq_flags_t flags;
+	physical_addr_t end = gphys + size;
+
+	if (!context->npt_pml4) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(NPT_LOCK(context), flags);
+
+	gphys &= ~((physical_addr_t)PAGE_SIZE - 1);
+	while (gphys < end) {
+		table = context->npt_pml4;
+		for (level = 0; level < (NPT_LEVEL_COUNT - 1); level++) {
+			next = npt_next_table(table,
+					NPT_LEVEL_INDEX(gphys, level), FALSE);
+			if (!next) {
+				break;
+			}
+			table = next;
+		}
+
+		/* Leaf entries lose write access whereas large entries
+		 * are cleared and get mapped again using 4KB pages.
+		 */
+		index = NPT_LEVEL_INDEX(gphys, level);
+		if (level == (NPT_LEVEL_COUNT - 1)) {
+			table[index] &= ~NPT_PTE_RW;
+		} else if (table[index] & NPT_PTE_LARGE) {
+			table[index] = 0;
+		}
+		gphys &= ~((1ULL << NPT_LEVEL_SHIFT(level)) - 1);
+		gphys += 1ULL << NPT_LEVEL_SHIFT(level);
+	}
+
+	/* Stale translations are tagged with our ASID. Flush them
+	 * before next VMRUN whatever happens to tlb_control meanwhile.
+	 */
+	arch_atomic_write(&context->npt_flush, 1);
+
+	vmm_spin_unlock_irqrestore_lite(NPT_LOCK(context), flags);
+}
+
+int amd_npt_flush(struct vcpu_hw_context *context, u64 **detached)
+{
+	u32 i;
+	u64 *old, *pml4 = context->npt_pml4;
+	physical_addr_t pa;
+	irq_flags_t flags;
+
+	*detached = NULL;
+
+	if (!pml4) {
+		return VMM_OK;
+	}
+
+	/* Detached tables are kept reachable from a private copy of
+	 * top-level entries until no host CPU can walk them anymore.
+	 */
+	old = npt_alloc_table(&pa);
+	if (!old) {
+		return VMM_ENOMEM;
+	}
+
+	vmm_spin_lock_irqsave_lite(NPT_LOCK(context), flags);
+
+	for (i = 0; i < NPT_TABLE_ENTCNT; i++) {
+		if (pml4[i] & NPT_PTE_PRESENT) {
+			old[i] = pml4[i];
+			pml4[i] = 0;
+		}
+	}
+
+	/* Stale translations are tagged with our ASID. Flush them
+	 * before next VMRUN whatever happens to tlb_control meanwhile.
+	 */
+	arch_atomic_write(&context->npt_flush, 1);
+
+	vmm_spin_unlock_irqrestore_lite(NPT_LOCK(context), flags);
+
+	*detached = old;
+
+	return VMM_OK;
+}
+
+void amd_npt_free_detached(u64 *detached)
+{
+	if (detached) {
+		npt_free_table(detached, 0);
+	}
+}
+
+int amd_npt_init(struct vcpu_hw_context *context)
+{
+	physical_addr_t pa;
+
+	context->npt_pml4 = npt_alloc_table(&pa);
+	if (!context->npt_pml4) {
+		return VMM_ENOMEM;
+	}
+
+	context->n_cr3 = pa;
+
+	return VMM_OK;
+}
+
+void amd_npt_deinit(struct vcpu_hw_context *context)
+{
+	if (!context->npt_pml4) {
+		return;
+	}
+
+	npt_free_table(context->npt_pml4, 0);
+	context->npt_pml4 = NULL;
+	context->n_cr3 = 0;
+}
@@ -24,9 +24,14 @@
 #include <vmm_host_aspace.h>
 #include <processor_flags.h>
 #include <libs/bitops.h>
+#include <libs/bitmap.h>
 #include <libs/stringlib.h>
 #include <vmm_error.h>
 #include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_percpu.h>
+#include <vmm_spinlocks.h>
+#include <arch_atomic.h>
 #include <vmm_manager.h>
 #include <cpu_features.h>
 #include <cpu_vm.h>
@@ -89,15 +94,119 @@ static struct vmcb *alloc_vmcb(void)
 	return vmcb;
 }
 
+/*
+ * ASID 0 belongs to host. ASIDs are allocated separately on each host
+ * CPU and a VCPU keeps its ASID only while it runs on the same host
+ * CPU, so that its TLB entries survive VMRUN/#VMEXIT. A VCPU moving to
+ * another host CPU gives back its ASID and gets a new one over there.
+ *
+ * When a host CPU runs out of ASIDs, it starts a new generation which
+ * invalidates all ASIDs handed out by it and flushes its whole TLB.
+ */
+#define SVM_ASID_MAX		(CONFIG_MAX_VCPU_COUNT + 1)
+
+struct svm_asid_ctrl {
+	vmm_spinlock_t lock;
+	u32 generation;
+	u32 nr_asids;
+	DECLARE_BITMAP(map, SVM_ASID_MAX);
+};
+
+static DEFINE_PER_CPU(struct svm_asid_ctrl, svm_asids);
+
+static void svm_asid_init(struct cpuinfo_x86 *cpuinfo)
+{
+	u32 cpu;
+	struct svm_asid_ctrl *actrl;
+
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		actrl = &per_cpu(svm_asids, cpu);
+		INIT_SPIN_LOCK(&actrl->lock);
+		actrl->generation = 1;
+		actrl->nr_asids = min(cpuinfo->hw_nr_asids, (u32)SVM_ASID_MAX);
+		bitmap_zero(actrl->map, SVM_ASID_MAX);
+		__set_bit(0, actrl->map);
+	}
+}
+
+/* Give back ASID of VCPU to the host CPU it was allocated on */
+static void svm_asid_release(struct vcpu_hw_context *context)
+{
+	irq_flags_t flags;
+	struct svm_asid_ctrl *actrl;
+
+	if (!context->asid_generation)
+		return;
+
+	actrl = &per_cpu(svm_asids, context->asid_cpu);
+
+	vmm_spin_lock_irqsave_lite(&actrl->lock, flags);
+	if (context->asid_generation == actrl->generation)
+		__clear_bit(context->asid, actrl->map);
+	context->asid_generation = 0;
+	vmm_spin_unlock_irqrestore_lite(&actrl->lock, flags);
+}
+
+/*
+ * Make sure VCPU has a valid ASID on current host CPU.
+ * Note: This is called with global interrupts disabled just before
+ * VMRUN so that VCPU cannot move to another host CPU meanwhile.
+ */
+static void svm_asid_assign(struct vcpu_hw_context *context)
+{
+	u32 asid, cpu = vmm_smp_processor_id();
+	struct svm_asid_ctrl *actrl = &this_cpu(svm_asids);
+
+	/* Without enough ASIDs, share ASID 1 and flush on every VMRUN */
+	if (actrl->nr_asids < 2) {
+		context->asid = 1;
+		context->vmcb->guest_asid = 1;
+		context->vmcb->tlb_control = SVM_TLB_FLUSH_ALL;
+		return;
+	}
+
+	if (context->asid_generation &&
+	    (context->asid_cpu == cpu) &&
+	    (context->asid_generation == actrl->generation))
+		return;
+
+	svm_asid_release(context);
+
+	vmm_spin_lock_lite(&actrl->lock);
+
+	asid = find_first_zero_bit(actrl->map, actrl->nr_asids);
+	if (asid >= actrl->nr_asids) {
+		actrl->generation++;
+		if (!actrl->generation)
+			actrl->generation = 1;
+		bitmap_zero(actrl->map, SVM_ASID_MAX);
+		__set_bit(0, actrl->map);
+		asid = 1;
+		context->vmcb->tlb_control = SVM_TLB_FLUSH_ALL;
+	} else if (context->vmcb->tlb_control == SVM_TLB_FLUSH_NOTHING) {
+		/* Previous owner of the ASID might have left TLB entries */
+		context->vmcb->tlb_control = SVM_TLB_FLUSH_ASID;
+	}
+	__set_bit(asid, actrl->map);
+
+	context->asid = asid;
+	context->asid_cpu = cpu;
+	context->asid_generation = actrl->generation;
+	context->vmcb->guest_asid = asid;
+
+	vmm_spin_unlock_lite(&actrl->lock);
+}
+
 static void set_control_params (struct vcpu_hw_context *context)
 {
 	struct vmcb *vmcb = context->vmcb;
 
 	/* Enable/disable nested paging (See AMD64 manual Vol. 2, p. 409) */
-	vmcb->np_enable = 0;
-	vmcb->tlb_control = 1; /* Flush all TLBs global/local/asid wide */
+	vmcb->np_enable = (context->npt_enabled) ? 1 : 0;
+	vmcb->n_cr3 = context->n_cr3;
+	vmcb->tlb_control = SVM_TLB_FLUSH_ALL; /* Flush all TLBs global/local/asid wide */
 	vmcb->tsc_offset = 0;
-	vmcb->guest_asid = 1;
+	vmcb->guest_asid = 1; /* Actual ASID is assigned before VMRUN */
 
 	/* enable EFLAGS.IF virtualization */
 	vmcb->vintr.fields.intr_masking = 1;
@@ -140,6 +249,21 @@ static void set_control_params (struct vcpu_hw_context *context)
 				       INTRCPT_EXC_PF);
 
 	vmcb->exception_intercepts = 0xffffffffUL;
+
+	/*
+	 * With nested paging the guest owns its page tables and
+	 * control registers. Only nested page faults need handling.
+	 */
+	if (context->npt_enabled) {
+		vmcb->cr_intercepts &= ~(INTRCPT_WRITE_CR3 | INTRCPT_READ_CR3 |
+					 INTRCPT_WRITE_CR0 | INTRCPT_READ_CR0 |
+					 INTRCPT_WRITE_CR2 | INTRCPT_READ_CR2 |
+					 INTRCPT_WRITE_CR1 | INTRCPT_READ_CR1 |
+					 INTRCPT_WRITE_CR4 | INTRCPT_READ_CR4);
+		vmcb->general1_intercepts &= ~(INTRCPT_CR0_WR |
+					       INTRCPT_INVLPG);
+		vmcb->exception_intercepts &= ~INTRCPT_EXC_PF;
+	}
 }
 
 static void set_vm_to_powerup_state(struct vcpu_hw_context *context)
@@ -161,11 +285,17 @@ static void set_vm_to_powerup_state(struct vcpu_hw_context *context)
 	vmcb->rflags = 0x2;
 	vmcb->efer = EFER_SVME;
 
-	if (vmm_host_va2pa((virtual_addr_t)context->shadow32_pgt, &gcr3_pa) != VMM_OK)
-		vmm_panic("ERROR: Couldn't convert guest shadow table virtual address to physical!\n");
+	if (context->npt_enabled) {
+		/* Nested paging translates real mode accesses directly */
+		vmcb->cr0 = context->g_cr0;
+		vmcb->cr3 = 0;
+	} else {
+		if (vmm_host_va2pa((virtual_addr_t)context->shadow32_pgt, &gcr3_pa) != VMM_OK)
+			vmm_panic("ERROR: Couldn't convert guest shadow table virtual address to physical!\n");
 
-	/* Since this VCPU is in power-up stage, two-fold 32-bit page table apply to it */
-	vmcb->cr3 = gcr3_pa;
+		/* Since this VCPU is in power-up stage, two-fold 32-bit page table apply to it */
+		vmcb->cr3 = gcr3_pa;
+	}
 
 	/*
 	 * Make the CS.RIP point to 0xFFFF0. The reset vector. The Bios seems
@@ -304,6 +434,15 @@ static __unused void set_vm_to_mbr_start_state(struct vmcb* vmcb, enum svm_init_
 static void svm_run(struct vcpu_hw_context *context)
 {
 	clgi();
+
+	svm_asid_assign(context);
+
+	/* Nested translations were removed since last VMRUN */
+	if (arch_atomic_read(&context->npt_flush) &&
+	    arch_atomic_cmpxchg(&context->npt_flush, 1, 0) &&
+	    (context->vmcb->tlb_control == SVM_TLB_FLUSH_NOTHING))
+		context->vmcb->tlb_control = SVM_TLB_FLUSH_ASID;
+
 	asm volatile ("push %%rbp \n\t"
 		      "mov %c[rbx](%[context]), %%rbx \n\t"
 		      "mov %c[rcx](%[context]), %%rcx \n\t"
@@ -371,6 +510,15 @@ static void svm_run(struct vcpu_hw_context *context)
 
 	context->g_regs[GUEST_REGS_RAX] = context->vmcb->rax;
 
+	/*
+	 * Guest TLB entries are tagged with ASID private to this host
+	 * CPU, so next VMRUN on this host CPU need not flush. Moving to
+	 * another host CPU assigns new ASID which is flushed if needed.
+	 * Shadow paging still relies on flush-on-VMRUN.
+	 */
+	if (context->npt_enabled)
+		context->vmcb->tlb_control = SVM_TLB_FLUSH_NOTHING;
+
 	/* invalidate the previously injected event */
 	if (context->vmcb->eventinj.fields.v)
 		context->vmcb->eventinj.fields.v = 0;
@@ -433,6 +581,23 @@ int amd_setup_vm_control(struct vcpu_hw_context *context)
 	if (vmm_host_va2pa((virtual_addr_t)context->vmcb, &context->vmcb_pa) != VMM_OK)
 		vmm_panic("Critical conversion of VMCB VA=>PA failed!\n");
 
+	/* ASID is assigned on the host CPU running the VCPU */
+	context->asid = 0;
+	context->asid_cpu = 0;
+	context->asid_generation = 0;
+	arch_atomic_write(&context->npt_flush, 0);
+
+	/* Use nested paging when available, shadow paging otherwise */
+	context->npt_enabled = FALSE;
+	if (context->cpuinfo->hw_nested_paging) {
+		if (amd_npt_init(context) == VMM_OK) {
+			context->npt_enabled = TRUE;
+			VM_LOG(LVL_INFO, "Nested paging enabled.\n");
+		} else {
+			VM_LOG(LVL_ERR, "Failed to allocate nested page table, "
+			       "using shadow paging.\n");
+		}
+	}
 
 	/* Set control params for this VM */
 	set_control_params(context);
@@ -459,6 +624,21 @@ int amd_setup_vm_control(struct vcpu_hw_context *context)
 	return VMM_OK;
 }
 
+void amd_deinit_vm_control(struct vcpu_hw_context *context)
+{
+	svm_asid_release(context);
+
+	amd_npt_deinit(context);
+	context->npt_enabled = FALSE;
+
+	if (context->vmcb) {
+		vmm_host_free_pages((virtual_addr_t)context->vmcb,
+				    NR_SAVE_AREA_PAGES);
+		context->vmcb = NULL;
+		context->vmcb_pa = 0;
+	}
+}
+
 int amd_init(struct cpuinfo_x86 *cpuinfo)
 {
 	/* FIXME: SMP: This should be done by all CPUs? */
@@ -467,6 +647,8 @@ int amd_init(struct cpuinfo_x86 *cpuinfo)
 		return VMM_EFAIL;
 	}
 
+	svm_asid_init(cpuinfo);
+
 	VM_LOG(LVL_VERBOSE, "AMD SVM enable success!\n");
 
 	return VMM_OK;
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_counter.c
+ * @author agent (agent@local)
+ * @brief command for registered per-cpu counters.
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <vmm_percpu_counter.h>
+#include <libs/stringlib.h>
+
+#define MODULE_DESC			"Command counter"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_counter_init
+#define	MODULE_EXIT			cmd_counter_exit
+
+static void cmd_counter_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   counter help\n");
+	vmm_cprintf(cdev, "   counter list\n");
+	vmm_cprintf(cdev, "   counter reset [<counter_name>]\n");
+}
+
+static int cmd_counter_list_iter(struct vmm_percpu_counter *fbc, void *data)
+{
+	struct vmm_chardev *cdev = data;
+
+	vmm_cprintf(cdev, " %20"PRIi64"  %s\n",
+		    vmm_percpu_counter_sum(fbc), fbc->name);
+
+	return VMM_OK;
+}
+
+static int cmd_counter_list(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, " %20s  %s\n", "Value", "Counter Name");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_percpu_counter_iterate(cdev, cmd_counter_list_iter);
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, "Total %d counters\n", vmm_percpu_counter_count());
+
+	return VMM_OK;
+}
+
+static int cmd_counter_reset_iter(struct vmm_percpu_counter *fbc, void *data)
+{
+	if (strcmp(fbc->name, data)) {
+		return VMM_OK;
+	}
+
+	vmm_percpu_counter_set(fbc, 0);
+
+	return 1;
+}
+
+static int cmd_counter_reset(struct vmm_chardev *cdev, const char *name)
+{
+	if (!name) {
+		vmm_percpu_counter_reset_all();
+		return VMM_OK;
+	}
+
+	if (!vmm_percpu_counter_iterate((void *)name,
+					cmd_counter_reset_iter)) {
+		vmm_cprintf(cdev, "Failed to find counter %s\n", name);
+		return VMM_ENOTAVAIL;
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_counter_exec(struct vmm_chardev *cdev, int argc, char **argv)
+{
+	if (argc == 2) {
+		if (strcmp(argv[1], "help") == 0) {
+			cmd_counter_usage(cdev);
+			return VMM_OK;
+		} else if (strcmp(argv[1], "list") == 0) {
+			return cmd_counter_list(cdev);
+		} else if (strcmp(argv[1], "reset") == 0) {
+			return cmd_counter_reset(cdev, NULL);
+		}
+	} else if ((argc == 3) && (strcmp(argv[1], "reset") == 0)) {
+		return cmd_counter_reset(cdev, argv[2]);
+	}
+	cmd_counter_usage(cdev);
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_counter = {
+	.name = "counter",
+	.desc = "per-cpu counter statistics",
+	.usage = cmd_counter_usage,
+	.exec = cmd_counter_exec,
+};
+
+static int __init cmd_counter_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_counter);
+}
+
+static void __exit cmd_counter_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_counter);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_drawfn.c
+ * @author agent (agent@local)
+ * @brief command for framebuffer format conversion routines.
+ */
+
+#include <vmm_error.h>
+#include <vmm_macros.h>
+#include <vmm_stdio.h>
+#include <vmm_heap.h>
+#include <vmm_timer.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <vio/vmm_vdisplay.h>
+#include <libs/stringlib.h>
+#include <libs/mathlib.h>
+#include <emu/drawfn.h>
+
+#define MODULE_DESC			"Command drawfn"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_drawfn_init
+#define	MODULE_EXIT			cmd_drawfn_exit
+
+#define DRAWFN_BENCH_DEF_WIDTH		1024
+#define DRAWFN_BENCH_MAX_WIDTH		8192
+#define DRAWFN_BENCH_DEF_ITERATIONS	1000
+
+static void cmd_drawfn_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   drawfn help\n");
+	vmm_cprintf(cdev, "   drawfn list\n");
+	vmm_cprintf(cdev, "   drawfn bench [<width>] [<iterations>]\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   Only accelerated routines usable on "
+			  "host CPU are shown.\n");
+	vmm_cprintf(cdev, "   Benchmark reports MPixel/s for 32bpp "
+			  "surface.\n");
+}
+
+static const char *drawfn_format_name(enum drawfn_format format)
+{
+	return (format == DRAWFN_FORMAT_RGB) ? "rgb" : "bgr";
+}
+
+static bool drawfn_is_installed(struct drawfn_simd *ds)
+{
+	u32 index = DRAWFN_FNTABLE_INDEX(ds->format, ds->order, ds->bppmode);
+
+	return (drawfn_surface_fntable_32[index] == ds->fn) ? TRUE : FALSE;
+}
+
+static int cmd_drawfn_list(struct vmm_chardev *cdev)
+{
+	u32 i, count;
+	struct drawfn_simd *ds;
+
+	drawfn_simd_init();
+
+	count = drawfn_simd_count();
+
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------\n");
+	vmm_cprintf(cdev, " %-6s %-16s %-8s %-10s\n",
+			  "ISA", "Name", "Format", "Installed");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------\n");
+	for (i = 0; i < count; i++) {
+		ds = drawfn_simd_get(i);
+		if (!ds) {
+			continue;
+		}
+		vmm_cprintf(cdev, " %-6s %-16s %-8s %-10s\n",
+			    ds->isa, ds->name, drawfn_format_name(ds->format),
+			    (drawfn_is_installed(ds)) ? "yes" : "no");
+	}
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------\n");
+	vmm_cprintf(cdev, "Total %d accelerated routines\n", count);
+
+	return VMM_OK;
+}
+
+static u64 drawfn_bench_run(drawfn fn, struct vmm_surface *sf,
+			    u32 *palette, u8 *dst, const u8 *src,
+			    u32 width, u32 iterations)
+{
+	u32 i;
+	u64 tstamp;
+
+	tstamp = vmm_timer_timestamp();
+	for (i = 0; i < iterations; i++) {
+		fn(sf, palette, dst, src, width, 4);
+	}
+	tstamp = vmm_timer_timestamp() - tstamp;
+
+	return (tstamp) ? tstamp : 1;
+}
+
+/* Print MPixel/s with one decimal point */
+static void drawfn_bench_print(struct vmm_chardev *cdev,
+			       u32 width, u32 iterations, u64 nsecs)
+{
+	u64 rate = udiv64((u64)width * iterations * 10000, nsecs);
+
+	vmm_cprintf(cdev, " %7"PRIu64".%"PRIu64,
+		    udiv64(rate, 10), umod64(rate, 10));
+}
+
+static int cmd_drawfn_bench(struct vmm_chardev *cdev,
+			    u32 width, u32 iterations)
+{
+	int rc = VMM_OK;
+	u32 i, count, *palette;
+	u64 gen_nsecs, simd_nsecs;
+	u8 *src, *gen_dst, *simd_dst;
+	struct drawfn_simd *ds;
+	struct vmm_surface sf;
+
+	drawfn_simd_init();
+
+	/* Width multiple of 8 so that all routines write same pixels */
+	width = align(width, 8);
+	if (!width || (DRAWFN_BENCH_MAX_WIDTH < width) || !iterations) {
+		return VMM_EINVALID;
+	}
+
+	memset(&sf, 0, sizeof(sf));
+	src = vmm_malloc(width * 4);
+	gen_dst = vmm_malloc(width * 4);
+	simd_dst = vmm_malloc(width * 4);
+	palette = vmm_malloc(256 * sizeof(u32));
+	if (!src || !gen_dst || !simd_dst || !palette) {
+		rc = VMM_ENOMEM;
+		goto done;
+	}
+
+	for (i = 0; i < (width * 4); i++) {
+		src[i] = (u8)(i * 131 + (i >> 8) * 7);
+	}
+	for (i = 0; i < 256; i++) {
+		palette[i] = (i * 0x010305) & 0x00ffffff;
+	}
+
+	count = drawfn_simd_count();
+
+	vmm_cprintf(cdev, "Width: %d pixels, Iterations: %d\n",
+		    width, iterations);
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "------------------\n");
+	vmm_cprintf(cdev, " %-6s %-12s %-6s %9s %9s %-8s\n",
+			  "ISA", "Name", "Format",
+			  "Generic", "SIMD", "Result");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "------------------\n");
+	for (i = 0; i < count; i++) {
+		ds = drawfn_simd_get(i);
+		if (!ds || !ds->generic) {
+			continue;
+		}
+
+		memset(gen_dst, 0, width * 4);
+		memset(simd_dst, 0, width * 4);
+		gen_nsecs = drawfn_bench_run(ds->generic, &sf, palette,
+					     gen_dst, src, width, iterations);
+		simd_nsecs = drawfn_bench_run(ds->fn, &sf, palette,
+					      simd_dst, src, width, iterations);
+
+		vmm_cprintf(cdev, " %-6s %-12s %-6s",
+			    ds->isa, ds->name, drawfn_format_name(ds->format));
+		drawfn_bench_print(cdev, width, iterations, gen_nsecs);
+		drawfn_bench_print(cdev, width, iterations, simd_nsecs);
+		vmm_cprintf(cdev, " %-8s\n",
+			    (memcmp(gen_dst, simd_dst, width * 4)) ?
+			    "MISMATCH" : "ok");
+	}
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "------------------\n");
+
+done:
+	if (palette) {
+		vmm_free(palette);
+	}
+	if (simd_dst) {
+		vmm_free(simd_dst);
+	}
+	if (gen_dst) {
+		vmm_free(gen_dst);
+	}
+	if (src) {
+		vmm_free(src);
+	}
+
+	return rc;
+}
+
+static int cmd_drawfn_exec(struct vmm_chardev *cdev, int argc, char **argv)
+{
+	u32 width = DRAWFN_BENCH_DEF_WIDTH;
+	u32 iterations = DRAWFN_BENCH_DEF_ITERATIONS;
+
+	if (argc == 2) {
+		if (strcmp(argv[1], "help") == 0) {
+			cmd_drawfn_usage(cdev);
+			return VMM_OK;
+		} else if (strcmp(argv[1], "list") == 0) {
+			return cmd_drawfn_list(cdev);
+		}
+	}
+	if ((2 <= argc) && (argc <= 4) &&
+	    (strcmp(argv[1], "bench") == 0)) {
+		if (argc > 2) {
+			width = atoi(argv[2]);
+		}
+		if (argc > 3) {
+			iterations = atoi(argv[3]);
+		}
+		return cmd_drawfn_bench(cdev, width, iterations);
+	}
+	cmd_drawfn_usage(cdev);
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_drawfn = {
+	.name = "drawfn",
+	.desc = "framebuffer format conversion routines",
+	.usage = cmd_drawfn_usage,
+	.exec = cmd_drawfn_exec,
+};
+
+static int __init cmd_drawfn_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_drawfn);
+}
+
+static void __exit cmd_drawfn_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_drawfn);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
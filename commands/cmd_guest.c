@@ -54,9 +54,13 @@ static void cmd_guest_usage(struct vmm_chardev *cdev)
 	vmm_cprintf(cdev, "   guest dumpmem <guest_name> <gphys_addr> "
 			  "[mem_sz]\n");
 	vmm_cprintf(cdev, "   guest region  <guest_name> <gphys_addr>\n");
+	vmm_cprintf(cdev, "   guest memstat <guest_name>\n");
+	vmm_cprintf(cdev, "   guest balloon <guest_name> [<balloon_kb>]\n");
 	vmm_cprintf(cdev, "Note:\n");
 	vmm_cprintf(cdev, "   <guest_name> = node name under /guests "
 			  "device tree node\n");
+	vmm_cprintf(cdev, "   <balloon_kb> = memory (in KB) which guest "
+			  "is asked to give up\n");
 }
 
 static int guest_list_iter(struct vmm_guest *guest, void *priv)
@@ -298,12 +302,20 @@ static int cmd_guest_region(struct vmm_chardev *cdev, const char *name,
 	vmm_cprintf(cdev, "Region guest physical address: 0x%"PRIPADDR"\n",
 		    reg->gphys_addr);
 
-	vmm_cprintf(cdev, "Region host physical address : 0x%"PRIPADDR"\n",
-		    reg->hphys_addr);
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		vmm_cprintf(cdev, "Region host physical address : "
+				  "on-demand\n");
+	} else {
+		vmm_cprintf(cdev, "Region host physical address : "
+				  "0x%"PRIPADDR"\n", reg->hphys_addr);
+	}
 
 	vmm_cprintf(cdev, "Region physical size         : 0x%"PRIPSIZE"\n",
 		    reg->phys_size);
 
+	vmm_cprintf(cdev, "Region resident size         : 0x%"PRIPSIZE"\n",
+		    vmm_guest_region_rss(reg));
+
 	vmm_cprintf(cdev, "Region flags                 : 0x%08x\n",
 		    reg->flags);
 
@@ -324,6 +336,74 @@ static int cmd_guest_region(struct vmm_chardev *cdev, const char *name,
 	return VMM_OK;
 }
 
+static int cmd_guest_memstat(struct vmm_chardev *cdev, const char *name)
+{
+	struct vmm_guest *guest = vmm_manager_guest_find(name);
+
+	if (!guest) {
+		vmm_cprintf(cdev, "Failed to find guest\n");
+		return VMM_ENOTAVAIL;
+	}
+
+	vmm_cprintf(cdev, "Guest resident host RAM      : %"PRIPSIZE" KB\n",
+		    vmm_guest_aspace_rss(guest) >> 10);
+	vmm_cprintf(cdev, "Guest RAM merged             : %"PRIPSIZE" KB\n",
+		    vmm_guest_aspace_merged(guest) >> 10);
+	vmm_cprintf(cdev, "On-demand RAM committed      : %"PRIPSIZE" KB\n",
+		    vmm_guest_ondemand_committed() >> 10);
+	vmm_cprintf(cdev, "On-demand RAM commit limit   : %"PRIPSIZE" KB\n",
+		    vmm_guest_ondemand_commit_limit() >> 10);
+	vmm_cprintf(cdev, "On-demand RAM overcommit     : %d%%\n",
+		    vmm_guest_ondemand_overcommit_ratio());
+
+	return VMM_OK;
+}
+
+static int cmd_guest_balloon(struct vmm_chardev *cdev, const char *name,
+			     int argc, char **argv)
+{
+	int rc;
+	struct vmm_guest_balloon_info info;
+	struct vmm_guest *guest = vmm_manager_guest_find(name);
+
+	if (!guest) {
+		vmm_cprintf(cdev, "Failed to find guest\n");
+		return VMM_ENOTAVAIL;
+	}
+
+	if (argc > 3) {
+		rc = vmm_guest_balloon_set_target(guest,
+				(physical_size_t)strtoull(argv[3], NULL, 0) << 10);
+		if (rc) {
+			vmm_cprintf(cdev, "%s: Failed to set balloon size "
+				    "(error %d)\n", name, rc);
+			return rc;
+		}
+	}
+
+	rc = vmm_guest_balloon_get_info(guest, &info);
+	if (rc) {
+		vmm_cprintf(cdev, "%s: Failed to get balloon info "
+			    "(error %d)\n", name, rc);
+		return rc;
+	}
+
+	vmm_cprintf(cdev, "Balloon target size          : %"PRIPSIZE" KB\n",
+		    info.target >> 10);
+	vmm_cprintf(cdev, "Balloon actual size          : %"PRIPSIZE" KB\n",
+		    info.actual >> 10);
+	if (info.guest_total) {
+		vmm_cprintf(cdev, "Guest free memory            : "
+			    "%"PRIPSIZE" KB\n", info.guest_free >> 10);
+		vmm_cprintf(cdev, "Guest total memory           : "
+			    "%"PRIPSIZE" KB\n", info.guest_total >> 10);
+	}
+	vmm_cprintf(cdev, "Guest resident host RAM      : %"PRIPSIZE" KB\n",
+		    vmm_guest_aspace_rss(guest) >> 10);
+
+	return VMM_OK;
+}
+
 static int cmd_guest_param(struct vmm_chardev *cdev, int argc, char **argv,
 			   physical_addr_t *src_addr, u32 *size)
 {
@@ -380,6 +460,10 @@ static int cmd_guest_exec(struct vmm_chardev *cdev, int argc, char **argv)
 			return ret;
 		}
 		return cmd_guest_dumpmem(cdev, argv[2], src_addr, size);
+	} else if (strcmp(argv[1], "memstat") == 0) {
+		return cmd_guest_memstat(cdev, argv[2]);
+	} else if (strcmp(argv[1], "balloon") == 0) {
+		return cmd_guest_balloon(cdev, argv[2], argc, argv);
 	} else if (strcmp(argv[1], "region") == 0) {
 		ret = cmd_guest_param(cdev, argc, argv, &src_addr, &size);
 		if (VMM_OK != ret) {
@@ -33,6 +33,7 @@
 #include <vmm_host_ram.h>
 #include <vmm_host_vapool.h>
 #include <vmm_host_aspace.h>
+#include <vmm_guest_aspace.h>
 #include <vmm_modules.h>
 #include <vmm_cmdmgr.h>
 #include <vmm_delay.h>
@@ -61,6 +62,10 @@ static void cmd_host_usage(struct vmm_chardev *cdev)
 	vmm_cprintf(cdev, "   host extirq stats\n");
 	vmm_cprintf(cdev, "   host ram info\n");
 	vmm_cprintf(cdev, "   host ram bitmap [<column count>]\n");
+	vmm_cprintf(cdev, "   host ram merge info\n");
+	vmm_cprintf(cdev, "   host ram merge start\n");
+	vmm_cprintf(cdev, "   host ram merge stop\n");
+	vmm_cprintf(cdev, "   host ram merge rate <pages> <msecs>\n");
 	vmm_cprintf(cdev, "   host vapool info\n");
 	vmm_cprintf(cdev, "   host vapool state\n");
 	vmm_cprintf(cdev, "   host vapool bitmap [<column count>]\n");
@@ -287,6 +292,53 @@ static void cmd_host_ram_info(struct vmm_chardev *cdev)
 	}
 }
 
+static int cmd_host_ram_merge(struct vmm_chardev *cdev,
+			      int argc, char **argv)
+{
+	int rc;
+	struct vmm_guest_ram_merge_stats stats;
+
+	if (strcmp(argv[3], "start") == 0) {
+		rc = vmm_guest_ram_merge_start();
+		if (rc) {
+			vmm_cprintf(cdev, "Failed to start merging "
+				    "(error %d)\n", rc);
+		}
+		return rc;
+	} else if (strcmp(argv[3], "stop") == 0) {
+		vmm_guest_ram_merge_stop();
+		return VMM_OK;
+	} else if ((strcmp(argv[3], "rate") == 0) && (5 < argc)) {
+		rc = vmm_guest_ram_merge_set_rate(atoi(argv[4]),
+						  atoi(argv[5]));
+		if (rc) {
+			vmm_cprintf(cdev, "Invalid merging rate\n");
+		}
+		return rc;
+	} else if (strcmp(argv[3], "info") != 0) {
+		cmd_host_usage(cdev);
+		return VMM_EFAIL;
+	}
+
+	vmm_guest_ram_merge_get_stats(&stats);
+	vmm_cprintf(cdev, "State             : %s\n",
+		    (stats.running) ? "running" : "stopped");
+	vmm_cprintf(cdev, "Scan Rate         : %d pages every %d msecs\n",
+		    stats.scan_pages, stats.scan_msecs);
+	vmm_cprintf(cdev, "Pages Scanned     : %"PRIu64"\n",
+		    stats.pages_scanned);
+	vmm_cprintf(cdev, "Full Scans        : %"PRIu64"\n",
+		    stats.full_scans);
+	vmm_cprintf(cdev, "Pages Shared      : %d\n", stats.pages_shared);
+	vmm_cprintf(cdev, "Pages Sharing     : %d\n", stats.pages_sharing);
+	vmm_cprintf(cdev, "Pages Saved       : %d\n",
+		    stats.pages_sharing - stats.pages_shared);
+	vmm_cprintf(cdev, "COW Breaks        : %"PRIu64"\n",
+		    stats.cow_breaks);
+
+	return VMM_OK;
+}
+
 static void cmd_host_ram_bitmap(struct vmm_chardev *cdev, int colcnt)
 {
 	u32 ite, count, bn, bank_count = vmm_host_ram_bank_count();
@@ -557,6 +609,8 @@ static int cmd_host_exec(struct vmm_chardev *cdev, int argc, char **argv)
 			}
 			cmd_host_ram_bitmap(cdev, colcnt);
 			return VMM_OK;
+		} else if ((strcmp(argv[2], "merge") == 0) && (3 < argc)) {
+			return cmd_host_ram_merge(cdev, argc, argv);
 		}
 	} else if ((strcmp(argv[1], "vapool") == 0) && (2 < argc)) {
 		if (strcmp(argv[2], "info") == 0) {
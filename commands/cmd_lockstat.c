@@ -0,0 +1,215 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_lockstat.c
+ * @author agent (agent@local)
+ * @brief command for lock contention statistics.
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_heap.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <vmm_lockstat.h>
+#include <libs/stringlib.h>
+#include <libs/mathlib.h>
+#include <libs/libsort.h>
+
+#define MODULE_DESC			"Command lockstat"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_lockstat_init
+#define	MODULE_EXIT			cmd_lockstat_exit
+
+#define LOCKSTAT_DEFAULT_COUNT		20
+
+static void cmd_lockstat_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   lockstat help\n");
+	vmm_cprintf(cdev, "   lockstat show [<sort_key>] [<count>]\n");
+	vmm_cprintf(cdev, "   lockstat reset\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   <sort_key> = contentions|acquisitions|"
+			  "wait|max\n");
+	vmm_cprintf(cdev, "   default <sort_key> is contentions and "
+			  "default <count> is %d\n", LOCKSTAT_DEFAULT_COUNT);
+}
+
+static int cmd_lockstat_contentions_less(void *m, size_t a, size_t b)
+{
+	struct vmm_lockstat_info *ptr = m;
+
+	return (ptr[a].contentions > ptr[b].contentions) ? 1 : 0;
+}
+
+static int cmd_lockstat_acquisitions_less(void *m, size_t a, size_t b)
+{
+	struct vmm_lockstat_info *ptr = m;
+
+	return (ptr[a].acquisitions > ptr[b].acquisitions) ? 1 : 0;
+}
+
+static int cmd_lockstat_wait_less(void *m, size_t a, size_t b)
+{
+	struct vmm_lockstat_info *ptr = m;
+
+	return (ptr[a].total_wait_ns > ptr[b].total_wait_ns) ? 1 : 0;
+}
+
+static int cmd_lockstat_max_less(void *m, size_t a, size_t b)
+{
+	struct vmm_lockstat_info *ptr = m;
+
+	return (ptr[a].max_wait_ns > ptr[b].max_wait_ns) ? 1 : 0;
+}
+
+static void cmd_lockstat_swap(void *m, size_t a, size_t b)
+{
+	struct vmm_lockstat_info tmp;
+	struct vmm_lockstat_info *ptr = m;
+
+	tmp = ptr[a];
+	ptr[a] = ptr[b];
+	ptr[b] = tmp;
+}
+
+static const struct {
+	const char *name;
+	int (*less)(void *, size_t, size_t);
+} cmd_lockstat_keys[] = {
+	{ "contentions", cmd_lockstat_contentions_less },
+	{ "acquisitions", cmd_lockstat_acquisitions_less },
+	{ "wait", cmd_lockstat_wait_less },
+	{ "max", cmd_lockstat_max_less },
+	{ NULL, NULL },
+};
+
+static int cmd_lockstat_show(struct vmm_chardev *cdev,
+			     const char *key, u32 count)
+{
+	u32 i, total;
+	int (*less)(void *, size_t, size_t) = NULL;
+	struct vmm_lockstat_info *info;
+
+	for (i = 0; cmd_lockstat_keys[i].name; i++) {
+		if (!strcmp(cmd_lockstat_keys[i].name, key)) {
+			less = cmd_lockstat_keys[i].less;
+			break;
+		}
+	}
+	if (!less) {
+		cmd_lockstat_usage(cdev);
+		return VMM_EINVALID;
+	}
+
+	total = vmm_lockstat_class_count();
+	if (!total) {
+		vmm_cprintf(cdev, "No lock classes available\n");
+		return VMM_OK;
+	}
+
+	info = vmm_malloc(total * sizeof(*info));
+	if (!info) {
+		return VMM_ENOMEM;
+	}
+
+	for (i = 0; i < total; i++) {
+		vmm_lockstat_class_info(i, &info[i]);
+	}
+	libsort_smoothsort(info, 0, total, less, cmd_lockstat_swap);
+
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, " %12s %10s %12s %12s  %s\n",
+			  "Acquired", "Contended", "Avg Wait(ns)",
+			  "Max Wait(ns)", "Lock Class");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	for (i = 0; (i < total) && (i < count); i++) {
+		vmm_cprintf(cdev, " %12"PRIu64" %10"PRIu64" %12"PRIu64
+			    " %12"PRIu64"  %s\n",
+			    info[i].acquisitions, info[i].contentions,
+			    (info[i].contentions) ?
+			    udiv64(info[i].total_wait_ns,
+				   info[i].contentions) : 0,
+			    info[i].max_wait_ns, info[i].name);
+	}
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, "Showing %d of %d lock classes\n",
+		    (count < total) ? count : total, total);
+
+	vmm_free(info);
+
+	return VMM_OK;
+}
+
+static int cmd_lockstat_exec(struct vmm_chardev *cdev, int argc, char **argv)
+{
+	u32 count = LOCKSTAT_DEFAULT_COUNT;
+	const char *key = "contentions";
+
+	if (argc == 2) {
+		if (strcmp(argv[1], "help") == 0) {
+			cmd_lockstat_usage(cdev);
+			return VMM_OK;
+		} else if (strcmp(argv[1], "reset") == 0) {
+			vmm_lockstat_reset();
+			return VMM_OK;
+		}
+	}
+	if ((2 <= argc) && (argc <= 4) &&
+	    (strcmp(argv[1], "show") == 0)) {
+		if (argc > 2) {
+			key = argv[2];
+		}
+		if (argc > 3) {
+			count = atoi(argv[3]);
+		}
+		return cmd_lockstat_show(cdev, key, count);
+	}
+	cmd_lockstat_usage(cdev);
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_lockstat = {
+	.name = "lockstat",
+	.desc = "lock contention statistics",
+	.usage = cmd_lockstat_usage,
+	.exec = cmd_lockstat_exec,
+};
+
+static int __init cmd_lockstat_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_lockstat);
+}
+
+static void __exit cmd_lockstat_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_lockstat);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -27,7 +27,9 @@
 #include <vmm_cmdmgr.h>
 #include <vmm_heap.h>
 #include <vmm_timer.h>
+#include <vmm_manager.h>
 #include <vmm_profiler.h>
+#include <vmm_sampler.h>
 #include <arch_atomic.h>
 #include <arch_atomic64.h>
 #include <libs/stringlib.h>
@@ -42,17 +44,31 @@
 #define	MODULE_INIT			cmd_profile_init
 #define	MODULE_EXIT			cmd_profile_exit
 
+#ifdef CONFIG_PROFILE
 static bool cmd_profile_updated = FALSE;
+#endif
 
 static void cmd_profile_usage(struct vmm_chardev *cdev)
 {
 	vmm_cprintf(cdev, "Usage: \n");
 	vmm_cprintf(cdev, "   profile help\n");
+#ifdef CONFIG_PROFILE
 	vmm_cprintf(cdev, "   profile start\n");
 	vmm_cprintf(cdev, "   profile stop\n");
 	vmm_cprintf(cdev, "   profile status\n");
 	vmm_cprintf(cdev,
 		    "   profile dump [name|count|total_time|single_time]\n");
+#endif
+#ifdef CONFIG_SAMPLE_PROFILE
+	vmm_cprintf(cdev, "   profile sample_start [<frequency_hz>]\n");
+	vmm_cprintf(cdev, "   profile sample_stop\n");
+	vmm_cprintf(cdev, "   profile sample_status\n");
+	vmm_cprintf(cdev, "   profile sample_dump [flat|folded]\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   Folded output has one 'guest;vcpu;caller;"
+			  "function count' line per unique stack\n");
+	vmm_cprintf(cdev, "   which can be fed to flame graph tools.\n");
+#endif
 }
 
 static int cmd_profile_help(struct vmm_chardev *cdev, char *dummy)
@@ -62,6 +78,8 @@ static int cmd_profile_help(struct vmm_chardev *cdev, char *dummy)
 	return VMM_OK;
 }
 
+#ifdef CONFIG_PROFILE
+
 static int cmd_profile_status(struct vmm_chardev *cdev, char *dummy)
 {
 	if (vmm_profiler_isactive()) {
@@ -334,15 +352,303 @@ static int cmd_profile_stop(struct vmm_chardev *cdev, char *dummy)
 	return vmm_profiler_stop();
 }
 
+#endif
+
+#ifdef CONFIG_SAMPLE_PROFILE
+
+#define SAMPLE_SYM_NONE		(~0UL)
+
+struct cmd_sample {
+	u32 guest_id;
+	u32 vcpu_id;
+	u32 flags;
+	unsigned long func;
+	unsigned long caller;
+	u32 count;
+};
+
+struct cmd_sample_collect {
+	bool folded;
+	u32 count;
+	u32 max;
+	struct cmd_sample *samples;
+};
+
+static int cmd_sample_status(struct vmm_chardev *cdev, char *dummy)
+{
+	u32 cpu;
+
+	if (vmm_sampler_isactive()) {
+		vmm_cprintf(cdev, "sample profile is running at %d Hz\n",
+			    vmm_sampler_frequency());
+	} else {
+		vmm_cprintf(cdev, "sample profile is not running\n");
+	}
+
+	for_each_online_cpu(cpu) {
+		vmm_cprintf(cdev, "CPU%d: %d samples\n",
+			    cpu, vmm_sampler_total_count(cpu));
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_sample_start(struct vmm_chardev *cdev, char *freq)
+{
+	int rc;
+	u32 hz = VMM_SAMPLER_DEFAULT_FREQ;
+
+	if (freq) {
+		hz = atoi(freq);
+	}
+
+	rc = vmm_sampler_start(hz);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to start sample profile "
+			    "(error %d)\n", rc);
+	}
+
+	return rc;
+}
+
+static int cmd_sample_stop(struct vmm_chardev *cdev, char *dummy)
+{
+	return vmm_sampler_stop();
+}
+
+static int cmd_sample_count(u32 cpu, struct vmm_sampler_entry *e, void *data)
+{
+	(*(u32 *)data)++;
+
+	return VMM_OK;
+}
+
+/* Samples are reduced to symbol index at collection time so that
+ * samples within same function compare equal.
+ */
+static int cmd_sample_collect(u32 cpu, struct vmm_sampler_entry *e,
+			      void *data)
+{
+	struct cmd_sample_collect *c = data;
+	struct cmd_sample *s;
+	bool guest = (e->flags & VMM_SAMPLER_FLAG_GUEST) ? TRUE : FALSE;
+
+	if (c->count >= c->max) {
+		return VMM_ENOSPC;
+	}
+	s = &c->samples[c->count++];
+
+	s->flags = e->flags;
+	s->count = 1;
+	s->guest_id = e->guest_id;
+	s->vcpu_id = VMM_SAMPLER_ID_NONE;
+	s->func = SAMPLE_SYM_NONE;
+	s->caller = SAMPLE_SYM_NONE;
+
+	if (!guest) {
+		s->guest_id = VMM_SAMPLER_ID_NONE;
+		s->func = kallsyms_get_symbol_pos(e->pc, NULL, NULL);
+	}
+
+	if (c->folded) {
+		s->guest_id = e->guest_id;
+		s->vcpu_id = e->vcpu_id;
+		if (!guest && e->caller) {
+			s->caller = kallsyms_get_symbol_pos(e->caller,
+							    NULL, NULL);
+		}
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_sample_key_cmp(struct cmd_sample *a, struct cmd_sample *b)
+{
+	if (a->guest_id != b->guest_id) {
+		return (a->guest_id < b->guest_id) ? -1 : 1;
+	}
+	if (a->vcpu_id != b->vcpu_id) {
+		return (a->vcpu_id < b->vcpu_id) ? -1 : 1;
+	}
+	if (a->flags != b->flags) {
+		return (a->flags < b->flags) ? -1 : 1;
+	}
+	if (a->caller != b->caller) {
+		return (a->caller < b->caller) ? -1 : 1;
+	}
+	if (a->func != b->func) {
+		return (a->func < b->func) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static int cmd_sample_key_less(void *m, size_t a, size_t b)
+{
+	struct cmd_sample *ptr = m;
+
+	return (cmd_sample_key_cmp(&ptr[a], &ptr[b]) < 0) ? 1 : 0;
+}
+
+static int cmd_sample_count_less(void *m, size_t a, size_t b)
+{
+	struct cmd_sample *ptr = m;
+
+	return (ptr[a].count > ptr[b].count) ? 1 : 0;
+}
+
+static void cmd_sample_swap(void *m, size_t a, size_t b)
+{
+	struct cmd_sample tmp;
+	struct cmd_sample *ptr = m;
+
+	tmp = ptr[a];
+	ptr[a] = ptr[b];
+	ptr[b] = tmp;
+}
+
+static void cmd_sample_symbol(unsigned long index, char *name)
+{
+	name[0] = name[KSYM_NAME_LEN - 1] = 0;
+	if (index == SAMPLE_SYM_NONE) {
+		strcpy(name, "[unknown]");
+	} else {
+		kallsyms_expand_symbol(kallsyms_get_symbol_offset(index),
+				       name);
+	}
+}
+
+static void cmd_sample_print(struct vmm_chardev *cdev, bool folded,
+			     struct cmd_sample *s, u32 total)
+{
+	struct vmm_vcpu *vcpu;
+	struct vmm_guest *guest;
+	char func[KSYM_NAME_LEN], caller[KSYM_NAME_LEN];
+	const char *gname = "host";
+	const char *vname = "[none]";
+
+	if (s->guest_id != VMM_SAMPLER_ID_NONE) {
+		guest = vmm_manager_guest(s->guest_id);
+		gname = (guest) ? guest->name : "[destroyed]";
+	}
+	if (s->vcpu_id != VMM_SAMPLER_ID_NONE) {
+		vcpu = vmm_manager_vcpu(s->vcpu_id);
+		vname = (vcpu) ? vcpu->name : "[destroyed]";
+	}
+
+	if (s->flags & VMM_SAMPLER_FLAG_GUEST) {
+		strcpy(func, "[guest]");
+	} else {
+		cmd_sample_symbol(s->func, func);
+	}
+
+	if (folded) {
+		cmd_sample_symbol(s->caller, caller);
+		vmm_cprintf(cdev, "%s;%s;%s;%s %d\n",
+			    gname, vname, caller, func, s->count);
+	} else {
+		vmm_cprintf(cdev, " %-40s %-16s %8d %3d%%\n",
+			    func, gname, s->count,
+			    udiv32(s->count * 100, total));
+	}
+}
+
+static int cmd_sample_dump(struct vmm_chardev *cdev, char *mode)
+{
+	int rc;
+	u32 i, j, total = 0;
+	struct cmd_sample_collect c;
+
+	memset(&c, 0, sizeof(c));
+	if (mode && !strcmp(mode, "folded")) {
+		c.folded = TRUE;
+	} else if (mode && strcmp(mode, "flat")) {
+		cmd_profile_usage(cdev);
+		return VMM_EFAIL;
+	}
+
+	if (vmm_sampler_isactive()) {
+		vmm_cprintf(cdev, "Can't dump while sample profile "
+				  "is active\n");
+		return VMM_EFAIL;
+	}
+
+	rc = vmm_sampler_iterate(&c.max, cmd_sample_count);
+	if (rc) {
+		return rc;
+	}
+	if (!c.max) {
+		vmm_cprintf(cdev, "No samples available\n");
+		return VMM_OK;
+	}
+
+	c.samples = vmm_malloc(c.max * sizeof(*c.samples));
+	if (!c.samples) {
+		return VMM_ENOMEM;
+	}
+
+	rc = vmm_sampler_iterate(&c, cmd_sample_collect);
+	if (rc) {
+		goto done;
+	}
+	total = c.count;
+
+	/* Sort by key and merge identical samples */
+	libsort_smoothsort(c.samples, 0, c.count,
+			   cmd_sample_key_less, cmd_sample_swap);
+	for (i = 0, j = 1; j < c.count; j++) {
+		if (!cmd_sample_key_cmp(&c.samples[i], &c.samples[j])) {
+			c.samples[i].count++;
+		} else {
+			c.samples[++i] = c.samples[j];
+		}
+	}
+	c.count = i + 1;
+
+	if (!c.folded) {
+		libsort_smoothsort(c.samples, 0, c.count,
+				   cmd_sample_count_less, cmd_sample_swap);
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "-------------------------------\n");
+		vmm_cprintf(cdev, " %-40s %-16s %8s %4s\n",
+				  "Function", "Guest", "Samples", "Pct");
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "-------------------------------\n");
+	}
+	for (i = 0; i < c.count; i++) {
+		cmd_sample_print(cdev, c.folded, &c.samples[i], total);
+	}
+	if (!c.folded) {
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "-------------------------------\n");
+		vmm_cprintf(cdev, "Total %d samples\n", total);
+	}
+
+done:
+	vmm_free(c.samples);
+
+	return rc;
+}
+
+#endif
+
 static const struct {
 	char *name;
 	int (*function) (struct vmm_chardev *, char *);
 } const command[] = {
 	{"help", cmd_profile_help},
+#ifdef CONFIG_PROFILE
 	{"start", cmd_profile_start},
 	{"stop", cmd_profile_stop},
 	{"status", cmd_profile_status},
 	{"dump", cmd_profile_dump},
+#endif
+#ifdef CONFIG_SAMPLE_PROFILE
+	{"sample_start", cmd_sample_start},
+	{"sample_stop", cmd_sample_stop},
+	{"sample_status", cmd_sample_status},
+	{"sample_dump", cmd_sample_dump},
+#endif
 	{NULL, NULL},
 };
 
@@ -0,0 +1,282 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_trace.c
+ * @author agent (agent@local)
+ * @brief Implementation of trace command
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_heap.h>
+#include <vmm_delay.h>
+#include <vmm_timer.h>
+#include <vmm_chardev.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <vmm_trace.h>
+#include <libs/stringlib.h>
+#include <libs/mathlib.h>
+
+#define MODULE_DESC			"Command trace"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_trace_init
+#define	MODULE_EXIT			cmd_trace_exit
+
+#define TRACE_STREAM_POLL_MSECS		10
+
+/* Merge state of per-CPU rings */
+struct cmd_trace_merge {
+	u32 pos[CONFIG_CPU_COUNT];
+	bool valid[CONFIG_CPU_COUNT];
+	struct vmm_trace_entry e[CONFIG_CPU_COUNT];
+	u32 lost;
+};
+
+static void cmd_trace_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   trace help\n");
+	vmm_cprintf(cdev, "   trace list\n");
+	vmm_cprintf(cdev, "   trace enable <event_name>|all\n");
+	vmm_cprintf(cdev, "   trace disable <event_name>|all\n");
+	vmm_cprintf(cdev, "   trace clear\n");
+	vmm_cprintf(cdev, "   trace dump\n");
+	vmm_cprintf(cdev, "   trace stream <seconds> [<chardev_name>]\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   Dump shows all available entries whereas "
+			  "stream shows entries\n");
+	vmm_cprintf(cdev, "   recorded after it was started.\n");
+}
+
+static int cmd_trace_list(struct vmm_chardev *cdev)
+{
+	u32 id;
+
+	vmm_cprintf(cdev, "----------------------------------------\n");
+	vmm_cprintf(cdev, " %-4s %-24s %-8s\n", "ID", "Name", "Enabled");
+	vmm_cprintf(cdev, "----------------------------------------\n");
+	for (id = 0; id < VMM_TRACE_ID_MAX; id++) {
+		vmm_cprintf(cdev, " %-4d %-24s %-8s\n",
+			    id, vmm_trace_event_name(id),
+			    (vmm_trace_event_isenabled(id)) ? "yes" : "no");
+	}
+	vmm_cprintf(cdev, "----------------------------------------\n");
+
+	return VMM_OK;
+}
+
+static int cmd_trace_enable(struct vmm_chardev *cdev,
+			    const char *name, bool enable)
+{
+	int rc;
+	u32 id;
+
+	if (!strcmp(name, "all")) {
+		for (id = 0; id < VMM_TRACE_ID_MAX; id++) {
+			rc = vmm_trace_event_enable(id, enable);
+			if (rc) {
+				return rc;
+			}
+		}
+		return VMM_OK;
+	}
+
+	id = vmm_trace_event_find(name);
+	if (id == VMM_TRACE_ID_NONE) {
+		vmm_cprintf(cdev, "Trace event %s not found\n", name);
+		return VMM_ENOTAVAIL;
+	}
+
+	return vmm_trace_event_enable(id, enable);
+}
+
+static void cmd_trace_merge_init(struct cmd_trace_merge *m, bool from_first)
+{
+	u32 cpu;
+
+	memset(m, 0, sizeof(*m));
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		m->pos[cpu] = (from_first) ?
+			vmm_trace_first(cpu) : vmm_trace_last(cpu);
+	}
+}
+
+/* Retrieve oldest entry across all host CPUs */
+static bool cmd_trace_merge_next(struct cmd_trace_merge *m,
+				 struct vmm_trace_entry *e)
+{
+	u32 cpu, best = CONFIG_CPU_COUNT;
+
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		if (!m->valid[cpu]) {
+			m->valid[cpu] = (vmm_trace_read(cpu, &m->pos[cpu],
+						&m->e[cpu], &m->lost) == VMM_OK);
+		}
+		if (!m->valid[cpu]) {
+			continue;
+		}
+		if ((best == CONFIG_CPU_COUNT) ||
+		    (m->e[cpu].tstamp < m->e[best].tstamp)) {
+			best = cpu;
+		}
+	}
+
+	if (best == CONFIG_CPU_COUNT) {
+		return FALSE;
+	}
+
+	memcpy(e, &m->e[best], sizeof(*e));
+	m->valid[best] = FALSE;
+
+	return TRUE;
+}
+
+static void cmd_trace_print(struct vmm_chardev *cdev,
+			    struct vmm_trace_entry *e)
+{
+	vmm_cprintf(cdev, "[%3d] %5"PRIu64".%09"PRIu64" %-18s ",
+		    e->cpu, udiv64(e->tstamp, 1000000000ULL),
+		    umod64(e->tstamp, 1000000000ULL),
+		    vmm_trace_event_name(e->id));
+	vmm_cprintf(cdev, vmm_trace_event_format(e->id),
+		    e->args[0], e->args[1], e->args[2], e->args[3]);
+	vmm_cprintf(cdev, "\n");
+}
+
+static int cmd_trace_dump(struct vmm_chardev *cdev)
+{
+	u32 count = 0;
+	struct vmm_trace_entry e;
+	struct cmd_trace_merge *m;
+
+	m = vmm_malloc(sizeof(*m));
+	if (!m) {
+		return VMM_ENOMEM;
+	}
+
+	cmd_trace_merge_init(m, TRUE);
+	while (cmd_trace_merge_next(m, &e)) {
+		cmd_trace_print(cdev, &e);
+		count++;
+	}
+	vmm_cprintf(cdev, "Total %d entries (%d lost)\n", count, m->lost);
+
+	vmm_free(m);
+
+	return VMM_OK;
+}
+
+static int cmd_trace_stream(struct vmm_chardev *cdev,
+			    u32 seconds, const char *cdev_name)
+{
+	u64 deadline;
+	u32 count = 0;
+	struct vmm_trace_entry e;
+	struct vmm_chardev *out = cdev;
+	struct cmd_trace_merge *m;
+
+	if (cdev_name) {
+		out = vmm_chardev_find(cdev_name);
+		if (!out) {
+			vmm_cprintf(cdev, "Failed to find chardev %s\n",
+				    cdev_name);
+			return VMM_ENOTAVAIL;
+		}
+	}
+
+	m = vmm_malloc(sizeof(*m));
+	if (!m) {
+		return VMM_ENOMEM;
+	}
+
+	cmd_trace_merge_init(m, FALSE);
+	deadline = vmm_timer_timestamp() + (u64)seconds * 1000000000ULL;
+	while (vmm_timer_timestamp() < deadline) {
+		while (cmd_trace_merge_next(m, &e)) {
+			cmd_trace_print(out, &e);
+			count++;
+		}
+		vmm_msleep(TRACE_STREAM_POLL_MSECS);
+	}
+	while (cmd_trace_merge_next(m, &e)) {
+		cmd_trace_print(out, &e);
+		count++;
+	}
+	vmm_cprintf(cdev, "Total %d entries (%d lost)\n", count, m->lost);
+
+	vmm_free(m);
+
+	return VMM_OK;
+}
+
+static int cmd_trace_exec(struct vmm_chardev *cdev, int argc, char **argv)
+{
+	if (argc == 2) {
+		if (strcmp(argv[1], "help") == 0) {
+			cmd_trace_usage(cdev);
+			return VMM_OK;
+		} else if (strcmp(argv[1], "list") == 0) {
+			return cmd_trace_list(cdev);
+		} else if (strcmp(argv[1], "clear") == 0) {
+			vmm_trace_clear();
+			return VMM_OK;
+		} else if (strcmp(argv[1], "dump") == 0) {
+			return cmd_trace_dump(cdev);
+		}
+	} else if (argc == 3) {
+		if (strcmp(argv[1], "enable") == 0) {
+			return cmd_trace_enable(cdev, argv[2], TRUE);
+		} else if (strcmp(argv[1], "disable") == 0) {
+			return cmd_trace_enable(cdev, argv[2], FALSE);
+		}
+	}
+	if ((argc == 3 || argc == 4) &&
+	    (strcmp(argv[1], "stream") == 0)) {
+		return cmd_trace_stream(cdev, atoi(argv[2]),
+					(argc == 4) ? argv[3] : NULL);
+	}
+	cmd_trace_usage(cdev);
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_trace = {
+	.name = "trace",
+	.desc = "hypervisor event tracing",
+	.usage = cmd_trace_usage,
+	.exec = cmd_trace_exec,
+};
+
+static int __init cmd_trace_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_trace);
+}
+
+static void __exit cmd_trace_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_trace);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -27,6 +27,9 @@
 #include <vmm_devtree.h>
 #include <vmm_manager.h>
 #include <vmm_scheduler.h>
+#include <vmm_vcpu_irq.h>
+#include <vmm_exitstat.h>
+#include <vmm_heap.h>
 #include <vmm_host_ram.h>
 #include <vmm_host_vapool.h>
 #include <vmm_host_aspace.h>
@@ -61,6 +64,9 @@ static void cmd_vcpu_usage(struct vmm_chardev *cdev)
 			  "<hcpu0> <hcpu1> <hcpu2> ...\n");
 	vmm_cprintf(cdev, "   vcpu dumpreg <vcpu_id>\n");
 	vmm_cprintf(cdev, "   vcpu dumpstat <vcpu_id>\n");
+#ifdef CONFIG_VCPU_EXITSTAT
+	vmm_cprintf(cdev, "   vcpu exitstat <vcpu_id> [hist|reset]\n");
+#endif
 }
 
 static int cmd_vcpu_help(struct vmm_chardev *cdev,
@@ -536,6 +542,7 @@ static int cmd_vcpu_dumpstat(struct vmm_chardev *cdev,
 	u32 state, hcpu, reset_count;
 	u64 last_reset_nsecs, total_nsecs;
 	u64 ready_nsecs, running_nsecs, paused_nsecs, halted_nsecs;
+	u64 poll_ns, poll_success, poll_fail;
 	struct vmm_vcpu *vcpu;
 
 	if (!argc) {
@@ -619,12 +626,147 @@ static int cmd_vcpu_dumpstat(struct vmm_chardev *cdev,
 			  h, m, s, ms);
 	vmm_cprintf(cdev, "\n");
 
+	/* Halt-polling statistics */
+	if (vcpu->is_normal &&
+	    !vmm_vcpu_irq_wait_poll_stats(vcpu, &poll_ns,
+					  &poll_success, &poll_fail)) {
+		vmm_cprintf(cdev, "Halt Poll Window : %"PRIu64" ns\n",
+				  poll_ns);
+		vmm_cprintf(cdev, "Halt Poll Success: %"PRIu64"\n",
+				  poll_success);
+		vmm_cprintf(cdev, "Halt Poll Fail   : %"PRIu64"\n",
+				  poll_fail);
+		vmm_cprintf(cdev, "\n");
+	}
+
 	/* Architecture specific dumpstat */
 	arch_vcpu_stat_dump(cdev, vcpu);
 
 	return ret;
 }
 
+#ifdef CONFIG_VCPU_EXITSTAT
+static void exitstat_print(struct vmm_chardev *cdev, const char *name,
+			   struct vmm_exitstat_hist *h)
+{
+	vmm_cprintf(cdev, " %-16s %10"PRIu64" %10"PRIu64" %10"PRIu64
+		    " %10"PRIu64"\n", name, h->count,
+		    (h->count) ? udiv64(h->total_nsecs, h->count) : 0,
+		    h->max_nsecs, udiv64(h->total_nsecs, 1000));
+}
+
+static void exitstat_print_hist(struct vmm_chardev *cdev, const char *name,
+				struct vmm_exitstat_hist *h)
+{
+	u32 b;
+
+	if (!h->count) {
+		return;
+	}
+
+	vmm_cprintf(cdev, "%s:\n", name);
+	for (b = 0; b < VMM_EXITSTAT_HIST_SIZE; b++) {
+		if (!h->bucket[b]) {
+			continue;
+		}
+		vmm_cprintf(cdev, "  %s%10"PRIu64" ns : %d\n",
+			    (b == (VMM_EXITSTAT_HIST_SIZE - 1)) ? ">=" : "< ",
+			    (b == (VMM_EXITSTAT_HIST_SIZE - 1)) ?
+			    ((u64)1 << b) : ((u64)1 << (b + 1)),
+			    h->bucket[b]);
+	}
+}
+
+static int cmd_vcpu_exitstat(struct vmm_chardev *cdev,
+			     int argc, char **argv)
+{
+	int ret, id;
+	u32 i;
+	bool hist = FALSE;
+	struct vmm_vcpu *vcpu;
+	struct vmm_exitstat *es;
+
+	if (!argc) {
+		vmm_cprintf(cdev, "Must provide vcpu ID\n");
+		cmd_vcpu_usage(cdev);
+		return VMM_EINVALID;
+	}
+	id = atoi(argv[0]);
+
+	vcpu = vmm_manager_vcpu(id);
+	if (!vcpu) {
+		vmm_cprintf(cdev, "Failed to find vcpu\n");
+		return VMM_EFAIL;
+	}
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "reset") == 0) {
+			return vmm_exitstat_reset(vcpu);
+		} else if (strcmp(argv[1], "hist") == 0) {
+			hist = TRUE;
+		} else {
+			cmd_vcpu_usage(cdev);
+			return VMM_EINVALID;
+		}
+	}
+
+	es = vmm_malloc(sizeof(*es));
+	if (!es) {
+		return VMM_ENOMEM;
+	}
+
+	ret = vmm_exitstat_snapshot(vcpu, es);
+	if (ret) {
+		vmm_cprintf(cdev, "%s: Failed to get exit stats\n",
+			    vcpu->name);
+		goto done;
+	}
+
+	if (hist) {
+		for (i = 0; i < VMM_EXIT_MAX; i++) {
+			exitstat_print_hist(cdev, vmm_exitstat_class_name(i),
+					    &es->exits[i]);
+		}
+		for (i = 0; i < es->device_count; i++) {
+			exitstat_print_hist(cdev, es->devices[i].name,
+					    &es->devices[i].hist);
+		}
+		goto done;
+	}
+
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------------------------\n");
+	vmm_cprintf(cdev, " %-16s %10s %10s %10s %10s\n",
+			  "Exit", "Count", "Avg(ns)", "Max(ns)", "Total(us)");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------------------------\n");
+	for (i = 0; i < VMM_EXIT_MAX; i++) {
+		exitstat_print(cdev, vmm_exitstat_class_name(i),
+			       &es->exits[i]);
+	}
+	if (es->device_count) {
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "--------------------------\n");
+		vmm_cprintf(cdev, " %-16s %10s %10s %10s %10s\n",
+				  "Device", "Count", "Avg(ns)", "Max(ns)",
+				  "Total(us)");
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "--------------------------\n");
+		for (i = 0; i < es->device_count; i++) {
+			exitstat_print(cdev, es->devices[i].name,
+				       &es->devices[i].hist);
+		}
+	}
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "--------------------------\n");
+
+done:
+	vmm_free(es);
+
+	return ret;
+}
+#endif
+
 static const struct {
 	char *name;
 	int (*function) (struct vmm_chardev *, int, char **);
@@ -644,6 +786,9 @@ static const struct {
 	{"set_affinity", cmd_vcpu_set_affinity, 2},
 	{"dumpreg", cmd_vcpu_dumpreg, 1},
 	{"dumpstat", cmd_vcpu_dumpstat, 1},
+#ifdef CONFIG_VCPU_EXITSTAT
+	{"exitstat", cmd_vcpu_exitstat, 1},
+#endif
 	{NULL, NULL, 0},
 };
 	
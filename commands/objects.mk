@@ -39,10 +39,14 @@ commands-objs-$(CONFIG_CMD_WALLCLOCK)+= cmd_wallclock.o
 commands-objs-$(CONFIG_CMD_GPIO)+= cmd_gpio.o
 commands-objs-$(CONFIG_CMD_MODULE)+= cmd_module.o
 commands-objs-$(CONFIG_CMD_PROFILE)+= cmd_profile.o
+commands-objs-$(CONFIG_CMD_TRACE)+= cmd_trace.o
+commands-objs-$(CONFIG_CMD_LOCKSTAT)+= cmd_lockstat.o
+commands-objs-$(CONFIG_CMD_COUNTER)+= cmd_counter.o
 
 commands-objs-$(CONFIG_CMD_VSERIAL)+= cmd_vserial.o
 commands-objs-$(CONFIG_CMD_VDISK)+= cmd_vdisk.o
 commands-objs-$(CONFIG_CMD_VDISPLAY)+= cmd_vdisplay.o
+commands-objs-$(CONFIG_CMD_DRAWFN)+= cmd_drawfn.o
 commands-objs-$(CONFIG_CMD_VINPUT)+= cmd_vinput.o
 commands-objs-$(CONFIG_CMD_VSCREEN)+= cmd_vscreen.o
 
@@ -182,6 +182,50 @@ int vmm_blockdev_flush_cache(struct vmm_blockdev *bdev)
 }
 VMM_EXPORT_SYMBOL(vmm_blockdev_flush_cache);
 
+int vmm_blockdev_direct_access(struct vmm_blockdev *bdev,
+			       enum vmm_request_type type,
+			       u64 lba, u32 bcnt, void **va)
+{
+	int rc;
+	irq_flags_t flags;
+
+	if (!bdev || !bdev->rq || !va) {
+		return VMM_EFAIL;
+	}
+
+	if ((type != VMM_REQUEST_READ) &&
+	    (type != VMM_REQUEST_WRITE)) {
+		return VMM_EINVALID;
+	}
+
+	if ((type == VMM_REQUEST_WRITE) &&
+	   !(bdev->flags & VMM_BLOCKDEV_RW)) {
+		return VMM_EINVALID;
+	}
+
+	if (bdev->num_blocks < bcnt) {
+		return VMM_ERANGE;
+	}
+	if ((lba < bdev->start_lba) ||
+	    ((bdev->start_lba + bdev->num_blocks) <= lba)) {
+		return VMM_ERANGE;
+	}
+	if ((bdev->start_lba + bdev->num_blocks) < (lba + bcnt)) {
+		return VMM_ERANGE;
+	}
+
+	if (!bdev->rq->direct_access) {
+		return VMM_ENOTSUPP;
+	}
+
+	vmm_spin_lock_irqsave(&bdev->rq->lock, flags);
+	rc = bdev->rq->direct_access(bdev->rq, lba, bcnt, va);
+	vmm_spin_unlock_irqrestore(&bdev->rq->lock, flags);
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(vmm_blockdev_direct_access);
+
 struct blockdev_rw {
 	bool failed;
 	struct vmm_request req;
@@ -217,8 +261,20 @@ static int blockdev_rw_blocks(struct vmm_blockdev *bdev,
 				u8 *buf, u64 lba, u64 bcnt)
 {
 	int rc;
+	void *va;
 	struct blockdev_rw rw;
 
+	/* Memory backed block devices don't need a request */
+	if (!vmm_blockdev_direct_access(bdev, type, bdev->start_lba + lba,
+					bcnt, &va)) {
+		if (type == VMM_REQUEST_WRITE) {
+			memcpy(va, buf, bcnt * bdev->block_size);
+		} else {
+			memcpy(buf, va, bcnt * bdev->block_size);
+		}
+		return VMM_OK;
+	}
+
 	rw.failed = FALSE;
 	rw.req.type = type;
 	rw.req.lba = bdev->start_lba + lba;
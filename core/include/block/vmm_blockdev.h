@@ -84,6 +84,15 @@ struct vmm_request_queue {
 	 */
 	int (*flush_cache)(struct vmm_request_queue *rq);
 
+	/* Note: This is an optional callback only required
+	 * if request queue is backed by memory which is always
+	 * mapped in host address space. It provides host virtual
+	 * address of given blocks so that users can do IO using
+	 * plain memcpy() without submitting requests.
+	 */
+	int (*direct_access)(struct vmm_request_queue *rq,
+			     u64 lba, u32 bcnt, void **va);
+
 	void *priv;
 };
 
@@ -93,6 +102,7 @@ struct vmm_request_queue {
 			(rq)->make_request = NULL; \
 			(rq)->abort_request = NULL; \
 			(rq)->flush_cache = NULL; \
+			(rq)->direct_access = NULL; \
 			(rq)->priv = NULL; \
 		} while (0)
 
@@ -173,6 +183,17 @@ int vmm_blockdev_abort_request(struct vmm_request *r);
  */
 int vmm_blockdev_flush_cache(struct vmm_blockdev *bdev);
 
+/** Generic block IO direct access
+ *  Note: This API provides host virtual address of given blocks
+ *  if request queue of block device supports direct access. The
+ *  virtual address remains valid till block device is registered.
+ *  Note: Returns VMM_ENOTSUPP if direct access is not possible in
+ *  which case vmm_blockdev_submit_request() must be used.
+ */
+int vmm_blockdev_direct_access(struct vmm_blockdev *bdev,
+			       enum vmm_request_type type,
+			       u64 lba, u32 bcnt, void **va);
+
 /** Generic block IO read/write
  *  Note: This is a blocking API hence must be 
  *  called from Orphan (or Thread) Context
@@ -41,9 +41,9 @@ struct vmm_netswitch {
 	char name[VMM_FIELD_NAME_SIZE];
 	int flags;
 	struct vmm_device dev;
-	/* Lock to protect port list */
-	vmm_rwlock_t port_list_lock;
-	/* List of ports */
+	/* Lock to serialize port list updates */
+	vmm_spinlock_t port_list_lock;
+	/* List of ports (RCU protected) */
 	struct dlist port_list;
 	/* Handle RX packets from port to switch */
 	int (*port2switch_xfer) (struct vmm_netswitch *,
@@ -80,6 +80,7 @@ struct vmm_vdisk {
 	vmm_spinlock_t blk_lock; /* Protect blk pointer */
 	struct vmm_blockdev *blk;
 	u32 blk_factor;
+	atomic_t direct_count; /* Direct IO copies in progress */
 
 	void *priv;
 };
@@ -177,6 +178,22 @@ int vmm_vdisk_submit_request(struct vmm_vdisk *vdisk,
 			     enum vmm_vdisk_request_type type,
 			     u64 lba, void *data, u32 data_len);
 
+/** Do IO directly on memory backing the virtual disk
+ *  Note: The copy() callback is called with host virtual address
+ *  of requested blocks and it must return number of bytes copied.
+ *  The copy() runs without holding any lock and the attached block
+ *  device is only detached after copy() returns, so copy() must not
+ *  take long.
+ *  Note: Returns VMM_ENOTSUPP if attached block device does not
+ *  support direct access in which case vmm_vdisk_submit_request()
+ *  must be used.
+ */
+int vmm_vdisk_direct_rw(struct vmm_vdisk *vdisk,
+			enum vmm_vdisk_request_type type,
+			u64 lba, u32 data_len,
+			u32 (*copy)(void *va, u32 len, void *priv),
+			void *priv);
+
 /* Abort IO request from virtual disk */
 int vmm_vdisk_abort_request(struct vmm_vdisk *vdisk,
 			    struct vmm_vdisk_request *vreq);
@@ -82,6 +82,7 @@ void vmm_pixelformat_init_default(struct vmm_pixelformat *pf, int bpp);
 void vmm_pixelformat_init_different_endian(struct vmm_pixelformat *pf, int bpp);
 
 struct vmm_surface;
+struct vmm_guest_dirty_log;
 
 /** Representation of surface operations 
  *  Note: All surface operations are optional.
@@ -97,8 +98,8 @@ struct vmm_surface_ops {
 	u8   (*read8)(struct vmm_surface *s, u8 *src);
 	void (*write16)(struct vmm_surface *s, u16 *dst, u16 val);
 	u16  (*read16)(struct vmm_surface *s, u16 *src);
-	void (*write32)(struct vmm_surface *s, u32 *dst, u16 val);
-	u16  (*read32)(struct vmm_surface *s, u32 *src);
+	void (*write32)(struct vmm_surface *s, u32 *dst, u32 val);
+	u32  (*read32)(struct vmm_surface *s, u32 *src);
 
 	void (*refresh)(struct vmm_surface *s);
 
@@ -135,6 +136,15 @@ struct vmm_surface {
 	struct vmm_pixelformat pf;
 	const struct vmm_surface_ops *ops;
 	void *priv;
+	/* Dirty page logging of guest framebuffer
+	 * (managed by vmm_surface_update)
+	 */
+	struct vmm_guest *dlog_guest;
+	physical_addr_t dlog_gphys;
+	physical_size_t dlog_size;
+	bool dlog_full;
+	struct vmm_guest_dirty_log *dlog;
+	unsigned long *dlog_bmap;
 };
 
 /** Retrive private context of surface */
@@ -184,7 +194,7 @@ static inline u16 vmm_surface_read16(struct vmm_surface *s, u16 *src)
 }
 
 /** Write 32bit to surface data */
-static inline void vmm_surface_write32(struct vmm_surface *s, u32 *dst, u16 v)
+static inline void vmm_surface_write32(struct vmm_surface *s, u32 *dst, u32 v)
 {
 	if (s && s->ops && s->ops->write32) {
 		s->ops->write32(s, dst, v);
@@ -203,7 +213,12 @@ static inline u32 vmm_surface_read32(struct vmm_surface *s, u32 *src)
 	}
 }
 
-/** Update surface data from guest memory */
+/** Update surface data from guest memory
+ *  Note: Only rows touching guest pages written since last update
+ *  are converted when dirty page logging is supported for guest.
+ *  Note: Upon return first_row and last_row are the first and last
+ *  updated rows or first_row is negative if nothing was updated.
+ */
 void vmm_surface_update(struct vmm_surface *s,
 			struct vmm_guest *guest,
 			physical_addr_t gphys,
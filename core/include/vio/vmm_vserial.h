@@ -26,17 +26,29 @@
 #include <vmm_types.h>
 #include <vmm_spinlocks.h>
 #include <vmm_notifier.h>
+#include <vmm_workqueue.h>
 #include <libs/list.h>
 #include <libs/fifo.h>
 
 #define VMM_VSERIAL_IPRIORITY			0
 
+/* Size of guest output ring (must be power of 2) */
+#define VMM_VSERIAL_RING_SIZE			4096
+/* Window for coalescing receiver notifications */
+#define VMM_VSERIAL_COALESCE_NSECS		1000000ULL
+/* Max bytes delivered to receivers in one batch */
+#define VMM_VSERIAL_DRAIN_BATCH			64
+/* Max bytes taken from fill callback in one batch */
+#define VMM_VSERIAL_FILL_BATCH			64
+
 struct vmm_vserial_receiver;
 struct vmm_vserial;
 
 /** Representation of a virtual serial port recevier 
  *  Note: receive callback can be called in any context hence
  *  hence we cannot sleep in receive callback.
+ *  Note: receive callback is usually called in batches from
+ *  workqueue context after a short coalescing window.
  */
 struct vmm_vserial_receiver {
 	struct dlist head;
@@ -55,6 +67,20 @@ struct vmm_vserial {
 	vmm_spinlock_t receiver_list_lock;
 	struct dlist receiver_list;
 	struct fifo *receive_fifo;
+
+	/* Guest output ring where emulators are the producer and
+	 * drain work is the consumer. The producers are serialized
+	 * using ring_lock so that ring is single-producer and
+	 * single-consumer. The ring_lock is only held for copying
+	 * bytes into ring. The consumer holds receiver_list_lock.
+	 */
+	vmm_spinlock_t ring_lock;
+	u8 *ring;
+	u32 ring_head;
+	u32 ring_tail;
+	atomic_t drain_pending;
+	struct vmm_delayed_work drain_work;
+
 	void *priv;
 };
 
@@ -84,9 +110,26 @@ static inline void *vmm_vserial_priv(struct vmm_vserial *vser)
 /** Send bytes to virtual serial port */
 u32 vmm_vserial_send(struct vmm_vserial *vser, u8 *src, u32 len);
 
-/** Receive bytes on virtual serial port */
+/** Receive bytes on virtual serial port
+ *  Note: bytes are queued in guest output ring and receivers
+ *  are notified later so this can be called from any context.
+ */
 u32 vmm_vserial_receive(struct vmm_vserial *vser, u8 *dst, u32 len);
 
+/** Receive bytes on virtual serial port using fill callback
+ *  Note: fill callback writes into a batch buffer and returns
+ *  number of bytes written. It is called without any lock held
+ *  and can be called more than once with up-to
+ *  VMM_VSERIAL_FILL_BATCH bytes.
+ *  @returns number of bytes received
+ */
+u32 vmm_vserial_receive_fill(struct vmm_vserial *vser, u32 len,
+			     u32 (*fill) (void *priv, u8 *dst, u32 len),
+			     void *priv);
+
+/** Flush guest output ring to receivers immediately */
+void vmm_vserial_receive_flush(struct vmm_vserial *vser);
+
 /** Register receiver to a virtual serial port */
 int vmm_vserial_register_receiver(struct vmm_vserial *vser, 
 		void (*recv) (struct vmm_vserial *, void *, u8), void *priv);
@@ -44,6 +44,7 @@
 #define VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_RAM	"alloced_ram"
 #define VMM_DEVTREE_DEVICE_TYPE_VAL_ROM		"rom"
 #define VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_ROM	"alloced_rom"
+#define VMM_DEVTREE_DEVICE_TYPE_VAL_ONDEMAND_RAM	"ondemand_ram"
 #define VMM_DEVTREE_COMPATIBLE_ATTR_NAME	"compatible"
 #define VMM_DEVTREE_CLOCK_FREQ_ATTR_NAME	"clock-frequency"
 #define VMM_DEVTREE_CLOCKS_ATTR_NAME		"clocks"
@@ -123,6 +124,7 @@ enum vmm_devtree_attrypes {
 
 struct vmm_devtree_attr {
 	struct dlist head;
+	struct dlist hash_head;
 	char name[VMM_FIELD_SHORT_NAME_SIZE];
 	u32 type;
 	void *value;
@@ -175,6 +177,11 @@ struct vmm_devtree_node {
 	vmm_rwlock_t child_lock;
 	struct dlist child_list;
 	atomic_t ref_count;
+	u32 attr_count;
+	struct dlist *attr_hash;
+	struct dlist phandle_head;
+	u32 phandle;
+	struct dlist compat_list;
 	/* Public fields */
 	char name[VMM_FIELD_SHORT_NAME_SIZE];
 	struct vmm_devtree_node *parent;
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_exitstat.h
+ * @author agent (agent@local)
+ * @brief header file of VCPU exit statistics.
+ *
+ * Architecture exception handlers classify each VCPU exit and call
+ * vmm_exitstat_begin()/vmm_exitstat_end() around exit handling. Device
+ * emulation reports the emulated device touched by an exit so that
+ * MMIO and port IO exits are also accounted per emulated device.
+ */
+
+#ifndef _VMM_EXITSTAT_H__
+#define _VMM_EXITSTAT_H__
+
+#include <vmm_error.h>
+#include <vmm_types.h>
+#include <vmm_limits.h>
+#include <vmm_spinlocks.h>
+#include <vmm_timer.h>
+#include <vmm_manager.h>
+
+/* Number of log2 latency buckets (last bucket collects the rest) */
+#define VMM_EXITSTAT_HIST_SIZE		24
+/* Number of emulated devices tracked per VCPU */
+#define VMM_EXITSTAT_MAX_DEVICES	8
+
+enum vmm_exitstat_class {
+	VMM_EXIT_MMIO = 0,	/* Emulated MMIO (data abort or NPF) */
+	VMM_EXIT_PAGEFAULT,	/* Stage2/nested/shadow page fault */
+	VMM_EXIT_IO,		/* Emulated port IO */
+	VMM_EXIT_SYSREG,	/* System register, CP15/CP14, MSR or CRx */
+	VMM_EXIT_HVC,		/* HVC, SMC, PSCI or VMMCALL */
+	VMM_EXIT_WFI,		/* WFI, WFE or HLT */
+	VMM_EXIT_IRQ,		/* Host interrupt */
+	VMM_EXIT_INSN,		/* Other instruction emulation */
+	VMM_EXIT_EXCEPTION,	/* Intercepted guest exception */
+	VMM_EXIT_FPU,		/* Lazy FPU/SIMD trap */
+	VMM_EXIT_OTHER,
+	VMM_EXIT_MAX
+};
+
+/** Latency histogram of VCPU exits */
+struct vmm_exitstat_hist {
+	u64 count;
+	u64 total_nsecs;
+	u64 max_nsecs;
+	u32 bucket[VMM_EXITSTAT_HIST_SIZE];
+};
+
+/** Exit statistics of an emulated device */
+struct vmm_exitstat_device {
+	void *edev;
+	char name[VMM_FIELD_NAME_SIZE];
+	struct vmm_exitstat_hist hist;
+};
+
+/** Exit statistics of a VCPU */
+struct vmm_exitstat {
+	vmm_spinlock_t lock;
+	u64 reset_tstamp;
+	struct vmm_exitstat_hist exits[VMM_EXIT_MAX];
+	u32 device_count;
+	struct vmm_exitstat_device devices[VMM_EXITSTAT_MAX_DEVICES];
+	/* Emulated device touched by exit being handled */
+	void *cur_edev;
+	const char *cur_edev_name;
+};
+
+#ifdef CONFIG_VCPU_EXITSTAT
+
+/** Name of VCPU exit class */
+const char *vmm_exitstat_class_name(u32 exit_class);
+
+/** Start timing a VCPU exit
+ *  @returns timestamp to be passed to vmm_exitstat_end()
+ */
+static inline u64 vmm_exitstat_begin(struct vmm_vcpu *vcpu)
+{
+	return (vcpu && vcpu->exitstat) ? vmm_timer_timestamp() : 0;
+}
+
+/** Account a VCPU exit
+ *  Note: PAGEFAULT exits which touched an emulated device are
+ *  accounted as MMIO exits.
+ */
+void vmm_exitstat_end(struct vmm_vcpu *vcpu, u32 exit_class, u64 tstamp);
+
+/** Note emulated device touched by exit being handled */
+void vmm_exitstat_device(struct vmm_vcpu *vcpu, void *edev,
+			 const char *name);
+
+/** Allocate exit statistics of a VCPU */
+void vmm_exitstat_init(struct vmm_vcpu *vcpu);
+
+/** Free exit statistics of a VCPU */
+void vmm_exitstat_deinit(struct vmm_vcpu *vcpu);
+
+/** Clear exit statistics of a VCPU */
+int vmm_exitstat_reset(struct vmm_vcpu *vcpu);
+
+/** Take consistent snapshot of exit statistics of a VCPU */
+int vmm_exitstat_snapshot(struct vmm_vcpu *vcpu, struct vmm_exitstat *out);
+
+#else
+
+static inline const char *vmm_exitstat_class_name(u32 exit_class)
+{
+	return NULL;
+}
+
+static inline u64 vmm_exitstat_begin(struct vmm_vcpu *vcpu)
+{
+	return 0;
+}
+
+static inline void vmm_exitstat_end(struct vmm_vcpu *vcpu,
+				    u32 exit_class, u64 tstamp)
+{
+}
+
+static inline void vmm_exitstat_device(struct vmm_vcpu *vcpu, void *edev,
+				       const char *name)
+{
+}
+
+static inline void vmm_exitstat_init(struct vmm_vcpu *vcpu)
+{
+}
+
+static inline void vmm_exitstat_deinit(struct vmm_vcpu *vcpu)
+{
+}
+
+static inline int vmm_exitstat_reset(struct vmm_vcpu *vcpu)
+{
+	return VMM_ENOTAVAIL;
+}
+
+static inline int vmm_exitstat_snapshot(struct vmm_vcpu *vcpu,
+					struct vmm_exitstat *out)
+{
+	return VMM_ENOTAVAIL;
+}
+
+#endif
+
+#endif
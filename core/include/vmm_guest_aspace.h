@@ -70,11 +70,197 @@ int vmm_guest_physical_map(struct vmm_guest *guest,
 			   physical_size_t *hphys_size,
 			   u32 *reg_flags);
 
+/** Map guest physical address to some host physical address without
+ *  breaking sharing of merged guest RAM pages
+ *  Note: This is meant for stage2 (or nested) page faults only. The
+ *  VMM_REGION_ISSHARED flag is set in reg_flags for merged pages and
+ *  such pages must be mapped read-only. Guest writes to such pages
+ *  must be handled using vmm_guest_ram_unshare().
+ */
+int vmm_guest_physical_map_shared(struct vmm_guest *guest,
+				  physical_addr_t gphys_addr,
+				  physical_size_t gphys_size,
+				  physical_addr_t *hphys_addr,
+				  physical_size_t *hphys_size,
+				  u32 *reg_flags);
+
 /** Unmap guest physical address */
 int vmm_guest_physical_unmap(struct vmm_guest *guest,
 			     physical_addr_t gphys_addr,
 			     physical_size_t gphys_size);
 
+/** Discard guest RAM and give back host RAM backing it
+ *  Note: Only on-demand RAM regions can give back host RAM. Discarded
+ *  pages read as zeros and get populated again upon next guest access.
+ *  Note: Pages pinned by vmm_guest_physical_map() are kept as-is.
+ *  Note: Returns VMM_ENOTSUPP for other regions or if architecture
+ *  cannot unmap guest memory.
+ */
+int vmm_guest_ram_discard(struct vmm_guest *guest,
+			  physical_addr_t gphys_addr,
+			  physical_size_t gphys_size);
+
+/** Give private host RAM page to a merged guest RAM page
+ *  Note: The guest page is unmapped and has to be mapped again.
+ */
+int vmm_guest_ram_unshare(struct vmm_guest *guest,
+			  physical_addr_t gphys_addr);
+
+/** Representation of guest RAM merging statistics */
+struct vmm_guest_ram_merge_stats {
+	bool running;
+	u32 scan_pages;
+	u32 scan_msecs;
+	u32 pages_shared;
+	u32 pages_sharing;
+	u64 pages_scanned;
+	u64 full_scans;
+	u64 cow_breaks;
+};
+
+/** Start merging identical pages of on-demand guest RAM
+ *  Note: Identical pages are merged into one read-only host RAM page
+ *  and guest writes to merged pages give them private copy again.
+ */
+int vmm_guest_ram_merge_start(void);
+
+/** Stop merging identical pages of on-demand guest RAM
+ *  Note: Already merged pages stay merged until written by guest.
+ */
+void vmm_guest_ram_merge_stop(void);
+
+/** Set number of pages scanned per pass and delay between passes */
+int vmm_guest_ram_merge_set_rate(u32 scan_pages, u32 scan_msecs);
+
+/** Get guest RAM merging statistics
+ *  Note: pages_shared is number of host RAM pages holding merged pages
+ *  whereas pages_sharing is number of guest pages merged into them.
+ */
+void vmm_guest_ram_merge_get_stats(struct vmm_guest_ram_merge_stats *stats);
+
+/** Representation of guest memory balloon information */
+struct vmm_guest_balloon_info {
+	physical_size_t target;
+	physical_size_t actual;
+	physical_size_t guest_free;
+	physical_size_t guest_total;
+};
+
+/** Representation of guest memory balloon
+ *  Note: A memory balloon is provided by a device emulator and there
+ *  can be only one memory balloon per guest.
+ */
+struct vmm_guest_balloon {
+	struct dlist head;
+	struct vmm_guest *guest;
+	int (*set_target)(struct vmm_guest_balloon *bln,
+			  physical_size_t size);
+	int (*get_info)(struct vmm_guest_balloon *bln,
+			struct vmm_guest_balloon_info *info);
+	void *priv;
+};
+
+/** Register memory balloon of a guest
+ *  Note: Returns VMM_ENOTSUPP if architecture cannot unmap guest memory.
+ */
+int vmm_guest_balloon_register(struct vmm_guest_balloon *bln);
+
+/** Unregister memory balloon of a guest */
+int vmm_guest_balloon_unregister(struct vmm_guest_balloon *bln);
+
+/** Set size of guest memory balloon
+ *  Note: Returns VMM_ENODEV if guest has no memory balloon.
+ */
+int vmm_guest_balloon_set_target(struct vmm_guest *guest,
+				 physical_size_t size);
+
+/** Get information of guest memory balloon
+ *  Note: Guest free and total memory is zero if not reported by guest.
+ *  Note: Returns VMM_ENODEV if guest has no memory balloon.
+ */
+int vmm_guest_balloon_get_info(struct vmm_guest *guest,
+			       struct vmm_guest_balloon_info *info);
+
+/** Get host RAM resident for a guest
+ *  Note: This includes alloced/reserved RAM and ROM regions and the
+ *  populated part of on-demand RAM regions.
+ */
+physical_size_t vmm_guest_aspace_rss(struct vmm_guest *guest);
+
+/** Get size of guest RAM merged with identical pages
+ *  Note: Merged guest RAM is not included in resident host RAM.
+ */
+physical_size_t vmm_guest_aspace_merged(struct vmm_guest *guest);
+
+/** Get host RAM populated for a guest region */
+physical_size_t vmm_guest_region_rss(struct vmm_region *reg);
+
+/** Get total size of on-demand RAM regions of all guests */
+physical_size_t vmm_guest_ondemand_committed(void);
+
+/** Get limit on total size of on-demand RAM regions of all guests */
+physical_size_t vmm_guest_ondemand_commit_limit(void);
+
+/** Get on-demand RAM overcommit ratio in percent of host RAM */
+u32 vmm_guest_ondemand_overcommit_ratio(void);
+
+/** Set on-demand RAM overcommit ratio in percent of host RAM
+ *  Note: Only new on-demand RAM regions are checked against it.
+ */
+int vmm_guest_ondemand_set_overcommit_ratio(u32 ratio);
+
+/** Representation of dirty page logging for a guest physical range
+ *  Note: Pages of a dirty logged range are write protected in stage2
+ *  (or shadow) translation tables. First guest write to a page sets
+ *  its bit in dirty bitmap and makes the page writeable again.
+ */
+struct vmm_guest_dirty_log {
+	struct dlist head;
+	struct vmm_guest *guest;
+	physical_addr_t gphys_addr;
+	physical_size_t gphys_size;
+	u32 page_count;
+	unsigned long *dirty_bmap;
+};
+
+/** Start dirty page logging for given guest physical range
+ *  Note: All pages are reported dirty by first sync.
+ *  Note: Returns NULL if architecture cannot trap guest writes.
+ */
+struct vmm_guest_dirty_log *vmm_guest_dirty_log_start(
+					struct vmm_guest *guest,
+					physical_addr_t gphys_addr,
+					physical_size_t gphys_size);
+
+/** Stop dirty page logging */
+void vmm_guest_dirty_log_stop(struct vmm_guest_dirty_log *dlog);
+
+/** Retrive and clear dirty bitmap of dirty page logging
+ *  Note: The bitmap must have one bit for each page of logged range.
+ *  Note: Pages reported dirty are write protected again.
+ */
+int vmm_guest_dirty_log_sync(struct vmm_guest_dirty_log *dlog,
+			     unsigned long *bmap);
+
+/** Check whether given guest physical range overlaps dirty logging */
+bool vmm_guest_dirty_log_overlap(struct vmm_guest *guest,
+				 physical_addr_t gphys_addr,
+				 physical_size_t gphys_size);
+
+/** Check whether given guest page must be mapped write protected
+ *  because of dirty logging (i.e. it is not dirty yet)
+ */
+bool vmm_guest_dirty_log_clean(struct vmm_guest *guest,
+			       physical_addr_t gphys_addr);
+
+/** Mark given guest page as dirty in all dirty logs covering it
+ *  Note: Returns TRUE if guest page is dirty logged.
+ *  Note: This is usually called by architecture code upon write
+ *  permission fault.
+ */
+bool vmm_guest_dirty_log_mark(struct vmm_guest *guest,
+			      physical_addr_t gphys_addr);
+
 /** Add a new region from a given node in DTS */
 int vmm_guest_add_region_from_node(struct vmm_guest *guest,
 				   struct vmm_devtree_node *node,
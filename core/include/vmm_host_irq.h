@@ -27,6 +27,7 @@
 #include <vmm_cpumask.h>
 #include <vmm_spinlocks.h>
 #include <vmm_devtree.h>
+#include <vmm_rcu.h>
 #include <libs/list.h>
 
 /**
@@ -106,6 +107,7 @@ typedef vmm_irq_return_t (*vmm_host_irq_function_t) (int irq_no, void *dev);
 /** Host IRQ Action Abstraction */
 struct vmm_host_irq_action {
 	struct dlist head;
+	struct vmm_rcu_head rcu;
 	vmm_host_irq_function_t func;
 	void *dev;
 };
@@ -154,7 +156,7 @@ struct vmm_host_irq {
 	struct vmm_host_irq_chip *chip;
 	vmm_host_irq_handler_t handler;
 	void *handler_data;
-	vmm_rwlock_t action_lock[CONFIG_CPU_COUNT];
+	vmm_spinlock_t action_lock[CONFIG_CPU_COUNT];
 	struct dlist action_list[CONFIG_CPU_COUNT];
 };
 
@@ -392,7 +394,10 @@ int vmm_host_irq_register(u32 hirq,
 			  vmm_host_irq_function_t func,
 			  void *dev);
 
-/** Unregister function callback for given irq */
+/** Unregister function callback for given irq
+ *  Note: this waits for handlers of the irq running on other host
+ *  CPUs so that dev can be released upon return.
+ */
 int vmm_host_irq_unregister(u32 hirq,
 			    void *dev);
 
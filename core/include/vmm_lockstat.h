@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_lockstat.h
+ * @author agent (agent@local)
+ * @brief header file of spinlock and rwlock contention statistics.
+ *
+ * Locks are grouped into classes by the place where they are
+ * initialized (i.e. INIT_SPIN_LOCK(), INIT_RW_LOCK() or static
+ * initializer) so all locks initialized at one place share statistics.
+ */
+
+#ifndef _VMM_LOCKSTAT_H__
+#define _VMM_LOCKSTAT_H__
+
+#include <vmm_types.h>
+#include <vmm_compiler.h>
+
+/** Name of lock class for given lock initialization site */
+#define VMM_LOCKSTAT_NAME(_lock)	\
+		__FILE__ ":" stringify(__LINE__) " " #_lock
+
+struct vmm_spinlock;
+struct vmm_rwlock;
+
+/** Representation of a lock class */
+struct vmm_lockstat_class {
+	const char *name;
+	atomic64_t acquisitions;
+	atomic64_t contentions;
+	atomic64_t total_wait_ns;
+	atomic64_t max_wait_ns;
+};
+
+/** Snapshot of lock class statistics */
+struct vmm_lockstat_info {
+	const char *name;
+	u64 acquisitions;
+	u64 contentions;
+	u64 total_wait_ns;
+	u64 max_wait_ns;
+};
+
+/** Accounting versions of arch spin lock functions
+ *  Note: These are only used by vmm_spinlocks.h
+ */
+void vmm_lockstat_spin_lock(struct vmm_spinlock *lock);
+int vmm_lockstat_spin_trylock(struct vmm_spinlock *lock);
+
+/** Accounting versions of arch read/write lock functions
+ *  Note: These are only used by vmm_spinlocks.h
+ */
+void vmm_lockstat_write_lock(struct vmm_rwlock *lock);
+int vmm_lockstat_write_trylock(struct vmm_rwlock *lock);
+void vmm_lockstat_read_lock(struct vmm_rwlock *lock);
+int vmm_lockstat_read_trylock(struct vmm_rwlock *lock);
+
+/** Number of lock classes seen so far */
+u32 vmm_lockstat_class_count(void);
+
+/** Get statistics of lock class at given index */
+int vmm_lockstat_class_info(u32 index, struct vmm_lockstat_info *info);
+
+/** Clear statistics of all lock classes */
+void vmm_lockstat_reset(void);
+
+#endif
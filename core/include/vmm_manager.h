@@ -31,6 +31,7 @@
 #include <vmm_spinlocks.h>
 #include <vmm_devtree.h>
 #include <vmm_cpumask.h>
+#include <vmm_percpu_counter.h>
 #include <libs/list.h>
 #include <libs/rbtree.h>
 
@@ -50,6 +51,8 @@ enum vmm_region_flags {
 	VMM_REGION_ISRESERVED=0x00001000,
 	VMM_REGION_ISALLOCED=0x00002000,
 	VMM_REGION_ISDYNAMIC=0x00004000,
+	VMM_REGION_ISONDEMAND=0x00008000,
+	VMM_REGION_ISSHARED=0x00010000,
 };
 
 #define VMM_REGION_MANIFEST_MASK	(VMM_REGION_REAL | \
@@ -57,10 +60,12 @@ enum vmm_region_flags {
 					 VMM_REGION_ALIAS)
 
 struct vmm_region;
+struct vmm_region_ondemand;
 struct vmm_guest_aspace;
 struct vmm_vcpu_irqs;
 struct vmm_vcpu;
 struct vmm_guest;
+struct vmm_exitstat;
 
 struct vmm_region {
 	struct rb_node head;
@@ -72,6 +77,7 @@ struct vmm_region {
 	physical_size_t phys_size;
 	u32 align_order;
 	u32 flags;
+	struct vmm_region_ondemand *ondemand;
 	void *devemu_priv;
 	void *priv;
 };
@@ -95,6 +101,10 @@ struct vmm_guest_aspace {
 	vmm_rwlock_t reg_memtree_lock;
 	struct rb_root reg_memtree;
 	struct dlist reg_memprobe_list;
+	vmm_spinlock_t dirty_log_lock;
+	struct dlist dirty_log_list;
+	atomic_t rss_frames;
+	atomic_t merged_frames;
 	void *devemu_priv;
 };
 
@@ -106,20 +116,30 @@ struct vmm_guest_request {
 
 struct vmm_vcpu_irq {
 	atomic_t assert;
+	u32 prio;
 	u64 reason;
 };
 
 struct vmm_vcpu_irqs {
 	u32 irq_count;
 	struct vmm_vcpu_irq *irq;
+	u32 prio_count;
+	u32 word_count;
+	atomic_t *asserted;
+	atomic_t asserted_count;
+	atomic_t asserted_last;
 	atomic_t execute_pending;
-	atomic64_t assert_count;
-	atomic64_t execute_count;
-	atomic64_t deassert_count;
+	struct vmm_percpu_counter assert_count;
+	struct vmm_percpu_counter execute_count;
+	struct vmm_percpu_counter deassert_count;
 	struct {
 		vmm_spinlock_t lock;
 		bool state;
 		void *priv;
+		u64 tstamp;
+		u64 poll_ns;
+		u64 poll_success;
+		u64 poll_fail;
 	} wfi;
 };
 
@@ -221,6 +241,10 @@ struct vmm_vcpu {
 	u64 deadline;
 	u64 periodicity;
 
+	/* Priority inheritance context */
+	u8 base_priority;
+	atomic_t boost_count;
+
 	/* Architecture specific context */
 	arch_regs_t regs;
 	void *arch_priv;
@@ -228,6 +252,9 @@ struct vmm_vcpu {
 	/* Virtual IRQ context */
 	struct vmm_vcpu_irqs irqs;
 
+	/* Exit statistics */
+	struct vmm_exitstat *exitstat;
+
 	/* Resources acquired */
 	vmm_spinlock_t res_lock;
 	struct dlist res_head;
@@ -236,6 +263,9 @@ struct vmm_vcpu {
 	struct dlist wq_head;
 	vmm_spinlock_t *wq_lock;
 	void *wq_priv;
+
+	/* Workqueue worker (only for orphan VCPUs) */
+	void *worker;
 };
 
 /** Acquire manager lock */
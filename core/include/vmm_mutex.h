@@ -27,12 +27,26 @@
 #include <vmm_types.h>
 #include <vmm_waitqueue.h>
 
+/** Mutex statistics */
+struct vmm_mutex_stats {
+	u64 lock_count;
+	u64 contended_count;
+	u64 spin_count;
+	u64 wait_nsecs_total;
+	u64 wait_nsecs_max;
+	u64 hold_nsecs_total;
+	u64 hold_nsecs_max;
+};
+
 /** Mutex lock structure */
 struct vmm_mutex {
 	u32 lock;
 	struct vmm_vcpu_resource res;
 	struct vmm_vcpu *owner;
 	struct vmm_waitqueue wq;
+	bool boosted;
+	u64 lock_tstamp;
+	struct vmm_mutex_stats stats;
 };
 
 /** Cleanup callback for mutex when VCPU is destroyed
@@ -41,6 +55,17 @@ struct vmm_mutex {
 void __vmm_mutex_cleanup(struct vmm_vcpu *vcpu,
 			 struct vmm_vcpu_resource *vcpu_res);
 
+static inline void __vmm_mutex_stats_clear(struct vmm_mutex_stats *stats)
+{
+	stats->lock_count = 0;
+	stats->contended_count = 0;
+	stats->spin_count = 0;
+	stats->wait_nsecs_total = 0;
+	stats->wait_nsecs_max = 0;
+	stats->hold_nsecs_total = 0;
+	stats->hold_nsecs_max = 0;
+}
+
 /** Initialize mutex lock */
 #define INIT_MUTEX(__mut)	\
 do { \
@@ -49,6 +74,9 @@ do { \
 	(__mut)->res.cleanup = __vmm_mutex_cleanup; \
 	(__mut)->owner = NULL; \
 	INIT_WAITQUEUE(&(__mut)->wq, (__mut)); \
+	(__mut)->boosted = FALSE; \
+	(__mut)->lock_tstamp = 0; \
+	__vmm_mutex_stats_clear(&(__mut)->stats); \
 } while (0)
 
 #define __MUTEX_INITIALIZER(__mut) \
@@ -57,6 +85,8 @@ do { \
 	.res = { .name = "vmm_mutex", .cleanup = __vmm_mutex_cleanup }, \
 	.owner = NULL, \
 	.wq = __WAITQUEUE_INITIALIZER((__mut).wq, &(__mut)), \
+	.boosted = FALSE, \
+	.lock_tstamp = 0, \
 }
 
 #define DEFINE_MUTEX(__mut) \
@@ -82,4 +112,7 @@ int vmm_mutex_lock(struct vmm_mutex *mut);
 /** Lock mutex with timeout */
 int vmm_mutex_lock_timeout(struct vmm_mutex *mut, u64 *timeout);
 
+/** Retrive mutex statistics */
+int vmm_mutex_get_stats(struct vmm_mutex *mut, struct vmm_mutex_stats *stats);
+
 #endif /* __VMM_MUTEX_H__ */
@@ -37,6 +37,7 @@
 #include <arch_smp.h>
 
 extern virtual_addr_t __percpu_offset[CONFIG_CPU_COUNT];
+extern virtual_addr_t __percpu_dyn_offset[CONFIG_CPU_COUNT];
 
 #define RELOC_HIDE(ptr, off)	({ \
 		(typeof(ptr)) ((virtual_addr_t)(ptr) + (off)); })
@@ -47,12 +48,22 @@ extern virtual_addr_t __percpu_offset[CONFIG_CPU_COUNT];
 #define per_cpu(var, cpu)	(*RELOC_HIDE(&percpu_##var,	\
 				__percpu_offset[(cpu)]))
 
+#define this_cpu_ptr(ptr)	RELOC_HIDE((ptr),		\
+				__percpu_dyn_offset[arch_smp_id()])
+
+#define per_cpu_ptr(ptr, cpu)	RELOC_HIDE((ptr),		\
+				__percpu_dyn_offset[(cpu)])
+
 #else
 
 #define this_cpu(var)		percpu_##var
 
 #define per_cpu(var, cpu)	percpu_##var
 
+#define this_cpu_ptr(ptr)	(ptr)
+
+#define per_cpu_ptr(ptr, cpu)	(ptr)
+
 #endif
 
 #define get_cpu_var(var) this_cpu(var)
@@ -62,6 +73,15 @@ extern virtual_addr_t __percpu_offset[CONFIG_CPU_COUNT];
 /** Retrive per-cpu offset of current cpu */
 virtual_addr_t vmm_percpu_current_offset(void);
 
+/** Allocate zeroed memory from dynamic per-cpu area
+ *  Note: returned pointer must only be accessed using
+ *  this_cpu_ptr() or per_cpu_ptr()
+ */
+void *vmm_percpu_alloc(virtual_size_t size);
+
+/** Free memory allocated from dynamic per-cpu area */
+void vmm_percpu_free(void *ptr, virtual_size_t size);
+
 /** Initialize per-cpu areas */
 int vmm_percpu_init(void);
 
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_percpu_counter.h
+ * @author agent (agent@local)
+ * @brief Header file of per-cpu counters.
+ *
+ * A per-cpu counter keeps a small delta for each host CPU in the
+ * dynamic per-cpu area so that updates only touch memory local to
+ * the updating host CPU. The delta of a host CPU is folded into the
+ * shared count only when it crosses VMM_PERCPU_COUNTER_BATCH hence
+ * exact value is computed by summing up all deltas on read.
+ */
+
+#ifndef __VMM_PERCPU_COUNTER_H__
+#define __VMM_PERCPU_COUNTER_H__
+
+#include <vmm_types.h>
+#include <vmm_limits.h>
+#include <vmm_spinlocks.h>
+#include <libs/list.h>
+
+/** Max absolute value of per-cpu delta before folding */
+#define VMM_PERCPU_COUNTER_BATCH	1024
+
+/** Per-cpu counter */
+struct vmm_percpu_counter {
+	/* Registry list head and name */
+	struct dlist head;
+	char name[VMM_FIELD_NAME_SIZE];
+	/* Folded count */
+	vmm_spinlock_t lock;
+	s64 count;
+	/* Per-cpu deltas (dynamic per-cpu memory) */
+	s32 *counters;
+};
+
+/** Initialize per-cpu counter with given value */
+int vmm_percpu_counter_init(struct vmm_percpu_counter *fbc, s64 value);
+
+/** Destroy per-cpu counter
+ *  Note: registered counter must be unregistered before this
+ */
+void vmm_percpu_counter_destroy(struct vmm_percpu_counter *fbc);
+
+/** Add given amount to per-cpu counter
+ *  Note: this can be called from any context
+ */
+void vmm_percpu_counter_add(struct vmm_percpu_counter *fbc, s64 amount);
+
+/** Increment per-cpu counter */
+static inline void vmm_percpu_counter_inc(struct vmm_percpu_counter *fbc)
+{
+	vmm_percpu_counter_add(fbc, 1);
+}
+
+/** Decrement per-cpu counter */
+static inline void vmm_percpu_counter_dec(struct vmm_percpu_counter *fbc)
+{
+	vmm_percpu_counter_add(fbc, -1);
+}
+
+/** Approximate value of per-cpu counter (only folded count) */
+static inline s64 vmm_percpu_counter_read(struct vmm_percpu_counter *fbc)
+{
+	return fbc->count;
+}
+
+/** Exact value of per-cpu counter (folded count plus all deltas) */
+s64 vmm_percpu_counter_sum(struct vmm_percpu_counter *fbc);
+
+/** Set value of per-cpu counter
+ *  Note: updates racing with this function might be lost
+ */
+void vmm_percpu_counter_set(struct vmm_percpu_counter *fbc, s64 value);
+
+/** Register per-cpu counter with given name to counter registry
+ *  Note: this can only be called from Orphan VCPU context
+ */
+int vmm_percpu_counter_register(struct vmm_percpu_counter *fbc,
+				const char *name);
+
+/** Unregister per-cpu counter from counter registry
+ *  Note: this can only be called from Orphan VCPU context
+ */
+int vmm_percpu_counter_unregister(struct vmm_percpu_counter *fbc);
+
+/** Iterate over all registered per-cpu counters
+ *  Note: iteration stops if callback returns non-zero value
+ */
+int vmm_percpu_counter_iterate(void *data,
+		int (*iter)(struct vmm_percpu_counter *fbc, void *data));
+
+/** Count of registered per-cpu counters */
+u32 vmm_percpu_counter_count(void);
+
+/** Reset all registered per-cpu counters to zero */
+void vmm_percpu_counter_reset_all(void);
+
+#endif /* __VMM_PERCPU_COUNTER_H__ */
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_rcu.h
+ * @author agent (agent@local)
+ * @brief Header file of read-copy-update (RCU) synchronization.
+ *
+ * RCU read-side critical sections only disable preemption of the
+ * current VCPU, so they are very cheap and can be used from any
+ * context (Normal VCPU, Orphan VCPU, or IRQ). A read-side critical
+ * section must not sleep.
+ *
+ * A host CPU is in quiescent state whenever the scheduler is allowed
+ * to switch VCPUs on it, or when it is executing idle loop. A grace
+ * period ends after all host CPUs which were online when it started
+ * have passed through a quiescent state.
+ */
+
+#ifndef __VMM_RCU_H__
+#define __VMM_RCU_H__
+
+#include <vmm_types.h>
+#include <vmm_compiler.h>
+#include <vmm_scheduler.h>
+#include <arch_barrier.h>
+#include <libs/list.h>
+
+struct vmm_rcu_head;
+typedef void (*vmm_rcu_callback_t)(struct vmm_rcu_head *head);
+
+/** RCU callback structure to be embedded in RCU protected objects */
+struct vmm_rcu_head {
+	struct dlist head;
+	vmm_rcu_callback_t func;
+};
+
+/** Start RCU read-side critical section */
+static inline void vmm_rcu_read_lock(void)
+{
+	vmm_scheduler_preempt_disable();
+	barrier();
+}
+
+/** End RCU read-side critical section */
+static inline void vmm_rcu_read_unlock(void)
+{
+	barrier();
+	vmm_scheduler_preempt_enable();
+}
+
+/** Fetch RCU protected pointer for dereferencing
+ *  Note: must be used within RCU read-side critical section
+ */
+#define vmm_rcu_dereference(p)		\
+({					\
+	typeof(p) ____p = *(volatile typeof(p) *)&(p); \
+	barrier();			\
+	____p;				\
+})
+
+/** Publish RCU protected pointer after initializing pointed object */
+#define vmm_rcu_assign_pointer(p, v)	\
+do {					\
+	arch_smp_wmb();			\
+	*(volatile typeof(p) *)&(p) = (v); \
+} while (0)
+
+/** Report quiescent state of current host CPU
+ *  Note: this is only called by scheduler with interrupts disabled
+ */
+void vmm_rcu_note_qs(void);
+
+/** Wake-up grace period thread if current grace period has ended
+ *  Note: this is only called from scheduler timer event and idle loop
+ */
+void vmm_rcu_check(void);
+
+/** Queue callback to be invoked after a grace period
+ *  Note: can be called from any context
+ *  Note: callback is invoked in Orphan VCPU context
+ */
+void vmm_call_rcu(struct vmm_rcu_head *head, vmm_rcu_callback_t func);
+
+/** Wait till a full grace period has elapsed
+ *  Note: this can only be called from Orphan VCPU context
+ *  Note: this also waits for all callbacks queued before it
+ */
+void vmm_synchronize_rcu(void);
+
+/** Initialize RCU subsystem */
+int vmm_rcu_init(void);
+
+#endif /* __VMM_RCU_H__ */
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_sampler.h
+ * @author agent (agent@local)
+ * @brief header file of hypervisor sampling profiler.
+ */
+
+#ifndef _VMM_SAMPLER_H__
+#define _VMM_SAMPLER_H__
+
+#include <vmm_types.h>
+
+/* Number of samples in per-CPU ring (must be power of 2) */
+#define VMM_SAMPLER_RING_SIZE		4096
+#define VMM_SAMPLER_DEFAULT_FREQ	997
+#define VMM_SAMPLER_MAX_FREQ		10000
+
+#define VMM_SAMPLER_ID_NONE		0xFFFFFFFF
+
+#define VMM_SAMPLER_FLAG_GUEST		0x1
+
+/** Representation of a sample */
+struct vmm_sampler_entry {
+	virtual_addr_t pc;
+	virtual_addr_t caller;
+	u32 vcpu_id;
+	u32 guest_id;
+	u32 flags;
+};
+
+/** Check status of sampling profiler */
+bool vmm_sampler_isactive(void);
+
+/** Current sampling frequency (per-second per host CPU) */
+u32 vmm_sampler_frequency(void);
+
+/** Start sampling profiler on all online host CPUs
+ *  Note: samples of previous run are discarded
+ */
+int vmm_sampler_start(u32 freq);
+
+/** Stop sampling profiler on all online host CPUs */
+int vmm_sampler_stop(void);
+
+/** Total samples taken on given host CPU (including overwritten ones) */
+u32 vmm_sampler_total_count(u32 cpu);
+
+/** Iterate over samples available in per-CPU rings
+ *  Note: sampling profiler has to be stopped
+ */
+int vmm_sampler_iterate(void *data,
+			int (*fn)(u32 cpu, struct vmm_sampler_entry *e,
+				  void *data));
+
+#endif
@@ -62,6 +62,11 @@ void vmm_scheduler_irq_exit(arch_regs_t *regs);
 /** Check whether we are in IRQ context */
 bool vmm_scheduler_irq_context(void);
 
+/** Retrive registers saved by interrupt handlers on current host CPU
+ *  Note: returns NULL when not processing IRQ
+ */
+arch_regs_t *vmm_scheduler_irq_regs(void);
+
 /** Check whether we are in Orphan VCPU context */
 bool vmm_scheduler_orphan_context(void);
 
@@ -92,6 +97,12 @@ struct vmm_vcpu *vmm_scheduler_current_vcpu(void);
 /** Retrive current priority */
 u8 vmm_scheduler_current_priority(void);
 
+/** Change priority of given vcpu
+ *  Note: This does not preempt current vcpu of this host CPU so
+ *  caller has to yield if current vcpu priority is lowered.
+ */
+int vmm_scheduler_set_priority(struct vmm_vcpu *vcpu, u8 priority);
+
 /** Retrive current guest */
 struct vmm_guest *vmm_scheduler_current_guest(void);
 
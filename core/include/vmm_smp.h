@@ -79,19 +79,23 @@ void vmm_smp_ipi_exec(void);
 
 /** Asynchronus call to function on multiple cores
  *  Note: To ease development, we have dummy implementation for UP systems.
+ *  Note: Returns VMM_EBUSY if call queue of some core was full and
+ *  caller cannot wait for room (e.g. interrupts or preemption disabled)
+ *  in which case function is not called on that core.
  */
 #if !defined(CONFIG_SMP)
 static inline
-void vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
-			    void (*func)(void *, void *, void *),
-			    void *arg0, void *arg1, void *arg2)
+int vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
+			   void (*func)(void *, void *, void *),
+			   void *arg0, void *arg1, void *arg2)
 {
 	(func)(arg0, arg1, arg2);
+	return VMM_OK;
 }
 #else
-void vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
-			    void (*func)(void *, void *, void *),
-			    void *arg0, void *arg1, void *arg2);
+int vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
+			   void (*func)(void *, void *, void *),
+			   void *arg0, void *arg1, void *arg2);
 #endif
 
 /** Synchronus call to function on multiple cores
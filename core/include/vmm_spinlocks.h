@@ -28,9 +28,57 @@
 #include <arch_cpu_irq.h>
 #include <arch_locks.h>
 #include <vmm_types.h>
+#include <vmm_lockstat.h>
 
 #if defined(CONFIG_SMP)
 
+#if defined(CONFIG_LOCK_STAT)
+
+/*
+ * With lock statistics each lock also holds its class name
+ * and cached pointer to its class (see vmm_lockstat.h).
+ */
+struct vmm_spinlock {
+	arch_spinlock_t __tlock;
+	struct vmm_lockstat_class *__lsc;
+	const char *__lsname;
+};
+
+#define INIT_SPIN_LOCK(_lptr)		do { \
+					ARCH_SPIN_LOCK_INIT(&((_lptr)->__tlock)); \
+					(_lptr)->__lsc = NULL; \
+					(_lptr)->__lsname = VMM_LOCKSTAT_NAME(_lptr); \
+					} while (0)
+#define __SPINLOCK_INITIALIZER(_lock) 	\
+		{ .__tlock = ARCH_SPIN_LOCK_INITIALIZER, \
+		  .__lsc = NULL, \
+		  .__lsname = VMM_LOCKSTAT_NAME(_lock), }
+
+struct vmm_rwlock {
+	arch_rwlock_t __tlock;
+	struct vmm_lockstat_class *__lsc;
+	const char *__lsname;
+};
+
+#define INIT_RW_LOCK(_lptr)		do { \
+					ARCH_RW_LOCK_INIT(&((_lptr)->__tlock)); \
+					(_lptr)->__lsc = NULL; \
+					(_lptr)->__lsname = VMM_LOCKSTAT_NAME(_lptr); \
+					} while (0)
+#define __RWLOCK_INITIALIZER(_lock) 	\
+		{ .__tlock = ARCH_RW_LOCK_INITIALIZER, \
+		  .__lsc = NULL, \
+		  .__lsname = VMM_LOCKSTAT_NAME(_lock), }
+
+#define __vmm_spin_lock(lock)		vmm_lockstat_spin_lock(lock)
+#define __vmm_spin_trylock(lock)	vmm_lockstat_spin_trylock(lock)
+#define __vmm_write_lock(lock)		vmm_lockstat_write_lock(lock)
+#define __vmm_write_trylock(lock)	vmm_lockstat_write_trylock(lock)
+#define __vmm_read_lock(lock)		vmm_lockstat_read_lock(lock)
+#define __vmm_read_trylock(lock)	vmm_lockstat_read_trylock(lock)
+
+#else
+
 /*
  * FIXME: With SMP should rather be holding
  * more information like which core is holding the
@@ -52,6 +100,15 @@ struct vmm_rwlock {
 #define __RWLOCK_INITIALIZER(_lock) 	\
 		{ .__tlock = ARCH_RW_LOCK_INITIALIZER, }
 
+#define __vmm_spin_lock(lock)		arch_spin_lock(&(lock)->__tlock)
+#define __vmm_spin_trylock(lock)	arch_spin_trylock(&(lock)->__tlock)
+#define __vmm_write_lock(lock)		arch_write_lock(&(lock)->__tlock)
+#define __vmm_write_trylock(lock)	arch_write_trylock(&(lock)->__tlock)
+#define __vmm_read_lock(lock)		arch_read_lock(&(lock)->__tlock)
+#define __vmm_read_trylock(lock)	arch_read_trylock(&(lock)->__tlock)
+
+#endif
+
 #else
 
 struct vmm_spinlock {
@@ -104,15 +161,15 @@ extern void vmm_scheduler_preempt_enable(void);
 #if defined(CONFIG_SMP)
 #define vmm_spin_lock(lock)		do { \
 					vmm_scheduler_preempt_disable(); \
-					arch_spin_lock(&(lock)->__tlock); \
+					__vmm_spin_lock(lock); \
 					} while (0)
 #define vmm_write_lock(lock)		do { \
 					vmm_scheduler_preempt_disable(); \
-					arch_write_lock(&(lock)->__tlock); \
+					__vmm_write_lock(lock); \
 					} while (0)
 #define vmm_read_lock(lock)		do { \
 					vmm_scheduler_preempt_disable(); \
-					arch_read_lock(&(lock)->__tlock); \
+					__vmm_read_lock(lock); \
 					} while (0)
 #else
 #define vmm_spin_lock(lock)		do { \
@@ -130,7 +187,7 @@ extern void vmm_scheduler_preempt_enable(void);
 #define vmm_spin_trylock(lock)		({ \
 					int ret; \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_spin_trylock(&(lock)->__tlock); \
+					ret = __vmm_spin_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 					} \
@@ -139,7 +196,7 @@ extern void vmm_scheduler_preempt_enable(void);
 #define vmm_write_trylock(lock)		({ \
 					int ret; \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_write_trylock(&(lock)->__tlock); \
+					ret = __vmm_write_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 					} \
@@ -148,7 +205,7 @@ extern void vmm_scheduler_preempt_enable(void);
 #define vmm_read_trylock(lock)		({ \
 					int ret; \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_read_trylock(&(lock)->__tlock); \
+					ret = __vmm_read_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 					} \
@@ -201,13 +258,13 @@ extern void vmm_scheduler_preempt_enable(void);
  */
 #if defined(CONFIG_SMP)
 #define vmm_spin_lock_lite(lock)	do { \
-					arch_spin_lock(&(lock)->__tlock); \
+					__vmm_spin_lock(lock); \
 					} while (0)
 #define vmm_write_lock_lite(lock)	do { \
-					arch_write_lock(&(lock)->__tlock); \
+					__vmm_write_lock(lock); \
 					} while (0)
 #define vmm_read_lock_lite(lock)	do { \
-					arch_read_lock(&(lock)->__tlock); \
+					__vmm_read_lock(lock); \
 					} while (0)
 #else
 #define vmm_spin_lock_lite(lock)	do { \
@@ -245,17 +302,17 @@ extern void vmm_scheduler_preempt_enable(void);
 #define vmm_spin_lock_irq(lock) 	do { \
 					arch_cpu_irq_disable(); \
 					vmm_scheduler_preempt_disable(); \
-					arch_spin_lock(&(lock)->__tlock); \
+					__vmm_spin_lock(lock); \
 					} while (0)
 #define vmm_write_lock_irq(lock) 	do { \
 					arch_cpu_irq_disable(); \
 					vmm_scheduler_preempt_disable(); \
-					arch_write_lock(&(lock)->__tlock); \
+					__vmm_write_lock(lock); \
 					} while (0)
 #define vmm_read_lock_irq(lock) 	do { \
 					arch_cpu_irq_disable(); \
 					vmm_scheduler_preempt_disable(); \
-					arch_read_lock(&(lock)->__tlock); \
+					__vmm_read_lock(lock); \
 					} while (0)
 #else
 #define vmm_spin_lock_irq(lock) 	do { \
@@ -306,7 +363,7 @@ extern void vmm_scheduler_preempt_enable(void);
 					int ret; \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_spin_trylock(&(lock)->__tlock); \
+					ret = __vmm_spin_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 						arch_cpu_irq_restore(flags); \
@@ -318,7 +375,7 @@ extern void vmm_scheduler_preempt_enable(void);
 					int ret; \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_write_trylock(&(lock)->__tlock); \
+					ret = __vmm_write_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 						arch_cpu_irq_restore(flags); \
@@ -330,7 +387,7 @@ extern void vmm_scheduler_preempt_enable(void);
 					int ret; \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					ret = arch_read_trylock(&(lock)->__tlock); \
+					ret = __vmm_read_trylock(lock); \
 					if (!ret) { \
 						vmm_scheduler_preempt_enable(); \
 						arch_cpu_irq_restore(flags); \
@@ -368,19 +425,19 @@ extern void vmm_scheduler_preempt_enable(void);
 					do { \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					arch_spin_lock(&(lock)->__tlock); \
+					__vmm_spin_lock(lock); \
 					} while (0)
 #define vmm_write_lock_irqsave(lock, flags) \
 					do { \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					arch_write_lock(&(lock)->__tlock); \
+					__vmm_write_lock(lock); \
 					} while (0)
 #define vmm_read_lock_irqsave(lock, flags) \
 					do { \
 					arch_cpu_irq_save((flags)); \
 					vmm_scheduler_preempt_disable(); \
-					arch_read_lock(&(lock)->__tlock); \
+					__vmm_read_lock(lock); \
 					} while (0)
 #else
 #define vmm_spin_lock_irqsave(lock, flags) \
@@ -434,17 +491,17 @@ extern void vmm_scheduler_preempt_enable(void);
 #define vmm_spin_lock_irqsave_lite(lock, flags) \
 					do { \
 					arch_cpu_irq_save((flags)); \
-					arch_spin_lock(&(lock)->__tlock); \
+					__vmm_spin_lock(lock); \
 					} while (0)
 #define vmm_write_lock_irqsave_lite(lock, flags) \
 					do { \
 					arch_cpu_irq_save((flags)); \
-					arch_write_lock(&(lock)->__tlock); \
+					__vmm_write_lock(lock); \
 					} while (0)
 #define vmm_read_lock_irqsave_lite(lock, flags) \
 					do { \
 					arch_cpu_irq_save((flags)); \
-					arch_read_lock(&(lock)->__tlock); \
+					__vmm_read_lock(lock); \
 					} while (0)
 #else
 #define vmm_spin_lock_irqsave_lite(lock, flags) \
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_trace.h
+ * @author agent (agent@local)
+ * @brief header file of hypervisor event tracing.
+ *
+ * Trace events are declared at compile-time in vmm_trace_events.h
+ * and each event gets a tracepoint function trace_<name>(). When
+ * an event is disabled the tracepoint costs one load and one not
+ * taken branch. When enabled, the tracepoint records a binary entry
+ * into per-CPU ring of trace entries.
+ */
+
+#ifndef _VMM_TRACE_H__
+#define _VMM_TRACE_H__
+
+#include <vmm_types.h>
+#include <vmm_compiler.h>
+
+/* Number of entries in per-CPU ring (must be power of 2) */
+#define VMM_TRACE_RING_SIZE		4096
+
+#define VMM_TRACE_ID_NONE		0xFFFFFFFF
+
+#define VMM_TRACE_PROTO(args...)	args
+#define VMM_TRACE_ARGS(args...)		args
+
+enum vmm_trace_event_id {
+#define VMM_TRACE_EVENT(name, proto, args, fmt)	VMM_TRACE_ID_##name,
+#include <vmm_trace_events.h>
+#undef VMM_TRACE_EVENT
+	VMM_TRACE_ID_MAX
+};
+
+/** Representation of a trace entry */
+struct vmm_trace_entry {
+	u64 tstamp;
+	u32 id;
+	u32 cpu;
+	u64 args[4];
+};
+
+#ifdef CONFIG_TRACE
+
+/* Bitmap of enabled events (one bit per event id) */
+extern u32 vmm_trace_event_mask;
+
+/** Check whether given trace event is enabled */
+#define vmm_trace_enabled(name)	\
+	unlikely(vmm_trace_event_mask & (1U << VMM_TRACE_ID_##name))
+
+/** Record a trace entry on current host CPU
+ *  Note: Use trace_<name>() instead of calling this directly
+ */
+void __vmm_trace_record(u32 id, u64 a0, u64 a1, u64 a2, u64 a3);
+
+#define VMM_TRACE_EVENT(name, proto, args, fmt)				\
+static inline void trace_##name(proto)					\
+{									\
+	if (vmm_trace_enabled(name)) {					\
+		__vmm_trace_record(VMM_TRACE_ID_##name, args);		\
+	}								\
+}
+#include <vmm_trace_events.h>
+#undef VMM_TRACE_EVENT
+
+#else
+
+#define vmm_trace_enabled(name)	0
+
+#define VMM_TRACE_EVENT(name, proto, args, fmt)				\
+static inline void trace_##name(proto)					\
+{									\
+}
+#include <vmm_trace_events.h>
+#undef VMM_TRACE_EVENT
+
+#endif
+
+/** Name of given trace event */
+const char *vmm_trace_event_name(u32 id);
+
+/** Format string for arguments of given trace event */
+const char *vmm_trace_event_format(u32 id);
+
+/** Find trace event id using name */
+u32 vmm_trace_event_find(const char *name);
+
+/** Check whether given trace event id is enabled */
+bool vmm_trace_event_isenabled(u32 id);
+
+/** Enable/disable given trace event id
+ *  Note: Per-CPU rings are allocated upon first enable
+ */
+int vmm_trace_event_enable(u32 id, bool enable);
+
+/** Discard all trace entries recorded so far */
+void vmm_trace_clear(void);
+
+/** Retrieve position of oldest available trace entry of a host CPU */
+u32 vmm_trace_first(u32 cpu);
+
+/** Retrieve position after newest trace entry of a host CPU */
+u32 vmm_trace_last(u32 cpu);
+
+/** Read trace entry of a host CPU at given position
+ *  Note: This can be called while tracing is going on. Upon success
+ *  the position is advanced and number of entries overwritten before
+ *  they could be read is added to lost count.
+ *  @returns VMM_OK on success, VMM_ENOENT if no more entries
+ */
+int vmm_trace_read(u32 cpu, u32 *pos,
+		   struct vmm_trace_entry *e, u32 *lost);
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_trace_events.h
+ * @author agent (agent@local)
+ * @brief list of hypervisor trace events.
+ *
+ * This file is included multiple times by vmm_trace.h and vmm_trace.c
+ * with different definition of VMM_TRACE_EVENT() hence it does not
+ * have include guards.
+ *
+ * VMM_TRACE_EVENT(name, proto, args, fmt)
+ * name  - Event name (trace_<name>() is the tracepoint function)
+ * proto - Typed arguments of tracepoint function
+ * args  - Exactly four values recorded in trace entry
+ * fmt   - Format string used to print the four recorded values
+ */
+
+VMM_TRACE_EVENT(sched_switch,
+	VMM_TRACE_PROTO(u32 prev_vcpu, u32 next_vcpu, u32 prev_state),
+	VMM_TRACE_ARGS(prev_vcpu, next_vcpu, prev_state, 0),
+	"prev=%"PRIu64" next=%"PRIu64" prev_state=0x%"PRIx64)
+
+VMM_TRACE_EVENT(vcpu_irq_assert,
+	VMM_TRACE_PROTO(u32 vcpu, u32 irq_no, u64 reason),
+	VMM_TRACE_ARGS(vcpu, irq_no, reason, 0),
+	"vcpu=%"PRIu64" irq=%"PRIu64" reason=0x%"PRIx64)
+
+VMM_TRACE_EVENT(devemu_read,
+	VMM_TRACE_PROTO(u32 vcpu, physical_addr_t gphys, u32 len,
+			u64 nsecs),
+	VMM_TRACE_ARGS(vcpu, gphys, len, nsecs),
+	"vcpu=%"PRIu64" gphys=0x%"PRIx64" len=%"PRIu64" nsecs=%"PRIu64)
+
+VMM_TRACE_EVENT(devemu_write,
+	VMM_TRACE_PROTO(u32 vcpu, physical_addr_t gphys, u32 len,
+			u64 nsecs),
+	VMM_TRACE_ARGS(vcpu, gphys, len, nsecs),
+	"vcpu=%"PRIu64" gphys=0x%"PRIx64" len=%"PRIu64" nsecs=%"PRIu64)
+
+VMM_TRACE_EVENT(virtio_queue_kick,
+	VMM_TRACE_PROTO(u32 guest, u32 dev_type, u32 vq),
+	VMM_TRACE_ARGS(guest, dev_type, vq, 0),
+	"guest=%"PRIu64" dev_type=%"PRIu64" vq=%"PRIu64)
+
+VMM_TRACE_EVENT(virtio_queue_pop,
+	VMM_TRACE_PROTO(virtual_addr_t vq, u16 head, u16 avail_idx),
+	VMM_TRACE_ARGS(vq, head, avail_idx, 0),
+	"vq=0x%"PRIx64" head=%"PRIu64" avail_idx=%"PRIu64)
+
+VMM_TRACE_EVENT(virtio_queue_used,
+	VMM_TRACE_PROTO(virtual_addr_t vq, u32 head, u32 len, u16 used_idx),
+	VMM_TRACE_ARGS(vq, head, len, used_idx),
+	"vq=0x%"PRIx64" head=%"PRIu64" len=%"PRIu64" used_idx=%"PRIu64)
+
+VMM_TRACE_EVENT(smp_ipi_call,
+	VMM_TRACE_PROTO(u32 dst_cpu, virtual_addr_t func, bool sync),
+	VMM_TRACE_ARGS(dst_cpu, func, sync, 0),
+	"dst_cpu=%"PRIu64" func=0x%"PRIx64" sync=%"PRIu64)
+
+VMM_TRACE_EVENT(smp_ipi_exec,
+	VMM_TRACE_PROTO(u32 src_cpu, virtual_addr_t func, bool sync),
+	VMM_TRACE_ARGS(src_cpu, func, sync, 0),
+	"src_cpu=%"PRIu64" func=0x%"PRIx64" sync=%"PRIu64)
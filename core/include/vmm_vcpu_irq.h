@@ -50,6 +50,12 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs);
 /** Current state of Wait for irq on given vcpu */
 bool vmm_vcpu_irq_wait_state(struct vmm_vcpu *vcpu);
 
+/** Retrive halt-polling statistics of given vcpu
+ *  Note: Any of the out pointers can be NULL
+ */
+int vmm_vcpu_irq_wait_poll_stats(struct vmm_vcpu *vcpu, u64 *poll_ns,
+				 u64 *poll_success, u64 *poll_fail);
+
 /** Initialize interrupts for given vcpu */
 int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu);
 
@@ -35,18 +35,39 @@ enum {
 	VMM_WORK_STATE_INPROGRESS=0x4,
 };
 
+/** Workqueue flags */
+enum {
+	/* Works are not bound to the submitting host CPU */
+	VMM_WQ_UNBOUND=0x1,
+	/* Works are executed by high priority workers */
+	VMM_WQ_HIGHPRI=0x2,
+};
+
 struct vmm_work;
 typedef void (*vmm_work_func_t)(struct vmm_work *work);
 struct vmm_workqueue;
+struct vmm_worker_pool;
 
 struct vmm_work {
 	vmm_spinlock_t lock;
 	struct dlist head;
 	u32 flags;
 	struct vmm_workqueue *wq;
+	struct vmm_worker_pool *pool;
+	u64 tstamp;
 	vmm_work_func_t func;
 };
 
+/** Workqueue statistics */
+struct vmm_workqueue_stats {
+	u64 queued_count;
+	u64 executed_count;
+	u64 queue_nsecs_total;
+	u64 queue_nsecs_max;
+	u64 exec_nsecs_total;
+	u64 exec_nsecs_max;
+};
+
 struct vmm_delayed_work {
 	struct vmm_work work;
 	struct vmm_timer_event event;
@@ -57,6 +78,8 @@ struct vmm_delayed_work {
 				INIT_LIST_HEAD(&(w)->head); \
 				(w)->flags = VMM_WORK_STATE_CREATED; \
 				(w)->wq = NULL; \
+				(w)->pool = NULL; \
+				(w)->tstamp = 0; \
 				(w)->func = _f; \
 				} while (0)
 
@@ -70,6 +93,8 @@ struct vmm_delayed_work {
 	.flags = VMM_WORK_STATE_CREATED,				\
 	.head	= { &(n).head, &(n).head },				\
 	.wq = NULL,							\
+	.pool = NULL,							\
+	.tstamp = 0,							\
 	.func = (f),							\
 	}
 
@@ -123,12 +148,29 @@ int vmm_workqueue_stop_work(struct vmm_work *work);
 /** Stop a scheduled or in-progress delayed work */
 int vmm_workqueue_stop_delayed_work(struct vmm_delayed_work *work);
 
-/** Forcefully flush all pending work in a workqueue */
+/** Forcefully flush all pending work in a workqueue
+ *  Note: this can only be called from Orphan VCPU context (including
+ *  works of other workqueues) but not from works of same workqueue.
+ */
 int vmm_workqueue_flush(struct vmm_workqueue *wq);
 
-/** Retrive workqueue instance from workqueue index */
+/** Retrive worker thread of a workqueue created using
+ *  vmm_workqueue_create()
+ *  Note: workqueues sharing worker pools have no thread of their own
+ *  hence NULL is returned for such workqueues.
+ */
 struct vmm_thread *vmm_workqueue_get_thread(struct vmm_workqueue *wq);
 
+/** Retrive name of a workqueue */
+const char *vmm_workqueue_get_name(struct vmm_workqueue *wq);
+
+/** Retrive statistics of a workqueue */
+int vmm_workqueue_get_stats(struct vmm_workqueue *wq,
+			    struct vmm_workqueue_stats *stats);
+
+/** Retrive system workqueue with given flags */
+struct vmm_workqueue *vmm_workqueue_system(u32 flags);
+
 /** Retrive workqueue instance from workqueue index */
 struct vmm_workqueue *vmm_workqueue_index2workqueue(int index);
 
@@ -138,9 +180,30 @@ u32 vmm_workqueue_count(void);
 /** Destroy workqueue */
 int vmm_workqueue_destroy(struct vmm_workqueue *wq);
 
-/** Create workqueue with given name and thread priority */
+/** Create workqueue with given name and thread priority
+ *  Note: Such workqueue has one dedicated worker thread so its
+ *  works are executed one at a time in the order of scheduling.
+ */
 struct vmm_workqueue *vmm_workqueue_create(const char *name, u8 priority);
 
+/** Allocate workqueue with given name and flags
+ *  Note: Such workqueue shares concurrency managed worker pools
+ *  with system workqueues so its works can execute concurrently.
+ */
+struct vmm_workqueue *vmm_workqueue_alloc(const char *name, u32 flags);
+
+/** Notify that given VCPU is about to sleep
+ *  Note: Don't call this function directly it's meant to be called
+ *  from waitqueue only.
+ */
+void vmm_workqueue_worker_sleeping(struct vmm_vcpu *vcpu);
+
+/** Notify that given VCPU woke up after sleeping
+ *  Note: Don't call this function directly it's meant to be called
+ *  from waitqueue only.
+ */
+void vmm_workqueue_worker_waking(struct vmm_vcpu *vcpu);
+
 /** Initialize workqueue framework */
 int vmm_workqueue_init(void);
 
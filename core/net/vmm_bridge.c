@@ -31,6 +31,7 @@
 #include <net/vmm_netswitch.h>
 #include <net/vmm_netport.h>
 #include <libs/stringlib.h>
+#include <libs/rculist.h>
 
 #undef DEBUG_BRIDGE
 
@@ -218,10 +219,8 @@ static int bridge_rx_handler(struct vmm_netswitch *nsw,
 			     struct vmm_netport *src,
 			     struct vmm_mbuf *mbuf)
 {
-	irq_flags_t f;
 	const u8 *srcmac, *dstmac;
 	bool broadcast = TRUE;
-	struct dlist *l, *l1;
 	struct vmm_netport *dst, *port;
 	struct bridge_ctrl *br = nsw->priv;
 
@@ -247,17 +246,14 @@ static int bridge_rx_handler(struct vmm_netswitch *nsw,
 	/* Transfer mbuf to appropriate ports */
 	if (broadcast) {
 		DPRINTF("%s: broadcasting\n", __func__);
-		vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
-		list_for_each_safe(l, l1, &nsw->port_list) {
-			port = list_port(l);
+		vmm_rcu_read_lock();
+		list_for_each_entry_rcu(port, &nsw->port_list, head) {
 			if (port == src) {
 				continue;
 			}
-			vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
 			vmm_switch2port_xfer_mbuf(nsw, port, mbuf);
-			vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
 		}
-		vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+		vmm_rcu_read_unlock();
 	} else {
 		DPRINTF("%s: unicasting to \"%s\"\n", __func__, dst->name);
 		vmm_switch2port_xfer_mbuf(nsw, dst, mbuf);
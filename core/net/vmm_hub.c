@@ -27,6 +27,7 @@
 #include <net/vmm_mbuf.h>
 #include <net/vmm_netswitch.h>
 #include <net/vmm_netport.h>
+#include <libs/rculist.h>
 
 #undef DEBUG_HUB
 
@@ -45,23 +46,18 @@ static int hub_rx_handler(struct vmm_netswitch *nsw,
 			     struct vmm_netport *src,
 			     struct vmm_mbuf *mbuf)
 {
-	irq_flags_t f;
-	struct dlist *l, *l1;
 	struct vmm_netport *port;
 
 	/* Broadcast mbuf to all ports except source port */
 	DPRINTF("%s: broadcasting\n", __func__);
-	vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
-	list_for_each_safe(l, l1, &nsw->port_list) {
-		port = list_port(l);
+	vmm_rcu_read_lock();
+	list_for_each_entry_rcu(port, &nsw->port_list, head) {
 		if (port == src) {
 			continue;
 		}
-		vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
 		vmm_switch2port_xfer_mbuf(nsw, port, mbuf);
-		vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
 	}
-	vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+	vmm_rcu_read_unlock();
 
 	return VMM_OK;
 }
@@ -37,7 +37,7 @@
 #include <net/vmm_protocol.h>
 #include <net/vmm_netswitch.h>
 #include <net/vmm_netport.h>
-#include <libs/list.h>
+#include <libs/rculist.h>
 #include <libs/mathlib.h>
 #include <libs/stringlib.h>
 
@@ -406,7 +406,7 @@ struct vmm_netswitch *vmm_netswitch_alloc(char *name)
 
 	strncpy(nsw->name, name, VMM_FIELD_NAME_SIZE);
 
-	INIT_RW_LOCK(&nsw->port_list_lock);
+	INIT_SPIN_LOCK(&nsw->port_list_lock);
 	INIT_LIST_HEAD(&nsw->port_list);
 
 	goto vmm_netswitch_alloc_done;
@@ -446,9 +446,9 @@ int vmm_netswitch_port_add(struct vmm_netswitch *nsw,
 
 	if (rc == VMM_OK) {
 		/* Add the port to the port_list */
-		vmm_write_lock_irqsave_lite(&nsw->port_list_lock, f);
-		list_add_tail(&port->head, &nsw->port_list);
-		vmm_write_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+		vmm_spin_lock_irqsave_lite(&nsw->port_list_lock, f);
+		list_add_tail_rcu(&port->head, &nsw->port_list);
+		vmm_spin_unlock_irqrestore_lite(&nsw->port_list_lock, f);
 
 		/* Mark this port to belong to the netswitch */
 		port->nsw = nsw;
@@ -492,9 +492,12 @@ static void netswitch_port_remove(struct vmm_netswitch *nsw,
 	}
 
 	/* Remove the port from port_list */
-	vmm_write_lock_irqsave_lite(&nsw->port_list_lock, f);
-	list_del(&port->head);
-	vmm_write_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+	vmm_spin_lock_irqsave_lite(&nsw->port_list_lock, f);
+	list_del_rcu(&port->head);
+	vmm_spin_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+
+	/* Wait for netswitch RX handlers still using this port */
+	vmm_synchronize_rcu();
 
 	/* Call the netswitch's port_remove handler */
 	if (nsw->port_remove) {
@@ -572,17 +575,17 @@ int vmm_netswitch_unregister(struct vmm_netswitch *nsw)
 		return VMM_EFAIL;
 	}
 
-	vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
+	vmm_spin_lock_irqsave_lite(&nsw->port_list_lock, f);
 
 	/* Remove any ports still attached to this nsw */
 	while (!list_empty(&nsw->port_list)) {
 		port = list_port(list_first(&nsw->port_list));
-		vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+		vmm_spin_unlock_irqrestore_lite(&nsw->port_list_lock, f);
 		netswitch_port_remove(nsw, port);
-		vmm_read_lock_irqsave_lite(&nsw->port_list_lock, f);
+		vmm_spin_lock_irqsave_lite(&nsw->port_list_lock, f);
 	}
 
-	vmm_read_unlock_irqrestore_lite(&nsw->port_list_lock, f);
+	vmm_spin_unlock_irqrestore_lite(&nsw->port_list_lock, f);
 
 	return vmm_devdrv_unregister_device(&nsw->dev);
 }
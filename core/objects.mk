@@ -42,6 +42,7 @@ core-objs-y+= vmm_host_vapool.o
 core-objs-y+= vmm_host_aspace.o
 core-objs-y+= vmm_msi.o
 core-objs-y+= vmm_percpu.o
+core-objs-y+= vmm_percpu_counter.o
 core-objs-$(CONFIG_SMP)+= vmm_smp.o
 core-objs-y+= vmm_clocksource.o
 core-objs-y+= vmm_clockchip.o
@@ -58,12 +59,17 @@ core-objs-y+= vmm_semaphore.o
 core-objs-y+= vmm_mutex.o
 core-objs-y+= vmm_notifier.o
 core-objs-y+= vmm_workqueue.o
+core-objs-y+= vmm_rcu.o
 core-objs-y+= vmm_cmdmgr.o
 core-objs-y+= vmm_wallclock.o
 core-objs-y+= vmm_chardev.o
 core-objs-y+= vmm_modules.o
 core-objs-y+= vmm_params.o
 core-objs-$(CONFIG_PROFILE)+= vmm_profiler.o
+core-objs-$(CONFIG_SAMPLE_PROFILE)+= vmm_sampler.o
+core-objs-$(CONFIG_TRACE)+= vmm_trace.o
+core-objs-$(CONFIG_VCPU_EXITSTAT)+= vmm_exitstat.o
+core-objs-$(CONFIG_LOCK_STAT)+= vmm_lockstat.o
 core-objs-$(CONFIG_LOADBAL)+= vmm_loadbal.o
 core-objs-$(CONFIG_IOMMU)+= vmm_iommu.o
 core-objs-y+= vmm_extable.o
@@ -25,9 +25,11 @@
 #include <vmm_compiler.h>
 #include <vmm_heap.h>
 #include <vmm_mutex.h>
+#include <vmm_delay.h>
 #include <vmm_stdio.h>
 #include <vmm_modules.h>
 #include <vio/vmm_vdisk.h>
+#include <arch_atomic.h>
 #include <libs/stringlib.h>
 #include <libs/mathlib.h>
 
@@ -220,6 +222,68 @@ int vmm_vdisk_submit_request(struct vmm_vdisk *vdisk,
 }
 VMM_EXPORT_SYMBOL(vmm_vdisk_submit_request);
 
+int vmm_vdisk_direct_rw(struct vmm_vdisk *vdisk,
+			enum vmm_vdisk_request_type type,
+			u64 lba, u32 data_len,
+			u32 (*copy)(void *va, u32 len, void *priv),
+			void *priv)
+{
+	int rc;
+	void *va;
+	u32 bcnt;
+	irq_flags_t flags;
+	enum vmm_request_type rtype;
+
+	if (!vdisk || !copy) {
+		return VMM_EINVALID;
+	}
+	if (data_len < vdisk->block_size) {
+		return VMM_EINVALID;
+	}
+
+	switch (type) {
+	case VMM_VDISK_REQUEST_READ:
+		rtype = VMM_REQUEST_READ;
+		break;
+	case VMM_VDISK_REQUEST_WRITE:
+		rtype = VMM_REQUEST_WRITE;
+		break;
+	default:
+		return VMM_EINVALID;
+	};
+
+	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
+	if (vdisk->blk) {
+		bcnt = udiv32(data_len, vdisk->block_size) * vdisk->blk_factor;
+		rc = vmm_blockdev_direct_access(vdisk->blk, rtype,
+			(lba + vdisk->blk->start_lba) * vdisk->blk_factor,
+			bcnt, &va);
+		if (!rc) {
+			data_len = bcnt * vdisk->blk->block_size;
+			arch_atomic_inc(&vdisk->direct_count);
+		}
+	} else {
+		rc = VMM_ENODEV;
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+	/* Copy without blk_lock so that other IO on virtual disk is
+	 * not held up. Detaching waits for us to finish.
+	 */
+	if (!rc) {
+		if (copy(va, data_len, priv) != data_len) {
+			rc = VMM_EIO;
+		}
+		arch_atomic_dec(&vdisk->direct_count);
+	}
+
+	DPRINTF("%s: vdisk=%s lba=0x%llx len=%d rc=%d\n",
+		__func__, vdisk->name, lba, data_len, rc);
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_direct_rw);
+
 int vmm_vdisk_abort_request(struct vmm_vdisk *vdisk,
 			    struct vmm_vdisk_request *vreq)
 {
@@ -365,6 +429,14 @@ void vmm_vdisk_attach_block_device(struct vmm_vdisk *vdisk,
 }
 VMM_EXPORT_SYMBOL(vmm_vdisk_attach_block_device);
 
+/* Wait for direct IO copies on memory of detached block device */
+static void vdisk_wait_direct(struct vmm_vdisk *vdisk)
+{
+	while (arch_atomic_read(&vdisk->direct_count)) {
+		vmm_udelay(1);
+	}
+}
+
 void vmm_vdisk_detach_block_device(struct vmm_vdisk *vdisk)
 {
 	bool detached;
@@ -384,6 +456,8 @@ void vmm_vdisk_detach_block_device(struct vmm_vdisk *vdisk)
 	vdisk->blk_factor = 1;
 	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
 
+	vdisk_wait_direct(vdisk);
+
 	if (detached && vdisk->detached) {
 		vdisk->detached(vdisk);
 	}
@@ -443,6 +517,7 @@ struct vmm_vdisk *vmm_vdisk_create(const char *name, u32 block_size,
 	INIT_SPIN_LOCK(&vdisk->blk_lock);
 	vdisk->blk = NULL;
 	vdisk->blk_factor = 1;
+	ARCH_ATOMIC_INIT(&vdisk->direct_count, 0);
 	vdisk->priv = priv;
 
 	list_add_tail(&vdisk->head, &vdctrl.vdisk_list);
@@ -619,6 +694,9 @@ static int vdisk_blk_notification(struct vmm_notifier_block *nb,
 			vdisk->blk_factor = 1;
 		}
 		vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+		/* Block device memory may go away after we return */
+		vdisk_wait_direct(vdisk);
 	}
 
 	/* Unlock virtual disk list */
@@ -25,11 +25,13 @@
 #include <vmm_macros.h>
 #include <vmm_heap.h>
 #include <vmm_mutex.h>
+#include <vmm_host_aspace.h>
 #include <vmm_modules.h>
 #include <vmm_guest_aspace.h>
 #include <vio/vmm_vdisplay.h>
 #include <libs/mathlib.h>
 #include <libs/stringlib.h>
+#include <libs/bitmap.h>
 
 #define MODULE_DESC			"Virtual Display Framework"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -185,6 +187,78 @@ void vmm_pixelformat_init_different_endian(struct vmm_pixelformat *pf, int bpp)
 }
 VMM_EXPORT_SYMBOL(vmm_pixelformat_init_different_endian);
 
+static void __surface_dirty_log_stop(struct vmm_surface *s)
+{
+	if (s->dlog) {
+		vmm_guest_dirty_log_stop(s->dlog);
+		s->dlog = NULL;
+	}
+	if (s->dlog_bmap) {
+		vmm_free(s->dlog_bmap);
+		s->dlog_bmap = NULL;
+	}
+	s->dlog_guest = NULL;
+	s->dlog_gphys = 0;
+	s->dlog_size = 0;
+}
+
+/* Retrive pages of guest framebuffer written since last update.
+ * Returns FALSE if all rows need to be updated.
+ */
+static bool __surface_dirty_log_sync(struct vmm_surface *s,
+				     struct vmm_guest *guest,
+				     physical_addr_t gphys,
+				     physical_size_t size)
+{
+	bool full = s->dlog_full;
+
+	s->dlog_full = FALSE;
+
+	/* Restart dirty logging if guest framebuffer changed */
+	if ((s->dlog_guest != guest) ||
+	    (s->dlog_gphys != gphys) ||
+	    (s->dlog_size != size)) {
+		__surface_dirty_log_stop(s);
+		s->dlog_guest = guest;
+		s->dlog_gphys = gphys;
+		s->dlog_size = size;
+		s->dlog = vmm_guest_dirty_log_start(guest, gphys, size);
+		if (s->dlog) {
+			s->dlog_bmap = vmm_zalloc(
+				bitmap_estimate_size(s->dlog->page_count));
+			if (!s->dlog_bmap) {
+				vmm_guest_dirty_log_stop(s->dlog);
+				s->dlog = NULL;
+			}
+		}
+	}
+
+	if (!s->dlog) {
+		return FALSE;
+	}
+
+	vmm_guest_dirty_log_sync(s->dlog, s->dlog_bmap);
+
+	return !full;
+}
+
+/* Check whether guest framebuffer range [gphys, gphys + len) is dirty */
+static bool __surface_dirty_log_isdirty(struct vmm_surface *s,
+					physical_addr_t gphys, u32 len)
+{
+	u32 pg, last_pg;
+
+	pg = (gphys - s->dlog->gphys_addr) >> VMM_PAGE_SHIFT;
+	last_pg = (gphys + len - 1 - s->dlog->gphys_addr) >> VMM_PAGE_SHIFT;
+	for (; pg <= last_pg; pg++) {
+		if (bitmap_isset(s->dlog_bmap, pg)) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 void vmm_surface_update(struct vmm_surface *s,
 			struct vmm_guest *guest,
 			physical_addr_t src_gphys,
@@ -201,9 +275,11 @@ void vmm_surface_update(struct vmm_surface *s,
 {
 #define CHUNK_SIZE		256
 	u32 len;
-	int i, j;
+	bool use_dlog;
+	int i, j, first, last;
 	int chunk_len, chunk_cols, chunk_dst_row_pitch;
-	u8 *dst, chunk[CHUNK_SIZE];
+	u8 *dst, *row_dst, chunk[CHUNK_SIZE];
+	physical_addr_t row_gphys;
 
 	/* Sanity check */
 	if (!s || !guest || !first_row || !last_row) {
@@ -225,6 +301,10 @@ void vmm_surface_update(struct vmm_surface *s,
 		return;
 	}
 
+	/* Find out guest framebuffer pages written since last update */
+	use_dlog = __surface_dirty_log_sync(s, guest, src_gphys,
+					(physical_size_t)rows * src_width);
+
 	/* Determine dst pointer */
 	dst = vmm_surface_data(s);
 	if (dst_col_pitch < 0) {
@@ -233,13 +313,23 @@ void vmm_surface_update(struct vmm_surface *s,
 	if (dst_row_pitch < 0) {
 		dst -= dst_row_pitch * (rows - 1);
 	}
-	dst += (*first_row) * dst_row_pitch;
-
-	/* Determine src guest physical address */
-	src_gphys += (*first_row) * src_width;
 
-	/* Update surface data in chunks */
+	/* Update surface data of dirty rows in chunks */
+	first = -1;
+	last = -1;
 	for (i = *first_row; i < rows; i++) {
+		row_gphys = src_gphys + (physical_addr_t)i * src_width;
+		row_dst = dst + i * dst_row_pitch;
+
+		if (use_dlog &&
+		    !__surface_dirty_log_isdirty(s, row_gphys, src_width)) {
+			continue;
+		}
+		if (first < 0) {
+			first = i;
+		}
+		last = i;
+
 		j = 0;
 		while (j < src_width) {
 			chunk_len = min(src_width - j, CHUNK_SIZE);
@@ -247,23 +337,25 @@ void vmm_surface_update(struct vmm_surface *s,
 			chunk_len = sdiv32((chunk_cols * src_width), cols);
 			chunk_dst_row_pitch =
 				sdiv32((chunk_len * dst_row_pitch), src_width);
-			
-			len = vmm_guest_memory_read(guest, src_gphys,
+
+			len = vmm_guest_memory_read(guest, row_gphys,
 						    chunk, chunk_len, FALSE);
 			if (len != chunk_len) {
 				goto next_chunk;
 			}
 
-			fn(s, fn_priv, dst, chunk, chunk_cols, dst_col_pitch);
+			fn(s, fn_priv, row_dst, chunk, chunk_cols,
+			   dst_col_pitch);
 
 next_chunk:
 			j += chunk_len;
-			src_gphys += chunk_len;
-			dst += chunk_dst_row_pitch;
+			row_gphys += chunk_len;
+			row_dst += chunk_dst_row_pitch;
 		}
 	}
 
-	*last_row = i;
+	*first_row = first;
+	*last_row = last;
 }
 VMM_EXPORT_SYMBOL(vmm_surface_update);
 
@@ -299,7 +391,13 @@ int vmm_surface_init(struct vmm_surface *s,
 #endif
 	memcpy(&s->pf, pf, sizeof(struct vmm_pixelformat));
 	s->ops = ops;
-	s->priv = NULL;
+	s->priv = priv;
+	s->dlog_guest = NULL;
+	s->dlog_gphys = 0;
+	s->dlog_size = 0;
+	s->dlog_full = FALSE;
+	s->dlog = NULL;
+	s->dlog_bmap = NULL;
 
 	return VMM_OK;
 }
@@ -339,6 +437,8 @@ void vmm_surface_free(struct vmm_surface *s)
 		return;
 	}
 
+	__surface_dirty_log_stop(s);
+
 	vmm_free(s);
 }
 VMM_EXPORT_SYMBOL(vmm_surface_free);
@@ -445,6 +545,9 @@ VMM_EXPORT_SYMBOL(vmm_vdisplay_surface_refresh);
 
 static void __surface_gfx_clear(struct vmm_surface *sf)
 {
+	/* Cleared surface needs full update */
+	sf->dlog_full = TRUE;
+
 	if (sf->ops && sf->ops->gfx_clear) {
 		sf->ops->gfx_clear(sf);
 	}
@@ -509,6 +612,9 @@ VMM_EXPORT_SYMBOL(vmm_vdisplay_surface_gfx_update);
 
 static void __surface_gfx_resize(struct vmm_surface *s, int w, int h)
 {
+	/* Resized surface needs full update */
+	s->dlog_full = TRUE;
+
 	w = max(w, 0);
 	h = max(h, 0);
 
@@ -763,6 +869,7 @@ int vmm_vdisplay_del_surface(struct vmm_vdisplay *vdis,
 	}
 
 	list_del(&sf->head);
+	__surface_dirty_log_stop(sf);
 
 	vmm_spin_unlock_irqrestore(&vdis->surface_list_lock, flags);
 
@@ -854,6 +961,7 @@ int vmm_vdisplay_destroy(struct vmm_vdisplay *vdis)
 		sf = list_first_entry(&vdis->surface_list,
 					struct vmm_surface, head);
 		list_del(&sf->head);
+		__surface_dirty_log_stop(sf);
 	}
 	vmm_spin_unlock_irqrestore(&vdis->surface_list_lock, flags);
 
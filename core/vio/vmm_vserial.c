@@ -26,6 +26,8 @@
 #include <vmm_heap.h>
 #include <vmm_mutex.h>
 #include <vmm_modules.h>
+#include <arch_atomic.h>
+#include <arch_barrier.h>
 #include <vio/vmm_vserial.h>
 #include <libs/stringlib.h>
 
@@ -78,37 +80,183 @@ u32 vmm_vserial_send(struct vmm_vserial *vser, u8 *src, u32 len)
 }
 VMM_EXPORT_SYMBOL(vmm_vserial_send);
 
-u32 vmm_vserial_receive(struct vmm_vserial *vser, u8 *dst, u32 len)
+/* Note: This function must be called with receiver_list_lock held */
+static void __vserial_drain(struct vmm_vserial *vser)
 {
-	u32 i;
-	irq_flags_t flags;
+	u32 i, head, tail, count;
+	u8 batch[VMM_VSERIAL_DRAIN_BATCH];
 	struct vmm_vserial_receiver *receiver;
 
-	if (!vser || !dst) {
-		return 0;
+	while (1) {
+		tail = vser->ring_tail;
+		head = vser->ring_head;
+		arch_smp_rmb();
+		if (head == tail) {
+			break;
+		}
+
+		count = min(head - tail, (u32)VMM_VSERIAL_DRAIN_BATCH);
+		for (i = 0; i < count; i++) {
+			batch[i] = vser->ring[(tail + i) &
+					     (VMM_VSERIAL_RING_SIZE - 1)];
+		}
+
+		/* Release ring space only after reading it */
+		arch_smp_mb();
+		vser->ring_tail = tail + count;
+
+		if (list_empty(&vser->receiver_list)) {
+			for (i = 0; i < count; i++) {
+				fifo_enqueue(vser->receive_fifo,
+					     &batch[i], TRUE);
+			}
+			continue;
+		}
+
+		list_for_each_entry(receiver, &vser->receiver_list, head) {
+			for (i = 0; i < count; i++) {
+				receiver->recv(vser, receiver->priv, batch[i]);
+			}
+		}
+	}
+}
+
+void vmm_vserial_receive_flush(struct vmm_vserial *vser)
+{
+	irq_flags_t flags;
+
+	if (!vser) {
+		return;
 	}
 
 	vmm_spin_lock_irqsave(&vser->receiver_list_lock, flags);
+	__vserial_drain(vser);
+	vmm_spin_unlock_irqrestore(&vser->receiver_list_lock, flags);
+}
+VMM_EXPORT_SYMBOL(vmm_vserial_receive_flush);
 
-	if (list_empty(&vser->receiver_list)) {
-		vmm_spin_unlock_irqrestore(&vser->receiver_list_lock, flags);
+static void vserial_drain_work(struct vmm_work *work)
+{
+	struct vmm_delayed_work *dwork =
+			container_of(work, struct vmm_delayed_work, work);
+	struct vmm_vserial *vser =
+			container_of(dwork, struct vmm_vserial, drain_work);
+
+	/* Producers queueing after this point will schedule again */
+	arch_atomic_write(&vser->drain_pending, 0);
+	arch_smp_mb();
+
+	vmm_vserial_receive_flush(vser);
+}
 
-		for (i = 0; i < len ; i++) {
-			fifo_enqueue(vser->receive_fifo, &dst[i], TRUE);
+/* Copy bytes to guest output ring and return number of bytes copied */
+static u32 vserial_ring_put(struct vmm_vserial *vser, const u8 *src, u32 len)
+{
+	irq_flags_t flags;
+	u32 head, tail, off, space, chunk, done = 0;
+
+	vmm_spin_lock_irqsave(&vser->ring_lock, flags);
+
+	while (done < len) {
+		head = vser->ring_head;
+		tail = vser->ring_tail;
+		arch_smp_mb();
+
+		space = VMM_VSERIAL_RING_SIZE - (head - tail);
+		if (!space) {
+			break;
 		}
 
-		return i;
+		off = head & (VMM_VSERIAL_RING_SIZE - 1);
+		chunk = min(len - done, space);
+		chunk = min(chunk, VMM_VSERIAL_RING_SIZE - off);
+		memcpy(&vser->ring[off], &src[done], chunk);
+
+		/* Publish ring data before moving head */
+		arch_smp_wmb();
+		vser->ring_head = head + chunk;
+		done += chunk;
 	}
 
-	for (i = 0; i < len ; i++) {
-		list_for_each_entry(receiver, &vser->receiver_list, head) {
-			receiver->recv(vser, receiver->priv, dst[i]);
+	vmm_spin_unlock_irqrestore(&vser->ring_lock, flags);
+
+	return done;
+}
+
+/* Queue all bytes to guest output ring */
+static void vserial_queue(struct vmm_vserial *vser, const u8 *src, u32 len)
+{
+	u32 done = 0;
+
+	while (done < len) {
+		done += vserial_ring_put(vser, &src[done], len - done);
+		if (done < len) {
+			/* Ring is full so, deliver to receivers right
+			 * away instead of dropping guest output.
+			 */
+			vmm_vserial_receive_flush(vser);
 		}
 	}
+}
 
-	vmm_spin_unlock_irqrestore(&vser->receiver_list_lock, flags);
+/* Notify receivers after coalescing window */
+static void vserial_notify(struct vmm_vserial *vser)
+{
+	arch_smp_mb();
+	if (!arch_atomic_cmpxchg(&vser->drain_pending, 0, 1)) {
+		vmm_workqueue_schedule_delayed_work(NULL, &vser->drain_work,
+						VMM_VSERIAL_COALESCE_NSECS);
+	}
+}
 
-	return i;
+u32 vmm_vserial_receive_fill(struct vmm_vserial *vser, u32 len,
+			     u32 (*fill) (void *priv, u8 *dst, u32 len),
+			     void *priv)
+{
+	u32 chunk, filled, done;
+	u8 batch[VMM_VSERIAL_FILL_BATCH];
+
+	if (!vser || !fill) {
+		return 0;
+	}
+
+	/* Fill callback runs without any lock held */
+	done = 0;
+	while (done < len) {
+		chunk = min(len - done, (u32)VMM_VSERIAL_FILL_BATCH);
+		filled = fill(priv, batch, chunk);
+		if (filled > chunk) {
+			filled = chunk;
+		}
+
+		vserial_queue(vser, batch, filled);
+		done += filled;
+
+		if (filled < chunk) {
+			break;
+		}
+	}
+
+	if (done) {
+		vserial_notify(vser);
+	}
+
+	return done;
+}
+VMM_EXPORT_SYMBOL(vmm_vserial_receive_fill);
+
+u32 vmm_vserial_receive(struct vmm_vserial *vser, u8 *dst, u32 len)
+{
+	if (!vser || !dst) {
+		return 0;
+	}
+
+	if (len) {
+		vserial_queue(vser, dst, len);
+		vserial_notify(vser);
+	}
+
+	return len;
 }
 VMM_EXPORT_SYMBOL(vmm_vserial_receive);
 
@@ -249,9 +397,18 @@ struct vmm_vserial *vmm_vserial_create(const char *name,
 		return NULL;
 	}
 
+	vser->ring = vmm_malloc(VMM_VSERIAL_RING_SIZE);
+	if (!vser->ring) {
+		fifo_free(vser->receive_fifo);
+		vmm_free(vser);
+		vmm_mutex_unlock(&vsctrl.vser_list_lock);
+		return NULL;
+	}
+
 	INIT_LIST_HEAD(&vser->head);
 	if (strlcpy(vser->name, name, sizeof(vser->name)) >=
 	    sizeof(vser->name)) {
+		vmm_free(vser->ring);
 		fifo_free(vser->receive_fifo);
 		vmm_free(vser);
 		vmm_mutex_unlock(&vsctrl.vser_list_lock);
@@ -261,6 +418,11 @@ struct vmm_vserial *vmm_vserial_create(const char *name,
 	vser->send = send;
 	INIT_SPIN_LOCK(&vser->receiver_list_lock);
 	INIT_LIST_HEAD(&vser->receiver_list);
+	INIT_SPIN_LOCK(&vser->ring_lock);
+	vser->ring_head = 0;
+	vser->ring_tail = 0;
+	ARCH_ATOMIC_INIT(&vser->drain_pending, 0);
+	INIT_DELAYED_WORK(&vser->drain_work, vserial_drain_work);
 	vser->priv = priv;
 
 	list_add_tail(&vser->head, &vsctrl.vser_list);
@@ -288,6 +450,16 @@ int vmm_vserial_destroy(struct vmm_vserial *vser)
 		return VMM_EFAIL;
 	}
 
+	/* Don't let producers schedule drain work anymore and wait
+	 * for drain work which is already scheduled or running.
+	 */
+	arch_atomic_write(&vser->drain_pending, 1);
+	arch_smp_mb();
+	vmm_workqueue_stop_delayed_work(&vser->drain_work);
+
+	/* Deliver queued output to receivers before they go away */
+	vmm_vserial_receive_flush(vser);
+
 	/* Broadcast destroy event */
 	event.vser = vser;
 	event.data = NULL;
@@ -319,6 +491,7 @@ int vmm_vserial_destroy(struct vmm_vserial *vser)
 
 	list_del(&vs->head);
 
+	vmm_free(vs->ring);
 	fifo_free(vs->receive_fifo);
 	vmm_free(vs);
 
@@ -27,6 +27,9 @@
 #include <vmm_host_io.h>
 #include <vmm_host_irq.h>
 #include <vmm_mutex.h>
+#include <vmm_timer.h>
+#include <vmm_trace.h>
+#include <vmm_exitstat.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_devemu.h>
 #include <vmm_devemu_debug.h>
@@ -410,12 +413,18 @@ int vmm_devemu_emulate_read(struct vmm_vcpu *vcpu,
 			    enum vmm_devemu_endianness dst_endian)
 {
 	int rc;
+	u64 tstamp = 0;
 	struct vmm_region *reg;
+	struct vmm_emudev *edev;
 
 	if (!vcpu || !vcpu->guest) {
 		return VMM_EFAIL;
 	}
 
+	if (vmm_trace_enabled(devemu_read)) {
+		tstamp = vmm_timer_timestamp();
+	}
+
 	reg = vmm_guest_find_region(vcpu->guest, gphys_addr,
 			VMM_REGION_VIRTUAL | VMM_REGION_MEMORY, FALSE);
 	if (!reg) {
@@ -423,10 +432,20 @@ int vmm_devemu_emulate_read(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
-	rc = devemu_doread(reg->devemu_priv,
+	edev = reg->devemu_priv;
+	if (edev) {
+		vmm_exitstat_device(vcpu, edev, edev->node->name);
+	}
+
+	rc = devemu_doread(edev,
 			   gphys_addr - reg->gphys_addr,
 			   dst, dst_len, dst_endian);
 skip:
+	if (tstamp) {
+		trace_devemu_read(vcpu->id, gphys_addr, dst_len,
+				  vmm_timer_timestamp() - tstamp);
+	}
+
 	if (rc) {
 		vmm_printf("%s: vcpu=%s gphys=0x%"PRIPADDR" dst_len=%d "
 			   "failed (error %d)\n", __func__,
@@ -443,12 +462,18 @@ int vmm_devemu_emulate_write(struct vmm_vcpu *vcpu,
 			     enum vmm_devemu_endianness src_endian)
 {
 	int rc;
+	u64 tstamp = 0;
 	struct vmm_region *reg;
+	struct vmm_emudev *edev;
 
 	if (!vcpu || !vcpu->guest) {
 		return VMM_EFAIL;
 	}
 
+	if (vmm_trace_enabled(devemu_write)) {
+		tstamp = vmm_timer_timestamp();
+	}
+
 	reg = vmm_guest_find_region(vcpu->guest, gphys_addr,
 			VMM_REGION_VIRTUAL | VMM_REGION_MEMORY, FALSE);
 	if (!reg) {
@@ -456,10 +481,20 @@ int vmm_devemu_emulate_write(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
-	rc = devemu_dowrite(reg->devemu_priv,
+	edev = reg->devemu_priv;
+	if (edev) {
+		vmm_exitstat_device(vcpu, edev, edev->node->name);
+	}
+
+	rc = devemu_dowrite(edev,
 			    gphys_addr - reg->gphys_addr,
 			    src, src_len, src_endian);
 skip:
+	if (tstamp) {
+		trace_devemu_write(vcpu->id, gphys_addr, src_len,
+				   vmm_timer_timestamp() - tstamp);
+	}
+
 	if (rc) {
 		vmm_printf("%s: vcpu=%s gphys=0x%"PRIPADDR" src_len=%d "
 			   "failed (error %d)\n", __func__,
@@ -477,6 +512,7 @@ int vmm_devemu_emulate_ioread(struct vmm_vcpu *vcpu,
 {
 	int rc;
 	struct vmm_region *reg;
+	struct vmm_emudev *edev;
 
 	if (!vcpu || !vcpu->guest) {
 		return VMM_EFAIL;
@@ -489,7 +525,12 @@ int vmm_devemu_emulate_ioread(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
-	rc = devemu_doread(reg->devemu_priv,
+	edev = reg->devemu_priv;
+	if (edev) {
+		vmm_exitstat_device(vcpu, edev, edev->node->name);
+	}
+
+	rc = devemu_doread(edev,
 			   gphys_addr - reg->gphys_addr,
 			   dst, dst_len, dst_endian);
 skip:
@@ -510,6 +551,7 @@ int vmm_devemu_emulate_iowrite(struct vmm_vcpu *vcpu,
 {
 	int rc;
 	struct vmm_region *reg;
+	struct vmm_emudev *edev;
 
 	if (!vcpu || !vcpu->guest) {
 		return VMM_EFAIL;
@@ -522,7 +564,12 @@ int vmm_devemu_emulate_iowrite(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
-	rc = devemu_dowrite(reg->devemu_priv,
+	edev = reg->devemu_priv;
+	if (edev) {
+		vmm_exitstat_device(vcpu, edev, edev->node->name);
+	}
+
+	rc = devemu_dowrite(edev,
 			    gphys_addr - reg->gphys_addr,
 			    src, src_len, src_endian);
 skip:
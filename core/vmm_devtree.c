@@ -32,14 +32,235 @@
 #include <libs/mathlib.h>
 #include <libs/stringlib.h>
 
+#define DEVTREE_PHANDLE_HASH_SIZE	64
+#define DEVTREE_COMPAT_HASH_SIZE	64
+#define DEVTREE_PATH_CACHE_SIZE		32
+#define DEVTREE_PATH_CACHE_MAXLEN	64
+#define DEVTREE_ATTR_HASH_SIZE		16
+#define DEVTREE_ATTR_HASH_THRESHOLD	8
+
+struct devtree_compat_entry {
+	struct dlist head;
+	struct dlist node_head;
+	struct vmm_devtree_node *node;
+	const char *compat;
+};
+
+struct devtree_path_cache {
+	char path[DEVTREE_PATH_CACHE_MAXLEN];
+	struct vmm_devtree_node *node;
+};
+
 struct vmm_devtree_ctrl {
         struct vmm_devtree_node *root;
 	u32 nidtbl_count;
 	struct vmm_devtree_nidtbl_entry *nidtbl;
+	/* Lookup indexes protected by index_lock */
+	vmm_rwlock_t index_lock;
+	bool compat_index_broken;
+	struct dlist phandle_hash[DEVTREE_PHANDLE_HASH_SIZE];
+	struct dlist compat_hash[DEVTREE_COMPAT_HASH_SIZE];
+	struct devtree_path_cache path_cache[DEVTREE_PATH_CACHE_SIZE];
 };
 
 static struct vmm_devtree_ctrl dtree_ctrl;
 
+static u32 devtree_hash_string(const char *str, u32 max)
+{
+	u32 hash = 5381;
+
+	while (max-- && *str) {
+		hash = ((hash << 5) + hash) + (u8)*str++;
+	}
+
+	return hash;
+}
+
+static void devtree_phandle_unindex(struct vmm_devtree_node *node)
+{
+	irq_flags_t flags;
+
+	vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	if (!list_empty(&node->phandle_head)) {
+		list_del_init(&node->phandle_head);
+	}
+	vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+}
+
+static void devtree_phandle_index(struct vmm_devtree_node *node)
+{
+	u32 phnd;
+	irq_flags_t flags;
+
+	devtree_phandle_unindex(node);
+
+	if (vmm_devtree_read_u32(node, VMM_DEVTREE_PHANDLE_ATTR_NAME, &phnd)) {
+		return;
+	}
+
+	vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	node->phandle = phnd;
+	list_add_tail(&node->phandle_head,
+		&dtree_ctrl.phandle_hash[phnd & (DEVTREE_PHANDLE_HASH_SIZE - 1)]);
+	vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+}
+
+static void devtree_compat_unindex(struct vmm_devtree_node *node)
+{
+	irq_flags_t flags;
+	struct devtree_compat_entry *e, *en;
+
+	vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	list_for_each_entry_safe(e, en, &node->compat_list, node_head) {
+		list_del(&e->head);
+		list_del(&e->node_head);
+		vmm_free(e);
+	}
+	vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+}
+
+static void devtree_compat_index(struct vmm_devtree_node *node)
+{
+	u32 h;
+	int cplen, l;
+	const char *cp;
+	irq_flags_t flags;
+	struct devtree_compat_entry *e;
+
+	devtree_compat_unindex(node);
+
+	cp = vmm_devtree_attrval(node, VMM_DEVTREE_COMPATIBLE_ATTR_NAME);
+	cplen = vmm_devtree_attrlen(node, VMM_DEVTREE_COMPATIBLE_ATTR_NAME);
+	if (cp == NULL)
+		return;
+	while (cplen > 0) {
+		e = vmm_zalloc(sizeof(*e));
+		if (!e) {
+			/* Incomplete index so always walk the tree */
+			dtree_ctrl.compat_index_broken = TRUE;
+			return;
+		}
+		e->node = node;
+		e->compat = cp;
+		h = devtree_hash_string(cp, cplen);
+
+		vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+		list_add_tail(&e->head,
+		&dtree_ctrl.compat_hash[h & (DEVTREE_COMPAT_HASH_SIZE - 1)]);
+		list_add_tail(&e->node_head, &node->compat_list);
+		vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+
+		l = strlen(cp) + 1;
+		cp += l;
+		cplen -= l;
+	}
+}
+
+static void devtree_path_cache_forget(struct vmm_devtree_node *node)
+{
+	u32 i;
+	irq_flags_t flags;
+
+	vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	for (i = 0; i < DEVTREE_PATH_CACHE_SIZE; i++) {
+		if (dtree_ctrl.path_cache[i].node == node) {
+			dtree_ctrl.path_cache[i].node = NULL;
+		}
+	}
+	vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+}
+
+/* Checks whether node is anc or one of its descendants */
+static bool devtree_node_is_under(const struct vmm_devtree_node *node,
+				  const struct vmm_devtree_node *anc)
+{
+	while (node && (node != anc)) {
+		node = node->parent;
+	}
+
+	return (node) ? TRUE : FALSE;
+}
+
+static struct vmm_devtree_attr *devtree_find_attr(
+					const struct vmm_devtree_node *node,
+					const char *name)
+{
+	u32 h;
+	irq_flags_t flags;
+	struct vmm_devtree_attr *attr, *ret = NULL;
+	struct vmm_devtree_node *np = (struct vmm_devtree_node *)node;
+
+	vmm_read_lock_irqsave_lite(&np->attr_lock, flags);
+	if (np->attr_hash) {
+		h = devtree_hash_string(name, VMM_FIELD_SHORT_NAME_SIZE);
+		list_for_each_entry(attr,
+			&np->attr_hash[h & (DEVTREE_ATTR_HASH_SIZE - 1)],
+			hash_head) {
+			if (strcmp(attr->name, name) == 0) {
+				ret = attr;
+				break;
+			}
+		}
+	} else {
+		list_for_each_entry(attr, &np->attr_list, head) {
+			if (strcmp(attr->name, name) == 0) {
+				ret = attr;
+				break;
+			}
+		}
+	}
+	vmm_read_unlock_irqrestore_lite(&np->attr_lock, flags);
+
+	return ret;
+}
+
+static void devtree_attr_hash_add(struct vmm_devtree_node *node,
+				  struct vmm_devtree_attr *attr)
+{
+	u32 h = devtree_hash_string(attr->name, sizeof(attr->name));
+
+	list_add_tail(&attr->hash_head,
+		      &node->attr_hash[h & (DEVTREE_ATTR_HASH_SIZE - 1)]);
+}
+
+static void devtree_add_attr(struct vmm_devtree_node *node,
+			     struct vmm_devtree_attr *attr)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct dlist *hash = NULL;
+	struct vmm_devtree_attr *a;
+
+	/* Nodes with many attributes get hashed attribute lookup */
+	if (!node->attr_hash &&
+	    (DEVTREE_ATTR_HASH_THRESHOLD <= node->attr_count)) {
+		hash = vmm_malloc(DEVTREE_ATTR_HASH_SIZE * sizeof(*hash));
+		if (hash) {
+			for (i = 0; i < DEVTREE_ATTR_HASH_SIZE; i++) {
+				INIT_LIST_HEAD(&hash[i]);
+			}
+		}
+	}
+
+	vmm_write_lock_irqsave_lite(&node->attr_lock, flags);
+	list_add_tail(&attr->head, &node->attr_list);
+	node->attr_count++;
+	if (node->attr_hash) {
+		devtree_attr_hash_add(node, attr);
+	} else if (hash) {
+		node->attr_hash = hash;
+		hash = NULL;
+		list_for_each_entry(a, &node->attr_list, head) {
+			devtree_attr_hash_add(node, a);
+		}
+	}
+	vmm_write_unlock_irqrestore_lite(&node->attr_lock, flags);
+
+	if (hash) {
+		vmm_free(hash);
+	}
+}
+
 bool vmm_devtree_isliteral(u32 attrtype)
 {
 	bool ret = FALSE;
@@ -205,13 +426,9 @@ const void *vmm_devtree_attrval(const struct vmm_devtree_node *node,
 		return NULL;
 	}
 
-	vmm_devtree_for_each_attr(attr, node) {
-		if (strcmp(attr->name, attrib) == 0) {
-			return attr->value;
-		}
-	}
+	attr = devtree_find_attr(node, attrib);
 
-	return NULL;
+	return (attr) ? attr->value : NULL;
 }
 
 u32 vmm_devtree_attrlen(const struct vmm_devtree_node *node,
@@ -223,13 +440,9 @@ u32 vmm_devtree_attrlen(const struct vmm_devtree_node *node,
 		return 0;
 	}
 
-	vmm_devtree_for_each_attr(attr, node) {
-		if (strcmp(attr->name, attrib) == 0) {
-			return attr->len;
-		}
-	}
+	attr = devtree_find_attr(node, attrib);
 
-	return 0;
+	return (attr) ? attr->len : 0;
 }
 
 bool vmm_devtree_have_attr(const struct vmm_devtree_node *node)
@@ -278,35 +491,21 @@ struct vmm_devtree_attr *vmm_devtree_next_attr(
 	return ret;
 }
 
-int vmm_devtree_setattr(struct vmm_devtree_node *node,
-			const char *name, void *value,
-			u32 type, u32 len, bool value_is_be)
+static int devtree_setattr(struct vmm_devtree_node *node,
+			   const char *name, void *value,
+			   u32 type, u32 len, bool value_is_be)
 {
 	u32 i, sz, cnt;
-	bool found;
-	irq_flags_t flags;
 	struct vmm_devtree_attr *attr;
 
-	if (!node || !name ||
-	    (len && !value) ||
-	    (VMM_DEVTREE_MAX_ATTRTYPE <= type)) {
-		return VMM_EINVALID;
-	}
-
-	found = FALSE;
-	vmm_devtree_for_each_attr(attr, node) {
-		if (strcmp(attr->name, name) == 0) {
-			found = TRUE;
-			break;
-		}
-	}
-
-	if (!found) {
+	attr = devtree_find_attr(node, name);
+	if (!attr) {
 		attr = vmm_malloc(sizeof(struct vmm_devtree_attr));
 		if (!attr) {
 			return VMM_ENOMEM;
 		}
 		INIT_LIST_HEAD(&attr->head);
+		INIT_LIST_HEAD(&attr->hash_head);
 		attr->len = len;
 		attr->type = type;
 		strncpy(attr->name, name, sizeof(attr->name));
@@ -320,9 +519,7 @@ int vmm_devtree_setattr(struct vmm_devtree_node *node,
 		} else {
 			attr->value = NULL;
 		}
-		vmm_write_lock_irqsave_lite(&node->attr_lock, flags);
-		list_add_tail(&attr->head, &node->attr_list);
-		vmm_write_unlock_irqrestore_lite(&node->attr_lock, flags);
+		devtree_add_attr(node, attr);
 	} else {
 		attr->type = type;
 		if (attr->len != len) {
@@ -413,23 +610,47 @@ int vmm_devtree_setattr(struct vmm_devtree_node *node,
 	return VMM_OK;
 }
 
+int vmm_devtree_setattr(struct vmm_devtree_node *node,
+			const char *name, void *value,
+			u32 type, u32 len, bool value_is_be)
+{
+	int rc;
+	bool is_compat;
+
+	if (!node || !name ||
+	    (len && !value) ||
+	    (VMM_DEVTREE_MAX_ATTRTYPE <= type)) {
+		return VMM_EINVALID;
+	}
+
+	/* Compatible index points into attribute value
+	 * so drop it before the value gets updated.
+	 */
+	is_compat = (strcmp(name, VMM_DEVTREE_COMPATIBLE_ATTR_NAME) == 0);
+	if (is_compat) {
+		devtree_compat_unindex(node);
+	}
+
+	rc = devtree_setattr(node, name, value, type, len, value_is_be);
+
+	if (is_compat) {
+		devtree_compat_index(node);
+	} else if (strcmp(name, VMM_DEVTREE_PHANDLE_ATTR_NAME) == 0) {
+		devtree_phandle_index(node);
+	}
+
+	return rc;
+}
+
 struct vmm_devtree_attr *vmm_devtree_getattr(
 					const struct vmm_devtree_node *node,
 					const char *name)
 {
-	struct vmm_devtree_attr *attr;
-
 	if (!node || !name) {
 		return NULL;
 	}
 
-	vmm_devtree_for_each_attr(attr, node) {
-		if (strcmp(attr->name, name) == 0) {
-			return attr;
-		}
-	}
-
-	return NULL;
+	return devtree_find_attr(node, name);
 }
 
 int vmm_devtree_delattr(struct vmm_devtree_node *node, const char *name)
@@ -446,14 +667,24 @@ int vmm_devtree_delattr(struct vmm_devtree_node *node, const char *name)
 		return VMM_EFAIL;
 	}
 
-	if (attr->value) {
-		vmm_free(attr->value);
+	if (strcmp(attr->name, VMM_DEVTREE_COMPATIBLE_ATTR_NAME) == 0) {
+		devtree_compat_unindex(node);
+	} else if (strcmp(attr->name, VMM_DEVTREE_PHANDLE_ATTR_NAME) == 0) {
+		devtree_phandle_unindex(node);
 	}
 
 	vmm_write_lock_irqsave_lite(&node->attr_lock, flags);
 	list_del(&attr->head);
+	if (node->attr_hash) {
+		list_del(&attr->hash_head);
+	}
+	node->attr_count--;
 	vmm_write_unlock_irqrestore_lite(&node->attr_lock, flags);
 
+	if (attr->value) {
+		vmm_free(attr->value);
+	}
+
 	vmm_free(attr);
 
 	return VMM_OK;
@@ -1189,8 +1420,68 @@ struct vmm_devtree_node *vmm_devtree_getchild(struct vmm_devtree_node *node,
 	return np;
 }
 
+static struct vmm_devtree_node *devtree_path_cache_get(const char *path,
+							u32 *index)
+{
+	u32 len;
+	irq_flags_t flags;
+	struct devtree_path_cache *pc;
+	struct vmm_devtree_node *ret = NULL, *stale = NULL;
+
+	len = strlen(path);
+	if (DEVTREE_PATH_CACHE_MAXLEN <= len) {
+		*index = DEVTREE_PATH_CACHE_SIZE;
+		return NULL;
+	}
+
+	*index = devtree_hash_string(path, len) &
+					(DEVTREE_PATH_CACHE_SIZE - 1);
+	pc = &dtree_ctrl.path_cache[*index];
+
+	vmm_read_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	if (pc->node && (strcmp(pc->path, path) == 0)) {
+		stale = pc->node;
+		if (devtree_node_is_under(stale, dtree_ctrl.root)) {
+			ret = stale;
+			stale = NULL;
+			vmm_devtree_ref_node(ret);
+		}
+	}
+	vmm_read_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+
+	/* Evict node which is no longer part of device tree */
+	if (stale) {
+		vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+		if (pc->node == stale) {
+			pc->node = NULL;
+		}
+		vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+	}
+
+	return ret;
+}
+
+static void devtree_path_cache_set(const char *path, u32 index,
+				   struct vmm_devtree_node *node)
+{
+	irq_flags_t flags;
+	struct devtree_path_cache *pc;
+
+	if (DEVTREE_PATH_CACHE_SIZE <= index) {
+		return;
+	}
+	pc = &dtree_ctrl.path_cache[index];
+
+	vmm_write_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	strlcpy(pc->path, path, sizeof(pc->path));
+	pc->node = node;
+	vmm_write_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+}
+
 struct vmm_devtree_node *vmm_devtree_getnode(const char *path)
 {
+	u32 index;
+	const char *cpath = path;
 	struct vmm_devtree_node *node = dtree_ctrl.root;
 
 	if (!node)
@@ -1201,6 +1492,12 @@ struct vmm_devtree_node *vmm_devtree_getnode(const char *path)
 		return node;
 	}
 
+	node = devtree_path_cache_get(cpath, &index);
+	if (node) {
+		return node;
+	}
+	node = dtree_ctrl.root;
+
 	if (strncmp(node->name, path, strlen(node->name)) != 0)
 		return NULL;
 
@@ -1213,7 +1510,12 @@ struct vmm_devtree_node *vmm_devtree_getnode(const char *path)
 			path++;
 	}
 
-	return vmm_devtree_getchild(node, path);
+	node = vmm_devtree_getchild(node, path);
+	if (node) {
+		devtree_path_cache_set(cpath, index, node);
+	}
+
+	return node;
 }
 
 const struct vmm_devtree_nodeid *vmm_devtree_match_node(
@@ -1309,11 +1611,60 @@ void vmm_devtree_iterate_matching(struct vmm_devtree_node *node,
 	vmm_devtree_dref_node(node);
 }
 
+static struct vmm_devtree_node *devtree_find_compatible_indexed(
+				struct vmm_devtree_node *node,
+				const char *device_type,
+				const char *compatible,
+				u32 *count)
+{
+	u32 h;
+	const char *type;
+	irq_flags_t flags;
+	struct devtree_compat_entry *e;
+	struct vmm_devtree_node *ret = NULL;
+
+	if (!node) {
+		node = dtree_ctrl.root;
+	}
+
+	*count = 0;
+	h = devtree_hash_string(compatible, VMM_FIELD_COMPAT_SIZE);
+
+	vmm_read_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	list_for_each_entry(e,
+		&dtree_ctrl.compat_hash[h & (DEVTREE_COMPAT_HASH_SIZE - 1)],
+		head) {
+		if ((e->node == ret) || strcmp(e->compat, compatible)) {
+			continue;
+		}
+		if (device_type) {
+			type = vmm_devtree_attrval(e->node,
+					VMM_DEVTREE_DEVICE_TYPE_ATTR_NAME);
+			if (!type || strcmp(type, device_type)) {
+				continue;
+			}
+		}
+		if (!devtree_node_is_under(e->node, node)) {
+			continue;
+		}
+		ret = e->node;
+		(*count)++;
+	}
+	if (*count == 1) {
+		vmm_devtree_ref_node(ret);
+	}
+	vmm_read_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+
+	return (*count == 1) ? ret : NULL;
+}
+
 struct vmm_devtree_node *vmm_devtree_find_compatible(
 				struct vmm_devtree_node *node,
 				const char *device_type,
 				const char *compatible)
 {
+	u32 count;
+	struct vmm_devtree_node *ret;
 	struct vmm_devtree_nodeid id[2];
 
 	if (!compatible) {
@@ -1334,6 +1685,15 @@ struct vmm_devtree_node *vmm_devtree_find_compatible(
 		return NULL;
 	}
 
+	if (!dtree_ctrl.compat_index_broken) {
+		ret = devtree_find_compatible_indexed(node, device_type,
+						      compatible, &count);
+		if (count <= 1) {
+			return ret;
+		}
+	}
+
+	/* Several candidates so walk the tree to get first one */
 	return vmm_devtree_find_matching(node, id);
 }
 
@@ -1393,9 +1753,34 @@ done:
 
 struct vmm_devtree_node *vmm_devtree_find_node_by_phandle(u32 phandle)
 {
+	u32 count = 0;
+	irq_flags_t flags;
+	struct vmm_devtree_node *np, *ret = NULL;
+
 	if (!dtree_ctrl.root) {
 		return NULL;
 	}
+
+	vmm_read_lock_irqsave_lite(&dtree_ctrl.index_lock, flags);
+	list_for_each_entry(np,
+		&dtree_ctrl.phandle_hash[phandle & (DEVTREE_PHANDLE_HASH_SIZE - 1)],
+		phandle_head) {
+		if ((np->phandle == phandle) &&
+		    devtree_node_is_under(np, dtree_ctrl.root)) {
+			ret = np;
+			count++;
+		}
+	}
+	if (count == 1) {
+		vmm_devtree_ref_node(ret);
+	}
+	vmm_read_unlock_irqrestore_lite(&dtree_ctrl.index_lock, flags);
+
+	if (count <= 1) {
+		return ret;
+	}
+
+	/* Duplicate phandles so walk the tree to get first one */
 	return recursive_find_node_by_phandle(dtree_ctrl.root, phandle);
 }
 
@@ -1599,6 +1984,8 @@ void vmm_devtree_dref_node(struct vmm_devtree_node *node)
 		dtree_ctrl.root = NULL;
 	}
 
+	devtree_path_cache_forget(node);
+
 	vmm_read_lock_irqsave_lite(&node->attr_lock, flags);
 	list_for_each_entry_safe(attr, attr_next,
 				 &node->attr_list, head) {
@@ -1621,6 +2008,10 @@ void vmm_devtree_dref_node(struct vmm_devtree_node *node)
 		vmm_devtree_dref_node(parent);
 	}
 
+	if (node->attr_hash) {
+		vmm_free(node->attr_hash);
+	}
+
 	vmm_free(node);
 }
 
@@ -1726,6 +2117,8 @@ struct vmm_devtree_node *vmm_devtree_addnode(struct vmm_devtree_node *parent,
 	INIT_LIST_HEAD(&node->attr_list);
 	INIT_RW_LOCK(&node->child_lock);
 	INIT_LIST_HEAD(&node->child_list);
+	INIT_LIST_HEAD(&node->phandle_head);
+	INIT_LIST_HEAD(&node->compat_list);
 	arch_atomic_write(&node->ref_count, 1);
 	strncpy(node->name, name, sizeof(node->name));
 	node->parent = NULL;
@@ -1821,6 +2214,9 @@ int vmm_devtree_delnode(struct vmm_devtree_node *node)
 	}
 	vmm_read_unlock_irqrestore_lite(&node->child_lock, flags);
 
+	/* Deleted node must not be found by path anymore */
+	devtree_path_cache_forget(node);
+
 	vmm_devtree_dref_node(node);
 
 	return VMM_OK;
@@ -2002,13 +2398,20 @@ void vmm_devtree_nidtbl_destroy_matches(
 int __init vmm_devtree_init(void)
 {
 	int rc;
-	u32 nidtbl_cnt;
+	u32 i, nidtbl_cnt;
 	virtual_addr_t ca, nidtbl_va;
 	virtual_size_t nidtbl_sz;
 	struct vmm_devtree_nidtbl_entry *nide, *tnide;
 
 	/* Reset the control structure */
 	memset(&dtree_ctrl, 0, sizeof(dtree_ctrl));
+	INIT_RW_LOCK(&dtree_ctrl.index_lock);
+	for (i = 0; i < DEVTREE_PHANDLE_HASH_SIZE; i++) {
+		INIT_LIST_HEAD(&dtree_ctrl.phandle_hash[i]);
+	}
+	for (i = 0; i < DEVTREE_COMPAT_HASH_SIZE; i++) {
+		INIT_LIST_HEAD(&dtree_ctrl.compat_hash[i]);
+	}
 
 	/* Populate Board Specific Device Tree */
 	rc = arch_devtree_populate(&dtree_ctrl.root);
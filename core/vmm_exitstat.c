@@ -0,0 +1,228 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_exitstat.c
+ * @author agent (agent@local)
+ * @brief source file of VCPU exit statistics.
+ *
+ * Exit statistics of a VCPU are only updated by the host CPU running
+ * the VCPU so the per-VCPU lock is uncontended except when statistics
+ * are being read or reset.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_exitstat.h>
+#include <vmm_modules.h>
+#include <libs/stringlib.h>
+
+static const char *exitstat_class_names[VMM_EXIT_MAX] = {
+	[VMM_EXIT_MMIO] = "mmio",
+	[VMM_EXIT_PAGEFAULT] = "pagefault",
+	[VMM_EXIT_IO] = "io",
+	[VMM_EXIT_SYSREG] = "sysreg",
+	[VMM_EXIT_HVC] = "hvc",
+	[VMM_EXIT_WFI] = "wfi",
+	[VMM_EXIT_IRQ] = "irq",
+	[VMM_EXIT_INSN] = "insn",
+	[VMM_EXIT_EXCEPTION] = "exception",
+	[VMM_EXIT_FPU] = "fpu",
+	[VMM_EXIT_OTHER] = "other",
+};
+
+const char *vmm_exitstat_class_name(u32 exit_class)
+{
+	return (exit_class < VMM_EXIT_MAX) ?
+			exitstat_class_names[exit_class] : NULL;
+}
+VMM_EXPORT_SYMBOL(vmm_exitstat_class_name);
+
+static void exitstat_hist_update(struct vmm_exitstat_hist *h, u64 nsecs)
+{
+	u32 b = 0;
+	u64 n = nsecs;
+
+	while ((n >>= 1) && (b < (VMM_EXITSTAT_HIST_SIZE - 1))) {
+		b++;
+	}
+
+	h->count++;
+	h->total_nsecs += nsecs;
+	if (h->max_nsecs < nsecs) {
+		h->max_nsecs = nsecs;
+	}
+	h->bucket[b]++;
+}
+
+static struct vmm_exitstat_device *exitstat_find_device(
+						struct vmm_exitstat *es,
+						void *edev, const char *name)
+{
+	u32 i;
+	struct vmm_exitstat_device *d;
+
+	for (i = 0; i < es->device_count; i++) {
+		if (es->devices[i].edev == edev) {
+			return &es->devices[i];
+		}
+	}
+
+	if (VMM_EXITSTAT_MAX_DEVICES <= es->device_count) {
+		return NULL;
+	}
+
+	d = &es->devices[es->device_count++];
+	d->edev = edev;
+	if (name) {
+		strncpy(d->name, name, sizeof(d->name));
+		d->name[sizeof(d->name) - 1] = '\0';
+	}
+
+	return d;
+}
+
+void vmm_exitstat_end(struct vmm_vcpu *vcpu, u32 exit_class, u64 tstamp)
+{
+	u64 nsecs;
+	irq_flags_t flags;
+	struct vmm_exitstat *es;
+	struct vmm_exitstat_device *d;
+
+	if (!tstamp || !vcpu || !vcpu->exitstat) {
+		return;
+	}
+	es = vcpu->exitstat;
+	nsecs = vmm_timer_timestamp() - tstamp;
+
+	if (VMM_EXIT_MAX <= exit_class) {
+		exit_class = VMM_EXIT_OTHER;
+	}
+
+	vmm_spin_lock_irqsave_lite(&es->lock, flags);
+
+	if (es->cur_edev) {
+		if (exit_class == VMM_EXIT_PAGEFAULT) {
+			exit_class = VMM_EXIT_MMIO;
+		}
+		d = exitstat_find_device(es, es->cur_edev, es->cur_edev_name);
+		if (d) {
+			exitstat_hist_update(&d->hist, nsecs);
+		}
+		es->cur_edev = NULL;
+		es->cur_edev_name = NULL;
+	}
+
+	exitstat_hist_update(&es->exits[exit_class], nsecs);
+
+	vmm_spin_unlock_irqrestore_lite(&es->lock, flags);
+}
+VMM_EXPORT_SYMBOL(vmm_exitstat_end);
+
+void vmm_exitstat_device(struct vmm_vcpu *vcpu, void *edev,
+			 const char *name)
+{
+	if (!vcpu || !vcpu->exitstat) {
+		return;
+	}
+
+	/* Only updated by host CPU running the VCPU */
+	vcpu->exitstat->cur_edev = edev;
+	vcpu->exitstat->cur_edev_name = name;
+}
+VMM_EXPORT_SYMBOL(vmm_exitstat_device);
+
+void vmm_exitstat_init(struct vmm_vcpu *vcpu)
+{
+	struct vmm_exitstat *es;
+
+	if (!vcpu || !vcpu->is_normal || vcpu->exitstat) {
+		return;
+	}
+
+	/* Exit statistics are optional so failure is not fatal */
+	es = vmm_zalloc(sizeof(*es));
+	if (!es) {
+		return;
+	}
+	INIT_SPIN_LOCK(&es->lock);
+	es->reset_tstamp = vmm_timer_timestamp();
+
+	vcpu->exitstat = es;
+}
+
+void vmm_exitstat_deinit(struct vmm_vcpu *vcpu)
+{
+	struct vmm_exitstat *es;
+
+	if (!vcpu || !vcpu->exitstat) {
+		return;
+	}
+
+	es = vcpu->exitstat;
+	vcpu->exitstat = NULL;
+	vmm_free(es);
+}
+
+int vmm_exitstat_reset(struct vmm_vcpu *vcpu)
+{
+	irq_flags_t flags;
+	struct vmm_exitstat *es;
+
+	if (!vcpu) {
+		return VMM_EINVALID;
+	}
+	if (!vcpu->exitstat) {
+		return VMM_ENOTAVAIL;
+	}
+	es = vcpu->exitstat;
+
+	vmm_spin_lock_irqsave_lite(&es->lock, flags);
+	memset(es->exits, 0, sizeof(es->exits));
+	memset(es->devices, 0, sizeof(es->devices));
+	es->device_count = 0;
+	es->reset_tstamp = vmm_timer_timestamp();
+	vmm_spin_unlock_irqrestore_lite(&es->lock, flags);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_exitstat_reset);
+
+int vmm_exitstat_snapshot(struct vmm_vcpu *vcpu, struct vmm_exitstat *out)
+{
+	irq_flags_t flags;
+	struct vmm_exitstat *es;
+
+	if (!vcpu || !out) {
+		return VMM_EINVALID;
+	}
+	if (!vcpu->exitstat) {
+		return VMM_ENOTAVAIL;
+	}
+	es = vcpu->exitstat;
+
+	vmm_spin_lock_irqsave_lite(&es->lock, flags);
+	memcpy(out, es, sizeof(*out));
+	vmm_spin_unlock_irqrestore_lite(&es->lock, flags);
+
+	INIT_SPIN_LOCK(&out->lock);
+	out->cur_edev = NULL;
+	out->cur_edev_name = NULL;
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_exitstat_snapshot);
@@ -33,9 +33,14 @@
 #include <vmm_host_aspace.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_stdio.h>
+#include <vmm_mutex.h>
+#include <vmm_threads.h>
+#include <vmm_completion.h>
 #include <vmm_notifier.h>
 #include <arch_guest.h>
 #include <libs/stringlib.h>
+#include <libs/mathlib.h>
+#include <libs/bitmap.h>
 
 static BLOCKING_NOTIFIER_CHAIN(guest_aspace_notifier_chain);
 
@@ -148,135 +153,2095 @@ done:
 	return reg;
 }
 
+/* On-demand RAM regions are populated in blocks of guest physical
+ * address space. A block fully covered by region is backed by one
+ * naturally aligned host RAM block so that it can be mapped using
+ * a single stage2 (or nested) block mapping. Blocks partially covered
+ * by region or blocks for which host RAM is too fragmented are backed
+ * page-by-page.
+ */
+#define ONDEMAND_BLOCK_SHIFT		21
+#define ONDEMAND_BLOCK_SIZE		(1UL << ONDEMAND_BLOCK_SHIFT)
+#define ONDEMAND_BLOCK_PAGES		(ONDEMAND_BLOCK_SIZE >> VMM_PAGE_SHIFT)
+
+/* Flags in low bits of block and page entries. Pages which are merged
+ * with identical pages (shared) or about to be merged (write protected)
+ * are always backed page-by-page. Pinned blocks and pages are handed
+ * out by vmm_guest_physical_map() hence they are never merged.
+ */
+#define ONDEMAND_PRESENT		0x1
+#define ONDEMAND_SHARED			0x2
+#define ONDEMAND_WRPROT			0x4
+#define ONDEMAND_PINNED			0x8
+#define ONDEMAND_HPA(ent)		((ent) & ~((physical_addr_t)VMM_PAGE_MASK))
+
+/* Translation flags for on-demand regions */
+#define ONDEMAND_XLATE_POPULATE		0x1
+#define ONDEMAND_XLATE_UNSHARE		0x2
+#define ONDEMAND_XLATE_PIN		0x4
+#define ONDEMAND_XLATE_WRITE		0x8
+
+struct vmm_region_ondemand {
+	struct dlist head;
+	struct vmm_region *reg;
+	vmm_spinlock_t lock;
+	physical_addr_t base;
+	u32 block_count;
+	physical_addr_t *blocks;
+	physical_addr_t **pages;
+	u32 rss_frames;
+	u32 merged_frames;
+	u32 writers;
+	u32 wseq;
+	u32 *csums;
+};
+
+static struct {
+	vmm_spinlock_t lock;
+	u32 ratio;
+	u64 committed_frames;
+} odctrl = {
+	.lock = __SPINLOCK_INITIALIZER(odctrl.lock),
+	.ratio = CONFIG_GUEST_RAM_OVERCOMMIT_RATIO,
+	.committed_frames = 0,
+};
+
+/* Identical pages of on-demand regions are merged into one read-only
+ * host frame by a background scanner. Merged frames are kept in two
+ * rbtrees, one sorted by content checksum to find merge candidates
+ * and other sorted by host physical address to drop references.
+ *
+ * Pages seen with the same checksum in two consecutive scans are
+ * remembered in a small candidate table (indexed by checksum) until
+ * an identical page shows up or the next full scan begins.
+ */
+#define MERGE_CAND_COUNT		1024
+
+struct merge_frame {
+	struct rb_node hnode;
+	struct rb_node anode;
+	u32 csum;
+	u32 refs;
+	physical_addr_t hpa;
+};
+
+struct merge_cand {
+	struct vmm_region_ondemand *od;
+	u32 idx;
+	u32 csum;
+};
+
+static struct {
+	struct vmm_mutex lock;
+	struct dlist od_list;
+	struct vmm_region_ondemand *cur_od;
+	u32 cur_idx;
+	struct vmm_thread *thread;
+	struct vmm_completion cmpl;
+	bool running;
+	u32 scan_pages;
+	u32 scan_msecs;
+	u64 pages_scanned;
+	u64 full_scans;
+	vmm_spinlock_t frame_lock;
+	struct rb_root htree;
+	struct rb_root atree;
+	u32 frame_count;
+	u64 cow_breaks;
+	struct merge_cand cands[MERGE_CAND_COUNT];
+	u32 buf1[VMM_PAGE_SIZE / sizeof(u32)];
+	u32 buf2[VMM_PAGE_SIZE / sizeof(u32)];
+} mgctrl = {
+	.lock = __MUTEX_INITIALIZER(mgctrl.lock),
+	.od_list = LIST_HEAD_INIT(mgctrl.od_list),
+	.cmpl = __COMPLETION_INITIALIZER(mgctrl.cmpl),
+	.running = FALSE,
+	.scan_pages = CONFIG_GUEST_RAM_MERGE_PAGES,
+	.scan_msecs = CONFIG_GUEST_RAM_MERGE_MSECS,
+	.frame_lock = __SPINLOCK_INITIALIZER(mgctrl.frame_lock),
+};
+
+static u64 ondemand_commit_limit_frames(void)
+{
+	return udiv64((u64)vmm_host_ram_total_frame_count() * odctrl.ratio,
+		      100);
+}
+
+physical_size_t vmm_guest_aspace_rss(struct vmm_guest *guest)
+{
+	if (!guest) {
+		return 0;
+	}
+
+	return (physical_size_t)arch_atomic_read(&guest->aspace.rss_frames)
+							<< VMM_PAGE_SHIFT;
+}
+
+physical_size_t vmm_guest_aspace_merged(struct vmm_guest *guest)
+{
+	if (!guest) {
+		return 0;
+	}
+
+	return (physical_size_t)arch_atomic_read(&guest->aspace.merged_frames)
+							<< VMM_PAGE_SHIFT;
+}
+
+physical_size_t vmm_guest_region_rss(struct vmm_region *reg)
+{
+	if (!reg) {
+		return 0;
+	}
+
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		return (physical_size_t)reg->ondemand->rss_frames
+							<< VMM_PAGE_SHIFT;
+	}
+
+	return (reg->flags & VMM_REGION_ISHOSTRAM) ? reg->phys_size : 0;
+}
+
+physical_size_t vmm_guest_ondemand_committed(void)
+{
+	u64 ret;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	ret = odctrl.committed_frames;
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+
+	return (physical_size_t)ret << VMM_PAGE_SHIFT;
+}
+
+physical_size_t vmm_guest_ondemand_commit_limit(void)
+{
+	u64 ret;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	ret = ondemand_commit_limit_frames();
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+
+	return (physical_size_t)ret << VMM_PAGE_SHIFT;
+}
+
+u32 vmm_guest_ondemand_overcommit_ratio(void)
+{
+	return odctrl.ratio;
+}
+
+int vmm_guest_ondemand_set_overcommit_ratio(u32 ratio)
+{
+	irq_flags_t flags;
+
+	if (ratio < 100) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	odctrl.ratio = ratio;
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+
+	return VMM_OK;
+}
+
+/* Find merged frame by host physical address
+ * Note: Must be called with frame_lock held
+ */
+static struct merge_frame *merge_frame_find(physical_addr_t hpa)
+{
+	struct rb_node *pos = mgctrl.atree.rb_node;
+	struct merge_frame *mf;
+
+	while (pos) {
+		mf = rb_entry(pos, struct merge_frame, anode);
+		if (hpa < mf->hpa) {
+			pos = pos->rb_left;
+		} else if (mf->hpa < hpa) {
+			pos = pos->rb_right;
+		} else {
+			return mf;
+		}
+	}
+
+	return NULL;
+}
+
+/* Add merged frame to both trees
+ * Note: Must be called with frame_lock held
+ */
+static void merge_frame_insert(struct merge_frame *mf)
+{
+	struct rb_node **new, *parent;
+	struct merge_frame *pos;
+
+	new = &mgctrl.htree.rb_node;
+	parent = NULL;
+	while (*new) {
+		parent = *new;
+		pos = rb_entry(parent, struct merge_frame, hnode);
+		new = (mf->csum < pos->csum) ?
+			&parent->rb_left : &parent->rb_right;
+	}
+	rb_link_node(&mf->hnode, parent, new);
+	rb_insert_color(&mf->hnode, &mgctrl.htree);
+
+	new = &mgctrl.atree.rb_node;
+	parent = NULL;
+	while (*new) {
+		parent = *new;
+		pos = rb_entry(parent, struct merge_frame, anode);
+		new = (mf->hpa < pos->hpa) ?
+			&parent->rb_left : &parent->rb_right;
+	}
+	rb_link_node(&mf->anode, parent, new);
+	rb_insert_color(&mf->anode, &mgctrl.atree);
+
+	mgctrl.frame_count++;
+}
+
+/* Remove merged frame from both trees
+ * Note: Must be called with frame_lock held
+ */
+static void merge_frame_remove(struct merge_frame *mf)
+{
+	rb_erase(&mf->hnode, &mgctrl.htree);
+	rb_erase(&mf->anode, &mgctrl.atree);
+
+	mgctrl.frame_count--;
+}
+
+/* Drop reference of merged frame and free it upon last reference */
+static void merge_frame_put(physical_addr_t hpa)
+{
+	irq_flags_t flags;
+	struct merge_frame *mf;
+
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, flags);
+	mf = merge_frame_find(hpa);
+	if (mf) {
+		mf->refs--;
+		if (!mf->refs) {
+			merge_frame_remove(mf);
+		} else {
+			mf = NULL;
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, flags);
+
+	if (mf) {
+		vmm_host_ram_free(mf->hpa, VMM_PAGE_SIZE);
+		vmm_free(mf);
+	}
+}
+
+static void ondemand_block_range(struct vmm_region *reg, u32 b,
+				 physical_addr_t *start, physical_addr_t *end)
+{
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	*start = od->base + ((physical_addr_t)b << ONDEMAND_BLOCK_SHIFT);
+	*end = *start + ONDEMAND_BLOCK_SIZE;
+	if (*start < VMM_REGION_GPHYS_START(reg)) {
+		*start = VMM_REGION_GPHYS_START(reg);
+	}
+	if (VMM_REGION_GPHYS_END(reg) < *end) {
+		*end = VMM_REGION_GPHYS_END(reg);
+	}
+}
+
+/* Switch host RAM block to page granular backing
+ * Note: Must be called with region lock held
+ */
+static void ondemand_split_block(struct vmm_region_ondemand *od, u32 b,
+				 physical_addr_t *pages)
+{
+	u32 p;
+	physical_addr_t hpa = ONDEMAND_HPA(od->blocks[b]);
+	physical_addr_t bits = od->blocks[b] & VMM_PAGE_MASK;
+
+	/* Pages of host RAM block are freed one-by-one */
+	for (p = 0; p < ONDEMAND_BLOCK_PAGES; p++) {
+		pages[p] = (hpa + ((physical_addr_t)p << VMM_PAGE_SHIFT)) |
+			   bits;
+	}
+	od->blocks[b] = 0;
+	od->pages[b] = pages;
+}
+
+/* Try to back whole block with one host RAM block */
+static void ondemand_populate_block(struct vmm_region *reg, u32 b)
+{
+	irq_flags_t flags;
+	physical_addr_t hpa;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	if (!vmm_host_ram_alloc(&hpa, ONDEMAND_BLOCK_SIZE,
+				ONDEMAND_BLOCK_SHIFT)) {
+		return;
+	}
+	vmm_host_memory_set(hpa, 0, ONDEMAND_BLOCK_SIZE, TRUE);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (!od->blocks[b] && !od->pages[b]) {
+		od->blocks[b] = hpa | ONDEMAND_PRESENT;
+		od->rss_frames += ONDEMAND_BLOCK_PAGES;
+		arch_atomic_add(&reg->aspace->rss_frames,
+				ONDEMAND_BLOCK_PAGES);
+		hpa = 0;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	/* Some other VCPU populated this block before us */
+	if (hpa) {
+		vmm_host_ram_free(hpa, ONDEMAND_BLOCK_SIZE);
+	}
+}
+
+static int ondemand_populate_page(struct vmm_region *reg, u32 b, u32 p)
+{
+	irq_flags_t flags;
+	physical_addr_t hpa, *pages;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	if (!od->pages[b]) {
+		pages = vmm_zalloc(ONDEMAND_BLOCK_PAGES * sizeof(*pages));
+		if (!pages) {
+			return VMM_ENOMEM;
+		}
+		vmm_spin_lock_irqsave_lite(&od->lock, flags);
+		if (!od->blocks[b] && !od->pages[b]) {
+			od->pages[b] = pages;
+			pages = NULL;
+		}
+		vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+		if (pages) {
+			vmm_free(pages);
+		}
+	}
+
+	if (!vmm_host_ram_alloc(&hpa, VMM_PAGE_SIZE, VMM_PAGE_SHIFT)) {
+		return VMM_ENOMEM;
+	}
+	vmm_host_memory_set(hpa, 0, VMM_PAGE_SIZE, TRUE);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->pages[b] && !od->pages[b][p]) {
+		od->pages[b][p] = hpa | ONDEMAND_PRESENT;
+		od->rss_frames++;
+		arch_atomic_inc(&reg->aspace->rss_frames);
+		hpa = 0;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (hpa) {
+		vmm_host_ram_free(hpa, VMM_PAGE_SIZE);
+	}
+
+	return VMM_OK;
+}
+
+/* Unmap given guest physical range and all aliases of it */
+static int ondemand_unmap(struct vmm_guest *guest,
+			  physical_addr_t gphys_addr,
+			  physical_addr_t gphys_end)
+{
+	int rc;
+	irq_flags_t flags;
+	struct rb_node *pos;
+	struct vmm_region *reg;
+	physical_addr_t start, end;
+	struct vmm_guest_aspace *aspace = &guest->aspace;
+
+	rc = arch_guest_unmap(guest, gphys_addr, gphys_end - gphys_addr);
+	if (rc) {
+		return rc;
+	}
+
+	vmm_read_lock_irqsave_lite(&aspace->reg_memtree_lock, flags);
+	for (pos = rb_first(&aspace->reg_memtree); pos; pos = rb_next(pos)) {
+		reg = rb_entry(pos, struct vmm_region, head);
+		if (!(reg->flags & VMM_REGION_ALIAS)) {
+			continue;
+		}
+		start = max(VMM_REGION_HPHYS_START(reg), gphys_addr);
+		end = min(VMM_REGION_HPHYS_END(reg), gphys_end);
+		if (end <= start) {
+			continue;
+		}
+		rc = arch_guest_unmap(guest,
+				      VMM_REGION_HPHYS_TO_GPHYS(reg, start),
+				      end - start);
+		if (rc) {
+			break;
+		}
+	}
+	vmm_read_unlock_irqrestore_lite(&aspace->reg_memtree_lock, flags);
+
+	return rc;
+}
+
+/* Give private host RAM page to a shared (or write protected) page
+ * of on-demand region. This is called for guest writes to such pages.
+ */
+static int ondemand_unshare(struct vmm_region *reg, u32 b, u32 p)
+{
+	void *buf;
+	bool owned = FALSE;
+	irq_flags_t flags, fflags;
+	physical_addr_t gphys, ent, hpa;
+	struct merge_frame *mf = NULL;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	gphys = od->base + ((physical_addr_t)b << ONDEMAND_BLOCK_SHIFT) +
+			   ((physical_addr_t)p << VMM_PAGE_SHIFT);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	ent = (od->pages[b]) ? od->pages[b][p] : 0;
+	if (ent & ONDEMAND_WRPROT) {
+		/* Page is not merged yet so simply cancel merging */
+		od->pages[b][p] = ent & ~((physical_addr_t)ONDEMAND_WRPROT);
+		owned = TRUE;
+	} else if (ent & ONDEMAND_SHARED) {
+		/* Last user of merged frame takes it without copying */
+		vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, fflags);
+		mf = merge_frame_find(ONDEMAND_HPA(ent));
+		if (mf && (mf->refs == 1)) {
+			merge_frame_remove(mf);
+			mgctrl.cow_breaks++;
+			owned = TRUE;
+		} else {
+			mf = NULL;
+		}
+		vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, fflags);
+		if (owned) {
+			od->pages[b][p] = ONDEMAND_HPA(ent) | ONDEMAND_PRESENT;
+			od->rss_frames++;
+			od->merged_frames--;
+			arch_atomic_inc(&reg->aspace->rss_frames);
+			arch_atomic_dec(&reg->aspace->merged_frames);
+		}
+	} else {
+		ent = 0;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (!ent) {
+		return VMM_OK;
+	}
+
+	if (owned) {
+		if (mf) {
+			vmm_free(mf);
+		}
+		ondemand_unmap(reg->aspace->guest,
+			       gphys, gphys + VMM_PAGE_SIZE);
+		return VMM_OK;
+	}
+
+	/* Copy merged frame to a private host RAM page */
+	if (!vmm_host_ram_alloc(&hpa, VMM_PAGE_SIZE, VMM_PAGE_SHIFT)) {
+		return VMM_ENOMEM;
+	}
+	buf = vmm_malloc(VMM_PAGE_SIZE);
+	if (!buf) {
+		vmm_host_ram_free(hpa, VMM_PAGE_SIZE);
+		return VMM_ENOMEM;
+	}
+	vmm_host_memory_read(ONDEMAND_HPA(ent), buf, VMM_PAGE_SIZE, TRUE);
+	vmm_host_memory_write(hpa, buf, VMM_PAGE_SIZE, TRUE);
+	vmm_free(buf);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->pages[b] && (od->pages[b][p] == ent)) {
+		od->pages[b][p] = hpa | ONDEMAND_PRESENT;
+		od->rss_frames++;
+		od->merged_frames--;
+		arch_atomic_inc(&reg->aspace->rss_frames);
+		arch_atomic_dec(&reg->aspace->merged_frames);
+		hpa = 0;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	/* Some other VCPU unshared this page before us */
+	if (hpa) {
+		vmm_host_ram_free(hpa, VMM_PAGE_SIZE);
+		return VMM_OK;
+	}
+
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, fflags);
+	mgctrl.cow_breaks++;
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, fflags);
+
+	/* Guest might still map merged frame if unmap failed
+	 * so keep the reference of page in that case.
+	 */
+	if (!ondemand_unmap(reg->aspace->guest,
+			    gphys, gphys + VMM_PAGE_SIZE)) {
+		merge_frame_put(ONDEMAND_HPA(ent));
+	}
+
+	return VMM_OK;
+}
+
+/* Translate guest physical address of on-demand region and populate
+ * the containing block or page if required. If not populated then
+ * VMM_ENOENT is returned and avail_size covers the unpopulated part.
+ */
+static int ondemand_translate(struct vmm_region *reg,
+			      physical_addr_t gphys_addr, u32 xlate,
+			      physical_addr_t *hphys_addr,
+			      physical_size_t *avail_size, bool *shared)
+{
+	int rc;
+	u32 b, p;
+	bool unshare;
+	irq_flags_t flags;
+	physical_addr_t bstart, bend, ent;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	if ((gphys_addr < VMM_REGION_GPHYS_START(reg)) ||
+	    (VMM_REGION_GPHYS_END(reg) <= gphys_addr)) {
+		return VMM_EINVALID;
+	}
+
+	b = (gphys_addr - od->base) >> ONDEMAND_BLOCK_SHIFT;
+	p = ((gphys_addr - od->base) & (ONDEMAND_BLOCK_SIZE - 1))
+							>> VMM_PAGE_SHIFT;
+	ondemand_block_range(reg, b, &bstart, &bend);
+
+again:
+	unshare = FALSE;
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->blocks[b]) {
+		if (xlate & ONDEMAND_XLATE_PIN) {
+			od->blocks[b] |= ONDEMAND_PINNED;
+		}
+		ent = ONDEMAND_HPA(od->blocks[b]);
+		*hphys_addr = ent + (gphys_addr & (ONDEMAND_BLOCK_SIZE - 1));
+		*avail_size = bend - gphys_addr;
+		rc = VMM_OK;
+	} else if (od->pages[b] && od->pages[b][p]) {
+		ent = od->pages[b][p];
+		if ((ent & (ONDEMAND_SHARED | ONDEMAND_WRPROT)) &&
+		    (xlate & ONDEMAND_XLATE_UNSHARE)) {
+			unshare = TRUE;
+		} else if (xlate & ONDEMAND_XLATE_PIN) {
+			od->pages[b][p] |= ONDEMAND_PINNED;
+		}
+		if (shared) {
+			*shared = (ent & (ONDEMAND_SHARED | ONDEMAND_WRPROT)) ?
+								TRUE : FALSE;
+		}
+		*hphys_addr = ONDEMAND_HPA(ent) + (gphys_addr & VMM_PAGE_MASK);
+		*avail_size = VMM_PAGE_SIZE - (gphys_addr & VMM_PAGE_MASK);
+		rc = VMM_OK;
+	} else {
+		*avail_size = (od->pages[b]) ?
+			VMM_PAGE_SIZE - (gphys_addr & VMM_PAGE_MASK) :
+			bend - gphys_addr;
+		rc = VMM_ENOENT;
+	}
+	/* Writers are waited upon by merging of pages */
+	if (!rc && !unshare && (xlate & ONDEMAND_XLATE_WRITE)) {
+		od->writers++;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (unshare) {
+		rc = ondemand_unshare(reg, b, p);
+		if (rc) {
+			return rc;
+		}
+		goto again;
+	}
+
+	if ((rc != VMM_ENOENT) || !(xlate & ONDEMAND_XLATE_POPULATE)) {
+		return rc;
+	}
+
+	if (!od->pages[b] &&
+	    ((bend - bstart) == ONDEMAND_BLOCK_SIZE)) {
+		ondemand_populate_block(reg, b);
+		if (od->blocks[b]) {
+			goto again;
+		}
+	}
+
+	rc = ondemand_populate_page(reg, b, p);
+	if (rc) {
+		vmm_printf("%s: Failed to populate 0x%"PRIPADDR" for %s/%s\n",
+			   __func__, gphys_addr, reg->aspace->guest->name,
+			   reg->node->name);
+		return rc;
+	}
+
+	goto again;
+}
+
+/* Complete host write translated with ONDEMAND_XLATE_WRITE */
+static void ondemand_write_done(struct vmm_region *reg)
+{
+	irq_flags_t flags;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	od->writers--;
+	od->wseq++;
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+}
+
+/* Stop scanning on-demand region for merging
+ * Note: Must be called with merge lock held
+ */
+static void merge_forget(struct vmm_region_ondemand *od)
+{
+	u32 i;
+
+	if (mgctrl.cur_od == od) {
+		mgctrl.cur_od = NULL;
+		if (!list_is_last(&od->head, &mgctrl.od_list)) {
+			mgctrl.cur_od = list_entry(od->head.next,
+					struct vmm_region_ondemand, head);
+		}
+		mgctrl.cur_idx = 0;
+	}
+
+	for (i = 0; i < MERGE_CAND_COUNT; i++) {
+		if (mgctrl.cands[i].od == od) {
+			mgctrl.cands[i].od = NULL;
+		}
+	}
+}
+
+static int ondemand_init(struct vmm_region *reg)
+{
+	u64 frames;
+	irq_flags_t flags;
+	physical_addr_t end;
+	struct vmm_region_ondemand *od;
+
+	if (!(reg->flags & VMM_REGION_REAL) ||
+	    !(reg->flags & VMM_REGION_MEMORY) ||
+	    (reg->gphys_addr & VMM_PAGE_MASK) ||
+	    (reg->phys_size & VMM_PAGE_MASK) ||
+	    !reg->phys_size) {
+		return VMM_EINVALID;
+	}
+
+	frames = reg->phys_size >> VMM_PAGE_SHIFT;
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	if (ondemand_commit_limit_frames() <
+				(odctrl.committed_frames + frames)) {
+		vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+		return VMM_ENOSPC;
+	}
+	odctrl.committed_frames += frames;
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+
+	od = vmm_zalloc(sizeof(*od));
+	if (!od) {
+		goto fail_uncommit;
+	}
+
+	INIT_LIST_HEAD(&od->head);
+	od->reg = reg;
+	INIT_SPIN_LOCK(&od->lock);
+	od->base = reg->gphys_addr & ~((physical_addr_t)ONDEMAND_BLOCK_SIZE - 1);
+	end = VMM_REGION_GPHYS_END(reg) + ONDEMAND_BLOCK_SIZE - 1;
+	end &= ~((physical_addr_t)ONDEMAND_BLOCK_SIZE - 1);
+	od->block_count = (end - od->base) >> ONDEMAND_BLOCK_SHIFT;
+
+	od->blocks = vmm_zalloc(od->block_count * sizeof(*od->blocks));
+	if (!od->blocks) {
+		goto fail_free_od;
+	}
+	od->pages = vmm_zalloc(od->block_count * sizeof(*od->pages));
+	if (!od->pages) {
+		goto fail_free_blocks;
+	}
+
+	reg->ondemand = od;
+	reg->hphys_addr = 0;
+
+	vmm_mutex_lock(&mgctrl.lock);
+	list_add_tail(&od->head, &mgctrl.od_list);
+	vmm_mutex_unlock(&mgctrl.lock);
+
+	return VMM_OK;
+
+fail_free_blocks:
+	vmm_free(od->blocks);
+fail_free_od:
+	vmm_free(od);
+fail_uncommit:
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	odctrl.committed_frames -= frames;
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+	return VMM_ENOMEM;
+}
+
+static void ondemand_deinit(struct vmm_region *reg)
+{
+	u32 b, p;
+	irq_flags_t flags;
+	physical_addr_t ent;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	if (!od) {
+		return;
+	}
+
+	vmm_mutex_lock(&mgctrl.lock);
+	merge_forget(od);
+	list_del(&od->head);
+	vmm_mutex_unlock(&mgctrl.lock);
+
+	for (b = 0; b < od->block_count; b++) {
+		if (od->blocks[b]) {
+			vmm_host_ram_free(ONDEMAND_HPA(od->blocks[b]),
+					  ONDEMAND_BLOCK_SIZE);
+		}
+		if (!od->pages[b]) {
+			continue;
+		}
+		for (p = 0; p < ONDEMAND_BLOCK_PAGES; p++) {
+			ent = od->pages[b][p];
+			if (!ent) {
+				continue;
+			}
+			if (ent & ONDEMAND_SHARED) {
+				merge_frame_put(ONDEMAND_HPA(ent));
+			} else {
+				vmm_host_ram_free(ONDEMAND_HPA(ent),
+						  VMM_PAGE_SIZE);
+			}
+		}
+		vmm_free(od->pages[b]);
+	}
+	arch_atomic_sub(&reg->aspace->rss_frames, od->rss_frames);
+	arch_atomic_sub(&reg->aspace->merged_frames, od->merged_frames);
+
+	vmm_spin_lock_irqsave_lite(&odctrl.lock, flags);
+	odctrl.committed_frames -= reg->phys_size >> VMM_PAGE_SHIFT;
+	vmm_spin_unlock_irqrestore_lite(&odctrl.lock, flags);
+
+	if (od->csums) {
+		vmm_host_free_pages((virtual_addr_t)od->csums,
+			VMM_SIZE_TO_PAGE((reg->phys_size >> VMM_PAGE_SHIFT) *
+					 sizeof(*od->csums)));
+	}
+	vmm_free(od->pages);
+	vmm_free(od->blocks);
+	vmm_free(od);
+	reg->ondemand = NULL;
+}
+
+/* Translate guest physical address of a non-alias region */
+static int region_translate(struct vmm_region *reg,
+			    physical_addr_t gphys_addr, u32 xlate,
+			    physical_addr_t *hphys_addr,
+			    physical_size_t *avail_size, bool *shared)
+{
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		return ondemand_translate(reg, gphys_addr, xlate,
+					  hphys_addr, avail_size, shared);
+	}
+
+	*hphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
+	*avail_size = VMM_REGION_GPHYS_END(reg) - gphys_addr;
+	if (shared) {
+		*shared = FALSE;
+	}
+
+	return VMM_OK;
+}
+
 u32 vmm_guest_memory_read(struct vmm_guest *guest, 
 			  physical_addr_t gphys_addr, 
 			  void *dst, u32 len, bool cacheable)
 {
-	u32 bytes_read = 0, to_read;
-	physical_addr_t hphys_addr;
-	struct vmm_region *reg = NULL;
+	int rc;
+	u32 bytes_read = 0, to_read;
+	physical_addr_t hphys_addr;
+	physical_size_t avail_size;
+	struct vmm_region *reg = NULL;
+
+	if (!guest || !dst || !len) {
+		return 0;
+	}
+
+	while (bytes_read < len) {
+		reg = vmm_guest_find_region(guest, gphys_addr, 
+				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
+		if (!reg) {
+			break;
+		}
+
+		rc = region_translate(reg, gphys_addr, 0,
+				      &hphys_addr, &avail_size, NULL);
+		if (rc && (rc != VMM_ENOENT)) {
+			break;
+		}
+		to_read = ((len - bytes_read) < avail_size) ?
+			  (len - bytes_read) : avail_size;
+
+		if (rc == VMM_ENOENT) {
+			/* Unpopulated on-demand RAM reads as zero */
+			memset(dst, 0, to_read);
+		} else {
+			to_read = vmm_host_memory_read(hphys_addr,
+						dst, to_read, cacheable);
+		}
+		if (!to_read) {
+			break;
+		}
+
+		gphys_addr += to_read;
+		bytes_read += to_read;
+		dst += to_read;
+	}
+
+	return bytes_read;
+}
+
+u32 vmm_guest_memory_write(struct vmm_guest *guest, 
+			   physical_addr_t gphys_addr, 
+			   void *src, u32 len, bool cacheable)
+{
+	u32 bytes_written = 0, to_write;
+	physical_addr_t hphys_addr;
+	physical_size_t avail_size;
+	struct vmm_region *reg = NULL;
+
+	if (!guest || !src || !len) {
+		return 0;
+	}
+
+	while (bytes_written < len) {
+		reg = vmm_guest_find_region(guest, gphys_addr, 
+				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
+		if (!reg) {
+			break;
+		}
+
+		if (region_translate(reg, gphys_addr,
+				     ONDEMAND_XLATE_POPULATE |
+				     ONDEMAND_XLATE_UNSHARE |
+				     ONDEMAND_XLATE_WRITE,
+				     &hphys_addr, &avail_size, NULL)) {
+			break;
+		}
+		to_write = ((len - bytes_written) < avail_size) ?
+			   (len - bytes_written) : avail_size;
+
+		to_write = vmm_host_memory_write(hphys_addr,
+						 src, to_write, cacheable);
+		if (reg->flags & VMM_REGION_ISONDEMAND) {
+			ondemand_write_done(reg);
+		}
+		if (!to_write) {
+			break;
+		}
+
+		gphys_addr += to_write;
+		bytes_written += to_write;
+		src += to_write;
+	}
+
+	return bytes_written;
+}
+
+static int guest_physical_map(struct vmm_guest *guest,
+			      physical_addr_t gphys_addr,
+			      physical_size_t gphys_size,
+			      physical_addr_t *hphys_addr,
+			      physical_size_t *hphys_size,
+			      u32 *reg_flags, u32 xlate)
+{
+	int rc;
+	bool shared = FALSE;
+	physical_size_t avail_size;
+	struct vmm_region *reg = NULL;
+
+	if (!guest || !hphys_addr) {
+		return VMM_EFAIL;
+	}
+
+	reg = vmm_guest_find_region(guest, gphys_addr, 
+				    VMM_REGION_MEMORY, FALSE);
+	if (!reg) {
+		return VMM_EFAIL;
+	}
+	while (reg->flags & VMM_REGION_ALIAS) {
+		gphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
+		reg = vmm_guest_find_region(guest, gphys_addr, 
+					    VMM_REGION_MEMORY, FALSE);
+		if (!reg) {
+			return VMM_EFAIL;
+		}
+	}
+
+	rc = region_translate(reg, gphys_addr, xlate,
+			      hphys_addr, &avail_size, &shared);
+	if (rc) {
+		return rc;
+	}
+
+	if (hphys_size) {
+		*hphys_size = (gphys_size < avail_size) ?
+				gphys_size : avail_size;
+	}
+
+	if (reg_flags) {
+		*reg_flags = reg->flags;
+		if (shared) {
+			*reg_flags |= VMM_REGION_ISSHARED;
+		}
+	}
+
+	return VMM_OK;
+}
+
+int vmm_guest_physical_map(struct vmm_guest *guest,
+			   physical_addr_t gphys_addr,
+			   physical_size_t gphys_size,
+			   physical_addr_t *hphys_addr,
+			   physical_size_t *hphys_size,
+			   u32 *reg_flags)
+{
+	/* Host RAM handed out here can be accessed behind our back
+	 * so it is never merged with identical pages.
+	 */
+	return guest_physical_map(guest, gphys_addr, gphys_size,
+				  hphys_addr, hphys_size, reg_flags,
+				  ONDEMAND_XLATE_POPULATE |
+				  ONDEMAND_XLATE_UNSHARE |
+				  ONDEMAND_XLATE_PIN);
+}
+
+int vmm_guest_physical_map_shared(struct vmm_guest *guest,
+				  physical_addr_t gphys_addr,
+				  physical_size_t gphys_size,
+				  physical_addr_t *hphys_addr,
+				  physical_size_t *hphys_size,
+				  u32 *reg_flags)
+{
+	return guest_physical_map(guest, gphys_addr, gphys_size,
+				  hphys_addr, hphys_size, reg_flags,
+				  ONDEMAND_XLATE_POPULATE);
+}
+
+int vmm_guest_physical_unmap(struct vmm_guest *guest,
+			     physical_addr_t gphys_addr,
+			     physical_size_t gphys_size)
+{
+	/* Host RAM of on-demand regions stays populated until
+	 * the region is deleted so nothing to do here.
+	 */
+	return VMM_OK;
+}
+
+int vmm_guest_ram_unshare(struct vmm_guest *guest,
+			  physical_addr_t gphys_addr)
+{
+	u32 b, p;
+	struct vmm_region *reg;
+	struct vmm_region_ondemand *od;
+
+	if (!guest) {
+		return VMM_EINVALID;
+	}
+
+	reg = vmm_guest_find_region(guest, gphys_addr,
+				    VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
+	if (!reg) {
+		return VMM_EINVALID;
+	}
+	if (!(reg->flags & VMM_REGION_ISONDEMAND)) {
+		return VMM_OK;
+	}
+
+	od = reg->ondemand;
+	b = (gphys_addr - od->base) >> ONDEMAND_BLOCK_SHIFT;
+	p = ((gphys_addr - od->base) & (ONDEMAND_BLOCK_SIZE - 1))
+							>> VMM_PAGE_SHIFT;
+
+	return ondemand_unshare(reg, b, p);
+}
+
+/* Discard part of on-demand block. The frames array must have
+ * space for all pages of a block.
+ */
+static int ondemand_discard_block(struct vmm_region *reg, u32 b,
+				  physical_addr_t start, physical_addr_t end,
+				  physical_addr_t *frames)
+{
+	int rc;
+	bool whole;
+	irq_flags_t flags;
+	u32 p, pstart, pend, count = 0, rss = 0, merged = 0, pinned = 0;
+	physical_addr_t bstart, bend, ent, blk = 0;
+	physical_addr_t *pages = NULL, *free_pages = NULL;
+	struct vmm_region_ondemand *od = reg->ondemand;
+
+	ondemand_block_range(reg, b, &bstart, &bend);
+	whole = ((start == bstart) && (end == bend)) ? TRUE : FALSE;
+	pstart = ((start - od->base) & (ONDEMAND_BLOCK_SIZE - 1))
+							>> VMM_PAGE_SHIFT;
+	pend = pstart + ((end - start) >> VMM_PAGE_SHIFT);
+
+	/* Partially discarded block needs page granular backing */
+	if (od->blocks[b] && !whole) {
+		pages = vmm_zalloc(ONDEMAND_BLOCK_PAGES * sizeof(*pages));
+		if (!pages) {
+			return VMM_ENOMEM;
+		}
+	}
+
+	/* Host RAM pinned by vmm_guest_physical_map() is still accessed
+	 * by host emulators hence never given back.
+	 */
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->blocks[b] && !(od->blocks[b] & ONDEMAND_PINNED)) {
+		if (whole) {
+			blk = ONDEMAND_HPA(od->blocks[b]);
+			od->blocks[b] = 0;
+			od->rss_frames -= ONDEMAND_BLOCK_PAGES;
+			arch_atomic_sub(&reg->aspace->rss_frames,
+					ONDEMAND_BLOCK_PAGES);
+		} else if (pages) {
+			ondemand_split_block(od, b, pages);
+			pages = NULL;
+		}
+	}
+	if (od->pages[b]) {
+		for (p = pstart; p < pend; p++) {
+			ent = od->pages[b][p];
+			if (!ent) {
+				continue;
+			}
+			if (ent & ONDEMAND_PINNED) {
+				pinned++;
+				continue;
+			}
+			frames[count++] = ent;
+			od->pages[b][p] = 0;
+			if (ent & ONDEMAND_SHARED) {
+				merged++;
+			} else {
+				rss++;
+			}
+		}
+		od->rss_frames -= rss;
+		od->merged_frames -= merged;
+		arch_atomic_sub(&reg->aspace->rss_frames, rss);
+		arch_atomic_sub(&reg->aspace->merged_frames, merged);
+		/* Empty block can be backed by host RAM block again */
+		if (whole && !pinned) {
+			free_pages = od->pages[b];
+			od->pages[b] = NULL;
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (pages) {
+		vmm_free(pages);
+	}
+	if (free_pages) {
+		vmm_free(free_pages);
+	}
+
+	if (!blk && !count) {
+		return VMM_OK;
+	}
+
+	/* Faults racing with us might have mapped detached host RAM
+	 * so unmap again before freeing it. Detached host RAM which
+	 * guest might still access is leaked if unmap fails.
+	 */
+	rc = ondemand_unmap(reg->aspace->guest, start, end);
+	if (rc) {
+		return rc;
+	}
+
+	if (blk) {
+		vmm_host_ram_free(blk, ONDEMAND_BLOCK_SIZE);
+	}
+	for (p = 0; p < count; p++) {
+		if (frames[p] & ONDEMAND_SHARED) {
+			merge_frame_put(ONDEMAND_HPA(frames[p]));
+		} else {
+			vmm_host_ram_free(ONDEMAND_HPA(frames[p]),
+					  VMM_PAGE_SIZE);
+		}
+	}
+
+	return VMM_OK;
+}
+
+int vmm_guest_ram_discard(struct vmm_guest *guest,
+			  physical_addr_t gphys_addr,
+			  physical_size_t gphys_size)
+{
+	int rc = VMM_OK;
+	u32 b;
+	struct vmm_region *reg;
+	physical_addr_t *frames;
+	physical_addr_t end, reg_end, bstart, bend;
+
+	if (!guest ||
+	    (gphys_addr & VMM_PAGE_MASK) || (gphys_size & VMM_PAGE_MASK)) {
+		return VMM_EINVALID;
+	}
+	if (!arch_guest_can_trap_memory(guest)) {
+		return VMM_ENOTSUPP;
+	}
+
+	frames = vmm_malloc(ONDEMAND_BLOCK_PAGES * sizeof(*frames));
+	if (!frames) {
+		return VMM_ENOMEM;
+	}
+
+	end = gphys_addr + gphys_size;
+	while (gphys_addr < end) {
+		reg = vmm_guest_find_region(guest, gphys_addr,
+					    VMM_REGION_MEMORY, FALSE);
+		if (!reg) {
+			rc = VMM_EINVALID;
+			break;
+		}
+		if (!(reg->flags & VMM_REGION_ISONDEMAND)) {
+			rc = VMM_ENOTSUPP;
+			break;
+		}
+		reg_end = min(VMM_REGION_GPHYS_END(reg), end);
+
+		/* Unmap up-front so that we don't detach any host RAM
+		 * if architecture cannot unmap guest memory.
+		 */
+		rc = ondemand_unmap(guest, gphys_addr, reg_end);
+		if (rc) {
+			break;
+		}
+
+		while (gphys_addr < reg_end) {
+			b = (gphys_addr - reg->ondemand->base)
+						>> ONDEMAND_BLOCK_SHIFT;
+			ondemand_block_range(reg, b, &bstart, &bend);
+			bend = min(bend, reg_end);
+			rc = ondemand_discard_block(reg, b,
+						    gphys_addr, bend, frames);
+			if (rc) {
+				break;
+			}
+			gphys_addr = bend;
+		}
+		if (rc) {
+			break;
+		}
+	}
+
+	vmm_free(frames);
+
+	return rc;
+}
+
+/* Checksum of page content used as merge tree key */
+static u32 merge_checksum(const u32 *buf)
+{
+	u32 i, csum = 2166136261U;
+
+	for (i = 0; i < (VMM_PAGE_SIZE / sizeof(u32)); i++) {
+		csum ^= buf[i];
+		csum *= 16777619U;
+	}
+
+	return csum;
+}
+
+static physical_addr_t merge_page_addr(struct vmm_region_ondemand *od,
+				       u32 idx, u32 *b, u32 *p)
+{
+	physical_addr_t gphys = VMM_REGION_GPHYS_START(od->reg) +
+				((physical_addr_t)idx << VMM_PAGE_SHIFT);
+
+	*b = (gphys - od->base) >> ONDEMAND_BLOCK_SHIFT;
+	*p = ((gphys - od->base) & (ONDEMAND_BLOCK_SIZE - 1))
+							>> VMM_PAGE_SHIFT;
+
+	return gphys;
+}
+
+/* Read private page of on-demand region
+ * Note: Returns VMM_ENOENT if page cannot be merged
+ */
+static int merge_read(struct vmm_region_ondemand *od, u32 idx, u32 *buf)
+{
+	u32 b, p;
+	irq_flags_t flags;
+	physical_addr_t hpa = 0;
+
+	merge_page_addr(od, idx, &b, &p);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->blocks[b]) {
+		if (!(od->blocks[b] & ONDEMAND_PINNED)) {
+			hpa = ONDEMAND_HPA(od->blocks[b]) +
+				((physical_addr_t)p << VMM_PAGE_SHIFT);
+		}
+	} else if (od->pages[b] &&
+		   !(od->pages[b][p] & (ONDEMAND_SHARED |
+					ONDEMAND_WRPROT |
+					ONDEMAND_PINNED))) {
+		hpa = ONDEMAND_HPA(od->pages[b][p]);
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (!hpa) {
+		return VMM_ENOENT;
+	}
+
+	if (vmm_host_memory_read(hpa, buf,
+				 VMM_PAGE_SIZE, TRUE) != VMM_PAGE_SIZE) {
+		return VMM_EIO;
+	}
+
+	return VMM_OK;
+}
+
+/* Find merged frame with same content as mgctrl.buf1 and take
+ * a reference to it.
+ */
+static struct merge_frame *merge_frame_get(u32 csum)
+{
+	irq_flags_t flags;
+	struct rb_node *pos;
+	struct merge_frame *mf = NULL;
+
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, flags);
+	pos = mgctrl.htree.rb_node;
+	while (pos) {
+		mf = rb_entry(pos, struct merge_frame, hnode);
+		if (csum < mf->csum) {
+			pos = pos->rb_left;
+		} else if (mf->csum < csum) {
+			pos = pos->rb_right;
+		} else {
+			break;
+		}
+	}
+	if (pos) {
+		mf->refs++;
+	} else {
+		mf = NULL;
+	}
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, flags);
+
+	if (!mf) {
+		return NULL;
+	}
+
+	/* Merged frames are never written so compare outside lock */
+	if ((vmm_host_memory_read(mf->hpa, mgctrl.buf2,
+				  VMM_PAGE_SIZE, TRUE) != VMM_PAGE_SIZE) ||
+	    memcmp(mgctrl.buf1, mgctrl.buf2, VMM_PAGE_SIZE)) {
+		merge_frame_put(mf->hpa);
+		return NULL;
+	}
+
+	return mf;
+}
+
+/* Undo merge_protect() unless page changed meanwhile */
+static void merge_unprotect(struct vmm_region_ondemand *od, u32 idx,
+			    physical_addr_t ent)
+{
+	u32 b, p;
+	irq_flags_t flags;
+
+	merge_page_addr(od, idx, &b, &p);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->pages[b] && (od->pages[b][p] == ent)) {
+		od->pages[b][p] = ent & ~((physical_addr_t)ONDEMAND_WRPROT);
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+}
+
+/* Write protect private page of on-demand region and check that it
+ * still has same content as mgctrl.buf1. Upon success, the page is
+ * not mapped by guest and ent returns its write protected entry.
+ */
+static int merge_protect(struct vmm_region_ondemand *od, u32 idx,
+			 physical_addr_t *ent, u32 *wseq)
+{
+	int rc;
+	u32 b, p;
+	irq_flags_t flags;
+	physical_addr_t gphys, *pages = NULL;
+
+	gphys = merge_page_addr(od, idx, &b, &p);
+
+	/* Merged pages need page granular backing */
+	if (od->blocks[b]) {
+		pages = vmm_zalloc(ONDEMAND_BLOCK_PAGES * sizeof(*pages));
+		if (!pages) {
+			return VMM_ENOMEM;
+		}
+	}
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->blocks[b] && pages &&
+	    !(od->blocks[b] & ONDEMAND_PINNED)) {
+		ondemand_split_block(od, b, pages);
+		pages = NULL;
+	}
+	*ent = (od->pages[b]) ? od->pages[b][p] : 0;
+	if ((*ent & ONDEMAND_PRESENT) &&
+	    !(*ent & (ONDEMAND_SHARED | ONDEMAND_WRPROT | ONDEMAND_PINNED))) {
+		*ent |= ONDEMAND_WRPROT;
+		od->pages[b][p] = *ent;
+		*wseq = od->wseq;
+		rc = VMM_OK;
+	} else {
+		rc = VMM_EBUSY;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (pages) {
+		vmm_free(pages);
+	}
+	if (rc) {
+		return rc;
+	}
+
+	/* Guest faults see the page as shared from now on */
+	rc = ondemand_unmap(od->reg->aspace->guest,
+			    gphys, gphys + VMM_PAGE_SIZE);
+	if (!rc &&
+	    ((vmm_host_memory_read(ONDEMAND_HPA(*ent), mgctrl.buf2,
+				   VMM_PAGE_SIZE, TRUE) != VMM_PAGE_SIZE) ||
+	     memcmp(mgctrl.buf1, mgctrl.buf2, VMM_PAGE_SIZE))) {
+		rc = VMM_EBUSY;
+	}
+	if (rc) {
+		merge_unprotect(od, idx, *ent);
+	}
+
+	return rc;
+}
+
+/* Replace write protected page by merged frame or turn it into
+ * a merged frame itself if no merged frame is given.
+ */
+static int merge_commit(struct vmm_region_ondemand *od, u32 idx,
+			physical_addr_t ent, u32 wseq,
+			struct merge_frame *mf)
+{
+	int rc;
+	u32 b, p;
+	irq_flags_t flags;
+	struct vmm_guest_aspace *aspace = od->reg->aspace;
+
+	merge_page_addr(od, idx, &b, &p);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->pages[b] && (od->pages[b][p] == ent) &&
+	    !od->writers && (od->wseq == wseq)) {
+		od->pages[b][p] = (mf) ? mf->hpa | ONDEMAND_PRESENT :
+			ent & ~((physical_addr_t)ONDEMAND_WRPROT);
+		od->pages[b][p] |= ONDEMAND_SHARED;
+		od->rss_frames--;
+		od->merged_frames++;
+		arch_atomic_dec(&aspace->rss_frames);
+		arch_atomic_inc(&aspace->merged_frames);
+		rc = VMM_OK;
+	} else {
+		rc = VMM_EBUSY;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	return rc;
+}
+
+/* Undo merge_commit() unless page changed meanwhile. Returns
+ * VMM_ENOENT if page changed meanwhile. Any other error means
+ * that page was restored but guest might still map merged frame.
+ */
+static int merge_uncommit(struct vmm_region_ondemand *od, u32 idx,
+			  physical_addr_t ent, physical_addr_t hpa)
+{
+	u32 b, p;
+	bool ret = FALSE;
+	irq_flags_t flags;
+	physical_addr_t gphys;
+	struct vmm_guest_aspace *aspace = od->reg->aspace;
+
+	gphys = merge_page_addr(od, idx, &b, &p);
+
+	vmm_spin_lock_irqsave_lite(&od->lock, flags);
+	if (od->pages[b] &&
+	    (od->pages[b][p] == (hpa | ONDEMAND_PRESENT | ONDEMAND_SHARED))) {
+		od->pages[b][p] = ent & ~((physical_addr_t)ONDEMAND_WRPROT);
+		od->rss_frames++;
+		od->merged_frames--;
+		arch_atomic_inc(&aspace->rss_frames);
+		arch_atomic_dec(&aspace->merged_frames);
+		ret = TRUE;
+	}
+	vmm_spin_unlock_irqrestore_lite(&od->lock, flags);
+
+	if (!ret) {
+		return VMM_ENOENT;
+	}
+
+	return ondemand_unmap(aspace->guest, gphys, gphys + VMM_PAGE_SIZE);
+}
+
+/* Check that old content of a merged page is still same as
+ * mgctrl.buf1. Guest writes through mappings created before the
+ * page was write protected would be lost otherwise. Returns
+ * VMM_EBUSY if content changed. Any other error means that guest
+ * might still map old page.
+ */
+static int merge_stable(struct vmm_region_ondemand *od, u32 idx,
+			physical_addr_t hpa)
+{
+	int rc;
+	u32 b, p;
+	physical_addr_t gphys = merge_page_addr(od, idx, &b, &p);
+
+	/* No guest access to old page is possible after this */
+	rc = ondemand_unmap(od->reg->aspace->guest,
+			    gphys, gphys + VMM_PAGE_SIZE);
+	if (rc) {
+		return rc;
+	}
+
+	if ((vmm_host_memory_read(hpa, mgctrl.buf2,
+				  VMM_PAGE_SIZE, TRUE) != VMM_PAGE_SIZE) ||
+	    memcmp(mgctrl.buf1, mgctrl.buf2, VMM_PAGE_SIZE)) {
+		return VMM_EBUSY;
+	}
+
+	return VMM_OK;
+}
+
+/* Merge page with given merged frame. The reference to merged frame
+ * is passed on to page upon success.
+ */
+static int merge_into(struct vmm_region_ondemand *od, u32 idx,
+		      struct merge_frame *mf)
+{
+	int rc, urc;
+	u32 wseq;
+	physical_addr_t ent, hpa;
+
+	rc = merge_protect(od, idx, &ent, &wseq);
+	if (rc) {
+		return rc;
+	}
+
+	rc = merge_commit(od, idx, ent, wseq, mf);
+	if (rc) {
+		merge_unprotect(od, idx, ent);
+		return rc;
+	}
+
+	hpa = ONDEMAND_HPA(ent);
+	rc = merge_stable(od, idx, hpa);
+	if (rc) {
+		urc = merge_uncommit(od, idx, ent, mf->hpa);
+		if (urc != VMM_ENOENT) {
+			/* Page owns old frame again. The reference to
+			 * merged frame is kept if guest might map it.
+			 */
+			if (!urc) {
+				merge_frame_put(mf->hpa);
+			}
+			return VMM_OK;
+		}
+		if (rc != VMM_EBUSY) {
+			/* Guest might still map old frame so leak it */
+			return VMM_OK;
+		}
+	}
+
+	vmm_host_ram_free(hpa, VMM_PAGE_SIZE);
+
+	return VMM_OK;
+}
+
+/* Turn candidate page into merged frame. The candidate must have same
+ * content as mgctrl.buf1. Upon success, caller gets a reference to the
+ * new merged frame in addition to the reference of candidate page.
+ */
+static struct merge_frame *merge_promote(struct vmm_region_ondemand *od,
+					 u32 idx, u32 csum)
+{
+	u32 wseq;
+	irq_flags_t flags;
+	physical_addr_t ent;
+	struct merge_frame *mf;
+
+	mf = vmm_zalloc(sizeof(*mf));
+	if (!mf) {
+		return NULL;
+	}
+
+	if (merge_protect(od, idx, &ent, &wseq)) {
+		vmm_free(mf);
+		return NULL;
+	}
+
+	mf->csum = csum;
+	mf->hpa = ONDEMAND_HPA(ent);
+	mf->refs = 2;
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, flags);
+	merge_frame_insert(mf);
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, flags);
+
+	if (!merge_commit(od, idx, ent, wseq, NULL)) {
+		if (!merge_stable(od, idx, mf->hpa)) {
+			return mf;
+		}
+		if (merge_uncommit(od, idx, ent, mf->hpa) == VMM_ENOENT) {
+			/* Page went away hence its reference too */
+			merge_frame_put(mf->hpa);
+			return NULL;
+		}
+	} else {
+		merge_unprotect(od, idx, ent);
+	}
+
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, flags);
+	merge_frame_remove(mf);
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, flags);
+	vmm_free(mf);
+
+	return NULL;
+}
+
+/* Try to merge one page of on-demand region
+ * Note: Must be called with merge lock held
+ */
+static int merge_page(struct vmm_region_ondemand *od, u32 idx)
+{
+	int rc;
+	u32 csum, cidx;
+	struct merge_cand *cand;
+	struct merge_frame *mf;
+	struct vmm_region_ondemand *cod;
+
+	rc = merge_read(od, idx, mgctrl.buf1);
+	if (rc) {
+		return (rc == VMM_ENOENT) ? VMM_OK : rc;
+	}
+
+	/* Pages changing between scans are not worth merging */
+	csum = merge_checksum(mgctrl.buf1);
+	if (od->csums[idx] != csum) {
+		od->csums[idx] = csum;
+		return VMM_OK;
+	}
+
+	/* Merge with identical merged frame if available */
+	mf = merge_frame_get(csum);
+	if (mf) {
+		rc = merge_into(od, idx, mf);
+		if (rc) {
+			merge_frame_put(mf->hpa);
+		}
+		return rc;
+	}
+
+	/* Otherwise remember page as candidate for identical pages */
+	cand = &mgctrl.cands[csum % MERGE_CAND_COUNT];
+	cod = cand->od;
+	cidx = cand->idx;
+	if (!cod || (cand->csum != csum) || ((cod == od) && (cidx == idx)) ||
+	    merge_read(cod, cidx, mgctrl.buf2) ||
+	    memcmp(mgctrl.buf1, mgctrl.buf2, VMM_PAGE_SIZE)) {
+		cand->od = od;
+		cand->idx = idx;
+		cand->csum = csum;
+		return VMM_OK;
+	}
+	cand->od = NULL;
+
+	mf = merge_promote(cod, cidx, csum);
+	if (!mf) {
+		return VMM_OK;
+	}
+
+	rc = merge_into(od, idx, mf);
+	if (rc) {
+		merge_frame_put(mf->hpa);
+	}
+
+	return rc;
+}
+
+/* Scan given number of pages of on-demand regions for merging */
+static void merge_scan(u32 count)
+{
+	u32 page_count;
+	struct vmm_region_ondemand *od;
+
+	vmm_mutex_lock(&mgctrl.lock);
+
+	while (count && !list_empty(&mgctrl.od_list)) {
+		if (!mgctrl.cur_od) {
+			mgctrl.cur_od = list_first_entry(&mgctrl.od_list,
+					struct vmm_region_ondemand, head);
+			mgctrl.cur_idx = 0;
+		}
+		od = mgctrl.cur_od;
+		page_count = od->reg->phys_size >> VMM_PAGE_SHIFT;
+
+		/* Checksums are kept only for populated regions */
+		if (!od->csums && od->rss_frames) {
+			od->csums = (u32 *)vmm_host_alloc_pages(
+				VMM_SIZE_TO_PAGE(page_count * sizeof(u32)),
+				VMM_MEMORY_FLAGS_NORMAL);
+			if (od->csums) {
+				memset(od->csums, 0, page_count * sizeof(u32));
+			}
+		}
+		if (!od->csums) {
+			mgctrl.cur_idx = page_count;
+			count--;
+		}
+
+		while (count && (mgctrl.cur_idx < page_count)) {
+			/* Architecture cannot unmap pages of this guest */
+			if (merge_page(od, mgctrl.cur_idx) == VMM_ENOTSUPP) {
+				mgctrl.cur_idx = page_count;
+			} else {
+				mgctrl.cur_idx++;
+			}
+			mgctrl.pages_scanned++;
+			count--;
+		}
+		if (mgctrl.cur_idx < page_count) {
+			break;
+		}
 
-	if (!guest || !dst || !len) {
-		return 0;
+		if (list_is_last(&od->head, &mgctrl.od_list)) {
+			mgctrl.cur_od = NULL;
+			mgctrl.full_scans++;
+			/* Candidates of previous full scan are stale */
+			memset(mgctrl.cands, 0, sizeof(mgctrl.cands));
+		} else {
+			mgctrl.cur_od = list_entry(od->head.next,
+					struct vmm_region_ondemand, head);
+		}
+		mgctrl.cur_idx = 0;
 	}
 
-	while (bytes_read < len) {
-		reg = vmm_guest_find_region(guest, gphys_addr, 
-				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
-		if (!reg) {
-			break;
+	vmm_mutex_unlock(&mgctrl.lock);
+}
+
+static int merge_worker(void *data)
+{
+	u64 tstamp;
+
+	while (1) {
+		if (mgctrl.running) {
+			tstamp = (u64)mgctrl.scan_msecs * 1000000ULL;
+			vmm_completion_wait_timeout(&mgctrl.cmpl, &tstamp);
+		} else {
+			vmm_completion_wait(&mgctrl.cmpl);
+		}
+
+		if (mgctrl.running) {
+			merge_scan(mgctrl.scan_pages);
 		}
+	}
 
-		hphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
-		to_read = (reg->gphys_addr + reg->phys_size - gphys_addr);
-		to_read = ((len - bytes_read) < to_read) ? 
-			  (len - bytes_read) : to_read;
+	return VMM_OK;
+}
 
-		to_read = vmm_host_memory_read(hphys_addr,
-					       dst, to_read, cacheable);
-		if (!to_read) {
-			break;
+int vmm_guest_ram_merge_start(void)
+{
+	int rc = VMM_OK;
+
+	vmm_mutex_lock(&mgctrl.lock);
+
+	/* Scanner thread is created upon first start */
+	if (!mgctrl.thread) {
+		mgctrl.thread = vmm_threads_create("ram_merge",
+						   merge_worker, NULL,
+						   VMM_THREAD_DEF_PRIORITY,
+						   VMM_THREAD_DEF_TIME_SLICE);
+		if (!mgctrl.thread) {
+			rc = VMM_ENOMEM;
+		} else if ((rc = vmm_threads_start(mgctrl.thread))) {
+			vmm_threads_destroy(mgctrl.thread);
+			mgctrl.thread = NULL;
 		}
+	}
 
-		gphys_addr += to_read;
-		bytes_read += to_read;
-		dst += to_read;
+	if (!rc) {
+		mgctrl.running = TRUE;
+		vmm_completion_complete(&mgctrl.cmpl);
 	}
 
-	return bytes_read;
+	vmm_mutex_unlock(&mgctrl.lock);
+
+	return rc;
 }
 
-u32 vmm_guest_memory_write(struct vmm_guest *guest, 
-			   physical_addr_t gphys_addr, 
-			   void *src, u32 len, bool cacheable)
+void vmm_guest_ram_merge_stop(void)
 {
-	u32 bytes_written = 0, to_write;
-	physical_addr_t hphys_addr;
-	struct vmm_region *reg = NULL;
+	vmm_mutex_lock(&mgctrl.lock);
+	mgctrl.running = FALSE;
+	vmm_mutex_unlock(&mgctrl.lock);
+}
 
-	if (!guest || !src || !len) {
-		return 0;
+int vmm_guest_ram_merge_set_rate(u32 scan_pages, u32 scan_msecs)
+{
+	if (!scan_pages || !scan_msecs) {
+		return VMM_EINVALID;
 	}
 
-	while (bytes_written < len) {
-		reg = vmm_guest_find_region(guest, gphys_addr, 
-				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
-		if (!reg) {
-			break;
-		}
+	vmm_mutex_lock(&mgctrl.lock);
+	mgctrl.scan_pages = scan_pages;
+	mgctrl.scan_msecs = scan_msecs;
+	vmm_mutex_unlock(&mgctrl.lock);
 
-		hphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
-		to_write = (reg->gphys_addr + reg->phys_size - gphys_addr);
-		to_write = ((len - bytes_written) < to_write) ? 
-			   (len - bytes_written) : to_write;
+	return VMM_OK;
+}
 
-		to_write = vmm_host_memory_write(hphys_addr,
-						 src, to_write, cacheable);
-		if (!to_write) {
-			break;
+void vmm_guest_ram_merge_get_stats(struct vmm_guest_ram_merge_stats *stats)
+{
+	irq_flags_t flags;
+	struct vmm_region_ondemand *od;
+
+	if (!stats) {
+		return;
+	}
+
+	vmm_mutex_lock(&mgctrl.lock);
+	stats->running = mgctrl.running;
+	stats->scan_pages = mgctrl.scan_pages;
+	stats->scan_msecs = mgctrl.scan_msecs;
+	stats->pages_scanned = mgctrl.pages_scanned;
+	stats->full_scans = mgctrl.full_scans;
+	stats->pages_sharing = 0;
+	list_for_each_entry(od, &mgctrl.od_list, head) {
+		stats->pages_sharing += od->merged_frames;
+	}
+	vmm_mutex_unlock(&mgctrl.lock);
+
+	vmm_spin_lock_irqsave_lite(&mgctrl.frame_lock, flags);
+	stats->pages_shared = mgctrl.frame_count;
+	stats->cow_breaks = mgctrl.cow_breaks;
+	vmm_spin_unlock_irqrestore_lite(&mgctrl.frame_lock, flags);
+}
+
+static DEFINE_MUTEX(balloon_lock);
+static LIST_HEAD(balloon_list);
+
+static struct vmm_guest_balloon *balloon_find(struct vmm_guest *guest)
+{
+	struct vmm_guest_balloon *bln;
+
+	list_for_each_entry(bln, &balloon_list, head) {
+		if (bln->guest == guest) {
+			return bln;
 		}
+	}
 
-		gphys_addr += to_write;
-		bytes_written += to_write;
-		src += to_write;
+	return NULL;
+}
+
+int vmm_guest_balloon_register(struct vmm_guest_balloon *bln)
+{
+	int rc = VMM_OK;
+
+	if (!bln || !bln->guest || !bln->set_target || !bln->get_info) {
+		return VMM_EINVALID;
+	}
+	if (!arch_guest_can_trap_memory(bln->guest)) {
+		return VMM_ENOTSUPP;
 	}
 
-	return bytes_written;
+	vmm_mutex_lock(&balloon_lock);
+	if (balloon_find(bln->guest)) {
+		rc = VMM_EEXIST;
+	} else {
+		INIT_LIST_HEAD(&bln->head);
+		list_add_tail(&bln->head, &balloon_list);
+	}
+	vmm_mutex_unlock(&balloon_lock);
+
+	return rc;
 }
 
-int vmm_guest_physical_map(struct vmm_guest *guest,
-			   physical_addr_t gphys_addr,
-			   physical_size_t gphys_size,
-			   physical_addr_t *hphys_addr,
-			   physical_size_t *hphys_size,
-			   u32 *reg_flags)
+int vmm_guest_balloon_unregister(struct vmm_guest_balloon *bln)
 {
-	struct vmm_region *reg = NULL;
+	int rc = VMM_OK;
 
-	if (!guest || !hphys_addr) {
-		return VMM_EFAIL;
+	if (!bln) {
+		return VMM_EINVALID;
 	}
 
-	reg = vmm_guest_find_region(guest, gphys_addr, 
-				    VMM_REGION_MEMORY, FALSE);
-	if (!reg) {
-		return VMM_EFAIL;
+	vmm_mutex_lock(&balloon_lock);
+	if (balloon_find(bln->guest) != bln) {
+		rc = VMM_ENOTAVAIL;
+	} else {
+		list_del(&bln->head);
 	}
-	while (reg->flags & VMM_REGION_ALIAS) {
-		gphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
-		reg = vmm_guest_find_region(guest, gphys_addr, 
-					    VMM_REGION_MEMORY, FALSE);
-		if (!reg) {
-			return VMM_EFAIL;
-		}
+	vmm_mutex_unlock(&balloon_lock);
+
+	return rc;
+}
+
+int vmm_guest_balloon_set_target(struct vmm_guest *guest,
+				 physical_size_t size)
+{
+	int rc;
+	struct vmm_guest_balloon *bln;
+
+	if (!guest) {
+		return VMM_EINVALID;
 	}
 
-	*hphys_addr = VMM_REGION_GPHYS_TO_HPHYS(reg, gphys_addr);
+	vmm_mutex_lock(&balloon_lock);
+	bln = balloon_find(guest);
+	rc = (bln) ? bln->set_target(bln, size) : VMM_ENODEV;
+	vmm_mutex_unlock(&balloon_lock);
 
-	if (hphys_size) {
-		*hphys_size = reg->gphys_addr + reg->phys_size - gphys_addr;
-		if (gphys_size < *hphys_size) {
-			*hphys_size = gphys_size;
-		}
+	return rc;
+}
+
+int vmm_guest_balloon_get_info(struct vmm_guest *guest,
+			       struct vmm_guest_balloon_info *info)
+{
+	int rc;
+	struct vmm_guest_balloon *bln;
+
+	if (!guest || !info) {
+		return VMM_EINVALID;
 	}
 
-	if (reg_flags) {
-		*reg_flags = reg->flags;
+	memset(info, 0, sizeof(*info));
+
+	vmm_mutex_lock(&balloon_lock);
+	bln = balloon_find(guest);
+	rc = (bln) ? bln->get_info(bln, info) : VMM_ENODEV;
+	vmm_mutex_unlock(&balloon_lock);
+
+	return rc;
+}
+
+struct vmm_guest_dirty_log *vmm_guest_dirty_log_start(
+					struct vmm_guest *guest,
+					physical_addr_t gphys_addr,
+					physical_size_t gphys_size)
+{
+	irq_flags_t flags;
+	struct vmm_guest_dirty_log *dlog;
+	struct vmm_guest_aspace *aspace;
+
+	if (!guest || !gphys_size || !arch_guest_can_trap_memory(guest)) {
+		return NULL;
+	}
+	aspace = &guest->aspace;
+
+	dlog = vmm_zalloc(sizeof(*dlog));
+	if (!dlog) {
+		return NULL;
 	}
 
-	return VMM_OK;
+	INIT_LIST_HEAD(&dlog->head);
+	dlog->guest = guest;
+	dlog->gphys_addr = gphys_addr & ~VMM_PAGE_MASK;
+	dlog->gphys_size = VMM_ROUNDUP2_PAGE_SIZE(gphys_addr + gphys_size) -
+							dlog->gphys_addr;
+	dlog->page_count = dlog->gphys_size >> VMM_PAGE_SHIFT;
+	dlog->dirty_bmap = vmm_zalloc(bitmap_estimate_size(dlog->page_count));
+	if (!dlog->dirty_bmap) {
+		vmm_free(dlog);
+		return NULL;
+	}
+
+	/* Report all pages dirty in first sync */
+	bitmap_fill(dlog->dirty_bmap, dlog->page_count);
+
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	list_add_tail(&dlog->head, &aspace->dirty_log_list);
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	/* Ensure that architecture can trap guest writes */
+	if (arch_guest_write_protect(guest, dlog->gphys_addr,
+				     dlog->gphys_size)) {
+		vmm_guest_dirty_log_stop(dlog);
+		return NULL;
+	}
+
+	return dlog;
 }
 
-int vmm_guest_physical_unmap(struct vmm_guest *guest,
-			     physical_addr_t gphys_addr,
-			     physical_size_t gphys_size)
+void vmm_guest_dirty_log_stop(struct vmm_guest_dirty_log *dlog)
+{
+	irq_flags_t flags;
+	struct vmm_guest_aspace *aspace;
+
+	if (!dlog) {
+		return;
+	}
+	aspace = &dlog->guest->aspace;
+
+	/* Pages which remain write protected are made writeable
+	 * again by architecture code upon next write fault.
+	 */
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	list_del(&dlog->head);
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	vmm_free(dlog->dirty_bmap);
+	vmm_free(dlog);
+}
+
+int vmm_guest_dirty_log_sync(struct vmm_guest_dirty_log *dlog,
+			     unsigned long *bmap)
 {
-	/* We don't have dynamic host RAM allocation so
-	 * Nothing to do here.
+	u32 i, start;
+	irq_flags_t flags;
+	struct vmm_guest_aspace *aspace;
+
+	if (!dlog || !bmap) {
+		return VMM_EINVALID;
+	}
+	aspace = &dlog->guest->aspace;
+
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	bitmap_copy(bmap, dlog->dirty_bmap, dlog->page_count);
+	bitmap_zero(dlog->dirty_bmap, dlog->page_count);
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	/* Re-arm dirty logging for pages reported dirty. A guest
+	 * write done before write protection is in place will be
+	 * visible to whoever reads the pages after this sync.
 	 */
+	i = 0;
+	while (i < dlog->page_count) {
+		if (!bitmap_isset(bmap, i)) {
+			i++;
+			continue;
+		}
+		start = i;
+		while ((i < dlog->page_count) && bitmap_isset(bmap, i)) {
+			i++;
+		}
+		arch_guest_write_protect(dlog->guest,
+				dlog->gphys_addr + VMM_PFN_PHYS(start),
+				VMM_PFN_PHYS(i - start));
+	}
+
 	return VMM_OK;
 }
 
+bool vmm_guest_dirty_log_overlap(struct vmm_guest *guest,
+				 physical_addr_t gphys_addr,
+				 physical_size_t gphys_size)
+{
+	bool ret = FALSE;
+	irq_flags_t flags;
+	struct vmm_guest_dirty_log *dlog;
+	struct vmm_guest_aspace *aspace;
+
+	if (!guest) {
+		return FALSE;
+	}
+	aspace = &guest->aspace;
+
+	if (list_empty(&aspace->dirty_log_list)) {
+		return FALSE;
+	}
+
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	list_for_each_entry(dlog, &aspace->dirty_log_list, head) {
+		if ((gphys_addr < (dlog->gphys_addr + dlog->gphys_size)) &&
+		    (dlog->gphys_addr < (gphys_addr + gphys_size))) {
+			ret = TRUE;
+			break;
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	return ret;
+}
+
+bool vmm_guest_dirty_log_clean(struct vmm_guest *guest,
+			       physical_addr_t gphys_addr)
+{
+	bool ret = FALSE;
+	irq_flags_t flags;
+	struct vmm_guest_dirty_log *dlog;
+	struct vmm_guest_aspace *aspace;
+
+	if (!guest) {
+		return FALSE;
+	}
+	aspace = &guest->aspace;
+
+	if (list_empty(&aspace->dirty_log_list)) {
+		return FALSE;
+	}
+
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	list_for_each_entry(dlog, &aspace->dirty_log_list, head) {
+		if ((gphys_addr < dlog->gphys_addr) ||
+		    ((dlog->gphys_addr + dlog->gphys_size) <= gphys_addr)) {
+			continue;
+		}
+		if (!bitmap_isset(dlog->dirty_bmap,
+			(gphys_addr - dlog->gphys_addr) >> VMM_PAGE_SHIFT)) {
+			ret = TRUE;
+			break;
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	return ret;
+}
+
+bool vmm_guest_dirty_log_mark(struct vmm_guest *guest,
+			      physical_addr_t gphys_addr)
+{
+	bool ret = FALSE;
+	irq_flags_t flags;
+	struct vmm_guest_dirty_log *dlog;
+	struct vmm_guest_aspace *aspace;
+
+	if (!guest) {
+		return FALSE;
+	}
+	aspace = &guest->aspace;
+
+	if (list_empty(&aspace->dirty_log_list)) {
+		return FALSE;
+	}
+
+	vmm_spin_lock_irqsave_lite(&aspace->dirty_log_lock, flags);
+	list_for_each_entry(dlog, &aspace->dirty_log_list, head) {
+		if ((gphys_addr < dlog->gphys_addr) ||
+		    ((dlog->gphys_addr + dlog->gphys_size) <= gphys_addr)) {
+			continue;
+		}
+		bitmap_setbit(dlog->dirty_bmap,
+			(gphys_addr - dlog->gphys_addr) >> VMM_PAGE_SHIFT);
+		ret = TRUE;
+	}
+	vmm_spin_unlock_irqrestore_lite(&aspace->dirty_log_lock, flags);
+
+	return ret;
+}
+
 bool is_region_node_valid(struct vmm_devtree_node *rnode)
 {
 	u32 order;
@@ -317,7 +2282,8 @@ bool is_region_node_valid(struct vmm_devtree_node *rnode)
 		return FALSE;
 	}
 	if (!strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_RAM) ||
-	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_ROM)) {
+	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_ROM) ||
+	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ONDEMAND_RAM)) {
 		is_alloced = TRUE;
 	}
 
@@ -492,7 +2458,8 @@ static int region_add(struct vmm_guest *guest,
 	}
 
 	if (!strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_RAM) ||
-	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_RAM)) {
+	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_RAM) ||
+	    !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ONDEMAND_RAM)) {
 		reg->flags |= VMM_REGION_ISRAM;
 	} else if (!strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ROM) ||
 	      !strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_ROM)) {
@@ -512,6 +2479,10 @@ static int region_add(struct vmm_guest *guest,
 		reg->flags |= VMM_REGION_ISALLOCED;
 	}
 
+	if (!strcmp(aval, VMM_DEVTREE_DEVICE_TYPE_VAL_ONDEMAND_RAM)) {
+		reg->flags |= VMM_REGION_ISONDEMAND;
+	}
+
 	if ((reg->flags & VMM_REGION_REAL) &&
 	    (reg->flags & VMM_REGION_MEMORY) &&
 	    (reg->flags & VMM_REGION_ISRAM)) {
@@ -527,7 +2498,7 @@ static int region_add(struct vmm_guest *guest,
 	}
 
 	if ((reg->flags & VMM_REGION_REAL) &&
-	    !(reg->flags & VMM_REGION_ISALLOCED)) {
+	    !(reg->flags & (VMM_REGION_ISALLOCED | VMM_REGION_ISONDEMAND))) {
 		rc = vmm_devtree_read_physaddr(reg->node,
 				VMM_DEVTREE_HOST_PHYS_ATTR_NAME,
 				&reg->hphys_addr);
@@ -586,6 +2557,18 @@ static int region_add(struct vmm_guest *guest,
 		}
 	}
 
+	/* Setup on-demand RAM regions (populated upon first access) */
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		rc = ondemand_init(reg);
+		if (rc) {
+			vmm_printf("%s: Failed to setup on-demand "
+				   "RAM for %s/%s (error %d)\n",
+				   __func__, guest->name,
+				   reg->node->name, rc);
+			goto region_free_fail;
+		}
+	}
+
 	/* Allocate host RAM for alloced RAM/ROM regions */
 	if (!(reg->flags & (VMM_REGION_ALIAS | VMM_REGION_VIRTUAL)) &&
 	    (reg->flags & (VMM_REGION_ISRAM | VMM_REGION_ISROM)) &&
@@ -620,6 +2603,12 @@ static int region_add(struct vmm_guest *guest,
 		}
 	}
 
+	/* Account host RAM of alloced/reserved regions as resident */
+	if (reg->flags & VMM_REGION_ISHOSTRAM) {
+		arch_atomic_add(&aspace->rss_frames,
+				reg->phys_size >> VMM_PAGE_SHIFT);
+	}
+
 	/* Probe device emulation for real & virtual device regions */
 	if ((reg->flags & VMM_REGION_ISDEVICE) &&
 	    !(reg->flags & VMM_REGION_ALIAS)) {
@@ -682,9 +2671,14 @@ region_unprobe_fail:
 		vmm_devemu_remove_region(guest, reg);
 	}
 region_ram_free_fail:
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		ondemand_deinit(reg);
+	}
 	if (!(reg->flags & (VMM_REGION_ALIAS | VMM_REGION_VIRTUAL)) &&
 	    (reg->flags & (VMM_REGION_ISRAM | VMM_REGION_ISROM)) &&
 	    (reg->flags & VMM_REGION_ISHOSTRAM)) {
+		arch_atomic_sub(&aspace->rss_frames,
+				reg->phys_size >> VMM_PAGE_SHIFT);
 		if (reg->flags & VMM_REGION_ISALLOCED) {
 			vmm_devtree_delattr(reg->node,
 					    VMM_DEVTREE_HOST_PHYS_ATTR_NAME);
@@ -751,10 +2745,17 @@ static int region_del(struct vmm_guest *guest,
 		vmm_devemu_remove_region(guest, reg);
 	}
 
+	/* Free populated host RAM of on-demand region */
+	if (reg->flags & VMM_REGION_ISONDEMAND) {
+		ondemand_deinit(reg);
+	}
+
 	/* Free host RAM if region has alloced/reserved host RAM */
 	if (!(reg->flags & (VMM_REGION_ALIAS | VMM_REGION_VIRTUAL)) &&
 	    (reg->flags & (VMM_REGION_ISRAM | VMM_REGION_ISROM)) &&
 	    (reg->flags & VMM_REGION_ISHOSTRAM)) {
+		arch_atomic_sub(&aspace->rss_frames,
+				reg->phys_size >> VMM_PAGE_SHIFT);
 		if (reg->flags & VMM_REGION_ISALLOCED) {
 			vmm_devtree_delattr(reg->node,
 					    VMM_DEVTREE_HOST_PHYS_ATTR_NAME);
@@ -1077,6 +3078,10 @@ int vmm_guest_aspace_init(struct vmm_guest *guest)
 	INIT_RW_LOCK(&aspace->reg_memtree_lock);
 	aspace->reg_memtree = RB_ROOT;
 	INIT_LIST_HEAD(&aspace->reg_memprobe_list);
+	INIT_SPIN_LOCK(&aspace->dirty_log_lock);
+	INIT_LIST_HEAD(&aspace->dirty_log_list);
+	ARCH_ATOMIC_INIT(&aspace->rss_frames, 0);
+	ARCH_ATOMIC_INIT(&aspace->merged_frames, 0);
 	guest->aspace.devemu_priv = NULL;
 
 	/* Initialize device emulation context */
@@ -1188,6 +3193,15 @@ int vmm_guest_aspace_deinit(struct vmm_guest *guest)
 	}
 	guest->aspace.devemu_priv = NULL;
 
+	/* Stop dirty page logging not stopped by emulators. This must
+	 * be done after emulators are gone because they stop their own
+	 * dirty page logs upon removal.
+	 */
+	while (!list_empty(&aspace->dirty_log_list)) {
+		vmm_guest_dirty_log_stop(list_first_entry(&aspace->dirty_log_list,
+					struct vmm_guest_dirty_log, head));
+	}
+
 	/* De-reference address space node */
 	if (guest->aspace.node) {
 		vmm_devtree_dref_node(guest->aspace.node);
@@ -25,11 +25,14 @@
 #include <vmm_smp.h>
 #include <vmm_heap.h>
 #include <vmm_stdio.h>
+#include <vmm_delay.h>
 #include <vmm_host_irq.h>
 #include <vmm_host_irqext.h>
 #include <vmm_host_irqdomain.h>
+#include <arch_barrier.h>
 #include <arch_cpu_irq.h>
 #include <arch_host_irq.h>
+#include <libs/rculist.h>
 #include <libs/stringlib.h>
 
 struct vmm_host_irqs_ctrl {
@@ -43,20 +46,19 @@ static struct vmm_host_irqs_ctrl hirqctrl;
 
 void vmm_handle_percpu_irq(struct vmm_host_irq *irq, u32 cpu, void *data)
 {
-	irq_flags_t flags;
 	struct vmm_host_irq_action *act;
 
 	if (irq->chip && irq->chip->irq_ack) {
 		irq->chip->irq_ack(irq);
 	}
 
-	vmm_read_lock_irqsave_lite(&irq->action_lock[cpu], flags);
-	list_for_each_entry(act, &irq->action_list[cpu], head) {
+	vmm_rcu_read_lock();
+	list_for_each_entry_rcu(act, &irq->action_list[cpu], head) {
 		if (act->func(irq->num, act->dev) == VMM_IRQ_HANDLED) {
 			break;
 		}
 	}
-	vmm_read_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+	vmm_rcu_read_unlock();
 
 	if (irq->chip && irq->chip->irq_eoi) {
 		irq->chip->irq_eoi(irq);
@@ -65,16 +67,15 @@ void vmm_handle_percpu_irq(struct vmm_host_irq *irq, u32 cpu, void *data)
 
 void vmm_handle_fast_eoi(struct vmm_host_irq *irq, u32 cpu, void *data)
 {
-	irq_flags_t flags;
 	struct vmm_host_irq_action *act;
 
-	vmm_read_lock_irqsave_lite(&irq->action_lock[cpu], flags);
-	list_for_each_entry(act, &irq->action_list[cpu], head) {
+	vmm_rcu_read_lock();
+	list_for_each_entry_rcu(act, &irq->action_list[cpu], head) {
 		if (act->func(irq->num, act->dev) == VMM_IRQ_HANDLED) {
 			break;
 		}
 	}
-	vmm_read_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+	vmm_rcu_read_unlock();
 
 	if (irq->chip && irq->chip->irq_eoi) {
 		irq->chip->irq_eoi(irq);
@@ -83,7 +84,6 @@ void vmm_handle_fast_eoi(struct vmm_host_irq *irq, u32 cpu, void *data)
 
 void vmm_handle_level_irq(struct vmm_host_irq *irq, u32 cpu, void *data)
 {
-	irq_flags_t flags;
 	struct vmm_host_irq_action *act;
 
 	if (irq->chip) {
@@ -99,13 +99,13 @@ void vmm_handle_level_irq(struct vmm_host_irq *irq, u32 cpu, void *data)
 		}
 	}
 
-	vmm_read_lock_irqsave_lite(&irq->action_lock[cpu], flags);
-	list_for_each_entry(act, &irq->action_list[cpu], head) {
+	vmm_rcu_read_lock();
+	list_for_each_entry_rcu(act, &irq->action_list[cpu], head) {
 		if (act->func(irq->num, act->dev) == VMM_IRQ_HANDLED) {
 			break;
 		}
 	}
-	vmm_read_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+	vmm_rcu_read_unlock();
 
 	if (irq->chip && irq->chip->irq_unmask) {
 		irq->chip->irq_unmask(irq);
@@ -132,9 +132,12 @@ int vmm_host_generic_irq_exec(u32 hirq_no)
 	cpu = vmm_smp_processor_id();
 	irq->count[cpu]++;
 	irq->in_progress[cpu] = TRUE;
+	/* Pairs with barrier in host_irq_wait_handlers() */
+	arch_smp_mb();
 	if (irq->handler) {
 		irq->handler(irq, cpu, irq->handler_data);
 	}
+	arch_smp_mb();
 	irq->in_progress[cpu] = FALSE;
 
 	return VMM_OK;
@@ -542,7 +545,7 @@ static int host_irq_register(struct vmm_host_irq *irq,
 	irq_flags_t flags;
 	struct vmm_host_irq_action *act;
 
-	vmm_write_lock_irqsave_lite(&irq->action_lock[cpu], flags);
+	vmm_spin_lock_irqsave_lite(&irq->action_lock[cpu], flags);
 
 	found = FALSE;
 	list_for_each_entry(act, &irq->action_list[cpu], head) {
@@ -552,23 +555,23 @@ static int host_irq_register(struct vmm_host_irq *irq,
 		}
 	}
 	if (found) {
-		vmm_write_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+		vmm_spin_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
 		return VMM_EFAIL;
 	}
 
 	irq->name = name;
 	act = vmm_zalloc(sizeof(struct vmm_host_irq_action));
 	if (!act) {
-		vmm_write_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+		vmm_spin_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
 		return VMM_ENOMEM;
 	}
 	INIT_LIST_HEAD(&act->head);
 	act->func = func;
 	act->dev = dev;
 
-	list_add_tail(&act->head, &irq->action_list[cpu]);
+	list_add_tail_rcu(&act->head, &irq->action_list[cpu]);
 
-	vmm_write_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+	vmm_spin_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
 
 	return VMM_OK;
 }
@@ -603,6 +606,11 @@ int vmm_host_irq_register(u32 hirq,
 	return vmm_host_irq_enable(hirq);
 }
 
+static void host_irq_action_free(struct vmm_rcu_head *rcu)
+{
+	vmm_free(container_of(rcu, struct vmm_host_irq_action, rcu));
+}
+
 static int host_irq_unregister(struct vmm_host_irq *irq, void *dev,
 			       u32 cpu, bool *disable)
 {
@@ -610,7 +618,7 @@ static int host_irq_unregister(struct vmm_host_irq *irq, void *dev,
 	irq_flags_t flags;
 	struct vmm_host_irq_action *act;
 
-	vmm_write_lock_irqsave_lite(&irq->action_lock[cpu], flags);
+	vmm_spin_lock_irqsave_lite(&irq->action_lock[cpu], flags);
 	found = FALSE;
 	list_for_each_entry(act, &irq->action_list[cpu], head) {
 		if (act->dev == dev) {
@@ -619,21 +627,40 @@ static int host_irq_unregister(struct vmm_host_irq *irq, void *dev,
 		}
 	}
 	if (!found) {
-		vmm_write_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+		vmm_spin_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
 		return VMM_EFAIL;
 	}
 
-	list_del(&act->head);
-	vmm_free(act);
+	/* IRQ handlers might still be using this action */
+	list_del_rcu(&act->head);
+	vmm_call_rcu(&act->rcu, host_irq_action_free);
 	if (list_empty(&irq->action_list[cpu])) {
 		*disable = TRUE;
 	}
 
-	vmm_write_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
+	vmm_spin_unlock_irqrestore_lite(&irq->action_lock[cpu], flags);
 
 	return VMM_OK;
 }
 
+/* Wait for handlers of given irq running on other host CPUs */
+static void host_irq_wait_handlers(struct vmm_host_irq *irq)
+{
+	u32 cpu, this_cpu = vmm_smp_processor_id();
+
+	/* Pairs with barriers in vmm_host_irq_exec() */
+	arch_smp_mb();
+
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		if (cpu == this_cpu) {
+			continue;
+		}
+		while (irq->in_progress[cpu]) {
+			vmm_udelay(1);
+		}
+	}
+}
+
 int vmm_host_irq_unregister(u32 hirq, void *dev)
 {
 	int rc;
@@ -661,6 +688,10 @@ int vmm_host_irq_unregister(u32 hirq, void *dev)
 			}
 		}
 	}
+
+	/* Caller is free to release dev once we return */
+	host_irq_wait_handlers(irq);
+
 	if (disable) {
 		return vmm_host_irq_disable(hirq);
 	}
@@ -726,7 +757,7 @@ void __vmm_host_irq_init_desc(struct vmm_host_irq *irq,
 	irq->handler = NULL;
 	irq->handler_data = NULL;
 	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
-		INIT_RW_LOCK(&irq->action_lock[cpu]);
+		INIT_SPIN_LOCK(&irq->action_lock[cpu]);
 		INIT_LIST_HEAD(&irq->action_list[cpu]);
 	}
 }
@@ -32,6 +32,23 @@
 #include <libs/mathlib.h>
 #include <libs/bitmap.h>
 
+/* Free frames of a bank are also tracked as naturally aligned
+ * power-of-two blocks (buddy blocks) so that allocation does not
+ * have to scan the frame bitmap. For each order there is one bit
+ * per aligned block position and the bit is set when the block is
+ * free as a whole and its buddy is not free. To find free blocks
+ * quickly, per-order bitmaps are hierarchical where each upper level
+ * bit summarizes one word of the level below.
+ */
+#define HOST_RAM_ORDER_COUNT		24
+#define HOST_RAM_MAX_ORDER		(HOST_RAM_ORDER_COUNT - 1)
+#define HOST_RAM_HBMAP_MAX_LEVELS	8
+
+struct host_ram_hbmap {
+	u32 levels;
+	unsigned long *lvl[HOST_RAM_HBMAP_MAX_LEVELS];
+};
+
 struct vmm_host_ram_bank {
 	physical_addr_t start;
 	physical_size_t size;
@@ -42,6 +59,9 @@ struct vmm_host_ram_bank {
 	u32 bmap_sz;
 	u32 bmap_free;
 
+	physical_addr_t base_pfn;
+	struct host_ram_hbmap buddy[HOST_RAM_ORDER_COUNT];
+
 	struct vmm_resource res;
 };
 
@@ -52,12 +72,267 @@ struct vmm_host_ram_ctrl {
 
 static struct vmm_host_ram_ctrl rctrl;
 
+static virtual_size_t host_ram_hbmap_size(u32 nbits)
+{
+	virtual_size_t ret = 0;
+
+	while (1) {
+		ret += bitmap_estimate_size(nbits);
+		if (nbits <= BITS_PER_LONG) {
+			break;
+		}
+		nbits = BITS_TO_LONGS(nbits);
+	}
+
+	return ret;
+}
+
+static virtual_addr_t host_ram_hbmap_init(struct host_ram_hbmap *hb,
+					  u32 nbits, virtual_addr_t hkbase)
+{
+	hb->levels = 0;
+	while (1) {
+		BUG_ON(HOST_RAM_HBMAP_MAX_LEVELS <= hb->levels);
+		hb->lvl[hb->levels] = (unsigned long *)hkbase;
+		bitmap_zero(hb->lvl[hb->levels], nbits);
+		hkbase += bitmap_estimate_size(nbits);
+		hb->levels++;
+		if (nbits <= BITS_PER_LONG) {
+			break;
+		}
+		nbits = BITS_TO_LONGS(nbits);
+	}
+
+	return hkbase;
+}
+
+static inline bool host_ram_hbmap_test(struct host_ram_hbmap *hb, u32 bit)
+{
+	return (hb->lvl[0][BIT_WORD(bit)] & BIT_MASK(bit)) ? TRUE : FALSE;
+}
+
+static void host_ram_hbmap_set(struct host_ram_hbmap *hb, u32 bit)
+{
+	u32 l;
+	unsigned long old;
+
+	for (l = 0; l < hb->levels; l++) {
+		old = hb->lvl[l][BIT_WORD(bit)];
+		hb->lvl[l][BIT_WORD(bit)] = old | BIT_MASK(bit);
+		if (old) {
+			break;
+		}
+		bit = BIT_WORD(bit);
+	}
+}
+
+static void host_ram_hbmap_clear(struct host_ram_hbmap *hb, u32 bit)
+{
+	u32 l;
+
+	for (l = 0; l < hb->levels; l++) {
+		hb->lvl[l][BIT_WORD(bit)] &= ~BIT_MASK(bit);
+		if (hb->lvl[l][BIT_WORD(bit)]) {
+			break;
+		}
+		bit = BIT_WORD(bit);
+	}
+}
+
+static bool host_ram_hbmap_first(struct host_ram_hbmap *hb, u32 *bit)
+{
+	int l;
+	u32 pos = 0;
+
+	if (!hb->lvl[hb->levels - 1][0]) {
+		return FALSE;
+	}
+
+	for (l = hb->levels - 1; l >= 0; l--) {
+		pos = pos * BITS_PER_LONG + __ffs(hb->lvl[l][pos]);
+	}
+	*bit = pos;
+
+	return TRUE;
+}
+
+/* Number of aligned blocks of given order which can overlap a bank */
+static inline u32 host_ram_buddy_nbits(u32 frame_count, u32 order)
+{
+	return (frame_count >> order) + 2;
+}
+
+static inline u32 host_ram_buddy_idx(struct vmm_host_ram_bank *bank,
+				     u32 order, physical_addr_t pfn)
+{
+	return (u32)((pfn >> order) - (bank->base_pfn >> order));
+}
+
+static inline bool host_ram_buddy_valid(struct vmm_host_ram_bank *bank,
+					u32 order, physical_addr_t pfn)
+{
+	return ((bank->base_pfn <= pfn) &&
+		((pfn + ((physical_addr_t)1 << order)) <=
+		 (bank->base_pfn + bank->frame_count))) ? TRUE : FALSE;
+}
+
+static inline bool host_ram_buddy_isfree(struct vmm_host_ram_bank *bank,
+					 u32 order, physical_addr_t pfn)
+{
+	return host_ram_buddy_valid(bank, order, pfn) &&
+	       host_ram_hbmap_test(&bank->buddy[order],
+				   host_ram_buddy_idx(bank, order, pfn));
+}
+
+/* Add free block to buddy index and coalesce with free buddies */
+static void host_ram_buddy_put(struct vmm_host_ram_bank *bank,
+			       u32 order, physical_addr_t pfn)
+{
+	physical_addr_t bpfn;
+
+	while (order < HOST_RAM_MAX_ORDER) {
+		bpfn = pfn ^ ((physical_addr_t)1 << order);
+		if (!host_ram_buddy_isfree(bank, order, bpfn)) {
+			break;
+		}
+		host_ram_hbmap_clear(&bank->buddy[order],
+				     host_ram_buddy_idx(bank, order, bpfn));
+		pfn &= ~((physical_addr_t)1 << order);
+		order++;
+	}
+
+	host_ram_hbmap_set(&bank->buddy[order],
+			   host_ram_buddy_idx(bank, order, pfn));
+}
+
+/* Add arbitrary range of free frames to buddy index */
+static void host_ram_buddy_free_range(struct vmm_host_ram_bank *bank,
+				      physical_addr_t pfn, u32 count)
+{
+	u32 order;
+
+	while (count) {
+		for (order = 0; order < HOST_RAM_MAX_ORDER; order++) {
+			if (((pfn >> order) & 0x1) ||
+			    (count < (2UL << order))) {
+				break;
+			}
+		}
+		host_ram_buddy_put(bank, order, pfn);
+		pfn += (physical_addr_t)1 << order;
+		count -= 1UL << order;
+	}
+}
+
+/* Remove range of free frames from buddy index where blocks
+ * partially overlapping the range are split and the parts
+ * outside the range are given back.
+ */
+static void host_ram_buddy_take_range(struct vmm_host_ram_bank *bank,
+				      physical_addr_t pfn, u32 count)
+{
+	u32 order;
+	physical_addr_t bpfn, bend, end = pfn + count;
+
+	while (pfn < end) {
+		for (order = 0; order <= HOST_RAM_MAX_ORDER; order++) {
+			bpfn = pfn & ~(((physical_addr_t)1 << order) - 1);
+			if (host_ram_buddy_isfree(bank, order, bpfn)) {
+				break;
+			}
+		}
+		if (HOST_RAM_MAX_ORDER < order) {
+			/* Buddy index not in sync with frame bitmap */
+			WARN_ON(1);
+			break;
+		}
+
+		host_ram_hbmap_clear(&bank->buddy[order],
+				     host_ram_buddy_idx(bank, order, bpfn));
+		bend = bpfn + ((physical_addr_t)1 << order);
+		if (bpfn < pfn) {
+			host_ram_buddy_free_range(bank, bpfn, pfn - bpfn);
+		}
+		if (end < bend) {
+			host_ram_buddy_free_range(bank, end, bend - end);
+			bend = end;
+		}
+		pfn = bend;
+	}
+}
+
+static bool host_ram_range_isfree(struct vmm_host_ram_bank *bank,
+				  u32 bpos, u32 bcnt)
+{
+	return (find_next_bit(bank->bmap, bpos + bcnt, bpos) >=
+		(bpos + bcnt)) ? TRUE : FALSE;
+}
+
+/* Allocate from buddy index with lock held */
+static bool host_ram_buddy_alloc(struct vmm_host_ram_bank *bank,
+				 u32 bcnt, u32 align_order, u32 *bpos)
+{
+	u32 order, idx;
+	physical_addr_t pfn;
+
+	order = align_order - VMM_PAGE_SHIFT;
+	while ((1UL << order) < bcnt) {
+		order++;
+	}
+
+	for (; order <= HOST_RAM_MAX_ORDER; order++) {
+		if (!host_ram_hbmap_first(&bank->buddy[order], &idx)) {
+			continue;
+		}
+
+		host_ram_hbmap_clear(&bank->buddy[order], idx);
+		pfn = ((physical_addr_t)idx + (bank->base_pfn >> order))
+								<< order;
+		if (bcnt < (1UL << order)) {
+			host_ram_buddy_free_range(bank, pfn + bcnt,
+						  (1UL << order) - bcnt);
+		}
+		*bpos = pfn - bank->base_pfn;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Allocate by scanning frame bitmap with lock held. This is only
+ * used for requests larger than biggest buddy block or when buddy
+ * index is too fragmented to satisfy aligned request.
+ */
+static bool host_ram_scan_alloc(struct vmm_host_ram_bank *bank,
+				u32 bcnt, u32 align_order, u32 *bpos)
+{
+	u32 binc, pos;
+
+	binc = order_size(align_order) >> VMM_PAGE_SHIFT;
+	pos = bank->start & order_mask(align_order);
+	if (pos) {
+		pos = VMM_SIZE_TO_PAGE(order_size(align_order) - pos);
+	}
+	for (; (pos + bcnt) <= bank->frame_count; pos += binc) {
+		if (host_ram_range_isfree(bank, pos, bcnt)) {
+			host_ram_buddy_take_range(bank,
+					bank->base_pfn + pos, bcnt);
+			*bpos = pos;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 physical_size_t vmm_host_ram_alloc(physical_addr_t *pa,
 				   physical_size_t sz,
 				   u32 align_order)
 {
+	bool found;
 	irq_flags_t flags;
-	u32 i, found, bn, binc, bcnt, bpos, bfree;
+	u32 bn, bcnt, bpos;
 	struct vmm_host_ram_bank *bank;
 
 	if ((sz == 0) ||
@@ -79,31 +354,22 @@ physical_size_t vmm_host_ram_alloc(physical_addr_t *pa,
 			continue;
 		}
 
-		found = 0;
-		binc = order_size(align_order) >> VMM_PAGE_SHIFT;
-		bpos = bank->start & order_mask(align_order);
-		if (bpos) {
-			bpos = VMM_SIZE_TO_PAGE(order_size(align_order) - bpos);
+		found = FALSE;
+		if (((align_order - VMM_PAGE_SHIFT) <= HOST_RAM_MAX_ORDER) &&
+		    (bcnt <= (1UL << HOST_RAM_MAX_ORDER))) {
+			found = host_ram_buddy_alloc(bank, bcnt,
+						     align_order, &bpos);
 		}
-		for (; bpos < (bank->size >> VMM_PAGE_SHIFT); bpos += binc) {
-			bfree = 0;
-			for (i = bpos; i < (bpos + bcnt); i++) {
-				if (bitmap_isset(bank->bmap, i)) {
-					break;
-				}
-				bfree++;
-			}
-			if (bfree == bcnt) {
-				found = 1;
-				break;
-			}
+		if (!found) {
+			found = host_ram_scan_alloc(bank, bcnt,
+						    align_order, &bpos);
 		}
 		if (!found) {
 			vmm_spin_unlock_irqrestore_lite(&bank->bmap_lock, flags);
 			continue;
 		}
 
-		*pa = bank->start + bpos * VMM_PAGE_SIZE;
+		*pa = bank->start + (physical_addr_t)bpos * VMM_PAGE_SIZE;
 		bitmap_set(bank->bmap, bpos, bcnt);
 		bank->bmap_free -= bcnt;
 
@@ -118,7 +384,7 @@ physical_size_t vmm_host_ram_alloc(physical_addr_t *pa,
 int vmm_host_ram_reserve(physical_addr_t pa, physical_size_t sz)
 {
 	int rc = VMM_EINVALID;
-	u32 i, bn, bcnt, bpos, bfree;
+	u32 bn, bcnt, bpos;
 	irq_flags_t flags;
 	struct vmm_host_ram_bank *bank;
 
@@ -135,26 +401,14 @@ int vmm_host_ram_reserve(physical_addr_t pa, physical_size_t sz)
 
 		vmm_spin_lock_irqsave_lite(&bank->bmap_lock, flags);
 
-		if (bank->bmap_free < bcnt) {
-			vmm_spin_unlock_irqrestore_lite(&bank->bmap_lock, flags);
-			rc = VMM_ENOSPC;
-			break;
-		}
-
-		bfree = 0;
-		for (i = bpos; i < (bpos + bcnt); i++) {
-			if (bitmap_isset(bank->bmap, i)) {
-				break;
-			}
-			bfree++;
-		}
-
-		if (bfree != bcnt) {
+		if ((bank->bmap_free < bcnt) ||
+		    !host_ram_range_isfree(bank, bpos, bcnt)) {
 			vmm_spin_unlock_irqrestore_lite(&bank->bmap_lock, flags);
 			rc = VMM_ENOSPC;
 			break;
 		}
 
+		host_ram_buddy_take_range(bank, bank->base_pfn + bpos, bcnt);
 		bitmap_set(bank->bmap, bpos, bcnt);
 		bank->bmap_free -= bcnt;
 
@@ -170,7 +424,7 @@ int vmm_host_ram_reserve(physical_addr_t pa, physical_size_t sz)
 int vmm_host_ram_free(physical_addr_t pa, physical_size_t sz)
 {
 	int rc = VMM_EINVALID;
-	u32 bn, bcnt, bpos;
+	u32 bn, bcnt, bpos, bend, rstart, rend;
 	irq_flags_t flags;
 	struct vmm_host_ram_bank *bank;
 
@@ -184,11 +438,26 @@ int vmm_host_ram_free(physical_addr_t pa, physical_size_t sz)
 
 		bpos = (pa - bank->start) >> VMM_PAGE_SHIFT;
 		bcnt = VMM_SIZE_TO_PAGE(sz);
+		bend = bpos + bcnt;
 
 		vmm_spin_lock_irqsave_lite(&bank->bmap_lock, flags);
 
-		bitmap_clear(bank->bmap, bpos, bcnt);
-		bank->bmap_free += bcnt;
+		/* Only give back frames which are actually allocated
+		 * so that buddy index stays consistent with bitmap.
+		 */
+		rstart = bpos;
+		while (rstart < bend) {
+			rstart = find_next_bit(bank->bmap, bend, rstart);
+			if (bend <= rstart) {
+				break;
+			}
+			rend = find_next_zero_bit(bank->bmap, bend, rstart);
+			bitmap_clear(bank->bmap, rstart, rend - rstart);
+			bank->bmap_free += rend - rstart;
+			host_ram_buddy_free_range(bank,
+					bank->base_pfn + rstart, rend - rstart);
+			rstart = rend;
+		}
 
 		vmm_spin_unlock_irqrestore_lite(&bank->bmap_lock, flags);
 
@@ -312,7 +581,7 @@ u32 vmm_host_ram_bank_free_frames(u32 bank)
 virtual_size_t vmm_host_ram_estimate_hksize(void)
 {
 	int rc;
-	u32 bn, count;
+	u32 bn, count, order;
 	virtual_size_t ret;
 	physical_size_t size;
 
@@ -330,6 +599,10 @@ virtual_size_t vmm_host_ram_estimate_hksize(void)
 		}
 
 		ret += bitmap_estimate_size(size >> VMM_PAGE_SHIFT);
+		for (order = 0; order < HOST_RAM_ORDER_COUNT; order++) {
+			ret += host_ram_hbmap_size(host_ram_buddy_nbits(
+					size >> VMM_PAGE_SHIFT, order));
+		}
 	}
 
 	return ret;
@@ -338,7 +611,7 @@ virtual_size_t vmm_host_ram_estimate_hksize(void)
 int __init vmm_host_ram_init(virtual_addr_t hkbase)
 {
 	int rc;
-	u32 bn;
+	u32 bn, order;
 	struct vmm_host_ram_bank *bank;
 
 	memset(&rctrl, 0, sizeof(rctrl));
@@ -378,6 +651,16 @@ int __init vmm_host_ram_init(virtual_addr_t hkbase)
 		bank->bmap_free = bank->frame_count;
 
 		bitmap_zero(bank->bmap, bank->frame_count);
+		hkbase += bank->bmap_sz;
+
+		bank->base_pfn = bank->start >> VMM_PAGE_SHIFT;
+		for (order = 0; order < HOST_RAM_ORDER_COUNT; order++) {
+			hkbase = host_ram_hbmap_init(&bank->buddy[order],
+					host_ram_buddy_nbits(bank->frame_count,
+							     order), hkbase);
+		}
+		host_ram_buddy_free_range(bank, bank->base_pfn,
+					  bank->frame_count);
 
 		bank->res.start = bank->start;
 		bank->res.end = bank->start + bank->size - 1;
@@ -387,8 +670,6 @@ int __init vmm_host_ram_init(virtual_addr_t hkbase)
 		if (rc) {
 			return rc;
 		}
-
-		hkbase += bank->bmap_sz;
 	}
 
 	return VMM_OK;
@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_lockstat.c
+ * @author agent (agent@local)
+ * @brief source file of spinlock and rwlock contention statistics.
+ *
+ * Each lock caches pointer to its class which is looked-up by name
+ * on first acquisition. Classes live in a fixed size table so that
+ * no memory allocation is required in lock path. The uncontended
+ * case is detected using arch trylock and only contended acquisitions
+ * read timestamp twice to measure wait time.
+ */
+
+#include <vmm_error.h>
+#include <vmm_spinlocks.h>
+#include <vmm_timer.h>
+#include <vmm_modules.h>
+#include <vmm_lockstat.h>
+#include <arch_atomic64.h>
+#include <arch_cpu_irq.h>
+#include <arch_barrier.h>
+#include <libs/stringlib.h>
+
+#define LOCKSTAT_MAX_CLASSES	CONFIG_LOCK_STAT_MAX_CLASSES
+
+/* Last entry of class table collects locks which did not fit */
+static struct vmm_lockstat_class lockstat_classes[LOCKSTAT_MAX_CLASSES];
+static u32 lockstat_count;
+static arch_spinlock_t lockstat_lock = ARCH_SPIN_LOCK_INITIALIZER;
+
+static struct vmm_lockstat_class *lockstat_find_class(const char *name)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct vmm_lockstat_class *cls = NULL;
+
+	if (!name) {
+		name = "(unnamed)";
+	}
+
+	arch_cpu_irq_save(flags);
+	arch_spin_lock(&lockstat_lock);
+
+	for (i = 0; i < lockstat_count; i++) {
+		if ((lockstat_classes[i].name == name) ||
+		    !strcmp(lockstat_classes[i].name, name)) {
+			cls = &lockstat_classes[i];
+			break;
+		}
+	}
+
+	if (!cls) {
+		if (lockstat_count < (LOCKSTAT_MAX_CLASSES - 1)) {
+			cls = &lockstat_classes[lockstat_count];
+			cls->name = name;
+		} else {
+			cls = &lockstat_classes[LOCKSTAT_MAX_CLASSES - 1];
+			cls->name = "(overflow)";
+		}
+		arch_smp_wmb();
+		if (lockstat_count < LOCKSTAT_MAX_CLASSES) {
+			lockstat_count++;
+		}
+	}
+
+	arch_spin_unlock(&lockstat_lock);
+	arch_cpu_irq_restore(flags);
+
+	return cls;
+}
+
+static inline struct vmm_lockstat_class *lockstat_class(
+					struct vmm_lockstat_class **clsp,
+					const char *name)
+{
+	if (unlikely(!*clsp)) {
+		*clsp = lockstat_find_class(name);
+	}
+
+	return *clsp;
+}
+
+static void lockstat_acquired(struct vmm_lockstat_class *cls)
+{
+	arch_atomic64_inc(&cls->acquisitions);
+}
+
+static void lockstat_contended(struct vmm_lockstat_class *cls, u64 tstamp)
+{
+	u64 wait, old, prev;
+
+	wait = vmm_timer_timestamp() - tstamp;
+
+	arch_atomic64_inc(&cls->acquisitions);
+	arch_atomic64_inc(&cls->contentions);
+	arch_atomic64_add(&cls->total_wait_ns, wait);
+
+	old = arch_atomic64_read(&cls->max_wait_ns);
+	while (old < wait) {
+		prev = arch_atomic64_cmpxchg(&cls->max_wait_ns, old, wait);
+		if (prev == old) {
+			break;
+		}
+		old = prev;
+	}
+}
+
+void vmm_lockstat_spin_lock(struct vmm_spinlock *lock)
+{
+	u64 tstamp;
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_spin_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return;
+	}
+
+	tstamp = vmm_timer_timestamp();
+	arch_spin_lock(&lock->__tlock);
+	lockstat_contended(cls, tstamp);
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_spin_lock);
+
+int vmm_lockstat_spin_trylock(struct vmm_spinlock *lock)
+{
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_spin_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return 1;
+	}
+
+	return 0;
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_spin_trylock);
+
+void vmm_lockstat_write_lock(struct vmm_rwlock *lock)
+{
+	u64 tstamp;
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_write_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return;
+	}
+
+	tstamp = vmm_timer_timestamp();
+	arch_write_lock(&lock->__tlock);
+	lockstat_contended(cls, tstamp);
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_write_lock);
+
+int vmm_lockstat_write_trylock(struct vmm_rwlock *lock)
+{
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_write_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return 1;
+	}
+
+	return 0;
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_write_trylock);
+
+void vmm_lockstat_read_lock(struct vmm_rwlock *lock)
+{
+	u64 tstamp;
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_read_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return;
+	}
+
+	tstamp = vmm_timer_timestamp();
+	arch_read_lock(&lock->__tlock);
+	lockstat_contended(cls, tstamp);
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_read_lock);
+
+int vmm_lockstat_read_trylock(struct vmm_rwlock *lock)
+{
+	struct vmm_lockstat_class *cls =
+			lockstat_class(&lock->__lsc, lock->__lsname);
+
+	if (arch_read_trylock(&lock->__tlock)) {
+		lockstat_acquired(cls);
+		return 1;
+	}
+
+	return 0;
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_read_trylock);
+
+u32 vmm_lockstat_class_count(void)
+{
+	u32 ret;
+
+	ret = lockstat_count;
+	arch_smp_rmb();
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_class_count);
+
+int vmm_lockstat_class_info(u32 index, struct vmm_lockstat_info *info)
+{
+	struct vmm_lockstat_class *cls;
+
+	if (!info || (vmm_lockstat_class_count() <= index)) {
+		return VMM_EINVALID;
+	}
+
+	cls = &lockstat_classes[index];
+	info->name = cls->name;
+	info->acquisitions = arch_atomic64_read(&cls->acquisitions);
+	info->contentions = arch_atomic64_read(&cls->contentions);
+	info->total_wait_ns = arch_atomic64_read(&cls->total_wait_ns);
+	info->max_wait_ns = arch_atomic64_read(&cls->max_wait_ns);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_class_info);
+
+void vmm_lockstat_reset(void)
+{
+	u32 i, count = vmm_lockstat_class_count();
+	struct vmm_lockstat_class *cls;
+
+	for (i = 0; i < count; i++) {
+		cls = &lockstat_classes[i];
+		arch_atomic64_write(&cls->acquisitions, 0);
+		arch_atomic64_write(&cls->contentions, 0);
+		arch_atomic64_write(&cls->total_wait_ns, 0);
+		arch_atomic64_write(&cls->max_wait_ns, 0);
+	}
+}
+VMM_EXPORT_SYMBOL(vmm_lockstat_reset);
@@ -38,6 +38,7 @@
 #include <vmm_scheduler.h>
 #include <vmm_loadbal.h>
 #include <vmm_threads.h>
+#include <vmm_rcu.h>
 #include <vmm_profiler.h>
 #include <vmm_devdrv.h>
 #include <vmm_devemu.h>
@@ -473,6 +474,13 @@ static void __init init_bootcpu(void)
 		goto init_bootcpu_fail;
 	}
 
+	/* Initialize RCU framework */
+	vmm_printf("init: RCU framework\n");
+	ret = vmm_rcu_init();
+	if (ret) {
+		goto init_bootcpu_fail;
+	}
+
 	/* Schedule system init work */
 	INIT_WORK(&sys_init, &system_init_work);
 	vmm_workqueue_schedule_work(NULL, &sys_init);
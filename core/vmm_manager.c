@@ -29,6 +29,7 @@
 #include <vmm_timer.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_vcpu_irq.h>
+#include <vmm_exitstat.h>
 #include <vmm_scheduler.h>
 #include <vmm_waitqueue.h>
 #include <vmm_workqueue.h>
@@ -574,6 +575,8 @@ struct vmm_vcpu *vmm_manager_vcpu_orphan_create(const char *name,
 
 		/* Update priority */
 		vcpu->priority = priority;
+		vcpu->base_priority = priority;
+		arch_atomic_write(&vcpu->boost_count, 0);
 
 		/* Update host CPU and affinity */
 		vcpu->hcpu = hcpu;
@@ -659,6 +662,9 @@ struct vmm_vcpu *vmm_manager_vcpu_orphan_create(const char *name,
 	INIT_LIST_HEAD(&vcpu->wq_head);
 	vcpu->wq_priv = NULL;
 
+	/* Initialize workqueue worker context */
+	vcpu->worker = NULL;
+
 	/* Notify scheduler about new VCPU */
 	if (vmm_manager_vcpu_set_state(vcpu,
 					VMM_VCPU_STATE_RESET)) {
@@ -1040,7 +1046,8 @@ static void manager_enqueue_req(struct vmm_guest *guest,
 	list_add_tail(&req->head, &guest->req_list);
 	vmm_spin_unlock_irqrestore_lite(&guest->req_lock, flags);
 
-	vmm_workqueue_schedule_work(NULL, &mngr.guest_work_array[guest->id]);
+	vmm_workqueue_schedule_work(vmm_workqueue_system(VMM_WQ_HIGHPRI),
+				    &mngr.guest_work_array[guest->id]);
 }
 
 static struct vmm_guest_request *manager_dequeue_req(struct vmm_guest *guest)
@@ -1100,7 +1107,8 @@ static void manager_req_work(struct vmm_work *work)
 
 		/* Reschedule work if we more request */
 		if (manager_have_req(guest)) {
-			vmm_workqueue_schedule_work(NULL,
+			vmm_workqueue_schedule_work(
+					vmm_workqueue_system(VMM_WQ_HIGHPRI),
 					&mngr.guest_work_array[guest->id]);
 		}
 	}
@@ -1383,6 +1391,8 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 			if (vcpu->priority < VMM_VCPU_MIN_PRIORITY) {
 				vcpu->priority = VMM_VCPU_MIN_PRIORITY;
 			}
+			vcpu->base_priority = vcpu->priority;
+			arch_atomic_write(&vcpu->boost_count, 0);
 
 			/* Update host CPU and affinity */
 			memcpy(&mngr.vcpu_affinity_mask[vcpu->id],
@@ -1519,6 +1529,9 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 			goto fail_dref_vsnode;
 		}
 
+		/* Initialize exit statistics */
+		vmm_exitstat_init(vcpu);
+
 		/* Initialize resource list */
 		INIT_SPIN_LOCK(&vcpu->res_lock);
 		INIT_LIST_HEAD(&vcpu->res_head);
@@ -1527,8 +1540,12 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 		INIT_LIST_HEAD(&vcpu->wq_head);
 		vcpu->wq_priv = NULL;
 
+		/* Initialize workqueue worker context */
+		vcpu->worker = NULL;
+
 		/* Notify scheduler about new VCPU */
 		if (vmm_manager_vcpu_set_state(vcpu, VMM_VCPU_STATE_RESET)) {
+			vmm_exitstat_deinit(vcpu);
 			vmm_vcpu_irq_deinit(vcpu);
 			arch_vcpu_deinit(vcpu);
 			vmm_free((void *)vcpu->stack_va);
@@ -1651,6 +1668,9 @@ int vmm_manager_guest_destroy(struct vmm_guest *guest)
 			return rc;
 		}
 
+		/* Free exit statistics */
+		vmm_exitstat_deinit(vcpu);
+
 		/* Deinit architecture specific context */
 		if ((rc = arch_vcpu_deinit(vcpu))) {
 			return rc;
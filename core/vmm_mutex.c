@@ -22,11 +22,114 @@
  */
 
 #include <vmm_error.h>
+#include <vmm_smp.h>
 #include <vmm_stdio.h>
+#include <vmm_timer.h>
 #include <vmm_scheduler.h>
 #include <vmm_mutex.h>
+#include <arch_barrier.h>
 #include <arch_cpu_irq.h>
 
+/*
+ * Priority inheritance: A VCPU blocking on a mutex raises priority of
+ * mutex owner to its own priority so that VCPUs of intermediate
+ * priority cannot starve the owner. The owner gets back its base
+ * priority when it releases the last mutex which boosted it. Only
+ * the direct owner is boosted (i.e. boosting is not transitive).
+ *
+ * Adaptive spinning: A VCPU finding mutex locked spins for at most
+ * CONFIG_MUTEX_SPIN_NSECS as long as mutex owner is running on some
+ * other host CPU, because such owner is likely to release mutex soon.
+ *
+ * Note: All mutex state is protected by the mutex waitqueue lock.
+ */
+
+static void mutex_boost_owner(struct vmm_mutex *mut, struct vmm_vcpu *vcpu)
+{
+	struct vmm_vcpu *owner = mut->owner;
+
+	if (!owner || (vcpu->priority <= owner->priority)) {
+		return;
+	}
+
+	if (!mut->boosted) {
+		mut->boosted = TRUE;
+		arch_atomic_inc(&owner->boost_count);
+	}
+
+	vmm_scheduler_set_priority(owner, vcpu->priority);
+}
+
+static bool mutex_unboost_owner(struct vmm_mutex *mut, struct vmm_vcpu *owner)
+{
+	if (!mut->boosted) {
+		return FALSE;
+	}
+	mut->boosted = FALSE;
+
+	if (arch_atomic_sub_return(&owner->boost_count, 1) > 0) {
+		return FALSE;
+	}
+
+	vmm_scheduler_set_priority(owner, owner->base_priority);
+
+	return TRUE;
+}
+
+static bool mutex_owner_running(struct vmm_mutex *mut)
+{
+	struct vmm_vcpu *owner = mut->owner;
+
+	return (owner &&
+		(owner->hcpu != vmm_smp_processor_id()) &&
+		(vmm_manager_vcpu_get_state(owner) ==
+					VMM_VCPU_STATE_RUNNING)) ? TRUE : FALSE;
+}
+
+/* Note: Must be called with mutex waitqueue lock held */
+static void mutex_acquired(struct vmm_mutex *mut, struct vmm_vcpu *vcpu,
+			   u64 wait_nsecs)
+{
+	mut->lock = 1;
+	vmm_manager_vcpu_resource_add(vcpu, &mut->res);
+	mut->owner = vcpu;
+	mut->lock_tstamp = vmm_timer_timestamp();
+
+	mut->stats.lock_count++;
+	mut->stats.wait_nsecs_total += wait_nsecs;
+	if (mut->stats.wait_nsecs_max < wait_nsecs) {
+		mut->stats.wait_nsecs_max = wait_nsecs;
+	}
+}
+
+/* Note: Must be called with mutex waitqueue lock held */
+static void mutex_released(struct vmm_mutex *mut)
+{
+	u64 hold_nsecs = vmm_timer_timestamp() - mut->lock_tstamp;
+
+	mut->stats.hold_nsecs_total += hold_nsecs;
+	if (mut->stats.hold_nsecs_max < hold_nsecs) {
+		mut->stats.hold_nsecs_max = hold_nsecs;
+	}
+
+	mut->lock = 0;
+	mut->owner = NULL;
+}
+
+/* Yield if priority of current VCPU was lowered below a ready VCPU */
+static void mutex_unboost_yield(void)
+{
+	u32 prio, hcpu = vmm_smp_processor_id();
+
+	for (prio = vmm_scheduler_current_priority() + 1;
+	     prio <= VMM_VCPU_MAX_PRIORITY; prio++) {
+		if (vmm_scheduler_ready_count(hcpu, prio)) {
+			vmm_scheduler_yield();
+			break;
+		}
+	}
+}
+
 void __vmm_mutex_cleanup(struct vmm_vcpu *vcpu,
 			 struct vmm_vcpu_resource *vcpu_res)
 {
@@ -40,8 +143,8 @@ void __vmm_mutex_cleanup(struct vmm_vcpu *vcpu,
 	vmm_spin_lock_irqsave(&mut->wq.lock, flags);
 
 	if (mut->lock && mut->owner == vcpu) {
-		mut->lock = 0;
-		mut->owner = NULL;
+		mutex_released(mut);
+		mutex_unboost_owner(mut, vcpu);
 		__vmm_waitqueue_wakeall(&mut->wq);
 	}
 
@@ -76,10 +179,26 @@ struct vmm_vcpu *vmm_mutex_owner(struct vmm_mutex *mut)
 	return ret;
 }
 
+int vmm_mutex_get_stats(struct vmm_mutex *mut, struct vmm_mutex_stats *stats)
+{
+	irq_flags_t flags;
+
+	if (!mut || !stats) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave(&mut->wq.lock, flags);
+	*stats = mut->stats;
+	vmm_spin_unlock_irqrestore(&mut->wq.lock, flags);
+
+	return VMM_OK;
+}
+
 int vmm_mutex_unlock(struct vmm_mutex *mut)
 {
 	int rc = VMM_EINVALID;
 	irq_flags_t flags;
+	bool unboosted = FALSE;
 	struct vmm_vcpu *current_vcpu = vmm_scheduler_current_vcpu();
 
 	BUG_ON(!mut);
@@ -90,13 +209,19 @@ int vmm_mutex_unlock(struct vmm_mutex *mut)
 	if (mut->lock && mut->owner == current_vcpu) {
 		mut->lock--;
 		if (!mut->lock) {
-			mut->owner = NULL;
+			mutex_released(mut);
 			vmm_manager_vcpu_resource_remove(current_vcpu,
 							 &mut->res);
+			/*
+			 * Wake waiters before dropping inherited priority
+			 * so that waking them does not try to preempt us
+			 * while we hold the waitqueue lock.
+			 */
 			rc = __vmm_waitqueue_wakeall(&mut->wq);
 			if (rc == VMM_ENOENT) {
 				rc = VMM_OK;
 			}
+			unboosted = mutex_unboost_owner(mut, current_vcpu);
 		} else {
 			rc = VMM_OK;
 		}
@@ -104,6 +229,10 @@ int vmm_mutex_unlock(struct vmm_mutex *mut)
 
 	vmm_spin_unlock_irqrestore(&mut->wq.lock, flags);
 
+	if (unboosted) {
+		mutex_unboost_yield();
+	}
+
 	return rc;
 }
 
@@ -118,9 +247,7 @@ int vmm_mutex_trylock(struct vmm_mutex *mut)
 	vmm_spin_lock_irq(&mut->wq.lock);
 
 	if (!mut->lock) {
-		mut->lock++;
-		vmm_manager_vcpu_resource_add(current_vcpu, &mut->res);
-		mut->owner = current_vcpu;
+		mutex_acquired(mut, current_vcpu, 0);
 		ret = 1;
 	} else if (mut->owner == current_vcpu) {
 		/*
@@ -140,6 +267,8 @@ static int mutex_lock_common(struct vmm_mutex *mut, u64 *timeout)
 {
 	int rc = VMM_OK;
 	irq_flags_t flags;
+	u64 tstamp = 0;
+	bool contended = FALSE;
 	struct vmm_vcpu *current_vcpu = vmm_scheduler_current_vcpu();
 
 	BUG_ON(!mut);
@@ -147,6 +276,27 @@ static int mutex_lock_common(struct vmm_mutex *mut, u64 *timeout)
 
 	vmm_spin_lock_irqsave(&mut->wq.lock, flags);
 
+	if (mut->lock && (mut->owner != current_vcpu)) {
+		contended = TRUE;
+		tstamp = vmm_timer_timestamp();
+
+		/* Spin while mutex owner is running on other host CPU */
+		while (CONFIG_MUTEX_SPIN_NSECS &&
+		       (!timeout || *timeout) &&
+		       mut->lock && mutex_owner_running(mut)) {
+			vmm_spin_unlock_irqrestore(&mut->wq.lock, flags);
+			arch_cpu_relax();
+			vmm_spin_lock_irqsave(&mut->wq.lock, flags);
+			if (CONFIG_MUTEX_SPIN_NSECS <=
+			    (vmm_timer_timestamp() - tstamp)) {
+				break;
+			}
+		}
+		if (!mut->lock) {
+			mut->stats.spin_count++;
+		}
+	}
+
 	while (mut->lock) {
 		/*
 		 * If VCPU owning the lock try to acquire it again then let
@@ -155,18 +305,20 @@ static int mutex_lock_common(struct vmm_mutex *mut, u64 *timeout)
 		if (mut->owner == current_vcpu) {
 			break;
 		}
+		mutex_boost_owner(mut, current_vcpu);
 		rc = __vmm_waitqueue_sleep(&mut->wq, timeout);
 		if (rc) {
 			/* Timeout or some other failure */
 			break;
 		}
 	}
+	if (contended) {
+		mut->stats.contended_count++;
+	}
 	if (rc == VMM_OK) {
 		if (!mut->lock) {
-			mut->lock = 1;
-			vmm_manager_vcpu_resource_add(current_vcpu,
-						      &mut->res);
-			mut->owner = current_vcpu;
+			mutex_acquired(mut, current_vcpu, (contended) ?
+					vmm_timer_timestamp() - tstamp : 0);
 		} else {
 			mut->lock++;
 		}
@@ -23,11 +23,103 @@
 
 #include <vmm_error.h>
 #include <vmm_cpumask.h>
+#include <vmm_spinlocks.h>
 #include <vmm_host_aspace.h>
 #include <vmm_percpu.h>
 #include <arch_sections.h>
+#include <libs/bitmap.h>
 #include <libs/stringlib.h>
 
+/* Dynamic per-cpu area is allocated in units of 8 bytes */
+#define PERCPU_DYN_UNIT_SHIFT	3
+#define PERCPU_DYN_UNIT		(1UL << PERCPU_DYN_UNIT_SHIFT)
+#define PERCPU_DYN_SIZE		VMM_ROUNDUP2_PAGE_SIZE(\
+				CONFIG_PERCPU_DYNAMIC_SIZE * 1024)
+#define PERCPU_DYN_UNITS	(PERCPU_DYN_SIZE >> PERCPU_DYN_UNIT_SHIFT)
+
+static DEFINE_SPINLOCK(percpu_dyn_lock);
+static unsigned long percpu_dyn_bmap[BITS_TO_LONGS(PERCPU_DYN_UNITS)];
+static virtual_addr_t __percpu_dyn_vaddr[CONFIG_CPU_COUNT] = { 0 };
+virtual_addr_t __percpu_dyn_offset[CONFIG_CPU_COUNT] = { 0 };
+
+static int percpu_dyn_order(virtual_size_t size)
+{
+	int order = 0;
+
+	while ((PERCPU_DYN_UNIT << order) < size) {
+		order++;
+	}
+
+	return order;
+}
+
+void *vmm_percpu_alloc(virtual_size_t size)
+{
+	int pos, order;
+	u32 cpu;
+	irq_flags_t flags;
+
+	if (!size || !__percpu_dyn_vaddr[0]) {
+		return NULL;
+	}
+
+	order = percpu_dyn_order(size);
+
+	vmm_spin_lock_irqsave_lite(&percpu_dyn_lock, flags);
+	pos = bitmap_find_free_region(percpu_dyn_bmap,
+				      PERCPU_DYN_UNITS, order);
+	vmm_spin_unlock_irqrestore_lite(&percpu_dyn_lock, flags);
+	if (pos < 0) {
+		return NULL;
+	}
+
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		if (!__percpu_dyn_vaddr[cpu]) {
+			continue;
+		}
+		memset((void *)(__percpu_dyn_vaddr[cpu] +
+				(pos << PERCPU_DYN_UNIT_SHIFT)), 0,
+		       PERCPU_DYN_UNIT << order);
+	}
+
+	return (void *)(__percpu_dyn_vaddr[0] +
+			(pos << PERCPU_DYN_UNIT_SHIFT));
+}
+
+void vmm_percpu_free(void *ptr, virtual_size_t size)
+{
+	int pos;
+	irq_flags_t flags;
+	virtual_addr_t va = (virtual_addr_t)ptr;
+
+	if (!ptr || !size ||
+	    (va < __percpu_dyn_vaddr[0]) ||
+	    ((__percpu_dyn_vaddr[0] + PERCPU_DYN_SIZE) <= va)) {
+		return;
+	}
+
+	pos = (va - __percpu_dyn_vaddr[0]) >> PERCPU_DYN_UNIT_SHIFT;
+
+	vmm_spin_lock_irqsave_lite(&percpu_dyn_lock, flags);
+	bitmap_release_region(percpu_dyn_bmap, pos, percpu_dyn_order(size));
+	vmm_spin_unlock_irqrestore_lite(&percpu_dyn_lock, flags);
+}
+
+static int __init percpu_dyn_init(u32 cpu)
+{
+	__percpu_dyn_vaddr[cpu] = vmm_host_alloc_pages(
+					VMM_SIZE_TO_PAGE(PERCPU_DYN_SIZE),
+					VMM_MEMORY_FLAGS_NORMAL);
+	if (!__percpu_dyn_vaddr[cpu]) {
+		return VMM_ENOMEM;
+	}
+	__percpu_dyn_offset[cpu] =
+			__percpu_dyn_vaddr[cpu] - __percpu_dyn_vaddr[0];
+	memset((void *)__percpu_dyn_vaddr[cpu], 0, PERCPU_DYN_SIZE);
+
+	return VMM_OK;
+}
+
 #ifdef CONFIG_SMP
 
 virtual_addr_t __percpu_vaddr[CONFIG_CPU_COUNT] = { 0 };
@@ -35,6 +127,7 @@ virtual_addr_t __percpu_offset[CONFIG_CPU_COUNT] = { 0 };
 
 int __init vmm_percpu_init(void)
 {
+	int rc;
 	u32 cpu, pgcount;
 	virtual_addr_t base = arch_percpu_vaddr();
 	virtual_size_t size = arch_percpu_size();
@@ -57,6 +150,13 @@ int __init vmm_percpu_init(void)
 		memset((void *)__percpu_vaddr[cpu], 0, VMM_PAGE_SIZE * pgcount);
 	}
 
+	/* Dynamic per-cpu area of each cpu */
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		if ((rc = percpu_dyn_init(cpu))) {
+			return rc;
+		}
+	}
+
 	return VMM_OK;
 }
 
@@ -64,8 +164,8 @@ int __init vmm_percpu_init(void)
 
 int __init vmm_percpu_init(void)
 {
-	/* Don't require to do anything for UP */
-	return VMM_OK;
+	/* Only dynamic per-cpu area required for UP */
+	return percpu_dyn_init(0);
 }
 
 #endif
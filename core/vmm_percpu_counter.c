@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_percpu_counter.c
+ * @author agent (agent@local)
+ * @brief Implementation of per-cpu counters.
+ */
+
+#include <vmm_error.h>
+#include <vmm_cpumask.h>
+#include <vmm_percpu.h>
+#include <vmm_mutex.h>
+#include <vmm_modules.h>
+#include <vmm_percpu_counter.h>
+#include <arch_cpu_irq.h>
+#include <libs/stringlib.h>
+
+struct vmm_percpu_counter_ctrl {
+	struct vmm_mutex lock;
+	u32 count;
+	struct dlist list;
+};
+
+static struct vmm_percpu_counter_ctrl pcctrl = {
+	.lock = __MUTEX_INITIALIZER(pcctrl.lock),
+	.count = 0,
+	.list = LIST_HEAD_INIT(pcctrl.list),
+};
+
+int vmm_percpu_counter_init(struct vmm_percpu_counter *fbc, s64 value)
+{
+	if (!fbc) {
+		return VMM_EINVALID;
+	}
+
+	INIT_LIST_HEAD(&fbc->head);
+	fbc->name[0] = '\0';
+	INIT_SPIN_LOCK(&fbc->lock);
+	fbc->count = value;
+	fbc->counters = vmm_percpu_alloc(sizeof(s32));
+	if (!fbc->counters) {
+		return VMM_ENOMEM;
+	}
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_init);
+
+void vmm_percpu_counter_destroy(struct vmm_percpu_counter *fbc)
+{
+	if (!fbc || !fbc->counters) {
+		return;
+	}
+
+	vmm_percpu_free(fbc->counters, sizeof(s32));
+	fbc->counters = NULL;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_destroy);
+
+void vmm_percpu_counter_add(struct vmm_percpu_counter *fbc, s64 amount)
+{
+	s64 count;
+	s32 *pcount;
+	irq_flags_t flags;
+
+	arch_cpu_irq_save(flags);
+
+	pcount = this_cpu_ptr(fbc->counters);
+	count = *pcount + amount;
+	if ((count >= VMM_PERCPU_COUNTER_BATCH) ||
+	    (count <= -VMM_PERCPU_COUNTER_BATCH)) {
+		vmm_spin_lock_lite(&fbc->lock);
+		fbc->count += count;
+		*pcount = 0;
+		vmm_spin_unlock_lite(&fbc->lock);
+	} else {
+		*pcount = count;
+	}
+
+	arch_cpu_irq_restore(flags);
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_add);
+
+s64 vmm_percpu_counter_sum(struct vmm_percpu_counter *fbc)
+{
+	u32 cpu;
+	s64 ret;
+	irq_flags_t flags;
+
+	if (!fbc || !fbc->counters) {
+		return 0;
+	}
+
+	vmm_spin_lock_irqsave_lite(&fbc->lock, flags);
+	ret = fbc->count;
+	for_each_possible_cpu(cpu) {
+		ret += *per_cpu_ptr(fbc->counters, cpu);
+	}
+	vmm_spin_unlock_irqrestore_lite(&fbc->lock, flags);
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_sum);
+
+void vmm_percpu_counter_set(struct vmm_percpu_counter *fbc, s64 value)
+{
+	u32 cpu;
+	irq_flags_t flags;
+
+	if (!fbc || !fbc->counters) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&fbc->lock, flags);
+	for_each_possible_cpu(cpu) {
+		*per_cpu_ptr(fbc->counters, cpu) = 0;
+	}
+	fbc->count = value;
+	vmm_spin_unlock_irqrestore_lite(&fbc->lock, flags);
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_set);
+
+int vmm_percpu_counter_register(struct vmm_percpu_counter *fbc,
+				const char *name)
+{
+	if (!fbc || !fbc->counters || !name) {
+		return VMM_EINVALID;
+	}
+
+	vmm_mutex_lock(&pcctrl.lock);
+
+	if (!list_empty(&fbc->head)) {
+		vmm_mutex_unlock(&pcctrl.lock);
+		return VMM_EEXIST;
+	}
+
+	strlcpy(fbc->name, name, sizeof(fbc->name));
+	list_add_tail(&fbc->head, &pcctrl.list);
+	pcctrl.count++;
+
+	vmm_mutex_unlock(&pcctrl.lock);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_register);
+
+int vmm_percpu_counter_unregister(struct vmm_percpu_counter *fbc)
+{
+	if (!fbc) {
+		return VMM_EINVALID;
+	}
+
+	vmm_mutex_lock(&pcctrl.lock);
+
+	if (list_empty(&fbc->head)) {
+		vmm_mutex_unlock(&pcctrl.lock);
+		return VMM_ENOTAVAIL;
+	}
+
+	list_del_init(&fbc->head);
+	pcctrl.count--;
+
+	vmm_mutex_unlock(&pcctrl.lock);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_unregister);
+
+int vmm_percpu_counter_iterate(void *data,
+		int (*iter)(struct vmm_percpu_counter *fbc, void *data))
+{
+	int rc = VMM_OK;
+	struct vmm_percpu_counter *fbc;
+
+	if (!iter) {
+		return VMM_EINVALID;
+	}
+
+	vmm_mutex_lock(&pcctrl.lock);
+
+	list_for_each_entry(fbc, &pcctrl.list, head) {
+		rc = iter(fbc, data);
+		if (rc) {
+			break;
+		}
+	}
+
+	vmm_mutex_unlock(&pcctrl.lock);
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_iterate);
+
+u32 vmm_percpu_counter_count(void)
+{
+	return pcctrl.count;
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_count);
+
+void vmm_percpu_counter_reset_all(void)
+{
+	struct vmm_percpu_counter *fbc;
+
+	vmm_mutex_lock(&pcctrl.lock);
+
+	list_for_each_entry(fbc, &pcctrl.list, head) {
+		vmm_percpu_counter_set(fbc, 0);
+	}
+
+	vmm_mutex_unlock(&pcctrl.lock);
+}
+VMM_EXPORT_SYMBOL(vmm_percpu_counter_reset_all);
@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_rcu.c
+ * @author agent (agent@local)
+ * @brief Implementation of read-copy-update (RCU) synchronization.
+ *
+ * Grace periods are driven by a single RCU thread. It waits for
+ * callbacks, takes all queued callbacks as one batch, marks each
+ * online host CPU as having a quiescent state pending and kicks
+ * other host CPUs so that they quickly pass through the scheduler.
+ * The last host CPU to report quiescent state asks the scheduler
+ * timer event (or idle loop) to wake-up RCU thread, which then
+ * invokes the batch of callbacks.
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_percpu.h>
+#include <vmm_spinlocks.h>
+#include <vmm_completion.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_rcu.h>
+
+#define RCU_PRIORITY			VMM_THREAD_DEF_PRIORITY
+#define RCU_TIMESLICE			VMM_THREAD_DEF_TIME_SLICE
+
+struct vmm_rcu_data {
+	bool qs_pending;
+};
+
+static DEFINE_PER_CPU(struct vmm_rcu_data, rdata);
+
+struct vmm_rcu_ctrl {
+	vmm_spinlock_t lock;
+	bool gp_active;
+	bool gp_wakeup;
+	u32 qs_remaining;
+	struct dlist cb_list;
+	struct vmm_completion gp_cmpl;
+	struct vmm_thread *gp_thread;
+};
+
+static struct vmm_rcu_ctrl rctrl = {
+	.lock = __SPINLOCK_INITIALIZER(rctrl.lock),
+	.gp_active = FALSE,
+	.gp_wakeup = FALSE,
+	.qs_remaining = 0,
+	.cb_list = LIST_HEAD_INIT(rctrl.cb_list),
+	.gp_cmpl = __COMPLETION_INITIALIZER(rctrl.gp_cmpl),
+	.gp_thread = NULL,
+};
+
+void vmm_rcu_note_qs(void)
+{
+	irq_flags_t flags;
+	struct vmm_rcu_data *rdp = &this_cpu(rdata);
+
+	if (!rdp->qs_pending) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+
+	if (rdp->qs_pending) {
+		rdp->qs_pending = FALSE;
+		if (rctrl.qs_remaining && !(--rctrl.qs_remaining)) {
+			rctrl.gp_wakeup = TRUE;
+		}
+	}
+
+	vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+}
+
+void vmm_rcu_check(void)
+{
+	bool wakeup;
+	irq_flags_t flags;
+
+	if (!rctrl.gp_wakeup) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+	wakeup = rctrl.gp_wakeup;
+	rctrl.gp_wakeup = FALSE;
+	vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+
+	if (wakeup) {
+		vmm_completion_complete_once(&rctrl.gp_cmpl);
+	}
+}
+
+void vmm_call_rcu(struct vmm_rcu_head *head, vmm_rcu_callback_t func)
+{
+	bool wakeup;
+	irq_flags_t flags;
+
+	BUG_ON(!head || !func);
+
+	INIT_LIST_HEAD(&head->head);
+	head->func = func;
+
+	vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+	wakeup = (!rctrl.gp_active && list_empty(&rctrl.cb_list)) ?
+								TRUE : FALSE;
+	list_add_tail(&head->head, &rctrl.cb_list);
+	vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+
+	/* RCU thread picks remaining callbacks after current batch */
+	if (wakeup) {
+		vmm_completion_complete_once(&rctrl.gp_cmpl);
+	}
+}
+
+struct rcu_synchronize {
+	struct vmm_rcu_head head;
+	struct vmm_completion cmpl;
+};
+
+static void rcu_synchronize_done(struct vmm_rcu_head *head)
+{
+	struct rcu_synchronize *rs =
+			container_of(head, struct rcu_synchronize, head);
+
+	vmm_completion_complete(&rs->cmpl);
+}
+
+void vmm_synchronize_rcu(void)
+{
+	struct rcu_synchronize rs;
+
+	/* Before RCU thread is created, only boot CPU is running
+	 * and nobody can be inside RCU read-side critical section.
+	 */
+	if (!rctrl.gp_thread) {
+		return;
+	}
+
+	BUG_ON(!vmm_scheduler_orphan_context());
+	BUG_ON(vmm_scheduler_current_vcpu() == rctrl.gp_thread->tvcpu);
+
+	INIT_COMPLETION(&rs.cmpl);
+	vmm_call_rcu(&rs.head, rcu_synchronize_done);
+	vmm_completion_wait(&rs.cmpl);
+}
+
+static void rcu_gp_start(struct dlist *batch)
+{
+	u32 cpu, self;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+
+	/* All callbacks queued till now belong to this grace period */
+	list_splice_tail_init(&rctrl.cb_list, batch);
+
+	/* Every online host CPU must report quiescent state */
+	rctrl.qs_remaining = 0;
+	rctrl.gp_wakeup = FALSE;
+	for_each_online_cpu(cpu) {
+		per_cpu(rdata, cpu).qs_pending = TRUE;
+		rctrl.qs_remaining++;
+	}
+	rctrl.gp_active = TRUE;
+
+	vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+
+	/* Kick other host CPUs so that they pass through scheduler */
+	self = vmm_smp_processor_id();
+	for_each_online_cpu(cpu) {
+		if ((cpu != self) && per_cpu(rdata, cpu).qs_pending) {
+			vmm_scheduler_force_resched(cpu);
+		}
+	}
+}
+
+static void rcu_gp_wait(void)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+	while (rctrl.qs_remaining) {
+		vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+		vmm_completion_wait(&rctrl.gp_cmpl);
+		vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+	}
+	rctrl.gp_active = FALSE;
+	vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+}
+
+static int rcu_main(void *data)
+{
+	irq_flags_t flags;
+	struct vmm_rcu_head *rh;
+	struct dlist batch;
+
+	while (1) {
+		/* Wait for callbacks */
+		vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+		while (list_empty(&rctrl.cb_list)) {
+			vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+			vmm_completion_wait(&rctrl.gp_cmpl);
+			vmm_spin_lock_irqsave_lite(&rctrl.lock, flags);
+		}
+		vmm_spin_unlock_irqrestore_lite(&rctrl.lock, flags);
+
+		/* Run one grace period for current batch of callbacks */
+		INIT_LIST_HEAD(&batch);
+		rcu_gp_start(&batch);
+		rcu_gp_wait();
+
+		/* Invoke callbacks of current batch */
+		while (!list_empty(&batch)) {
+			rh = list_entry(list_pop(&batch),
+					struct vmm_rcu_head, head);
+			rh->func(rh);
+		}
+	}
+
+	return VMM_OK;
+}
+
+int __init vmm_rcu_init(void)
+{
+	int rc;
+	struct vmm_thread *gp_thread;
+
+	/* Create RCU thread with default time slice */
+	gp_thread = vmm_threads_create("rcu", rcu_main, NULL,
+				       RCU_PRIORITY, RCU_TIMESLICE);
+	if (!gp_thread) {
+		return VMM_EFAIL;
+	}
+
+	/* Start RCU thread */
+	if ((rc = vmm_threads_start(gp_thread))) {
+		vmm_threads_destroy(gp_thread);
+		return rc;
+	}
+
+	rctrl.gp_thread = gp_thread;
+
+	return VMM_OK;
+}
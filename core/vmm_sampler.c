@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_sampler.c
+ * @author agent (agent@local)
+ * @brief source file of hypervisor sampling profiler.
+ *
+ * A per-CPU timer event periodically records program counter of
+ * the interrupted context along with current VCPU and Guest into
+ * per-CPU ring of samples. Each ring has only one writer (timer
+ * event of its host CPU) and it is read only after sampling is
+ * stopped hence no locking is required. Symbol lookup is left to
+ * the consumer of samples.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_percpu.h>
+#include <vmm_smp.h>
+#include <vmm_timer.h>
+#include <vmm_manager.h>
+#include <vmm_scheduler.h>
+#include <vmm_sampler.h>
+#include <arch_vcpu.h>
+#include <arch_barrier.h>
+#include <libs/mathlib.h>
+
+struct vmm_sampler_percpu {
+	struct vmm_timer_event ev;
+	struct vmm_sampler_entry *ring;
+	u32 head;
+};
+
+struct vmm_sampler_ctrl {
+	bool is_active;
+	u32 freq;
+	u64 period_ns;
+};
+
+static struct vmm_sampler_ctrl sctrl;
+static DEFINE_PER_CPU(struct vmm_sampler_percpu, spcpu);
+
+static void sampler_timer_event(struct vmm_timer_event *ev)
+{
+	arch_regs_t *regs;
+	struct vmm_vcpu *vcpu;
+	struct vmm_sampler_entry *e;
+	struct vmm_sampler_percpu *sp = &this_cpu(spcpu);
+
+	if (!sctrl.is_active) {
+		return;
+	}
+
+	/* Only sample when timer event is processed in IRQ */
+	regs = vmm_scheduler_irq_regs();
+	if (regs) {
+		vcpu = vmm_scheduler_current_vcpu();
+		e = &sp->ring[sp->head & (VMM_SAMPLER_RING_SIZE - 1)];
+		e->flags = 0;
+		if (arch_vcpu_regs_sample(vcpu, regs, &e->pc, &e->caller)) {
+			e->flags |= VMM_SAMPLER_FLAG_GUEST;
+		}
+		e->vcpu_id = (vcpu) ? vcpu->id : VMM_SAMPLER_ID_NONE;
+		e->guest_id = (vcpu && vcpu->guest) ?
+				vcpu->guest->id : VMM_SAMPLER_ID_NONE;
+		arch_smp_wmb();
+		sp->head++;
+	}
+
+	vmm_timer_event_start(ev, sctrl.period_ns);
+}
+
+static void sampler_start_on_cpu(void *a0, void *a1, void *a2)
+{
+	struct vmm_sampler_percpu *sp = &this_cpu(spcpu);
+
+	INIT_TIMER_EVENT(&sp->ev, sampler_timer_event, NULL);
+	vmm_timer_event_start(&sp->ev, sctrl.period_ns);
+}
+
+static void sampler_stop_on_cpu(void *a0, void *a1, void *a2)
+{
+	vmm_timer_event_stop(&this_cpu(spcpu).ev);
+}
+
+bool vmm_sampler_isactive(void)
+{
+	return sctrl.is_active;
+}
+
+u32 vmm_sampler_frequency(void)
+{
+	return sctrl.freq;
+}
+
+int vmm_sampler_start(u32 freq)
+{
+	u32 cpu;
+	struct vmm_sampler_percpu *sp;
+
+	if (sctrl.is_active) {
+		return VMM_EBUSY;
+	}
+	if (!freq || (VMM_SAMPLER_MAX_FREQ < freq)) {
+		return VMM_EINVALID;
+	}
+
+	/* Rings are retained after stop for dumping samples */
+	for_each_cpu(cpu, cpu_online_mask) {
+		sp = &per_cpu(spcpu, cpu);
+		if (!sp->ring) {
+			sp->ring = vmm_zalloc(VMM_SAMPLER_RING_SIZE *
+					      sizeof(*sp->ring));
+			if (!sp->ring) {
+				return VMM_ENOMEM;
+			}
+		}
+		sp->head = 0;
+	}
+
+	sctrl.freq = freq;
+	sctrl.period_ns = udiv64(1000000000ULL, freq);
+	sctrl.is_active = TRUE;
+	arch_smp_mb();
+
+	return vmm_smp_ipi_sync_call(cpu_online_mask, 1000,
+				     sampler_start_on_cpu, NULL, NULL, NULL);
+}
+
+int vmm_sampler_stop(void)
+{
+	if (!sctrl.is_active) {
+		return VMM_EFAIL;
+	}
+
+	sctrl.is_active = FALSE;
+	arch_smp_mb();
+
+	/* Timer event of a host CPU is stopped on same host CPU
+	 * so that it does not race with re-arming in handler.
+	 */
+	return vmm_smp_ipi_sync_call(cpu_online_mask, 1000,
+				     sampler_stop_on_cpu, NULL, NULL, NULL);
+}
+
+u32 vmm_sampler_total_count(u32 cpu)
+{
+	if (CONFIG_CPU_COUNT <= cpu) {
+		return 0;
+	}
+
+	return per_cpu(spcpu, cpu).head;
+}
+
+int vmm_sampler_iterate(void *data,
+			int (*fn)(u32 cpu, struct vmm_sampler_entry *e,
+				  void *data))
+{
+	int rc;
+	u32 cpu, i, count;
+	struct vmm_sampler_percpu *sp;
+
+	if (!fn) {
+		return VMM_EINVALID;
+	}
+	if (sctrl.is_active) {
+		return VMM_EBUSY;
+	}
+
+	for (cpu = 0; cpu < CONFIG_CPU_COUNT; cpu++) {
+		sp = &per_cpu(spcpu, cpu);
+		if (!sp->ring) {
+			continue;
+		}
+
+		count = min(sp->head, (u32)VMM_SAMPLER_RING_SIZE);
+		for (i = sp->head - count; i != sp->head; i++) {
+			rc = fn(cpu, &sp->ring[i & (VMM_SAMPLER_RING_SIZE - 1)],
+				data);
+			if (rc) {
+				return rc;
+			}
+		}
+	}
+
+	return VMM_OK;
+}
@@ -31,6 +31,8 @@
 #include <vmm_schedalgo.h>
 #include <vmm_scheduler.h>
 #include <vmm_stdio.h>
+#include <vmm_trace.h>
+#include <vmm_rcu.h>
 #include <arch_regs.h>
 #include <arch_cpu_irq.h>
 #include <arch_vcpu.h>
@@ -253,6 +255,9 @@ static void vmm_scheduler_switch(struct vmm_scheduler_ctrl *schedp,
 		if (current->preempt_count == preempt_min) {
 			irq_flags_t cf;
 
+			/* No RCU read-side critical section on this CPU */
+			vmm_rcu_note_qs();
+
 			vmm_write_lock_irqsave_lite(&current->sched_lock, cf);
 			next = __vmm_scheduler_next2(schedp, current, regs);
 			vmm_write_unlock_irqrestore_lite(&current->sched_lock,
@@ -272,10 +277,18 @@ static void vmm_scheduler_switch(struct vmm_scheduler_ctrl *schedp,
 			next = NULL;
 		}
 	} else {
+		vmm_rcu_note_qs();
 		next = __vmm_scheduler_next1(schedp, regs);
 	}
 
 	if (next) {
+		/* Don't read VCPU state unless sched_switch is enabled */
+		if (vmm_trace_enabled(sched_switch)) {
+			trace_sched_switch((current) ?
+					   current->id : VMM_TRACE_ID_NONE,
+					   next->id,
+					   vmm_manager_vcpu_get_state(current));
+		}
 		arch_vcpu_post_switch(next, regs);
 	}
 }
@@ -287,6 +300,9 @@ static void scheduler_timer_event(struct vmm_timer_event *ev)
 	if (schedp->irq_regs) {
 		vmm_scheduler_switch(schedp, schedp->irq_regs);
 	}
+
+	/* Wake-up RCU thread if grace period ended */
+	vmm_rcu_check();
 }
 
 void vmm_scheduler_preempt_disable(void)
@@ -654,6 +670,59 @@ int vmm_scheduler_set_hcpu(struct vmm_vcpu *vcpu, u32 hcpu)
 	return VMM_OK;
 }
 
+int vmm_scheduler_set_priority(struct vmm_vcpu *vcpu, u8 priority)
+{
+	int rc = VMM_OK;
+	u32 state, vhcpu;
+	irq_flags_t flags;
+	bool resched = FALSE;
+	struct vmm_scheduler_ctrl *schedp;
+
+	if (!vcpu ||
+	    (priority < VMM_VCPU_MIN_PRIORITY) ||
+	    (VMM_VCPU_MAX_PRIORITY < priority)) {
+		return VMM_EINVALID;
+	}
+
+	/* Lock VCPU scheduling */
+	vmm_write_lock_irqsave_lite(&vcpu->sched_lock, flags);
+
+	vhcpu = vcpu->hcpu;
+	if (vcpu->priority == priority) {
+		goto done;
+	}
+
+	schedp = &per_cpu(sched, vhcpu);
+	state = arch_atomic_read(&vcpu->state);
+
+	/* Ready queues are per-priority so requeue a ready VCPU */
+	if ((state == VMM_VCPU_STATE_READY) &&
+	    (schedp->current_vcpu != vcpu)) {
+		if ((rc = rq_detach(schedp, vcpu))) {
+			goto done;
+		}
+		vcpu->priority = priority;
+		if ((rc = rq_enqueue(schedp, vcpu))) {
+			goto done;
+		}
+		resched = (vhcpu != vmm_smp_processor_id()) &&
+			  rq_prempt_needed(schedp);
+	} else {
+		vcpu->priority = priority;
+	}
+
+done:
+	/* Unlock VCPU scheduling */
+	vmm_write_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+
+	/* Let other host CPU pick the VCPU if it has higher priority */
+	if (resched) {
+		vmm_scheduler_force_resched(vhcpu);
+	}
+
+	return rc;
+}
+
 void vmm_scheduler_irq_enter(arch_regs_t *regs, bool vcpu_context)
 {
 	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
@@ -712,6 +781,11 @@ bool vmm_scheduler_irq_context(void)
 	return this_cpu(sched).irq_context;
 }
 
+arch_regs_t *vmm_scheduler_irq_regs(void)
+{
+	return this_cpu(sched).irq_regs;
+}
+
 bool vmm_scheduler_orphan_context(void)
 {
 	bool ret = FALSE;
@@ -918,10 +992,16 @@ static void idle_orphan(void)
 	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
 
 	while (1) {
+		/* Idle loop is always a RCU quiescent state */
+		vmm_rcu_note_qs();
+
 		if (rq_length(schedp, IDLE_VCPU_PRIORITY) == 0) {
 			arch_cpu_wait_for_irq();
 		}
 
+		/* Wake-up RCU thread if grace period ended */
+		vmm_rcu_check();
+
 		vmm_scheduler_yield();
 	}
 }
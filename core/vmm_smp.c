@@ -30,7 +30,13 @@
 #include <vmm_timer.h>
 #include <vmm_completion.h>
 #include <vmm_manager.h>
-#include <libs/fifo.h>
+#include <vmm_scheduler.h>
+#include <vmm_trace.h>
+#include <vmm_heap.h>
+#include <arch_atomic.h>
+#include <arch_barrier.h>
+#include <arch_cpu_irq.h>
+#include <libs/log2.h>
 
 /* SMP processor ID for Boot CPU */
 static u32 smp_bootcpu_id = UINT_MAX;
@@ -72,8 +78,7 @@ bool vmm_smp_is_bootcpu(void)
  */
 #define SMP_IPI_MAX_ASYNC_PER_CPU	(64)
 
-#define SMP_IPI_WAIT_TRY_COUNT		100
-#define SMP_IPI_WAIT_UDELAY		1000
+#define SMP_IPI_WAIT_UDELAY		10
 
 #define IPI_VCPU_STACK_SZ 		CONFIG_THREAD_STACK_SIZE
 #define IPI_VCPU_PRIORITY 		VMM_VCPU_MAX_PRIORITY
@@ -90,59 +95,275 @@ struct smp_ipi_call {
 	void *arg2;
 };
 
+struct smp_ipi_slot {
+	atomic_t seq;
+	struct smp_ipi_call call;
+};
+
+/* Bounded multi-producer single-consumer queue of IPI calls.
+ *
+ * Each slot has a sequence number which tells producers and the
+ * consumer whose turn it is. Producers claim a position by advancing
+ * head using cmpxchg and publish the call by updating the slot
+ * sequence number. Only the destination host CPU dequeues so tail
+ * is a plain variable.
+ */
+struct smp_ipi_queue {
+	atomic_t head;
+	u32 tail;
+	u32 mask;
+	struct smp_ipi_slot *slots;
+};
+
 struct smp_ipi_ctrl {
-	struct fifo *sync_fifo;
-	struct fifo *async_fifo;
+	struct smp_ipi_queue sync_q;
+	struct smp_ipi_queue async_q;
+	atomic_t sync_done;
+	atomic_t ipi_pending;
+	atomic_t async_active;
 	struct vmm_completion ipi_avail;
 	struct vmm_vcpu *ipi_vcpu;
 };
 
 static DEFINE_PER_CPU(struct smp_ipi_ctrl, ictl);
 
-static void smp_ipi_sync_submit(struct smp_ipi_ctrl *ictlp, 
-				struct smp_ipi_call *ipic)
+static int smp_ipi_queue_init(struct smp_ipi_queue *q, u32 count)
 {
-	int try;
+	u32 i;
 
-	if (!ipic || !ipic->func) {
-		return;
+	count = roundup_pow_of_two(count);
+	q->slots = vmm_zalloc(count * sizeof(*q->slots));
+	if (!q->slots) {
+		return VMM_ENOMEM;
 	}
 
-	try = SMP_IPI_WAIT_TRY_COUNT;
-	while (!fifo_enqueue(ictlp->sync_fifo, ipic, FALSE) && try) {
-		arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
-		vmm_udelay(SMP_IPI_WAIT_UDELAY);
-		try--;
+	for (i = 0; i < count; i++) {
+		ARCH_ATOMIC_INIT(&q->slots[i].seq, i);
 	}
+	ARCH_ATOMIC_INIT(&q->head, 0);
+	q->tail = 0;
+	q->mask = count - 1;
+
+	return VMM_OK;
+}
+
+static void smp_ipi_queue_free(struct smp_ipi_queue *q)
+{
+	vmm_free(q->slots);
+	q->slots = NULL;
+}
 
-	if (!try) {
-		vmm_panic("CPU%d: IPI sync fifo full\n", ipic->dst_cpu);
+static bool smp_ipi_enqueue(struct smp_ipi_queue *q,
+			    struct smp_ipi_call *ipic, u32 *posp)
+{
+	u32 pos, seq;
+	struct smp_ipi_slot *slot;
+
+	pos = arch_atomic_read(&q->head);
+	while (1) {
+		slot = &q->slots[pos & q->mask];
+		seq = arch_atomic_read(&slot->seq);
+		arch_smp_rmb();
+		if (seq == pos) {
+			if ((u32)arch_atomic_cmpxchg(&q->head,
+						pos, pos + 1) == pos) {
+				break;
+			}
+		} else if ((s32)(seq - pos) < 0) {
+			/* Slot not yet consumed so queue is full */
+			return FALSE;
+		}
+		pos = arch_atomic_read(&q->head);
+	}
+
+	slot->call = *ipic;
+	arch_smp_wmb();
+	arch_atomic_write(&slot->seq, pos + 1);
+
+	if (posp) {
+		*posp = pos;
 	}
 
-	arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
+	return TRUE;
 }
 
-static void smp_ipi_async_submit(struct smp_ipi_ctrl *ictlp, 
-				 struct smp_ipi_call *ipic)
+static bool smp_ipi_queue_isempty(struct smp_ipi_queue *q)
 {
-	int try;
+	struct smp_ipi_slot *slot = &q->slots[q->tail & q->mask];
+
+	return ((u32)arch_atomic_read(&slot->seq) != (q->tail + 1)) ?
+								TRUE : FALSE;
+}
 
-	if (!ipic || !ipic->func) {
-		return;
+static bool smp_ipi_dequeue(struct smp_ipi_queue *q,
+			    struct smp_ipi_call *ipic)
+{
+	u32 pos = q->tail;
+	struct smp_ipi_slot *slot = &q->slots[pos & q->mask];
+
+	if ((u32)arch_atomic_read(&slot->seq) != (pos + 1)) {
+		return FALSE;
 	}
+	arch_smp_rmb();
+
+	*ipic = slot->call;
+	arch_smp_mb();
+
+	/* Hand over slot to producers of next round */
+	arch_atomic_write(&slot->seq, pos + q->mask + 1);
+	q->tail = pos + 1;
 
-	try = SMP_IPI_WAIT_TRY_COUNT;
-	while (!fifo_enqueue(ictlp->async_fifo, ipic, FALSE) && try) {
-		arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
-		vmm_udelay(SMP_IPI_WAIT_UDELAY);
-		try--;
+	return TRUE;
+}
+
+/* Note: This function must be called on host CPU owning ictlp
+ * with interrupts disabled.
+ */
+static void smp_ipi_sync_process(struct smp_ipi_ctrl *ictlp)
+{
+	struct smp_ipi_call ipic;
+
+	while (smp_ipi_dequeue(&ictlp->sync_q, &ipic)) {
+		if (ipic.func) {
+			trace_smp_ipi_exec(ipic.src_cpu,
+					   (virtual_addr_t)ipic.func, TRUE);
+			ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
+		}
+		arch_smp_mb();
+		arch_atomic_write(&ictlp->sync_done, ictlp->sync_q.tail);
+	}
+}
+
+/* Busy wait for other host CPUs. The other host CPU might in-turn be
+ * waiting for us so we process our own Sync IPIs when we can't take
+ * IPI because interrupts are disabled.
+ */
+static void smp_ipi_wait(void)
+{
+	irq_flags_t flags;
+
+	if (arch_cpu_irq_disabled()) {
+		arch_cpu_irq_save(flags);
+		smp_ipi_sync_process(&this_cpu(ictl));
+		arch_cpu_irq_restore(flags);
+	}
+
+	vmm_udelay(SMP_IPI_WAIT_UDELAY);
+}
+
+static void smp_ipi_trigger(struct vmm_cpumask *trig_mask)
+{
+	if (!vmm_cpumask_empty(trig_mask)) {
+		arch_smp_ipi_trigger(trig_mask);
+		vmm_cpumask_clear(trig_mask);
 	}
+}
+
+/* Mark IPI pending for destination host CPU and tell whether
+ * caller has to raise it. IPI is not required when destination
+ * is yet to process an earlier IPI because it will find our call
+ * in its queue.
+ */
+static bool smp_ipi_mark_pending(struct smp_ipi_ctrl *ictlp)
+{
+	arch_smp_mb();
 
-	if (!try) {
-		vmm_panic("CPU%d: IPI async fifo full\n", ipic->dst_cpu);
+	if (arch_atomic_read(&ictlp->ipi_pending)) {
+		return FALSE;
 	}
 
-	arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
+	return (arch_atomic_cmpxchg(&ictlp->ipi_pending, 0, 1) == 0) ?
+								TRUE : FALSE;
+}
+
+/* Enqueue call to destination queue. If the queue is full then
+ * raise already batched IPIs and wait for destination to make room
+ * or fail right away if caller cannot wait.
+ */
+static bool smp_ipi_submit(struct smp_ipi_ctrl *ictlp,
+			   struct smp_ipi_queue *q,
+			   struct smp_ipi_call *ipic,
+			   struct vmm_cpumask *trig_mask,
+			   bool can_wait, u32 *posp)
+{
+	while (!smp_ipi_enqueue(q, ipic, posp)) {
+		vmm_cpumask_set_cpu(ipic->dst_cpu, trig_mask);
+		smp_ipi_trigger(trig_mask);
+
+		if (!can_wait) {
+			return FALSE;
+		}
+
+		smp_ipi_wait();
+	}
+
+	return TRUE;
+}
+
+/* Async IPIs are processed by IPI bottom-half VCPU hence we can wait
+ * for room in async queue only if our own IPI bottom-half VCPU can
+ * run meanwhile. Otherwise, two host CPUs waiting for room in each
+ * other's async queue would livelock.
+ */
+static bool smp_ipi_async_can_wait(void)
+{
+	struct vmm_vcpu *vcpu;
+
+	if (arch_cpu_irq_disabled() || vmm_scheduler_irq_context()) {
+		return FALSE;
+	}
+
+	vcpu = vmm_scheduler_current_vcpu();
+	if (!vcpu || vcpu->preempt_count ||
+	    (vcpu == this_cpu(ictl).ipi_vcpu)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void smp_ipi_sync_submit(struct smp_ipi_ctrl *ictlp,
+				struct smp_ipi_call *ipic,
+				struct vmm_cpumask *trig_mask,
+				u32 *ticket)
+{
+	trace_smp_ipi_call(ipic->dst_cpu, (virtual_addr_t)ipic->func, TRUE);
+
+	/* Sync IPIs are processed in interrupt context and we process
+	 * our own Sync IPIs while waiting so waiting is always fine.
+	 */
+	smp_ipi_submit(ictlp, &ictlp->sync_q, ipic, trig_mask, TRUE, ticket);
+
+	if (smp_ipi_mark_pending(ictlp)) {
+		vmm_cpumask_set_cpu(ipic->dst_cpu, trig_mask);
+	}
+}
+
+static bool smp_ipi_async_submit(struct smp_ipi_ctrl *ictlp,
+				 struct smp_ipi_call *ipic,
+				 struct vmm_cpumask *trig_mask,
+				 bool can_wait)
+{
+	trace_smp_ipi_call(ipic->dst_cpu, (virtual_addr_t)ipic->func, FALSE);
+
+	if (!smp_ipi_submit(ictlp, &ictlp->async_q, ipic, trig_mask,
+			    can_wait, NULL)) {
+		return FALSE;
+	}
+
+	/* IPI bottom-half VCPU re-checks its queue after it becomes
+	 * inactive so no IPI required while it is active.
+	 */
+	arch_smp_mb();
+	if (arch_atomic_read(&ictlp->async_active)) {
+		return TRUE;
+	}
+
+	if (smp_ipi_mark_pending(ictlp)) {
+		vmm_cpumask_set_cpu(ipic->dst_cpu, trig_mask);
+	}
+
+	return TRUE;
 }
 
 static void smp_ipi_main(void)
@@ -155,9 +376,23 @@ static void smp_ipi_main(void)
 		vmm_completion_wait(&ictlp->ipi_avail);
 
 		/* Process async IPIs */
-		while (fifo_dequeue(ictlp->async_fifo, &ipic)) {
-			if (ipic.func) {
-				ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
+		while (1) {
+			arch_atomic_write(&ictlp->async_active, 1);
+			arch_smp_mb();
+
+			while (smp_ipi_dequeue(&ictlp->async_q, &ipic)) {
+				if (ipic.func) {
+					trace_smp_ipi_exec(ipic.src_cpu,
+						(virtual_addr_t)ipic.func, FALSE);
+					ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
+				}
+			}
+
+			arch_atomic_write(&ictlp->async_active, 0);
+			arch_smp_mb();
+
+			if (smp_ipi_queue_isempty(&ictlp->async_q)) {
+				break;
 			}
 		}
 	}
@@ -165,48 +400,62 @@ static void smp_ipi_main(void)
 
 void vmm_smp_ipi_exec(void)
 {
-	struct smp_ipi_call ipic;
 	struct smp_ipi_ctrl *ictlp = &this_cpu(ictl);
 
+	/* Calls enqueued after this point will raise new IPI */
+	arch_atomic_write(&ictlp->ipi_pending, 0);
+	arch_smp_mb();
+
 	/* Process Sync IPIs */
-	while (fifo_dequeue(ictlp->sync_fifo, &ipic)) {
-		if (ipic.func) {
-			ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
-		}
-	}
+	smp_ipi_sync_process(ictlp);
 
 	/* Signal IPI available event */
-	vmm_completion_complete(&ictlp->ipi_avail);
+	if (!smp_ipi_queue_isempty(&ictlp->async_q)) {
+		vmm_completion_complete(&ictlp->ipi_avail);
+	}
 }
 
-void vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
-			     void (*func)(void *, void *, void *),
-			     void *arg0, void *arg1, void *arg2)
+int vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
+			    void (*func)(void *, void *, void *),
+			    void *arg0, void *arg1, void *arg2)
 {
+	int rc = VMM_OK;
+	bool can_wait, call_local = FALSE;
 	u32 c, cpu = vmm_smp_processor_id();
+	struct vmm_cpumask trig_mask = VMM_CPU_MASK_NONE;
 	struct smp_ipi_call ipic;
 
 	if (!dest || !func) {
-		return;
+		return VMM_EFAIL;
 	}
 
+	can_wait = smp_ipi_async_can_wait();
+
+	ipic.src_cpu = cpu;
+	ipic.func = func;
+	ipic.arg0 = arg0;
+	ipic.arg1 = arg1;
+	ipic.arg2 = arg2;
+
+	/* Enqueue to all destinations and then raise one IPI */
 	for_each_cpu(c, dest) {
 		if (c == cpu) {
-			func(arg0, arg1, arg2);
-		} else {
-			if (!vmm_cpu_online(c)) {
-				continue;
-			}
-
-			ipic.src_cpu = cpu;
+			call_local = TRUE;
+		} else if (vmm_cpu_online(c)) {
 			ipic.dst_cpu = c;
-			ipic.func = func;
-			ipic.arg0 = arg0;
-			ipic.arg1 = arg1;
-			ipic.arg2 = arg2;
-			smp_ipi_async_submit(&per_cpu(ictl, c), &ipic);
+			if (!smp_ipi_async_submit(&per_cpu(ictl, c),
+						  &ipic, &trig_mask, can_wait)) {
+				rc = VMM_EBUSY;
+			}
 		}
 	}
+	smp_ipi_trigger(&trig_mask);
+
+	if (call_local) {
+		func(arg0, arg1, arg2);
+	}
+
+	return rc;
 }
 
 int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
@@ -215,46 +464,52 @@ int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
 			   void *arg0, void *arg1, void *arg2)
 {
 	int rc = VMM_OK;
+	bool call_local = FALSE;
 	u64 timeout_tstamp;
-	u32 c, trig_count, cpu = vmm_smp_processor_id();
+	u32 c, done, trig_count, cpu = vmm_smp_processor_id();
+	u32 ticket[CONFIG_CPU_COUNT];
+	struct vmm_cpumask wait_mask = VMM_CPU_MASK_NONE;
 	struct vmm_cpumask trig_mask = VMM_CPU_MASK_NONE;
 	struct smp_ipi_call ipic;
-	struct smp_ipi_ctrl *ictlp;
 
 	if (!dest || !func) {
 		return VMM_EFAIL;
 	}
 
+	ipic.src_cpu = cpu;
+	ipic.func = func;
+	ipic.arg0 = arg0;
+	ipic.arg1 = arg1;
+	ipic.arg2 = arg2;
+
+	/* Enqueue to all destinations and then raise one IPI */
 	trig_count = 0;
 	for_each_cpu(c, dest) {
 		if (c == cpu) {
-			func(arg0, arg1, arg2);
-		} else {
-			if (!vmm_cpu_online(c)) {
-				continue;
-			}
-
-			ipic.src_cpu = cpu;
+			call_local = TRUE;
+		} else if (vmm_cpu_online(c)) {
 			ipic.dst_cpu = c;
-			ipic.func = func;
-			ipic.arg0 = arg0;
-			ipic.arg1 = arg1;
-			ipic.arg2 = arg2;
-			smp_ipi_sync_submit(&per_cpu(ictl, c), &ipic);
-			vmm_cpumask_set_cpu(c, &trig_mask);
+			smp_ipi_sync_submit(&per_cpu(ictl, c),
+					    &ipic, &trig_mask, &ticket[c]);
+			vmm_cpumask_set_cpu(c, &wait_mask);
 			trig_count++;
 		}
 	}
+	smp_ipi_trigger(&trig_mask);
+
+	if (call_local) {
+		func(arg0, arg1, arg2);
+	}
 
 	if (trig_count) {
 		rc = VMM_ETIMEDOUT;
 		timeout_tstamp = vmm_timer_timestamp();
 		timeout_tstamp += (u64)timeout_msecs * 1000000ULL;
 		while (vmm_timer_timestamp() < timeout_tstamp) {
-			for_each_cpu(c, &trig_mask) {
-				ictlp = &per_cpu(ictl, c);
-				if (!fifo_avail(ictlp->sync_fifo)) {
-					vmm_cpumask_clear_cpu(c, &trig_mask);
+			for_each_cpu(c, &wait_mask) {
+				done = arch_atomic_read(&per_cpu(ictl, c).sync_done);
+				if ((s32)(done - (ticket[c] + 1)) >= 0) {
+					vmm_cpumask_clear_cpu(c, &wait_mask);
 					trig_count--;
 				}
 			}
@@ -264,7 +519,7 @@ int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
 				break;
 			}
 
-			vmm_udelay(SMP_IPI_WAIT_UDELAY);
+			smp_ipi_wait();
 		}
 	}
 
@@ -278,22 +533,23 @@ int __cpuinit vmm_smp_ipi_init(void)
 	u32 cpu = vmm_smp_processor_id();
 	struct smp_ipi_ctrl *ictlp = &this_cpu(ictl);
 
-	/* Initialize Sync IPI FIFO */
-	ictlp->sync_fifo = fifo_alloc(sizeof(struct smp_ipi_call), 
-					   SMP_IPI_MAX_SYNC_PER_CPU);
-	if (!ictlp->sync_fifo) {
-		rc = VMM_ENOMEM;
+	/* Initialize Sync IPI queue */
+	rc = smp_ipi_queue_init(&ictlp->sync_q, SMP_IPI_MAX_SYNC_PER_CPU);
+	if (rc) {
 		goto fail;
 	}
 
-	/* Initialize Async IPI FIFO */
-	ictlp->async_fifo = fifo_alloc(sizeof(struct smp_ipi_call), 
-					   SMP_IPI_MAX_ASYNC_PER_CPU);
-	if (!ictlp->async_fifo) {
-		rc = VMM_ENOMEM;
+	/* Initialize Async IPI queue */
+	rc = smp_ipi_queue_init(&ictlp->async_q, SMP_IPI_MAX_ASYNC_PER_CPU);
+	if (rc) {
 		goto fail_free_sync;
 	}
 
+	/* Initialize IPI state */
+	ARCH_ATOMIC_INIT(&ictlp->sync_done, 0);
+	ARCH_ATOMIC_INIT(&ictlp->ipi_pending, 0);
+	ARCH_ATOMIC_INIT(&ictlp->async_active, 0);
+
 	/* Initialize IPI available completion event */
 	INIT_COMPLETION(&ictlp->ipi_avail);
 
@@ -334,10 +590,9 @@ fail_stop_vcpu:
 fail_free_vcpu:
 	vmm_manager_vcpu_orphan_destroy(ictlp->ipi_vcpu);
 fail_free_async:
-	fifo_free(ictlp->async_fifo);
+	smp_ipi_queue_free(&ictlp->async_q);
 fail_free_sync:
-	fifo_free(ictlp->sync_fifo);
+	smp_ipi_queue_free(&ictlp->sync_q);
 fail:
 	return rc;
 }
-
@@ -0,0 +1,279 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_trace.c
+ * @author agent (agent@local)
+ * @brief source file of hypervisor event tracing.
+ *
+ * Each host CPU has its own ring of trace entries which is written
+ * only by that host CPU with local interrupts disabled so writers
+ * never need locks. The ring head is free-running and readers keep
+ * their own position which allows any number of readers to consume
+ * trace entries concurrently with writers. A reader detects that
+ * an entry was overwritten while being copied by re-checking the
+ * ring head after the copy.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_mutex.h>
+#include <vmm_percpu.h>
+#include <vmm_smp.h>
+#include <vmm_timer.h>
+#include <vmm_trace.h>
+#include <vmm_modules.h>
+#include <arch_cpu_irq.h>
+#include <arch_barrier.h>
+#include <libs/stringlib.h>
+
+#define TRACE_RING_MASK		(VMM_TRACE_RING_SIZE - 1)
+
+struct vmm_trace_event {
+	const char *name;
+	const char *fmt;
+};
+
+struct vmm_trace_percpu {
+	struct vmm_trace_entry *ring;
+	u32 head;
+	u32 base;
+};
+
+/* Event mask has one bit for each trace event */
+typedef char trace_event_count_check[(VMM_TRACE_ID_MAX <= 32) ? 1 : -1];
+
+static const struct vmm_trace_event trace_events[VMM_TRACE_ID_MAX] = {
+#define VMM_TRACE_EVENT(name, proto, args, fmt)	\
+	[VMM_TRACE_ID_##name] = { #name, fmt },
+#include <vmm_trace_events.h>
+#undef VMM_TRACE_EVENT
+};
+
+static DEFINE_MUTEX(trace_lock);
+static DEFINE_PER_CPU(struct vmm_trace_percpu, tpcpu);
+
+u32 vmm_trace_event_mask = 0;
+VMM_EXPORT_SYMBOL(vmm_trace_event_mask);
+
+void __vmm_trace_record(u32 id, u64 a0, u64 a1, u64 a2, u64 a3)
+{
+	irq_flags_t flags;
+	struct vmm_trace_entry *e;
+	struct vmm_trace_percpu *tp;
+
+	arch_cpu_irq_save(flags);
+
+	tp = &this_cpu(tpcpu);
+	if (tp->ring) {
+		e = &tp->ring[tp->head & TRACE_RING_MASK];
+		e->tstamp = vmm_timer_timestamp();
+		e->id = id;
+		e->cpu = vmm_smp_processor_id();
+		e->args[0] = a0;
+		e->args[1] = a1;
+		e->args[2] = a2;
+		e->args[3] = a3;
+		arch_smp_wmb();
+		tp->head++;
+	}
+
+	arch_cpu_irq_restore(flags);
+}
+VMM_EXPORT_SYMBOL(__vmm_trace_record);
+
+const char *vmm_trace_event_name(u32 id)
+{
+	return (id < VMM_TRACE_ID_MAX) ? trace_events[id].name : NULL;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_event_name);
+
+const char *vmm_trace_event_format(u32 id)
+{
+	return (id < VMM_TRACE_ID_MAX) ? trace_events[id].fmt : NULL;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_event_format);
+
+u32 vmm_trace_event_find(const char *name)
+{
+	u32 id;
+
+	if (!name) {
+		return VMM_TRACE_ID_NONE;
+	}
+
+	for (id = 0; id < VMM_TRACE_ID_MAX; id++) {
+		if (!strcmp(trace_events[id].name, name)) {
+			return id;
+		}
+	}
+
+	return VMM_TRACE_ID_NONE;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_event_find);
+
+bool vmm_trace_event_isenabled(u32 id)
+{
+	if (VMM_TRACE_ID_MAX <= id) {
+		return FALSE;
+	}
+
+	return (vmm_trace_event_mask & (1U << id)) ? TRUE : FALSE;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_event_isenabled);
+
+static int trace_alloc_rings(void)
+{
+	u32 cpu;
+	struct vmm_trace_percpu *tp;
+
+	for_each_possible_cpu(cpu) {
+		tp = &per_cpu(tpcpu, cpu);
+		if (tp->ring) {
+			continue;
+		}
+		tp->ring = vmm_zalloc(VMM_TRACE_RING_SIZE *
+				      sizeof(*tp->ring));
+		if (!tp->ring) {
+			return VMM_ENOMEM;
+		}
+	}
+
+	/* Rings must be visible before any event is enabled */
+	arch_smp_wmb();
+
+	return VMM_OK;
+}
+
+int vmm_trace_event_enable(u32 id, bool enable)
+{
+	int rc = VMM_OK;
+
+	if (VMM_TRACE_ID_MAX <= id) {
+		return VMM_EINVALID;
+	}
+
+	vmm_mutex_lock(&trace_lock);
+
+	if (enable) {
+		rc = trace_alloc_rings();
+		if (!rc) {
+			vmm_trace_event_mask |= (1U << id);
+		}
+	} else {
+		vmm_trace_event_mask &= ~(1U << id);
+	}
+
+	vmm_mutex_unlock(&trace_lock);
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_event_enable);
+
+void vmm_trace_clear(void)
+{
+	u32 cpu;
+	struct vmm_trace_percpu *tp;
+
+	vmm_mutex_lock(&trace_lock);
+
+	for_each_possible_cpu(cpu) {
+		tp = &per_cpu(tpcpu, cpu);
+		tp->base = tp->head;
+	}
+
+	vmm_mutex_unlock(&trace_lock);
+}
+VMM_EXPORT_SYMBOL(vmm_trace_clear);
+
+u32 vmm_trace_first(u32 cpu)
+{
+	u32 head;
+	struct vmm_trace_percpu *tp;
+
+	if (CONFIG_CPU_COUNT <= cpu) {
+		return 0;
+	}
+	tp = &per_cpu(tpcpu, cpu);
+
+	head = tp->head;
+	if ((head - tp->base) > VMM_TRACE_RING_SIZE) {
+		return head - VMM_TRACE_RING_SIZE;
+	}
+
+	return tp->base;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_first);
+
+u32 vmm_trace_last(u32 cpu)
+{
+	if (CONFIG_CPU_COUNT <= cpu) {
+		return 0;
+	}
+
+	return per_cpu(tpcpu, cpu).head;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_last);
+
+int vmm_trace_read(u32 cpu, u32 *pos,
+		   struct vmm_trace_entry *e, u32 *lost)
+{
+	u32 head;
+	struct vmm_trace_percpu *tp;
+
+	if ((CONFIG_CPU_COUNT <= cpu) || !pos || !e) {
+		return VMM_EINVALID;
+	}
+	tp = &per_cpu(tpcpu, cpu);
+	if (!tp->ring) {
+		return VMM_ENOENT;
+	}
+
+	while (1) {
+		head = tp->head;
+		arch_smp_rmb();
+
+		if (*pos == head) {
+			return VMM_ENOENT;
+		}
+
+		/* Skip entries which were overwritten */
+		if ((head - *pos) > VMM_TRACE_RING_SIZE) {
+			if (lost) {
+				*lost += (head - *pos) - VMM_TRACE_RING_SIZE;
+			}
+			*pos = head - VMM_TRACE_RING_SIZE;
+		}
+
+		memcpy(e, &tp->ring[*pos & TRACE_RING_MASK], sizeof(*e));
+		arch_smp_rmb();
+
+		/* Writer might have started overwriting the entry */
+		if ((tp->head - *pos) < VMM_TRACE_RING_SIZE) {
+			break;
+		}
+		if (lost) {
+			*lost += 1;
+		}
+		(*pos)++;
+	}
+
+	(*pos)++;
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_trace_read);
@@ -22,19 +22,121 @@
  */
 
 #include <arch_vcpu.h>
+#include <arch_barrier.h>
 #include <vmm_error.h>
 #include <vmm_heap.h>
+#include <vmm_smp.h>
 #include <vmm_stdio.h>
 #include <vmm_timer.h>
 #include <vmm_scheduler.h>
+#include <vmm_trace.h>
 #include <vmm_devtree.h>
 #include <vmm_vcpu_irq.h>
 #include <libs/stringlib.h>
+#include <libs/bitops.h>
+#include <libs/mathlib.h>
 
 #define DEASSERTED	0
 #define ASSERTED	1
 #define PENDING		2
 
+/*
+ * Each VCPU has one bitmap of asserted irqs per priority level so
+ * that highest priority asserted irq is found using find-first-set
+ * on few words instead of scanning all irqs. A bit is set only after
+ * irq state becomes ASSERTED and cleared when irq leaves ASSERTED
+ * state. A stale bit (i.e. bit set but irq not ASSERTED) can appear
+ * when assert and deassert race, and it is dropped by the next
+ * vmm_vcpu_irq_process().
+ *
+ * Bitmap words are 32-bit because arch_atomic_cmpxchg() only updates
+ * lower 32 bits of atomic_t on 64-bit architectures.
+ */
+#define ASSERTED_WORD_BITS		32
+#define ASSERTED_WORD(irq_no)		((irq_no) / ASSERTED_WORD_BITS)
+#define ASSERTED_MASK(irq_no)		(1U << ((irq_no) % ASSERTED_WORD_BITS))
+#define ASSERTED_WORD_COUNT(count)	\
+	(((count) + ASSERTED_WORD_BITS - 1) / ASSERTED_WORD_BITS)
+
+static inline atomic_t *vcpu_irq_asserted_word(struct vmm_vcpu *vcpu,
+					       u32 irq_no)
+{
+	return &vcpu->irqs.asserted[vcpu->irqs.irq[irq_no].prio *
+				    vcpu->irqs.word_count +
+				    ASSERTED_WORD(irq_no)];
+}
+
+static void vcpu_irq_asserted_set(struct vmm_vcpu *vcpu, u32 irq_no)
+{
+	u32 old, mask = ASSERTED_MASK(irq_no);
+	atomic_t *word = vcpu_irq_asserted_word(vcpu, irq_no);
+
+	do {
+		old = (u32)arch_atomic_read(word);
+		if (old & mask) {
+			return;
+		}
+	} while ((u32)arch_atomic_cmpxchg(word, old, old | mask) != old);
+
+	arch_atomic_write(&vcpu->irqs.asserted_last, irq_no);
+	arch_atomic_add(&vcpu->irqs.asserted_count, 1);
+}
+
+static void vcpu_irq_asserted_clear(struct vmm_vcpu *vcpu, u32 irq_no)
+{
+	u32 old, mask = ASSERTED_MASK(irq_no);
+	atomic_t *word = vcpu_irq_asserted_word(vcpu, irq_no);
+
+	do {
+		old = (u32)arch_atomic_read(word);
+		if (!(old & mask)) {
+			return;
+		}
+	} while ((u32)arch_atomic_cmpxchg(word, old, old & ~mask) != old);
+
+	arch_atomic_sub(&vcpu->irqs.asserted_count, 1);
+}
+
+/* Find highest priority asserted irq. Priority zero irqs are never
+ * selected for execution.
+ */
+static int vcpu_irq_asserted_find(struct vmm_vcpu *vcpu)
+{
+	u32 val, prio, w, word_count = vcpu->irqs.word_count;
+	atomic_t *words;
+
+	for (prio = vcpu->irqs.prio_count - 1; prio > 0; prio--) {
+		words = &vcpu->irqs.asserted[prio * word_count];
+		for (w = 0; w < word_count; w++) {
+			val = (u32)arch_atomic_read(&words[w]);
+			if (val) {
+				return w * ASSERTED_WORD_BITS +
+					__ffs((unsigned long)val);
+			}
+		}
+	}
+
+	return -1;
+}
+
+/* Move irq from ASSERTED to PENDING state */
+static bool vcpu_irq_claim(struct vmm_vcpu *vcpu, u32 irq_no)
+{
+	if (arch_atomic_cmpxchg(&vcpu->irqs.irq[irq_no].assert,
+				ASSERTED, PENDING) == ASSERTED) {
+		vcpu_irq_asserted_clear(vcpu, irq_no);
+		return TRUE;
+	}
+
+	/* Drop stale bit but keep it if irq got asserted meanwhile */
+	vcpu_irq_asserted_clear(vcpu, irq_no);
+	if (arch_atomic_read(&vcpu->irqs.irq[irq_no].assert) == ASSERTED) {
+		vcpu_irq_asserted_set(vcpu, irq_no);
+	}
+
+	return FALSE;
+}
+
 void vmm_vcpu_irq_process(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 {
 	/* For non-normal vcpu dont do anything */
@@ -51,47 +153,45 @@ void vmm_vcpu_irq_process(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 	/* Proceed only if we have pending execute */
 	if (arch_atomic_dec_if_positive(&vcpu->irqs.execute_pending) >= 0) {
 		int irq_no = -1;
-		u32 i, tmp_prio, irq_count = vcpu->irqs.irq_count;
-		u32 irq_prio = 0;
-
-		/* Find the irq number to process */
-		for (i = 0; i < irq_count; i++) {
-			if (arch_atomic_read(&vcpu->irqs.irq[i].assert) ==
-			    ASSERTED) {
-				tmp_prio = arch_vcpu_irq_priority(vcpu, i);
-				if (tmp_prio > irq_prio) {
-					irq_no = i;
-					irq_prio = tmp_prio;
-				}
+
+		/* Fast path: only one irq asserted */
+		if (arch_atomic_read(&vcpu->irqs.asserted_count) == 1) {
+			irq_no = arch_atomic_read(&vcpu->irqs.asserted_last);
+			if ((irq_no >= vcpu->irqs.irq_count) ||
+			    !vcpu->irqs.irq[irq_no].prio ||
+			    !vcpu_irq_claim(vcpu, irq_no)) {
+				irq_no = -1;
 			}
 		}
-		if (irq_no == -1) {
-			return;
-		}
 
-		/* If irq number found then execute it */
-		if (arch_atomic_cmpxchg(&vcpu->irqs.irq[irq_no].assert,
-					ASSERTED, PENDING) == ASSERTED) {
-			if (arch_vcpu_irq_execute(vcpu, regs, irq_no,
-			    	vcpu->irqs.irq[irq_no].reason) == VMM_OK) {
-				arch_atomic_write(&vcpu->irqs.
-						  irq[irq_no].assert,
-						  DEASSERTED);
-				arch_atomic64_inc(&vcpu->irqs.
-						  execute_count);
-			} else {
-				/* arch_vcpu_irq_execute failed may be
-				 * because VCPU was already processing
-				 * a VCPU irq hence increment execute
-				 * pending count to try next time.
-				 */
-				arch_atomic_inc(&vcpu->irqs.
-						execute_pending);
-				arch_atomic_write(&vcpu->irqs.
-						  irq[irq_no].assert,
-						  ASSERTED);
+		/* Find the highest priority irq number to process */
+		while (irq_no == -1) {
+			irq_no = vcpu_irq_asserted_find(vcpu);
+			if (irq_no == -1) {
+				return;
+			}
+			if (!vcpu_irq_claim(vcpu, irq_no)) {
+				irq_no = -1;
 			}
 		}
+
+		/* Execute the claimed irq number */
+		if (arch_vcpu_irq_execute(vcpu, regs, irq_no,
+				vcpu->irqs.irq[irq_no].reason) == VMM_OK) {
+			arch_atomic_write(&vcpu->irqs.irq[irq_no].assert,
+					  DEASSERTED);
+			vmm_percpu_counter_inc(&vcpu->irqs.execute_count);
+		} else {
+			/* arch_vcpu_irq_execute failed may be
+			 * because VCPU was already processing
+			 * a VCPU irq hence increment execute
+			 * pending count to try next time.
+			 */
+			arch_atomic_inc(&vcpu->irqs.execute_pending);
+			arch_atomic_write(&vcpu->irqs.irq[irq_no].assert,
+					  ASSERTED);
+			vcpu_irq_asserted_set(vcpu, irq_no);
+		}
 	}
 }
 
@@ -103,6 +203,89 @@ static void vcpu_irq_wfi_try_resume(struct vmm_vcpu *vcpu, void *data)
 	}
 }
 
+/*
+ * Halt-polling: A VCPU waiting for irq first spins for a short
+ * per-VCPU window so that irqs arriving soon after wait for irq
+ * do not pay for full pause and resume of the VCPU. The window is
+ * grown when VCPU was paused only for a short time and shrunk when
+ * VCPU was paused for longer than CONFIG_WFI_HALT_POLL_NS. We never
+ * poll when other VCPUs are ready on the host CPU. Wait for irq is
+ * called from trap handlers with host irqs disabled so only irqs
+ * asserted from other host CPUs (i.e. execute_pending) can end the
+ * poll early.
+ */
+#define VCPU_IRQ_WFI_POLL_START_NS	10000ULL
+
+/* Note: Must be called with VCPU WFI lock held */
+static void vcpu_irq_wfi_poll_adjust(struct vmm_vcpu *vcpu, u64 block_ns)
+{
+	u64 poll_ns = vcpu->irqs.wfi.poll_ns;
+
+	if (!CONFIG_WFI_HALT_POLL_NS) {
+		return;
+	}
+
+	if (CONFIG_WFI_HALT_POLL_NS < block_ns) {
+		/* Shrink poll window */
+		if (CONFIG_WFI_HALT_POLL_SHRINK) {
+			poll_ns = udiv64(poll_ns, CONFIG_WFI_HALT_POLL_SHRINK);
+		} else {
+			poll_ns = 0;
+		}
+	} else if (poll_ns < block_ns) {
+		/* Grow poll window */
+		if (poll_ns) {
+			poll_ns *= CONFIG_WFI_HALT_POLL_GROW;
+		} else {
+			poll_ns = VCPU_IRQ_WFI_POLL_START_NS;
+		}
+		if (CONFIG_WFI_HALT_POLL_NS < poll_ns) {
+			poll_ns = CONFIG_WFI_HALT_POLL_NS;
+		}
+	}
+
+	vcpu->irqs.wfi.poll_ns = poll_ns;
+}
+
+/* Returns poll window used or zero if we did not poll */
+static u64 vcpu_irq_wfi_poll(struct vmm_vcpu *vcpu)
+{
+	u8 prio;
+	u32 hcpu;
+	u64 poll_ns, start;
+	irq_flags_t flags;
+
+	if (!CONFIG_WFI_HALT_POLL_NS) {
+		return 0;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vcpu->irqs.wfi.lock, flags);
+	poll_ns = vcpu->irqs.wfi.poll_ns;
+	vmm_spin_unlock_irqrestore_lite(&vcpu->irqs.wfi.lock, flags);
+	if (!poll_ns) {
+		return 0;
+	}
+
+	/* Don't poll if other VCPUs are ready on this host CPU */
+	hcpu = vmm_smp_processor_id();
+	for (prio = VMM_VCPU_MIN_PRIORITY + 1;
+	     prio <= VMM_VCPU_MAX_PRIORITY; prio++) {
+		if (vmm_scheduler_ready_count(hcpu, prio)) {
+			return 0;
+		}
+	}
+
+	start = vmm_timer_timestamp();
+	do {
+		if (arch_atomic_read(&vcpu->irqs.execute_pending)) {
+			break;
+		}
+		arch_cpu_relax();
+	} while ((vmm_timer_timestamp() - start) < poll_ns);
+
+	return poll_ns;
+}
+
 static int vcpu_irq_wfi_resume(struct vmm_vcpu *vcpu, bool use_async_ipi)
 {
 	int rc;
@@ -126,6 +309,10 @@ static int vcpu_irq_wfi_resume(struct vmm_vcpu *vcpu, bool use_async_ipi)
 		/* Stop wait for irq timeout event */
 		vmm_timer_event_stop(vcpu->irqs.wfi.priv);
 
+		/* Adjust poll window based on time spent waiting */
+		vcpu_irq_wfi_poll_adjust(vcpu,
+			vmm_timer_timestamp() - vcpu->irqs.wfi.tstamp);
+
 		rc = VMM_OK;
 	} else {
 		rc = VMM_ENOTAVAIL;
@@ -186,17 +373,20 @@ void vmm_vcpu_irq_assert(struct vmm_vcpu *vcpu, u32 irq_no, u64 reason)
 	}
 
 	/* Check irq number */
-	if (irq_no > vcpu->irqs.irq_count) {
+	if (irq_no >= vcpu->irqs.irq_count) {
 		return;
 	}
 
+	trace_vcpu_irq_assert(vcpu->id, irq_no, reason);
+
 	/* Assert the irq */
 	if (arch_atomic_cmpxchg(&vcpu->irqs.irq[irq_no].assert, 
 				DEASSERTED, ASSERTED) == DEASSERTED) {
 		if (arch_vcpu_irq_assert(vcpu, irq_no, reason) == VMM_OK) {
 			vcpu->irqs.irq[irq_no].reason = reason;
+			vcpu_irq_asserted_set(vcpu, irq_no);
 			arch_atomic_inc(&vcpu->irqs.execute_pending);
-			arch_atomic64_inc(&vcpu->irqs.assert_count);
+			vmm_percpu_counter_inc(&vcpu->irqs.assert_count);
 		} else {
 			arch_atomic_write(&vcpu->irqs.irq[irq_no].assert,
 					  DEASSERTED);
@@ -215,18 +405,24 @@ void vmm_vcpu_irq_deassert(struct vmm_vcpu *vcpu, u32 irq_no)
 	}
 
 	/* Check irq number */
-	if (irq_no > vcpu->irqs.irq_count) {
+	if (irq_no >= vcpu->irqs.irq_count) {
 		return;
 	}
 
 	/* Call arch specific deassert */
 	if (arch_vcpu_irq_deassert(vcpu, irq_no,
 				   vcpu->irqs.irq[irq_no].reason) == VMM_OK) {
-		arch_atomic64_inc(&vcpu->irqs.deassert_count);
+		vmm_percpu_counter_inc(&vcpu->irqs.deassert_count);
 	}
 
 	/* Reset VCPU irq assert state */
-	arch_atomic_write(&vcpu->irqs.irq[irq_no].assert, DEASSERTED);
+	if (arch_atomic_cmpxchg(&vcpu->irqs.irq[irq_no].assert,
+				ASSERTED, DEASSERTED) == ASSERTED) {
+		vcpu_irq_asserted_clear(vcpu, irq_no);
+	} else {
+		arch_atomic_write(&vcpu->irqs.irq[irq_no].assert,
+				  DEASSERTED);
+	}
 
 	/* Ensure irq reason is zeroed */
 	vcpu->irqs.irq[irq_no].reason = 0x0;
@@ -245,6 +441,7 @@ int vmm_vcpu_irq_wait_resume(struct vmm_vcpu *vcpu, bool use_async_ipi)
 
 int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs)
 {
+	u64 poll_ns;
 	irq_flags_t flags;
 	bool try_vcpu_pause = FALSE;
 
@@ -253,6 +450,9 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs)
 		return VMM_EFAIL;
 	}
 
+	/* Poll for irq before trying to pause the VCPU */
+	poll_ns = vcpu_irq_wfi_poll(vcpu);
+
 	/* Lock VCPU WFI */
 	vmm_spin_lock_irqsave_lite(&vcpu->irqs.wfi.lock, flags);
 
@@ -260,14 +460,23 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs)
 	    !arch_atomic_read(&vcpu->irqs.execute_pending)) {
 		try_vcpu_pause = TRUE;
 
+		/* Update poll statistics */
+		if (poll_ns) {
+			vcpu->irqs.wfi.poll_fail++;
+		}
+
 		/* Set wait for irq state */
 		vcpu->irqs.wfi.state = TRUE;
+		vcpu->irqs.wfi.tstamp = vmm_timer_timestamp();
 
 		/* Start wait for irq timeout event */
 		if (!nsecs) {
 			nsecs = CONFIG_WFI_TIMEOUT_SECS * 1000000000ULL;
 		}
 		vmm_timer_event_start(vcpu->irqs.wfi.priv, nsecs);
+	} else if (poll_ns) {
+		/* Update poll statistics */
+		vcpu->irqs.wfi.poll_success++;
 	}
 
 	/* Unlock VCPU WFI */
@@ -303,10 +512,90 @@ bool vmm_vcpu_irq_wait_state(struct vmm_vcpu *vcpu)
 	return ret;
 }
 
+int vmm_vcpu_irq_wait_poll_stats(struct vmm_vcpu *vcpu, u64 *poll_ns,
+				 u64 *poll_success, u64 *poll_fail)
+{
+	irq_flags_t flags;
+
+	/* Sanity Checks */
+	if (!vcpu || !vcpu->is_normal) {
+		return VMM_EFAIL;
+	}
+
+	/* Lock VCPU WFI */
+	vmm_spin_lock_irqsave_lite(&vcpu->irqs.wfi.lock, flags);
+
+	/* Read VCPU halt-polling statistics */
+	if (poll_ns) {
+		*poll_ns = vcpu->irqs.wfi.poll_ns;
+	}
+	if (poll_success) {
+		*poll_success = vcpu->irqs.wfi.poll_success;
+	}
+	if (poll_fail) {
+		*poll_fail = vcpu->irqs.wfi.poll_fail;
+	}
+
+	/* Unlock VCPU WFI */
+	vmm_spin_unlock_irqrestore_lite(&vcpu->irqs.wfi.lock, flags);
+
+	return VMM_OK;
+}
+
+static const struct {
+	const char *suffix;
+	size_t offset;
+} vcpu_irq_counters[] = {
+	{ "irq_assert", offsetof(struct vmm_vcpu_irqs, assert_count) },
+	{ "irq_execute", offsetof(struct vmm_vcpu_irqs, execute_count) },
+	{ "irq_deassert", offsetof(struct vmm_vcpu_irqs, deassert_count) },
+};
+
+#define vcpu_irq_counter(vcpu, i)	\
+	((struct vmm_percpu_counter *)((void *)&(vcpu)->irqs + \
+					vcpu_irq_counters[(i)].offset))
+
+static void vcpu_irq_counters_free(struct vmm_vcpu *vcpu, u32 count)
+{
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		vmm_percpu_counter_unregister(vcpu_irq_counter(vcpu, i));
+		vmm_percpu_counter_destroy(vcpu_irq_counter(vcpu, i));
+	}
+}
+
+static int vcpu_irq_counters_alloc(struct vmm_vcpu *vcpu)
+{
+	int rc;
+	u32 i;
+	char name[VMM_FIELD_NAME_SIZE];
+
+	for (i = 0; i < array_size(vcpu_irq_counters); i++) {
+		rc = vmm_percpu_counter_init(vcpu_irq_counter(vcpu, i), 0);
+		if (rc) {
+			vcpu_irq_counters_free(vcpu, i);
+			return rc;
+		}
+
+		vmm_snprintf(name, sizeof(name), "%s%s%s", vcpu->name,
+			     VMM_DEVTREE_PATH_SEPARATOR_STRING,
+			     vcpu_irq_counters[i].suffix);
+		rc = vmm_percpu_counter_register(vcpu_irq_counter(vcpu, i),
+						 name);
+		if (rc) {
+			vcpu_irq_counters_free(vcpu, i + 1);
+			return rc;
+		}
+	}
+
+	return VMM_OK;
+}
+
 int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 {
 	int rc;
-	u32 ite, irq_count;
+	u32 ite, irq_count, prio;
 	struct vmm_timer_event *ev;
 
 	/* Sanity Checks */
@@ -334,9 +623,32 @@ int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 			return VMM_ENOMEM;
 		}
 
+		/* Determine irq priorities (assumed to be fixed) */
+		vcpu->irqs.prio_count = 1;
+		for (ite = 0; ite < irq_count; ite++) {
+			prio = arch_vcpu_irq_priority(vcpu, ite);
+			vcpu->irqs.irq[ite].prio = prio;
+			if (vcpu->irqs.prio_count <= prio) {
+				vcpu->irqs.prio_count = prio + 1;
+			}
+		}
+
+		/* Allocate memory for per-priority asserted bitmaps */
+		vcpu->irqs.word_count = ASSERTED_WORD_COUNT(irq_count);
+		vcpu->irqs.asserted = vmm_zalloc(sizeof(atomic_t) *
+						 vcpu->irqs.prio_count *
+						 vcpu->irqs.word_count);
+		if (!vcpu->irqs.asserted) {
+			vmm_free(vcpu->irqs.irq);
+			vcpu->irqs.irq = NULL;
+			return VMM_ENOMEM;
+		}
+
 		/* Create wfi_timeout event */
 		ev = vmm_zalloc(sizeof(struct vmm_timer_event));
 		if (!ev) {
+			vmm_free(vcpu->irqs.asserted);
+			vcpu->irqs.asserted = NULL;
 			vmm_free(vcpu->irqs.irq);
 			vcpu->irqs.irq = NULL;
 			return VMM_ENOMEM;
@@ -348,6 +660,18 @@ int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 
 		/* Initialize wfi timeout event */
 		INIT_TIMER_EVENT(ev, vcpu_irq_wfi_timeout, vcpu);
+
+		/* Allocate and register per-cpu irq counters */
+		rc = vcpu_irq_counters_alloc(vcpu);
+		if (rc) {
+			vmm_free(vcpu->irqs.wfi.priv);
+			vcpu->irqs.wfi.priv = NULL;
+			vmm_free(vcpu->irqs.asserted);
+			vcpu->irqs.asserted = NULL;
+			vmm_free(vcpu->irqs.irq);
+			vcpu->irqs.irq = NULL;
+			return rc;
+		}
 	}
 
 	/* Save irq count */
@@ -357,24 +681,40 @@ int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 	arch_atomic_write(&vcpu->irqs.execute_pending, 0);
 
 	/* Set default assert & deassert counts */
-	arch_atomic64_write(&vcpu->irqs.assert_count, 0);
-	arch_atomic64_write(&vcpu->irqs.execute_count, 0);
-	arch_atomic64_write(&vcpu->irqs.deassert_count, 0);
+	vmm_percpu_counter_set(&vcpu->irqs.assert_count, 0);
+	vmm_percpu_counter_set(&vcpu->irqs.execute_count, 0);
+	vmm_percpu_counter_set(&vcpu->irqs.deassert_count, 0);
 
 	/* Reset irq processing data structures for VCPU */
 	for (ite = 0; ite < irq_count; ite++) {
 		vcpu->irqs.irq[ite].reason = 0;
 		arch_atomic_write(&vcpu->irqs.irq[ite].assert, DEASSERTED);
 	}
+	for (ite = 0; ite < (vcpu->irqs.prio_count *
+			     vcpu->irqs.word_count); ite++) {
+		arch_atomic_write(&vcpu->irqs.asserted[ite], 0);
+	}
+	arch_atomic_write(&vcpu->irqs.asserted_count, 0);
+	arch_atomic_write(&vcpu->irqs.asserted_last, 0);
 
 	/* Setup wait for irq context */
 	vcpu->irqs.wfi.state = FALSE;
+	vcpu->irqs.wfi.tstamp = 0;
+	vcpu->irqs.wfi.poll_ns = 0;
+	vcpu->irqs.wfi.poll_success = 0;
+	vcpu->irqs.wfi.poll_fail = 0;
 	rc = vmm_timer_event_stop(vcpu->irqs.wfi.priv);
 	if (rc != VMM_OK) {
+		vmm_free(vcpu->irqs.asserted);
+		vcpu->irqs.asserted = NULL;
 		vmm_free(vcpu->irqs.irq);
 		vcpu->irqs.irq = NULL;
 		vmm_free(vcpu->irqs.wfi.priv);
 		vcpu->irqs.wfi.priv = NULL;
+		if (!vcpu->reset_count) {
+			vcpu_irq_counters_free(vcpu,
+					array_size(vcpu_irq_counters));
+		}
 	}
 
 	return rc;
@@ -399,9 +739,16 @@ int vmm_vcpu_irq_deinit(struct vmm_vcpu *vcpu)
 	vmm_free(vcpu->irqs.wfi.priv);
 	vcpu->irqs.wfi.priv = NULL;
 
+	/* Free asserted bitmaps */
+	vmm_free(vcpu->irqs.asserted);
+	vcpu->irqs.asserted = NULL;
+
 	/* Free flags */
 	vmm_free(vcpu->irqs.irq);
 	vcpu->irqs.irq = NULL;
 
+	/* Unregister and free per-cpu irq counters */
+	vcpu_irq_counters_free(vcpu, array_size(vcpu_irq_counters));
+
 	return VMM_OK;
 }
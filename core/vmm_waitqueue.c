@@ -24,6 +24,7 @@
 #include <vmm_error.h>
 #include <vmm_timer.h>
 #include <vmm_waitqueue.h>
+#include <vmm_workqueue.h>
 #include <arch_cpu_irq.h>
 
 u32 vmm_waitqueue_count(struct vmm_waitqueue *wq) 
@@ -80,9 +81,15 @@ int __vmm_waitqueue_sleep(struct vmm_waitqueue *wq, u64 *timeout_nsecs)
 		p.ev = &wake_event;
 	}
 
+	/* Let workqueue wake another worker if VCPU is a worker */
+	vmm_workqueue_worker_sleeping(vcpu);
+
 	/* Try to Pause VCPU */
 	rc = vmm_scheduler_state_change(vcpu, VMM_VCPU_STATE_PAUSED);
 
+	/* Let workqueue account VCPU as running worker again */
+	vmm_workqueue_worker_waking(vcpu);
+
 	/* Remove VCPU from waitqueue */
 	list_del(&vcpu->wq_head);
 
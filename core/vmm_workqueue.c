@@ -32,19 +32,71 @@
 #include <vmm_workqueue.h>
 #include <libs/stringlib.h>
 
-struct vmm_workqueue {
+/*
+ * Works are executed by worker threads of a worker pool. Each host CPU
+ * has one normal and one high priority pool, and two more pools serve
+ * unbound works on any host CPU. These pools are shared by all system
+ * workqueues and workqueues created using vmm_workqueue_alloc().
+ *
+ * A pool lets only one of its workers run works at a time. When the
+ * running worker sleeps (i.e. blocks on a waitqueue) inside a work,
+ * an idle worker is woken up to continue with remaining works. A pool
+ * keeps one idle worker ready (up to CONFIG_WORKQUEUE_MAX_WORKERS) for
+ * this purpose, created by the worker which starts running works.
+ *
+ * Workqueues created using vmm_workqueue_create() get a private pool
+ * with single worker so their works are executed in-order.
+ */
+
+#define WORKER_POOL_UNBOUND		((u32)-1)
+#define WORKER_POOL_HIGHPRI		(VMM_THREAD_DEF_PRIORITY + 1)
+
+struct vmm_worker_pool {
 	vmm_spinlock_t lock;
-	struct dlist head;
+	u32 cpu;
+	u8 priority;
+	bool highpri;
 	struct dlist work_list;
+	struct dlist worker_list;
 	struct vmm_completion work_avail;
+	u32 max_workers;
+	u32 nr_workers;
+	u32 nr_idle;
+	u32 nr_running;
+	u32 worker_id;
+	const char *name;
+};
+
+struct vmm_worker {
+	struct dlist head;
+	struct vmm_worker_pool *pool;
 	struct vmm_thread *thread;
+	bool running;
+	bool sleeping;
+};
+
+struct vmm_workqueue {
+	vmm_spinlock_t lock;
+	struct dlist head;
+	char name[VMM_FIELD_NAME_SIZE];
+	u32 flags;
+	struct vmm_worker_pool *pool;
+	bool private_pool;
+	u32 nr_pending;
+	struct vmm_completion flush_done;
+	struct vmm_workqueue_stats stats;
 };
 
 struct vmm_workqueue_ctrl {
 	vmm_spinlock_t lock;
 	struct dlist wq_list;
 	u32 wq_count;
-	struct vmm_workqueue *syswq[CONFIG_CPU_COUNT];
+	struct vmm_worker_pool pools[CONFIG_CPU_COUNT][2];
+	struct vmm_worker_pool unbound_pools[2];
+	struct vmm_workqueue *syswq;
+	struct vmm_workqueue *syswq_highpri;
+	struct vmm_workqueue *syswq_unbound;
+	struct vmm_workqueue *syswq_unbound_highpri;
 };
 
 static struct vmm_workqueue_ctrl wqctrl;
@@ -129,9 +181,16 @@ stop_retry:
 		goto stop_retry;
 	}
 
-	if (work->wq && (work->flags & VMM_WORK_STATE_SCHEDULED)) {
+	if (work->pool && (work->flags & VMM_WORK_STATE_SCHEDULED)) {
+		vmm_spin_lock_irqsave(&(work->pool)->lock, flags1);
+		list_del_init(&work->head);
+		vmm_spin_unlock_irqrestore(&(work->pool)->lock, flags1);
+
 		vmm_spin_lock_irqsave(&(work->wq)->lock, flags1);
-		list_del(&work->head);
+		work->wq->nr_pending--;
+		if (!work->wq->nr_pending) {
+			vmm_completion_complete_all(&(work->wq)->flush_done);
+		}
 		vmm_spin_unlock_irqrestore(&(work->wq)->lock, flags1);
 	}
 
@@ -139,6 +198,7 @@ stop_retry:
 	work->flags &= ~VMM_WORK_STATE_INPROGRESS;
 	work->flags &= ~VMM_WORK_STATE_SCHEDULED;
 	work->wq = NULL;
+	work->pool = NULL;
 
 	vmm_spin_unlock_irqrestore(&work->lock, flags);
 
@@ -163,7 +223,48 @@ int vmm_workqueue_stop_delayed_work(struct vmm_delayed_work *work)
 
 struct vmm_thread *vmm_workqueue_get_thread(struct vmm_workqueue *wq)
 {
-	return (wq) ? wq->thread : NULL;
+	struct vmm_worker *worker;
+
+	if (!wq || !wq->private_pool ||
+	    list_empty(&wq->pool->worker_list)) {
+		return NULL;
+	}
+
+	worker = list_first_entry(&wq->pool->worker_list,
+				  struct vmm_worker, head);
+
+	return worker->thread;
+}
+
+const char *vmm_workqueue_get_name(struct vmm_workqueue *wq)
+{
+	return (wq) ? wq->name : NULL;
+}
+
+int vmm_workqueue_get_stats(struct vmm_workqueue *wq,
+			    struct vmm_workqueue_stats *stats)
+{
+	irq_flags_t flags;
+
+	if (!wq || !stats) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave(&wq->lock, flags);
+	memcpy(stats, &wq->stats, sizeof(*stats));
+	vmm_spin_unlock_irqrestore(&wq->lock, flags);
+
+	return VMM_OK;
+}
+
+struct vmm_workqueue *vmm_workqueue_system(u32 flags)
+{
+	if (flags & VMM_WQ_UNBOUND) {
+		return (flags & VMM_WQ_HIGHPRI) ?
+			wqctrl.syswq_unbound_highpri : wqctrl.syswq_unbound;
+	}
+
+	return (flags & VMM_WQ_HIGHPRI) ? wqctrl.syswq_highpri : wqctrl.syswq;
 }
 
 struct vmm_workqueue *vmm_workqueue_index2workqueue(int index)
@@ -213,14 +314,15 @@ int vmm_workqueue_flush(struct vmm_workqueue *wq)
 
 	vmm_spin_lock_irqsave(&wq->lock, flags);
 
-	while (!list_empty(&wq->work_list)) {
-		vmm_spin_unlock_irqrestore(&wq->lock, flags);
+	while (wq->nr_pending) {
+		REINIT_COMPLETION(&wq->flush_done);
 
-		/* Make sure thread is running */
-		vmm_threads_wakeup(wq->thread);
+		vmm_spin_unlock_irqrestore(&wq->lock, flags);
 
-		/* We release the processor to let the wq thread do its job */
-		vmm_scheduler_yield();
+		/* Sleeping lets pool of caller (if any) continue with
+		 * other works, so no deadlock when called from a work.
+		 */
+		vmm_completion_wait(&wq->flush_done);
 
 		vmm_spin_lock_irqsave(&wq->lock, flags);
 	}
@@ -230,10 +332,22 @@ int vmm_workqueue_flush(struct vmm_workqueue *wq)
 	return VMM_OK;
 }
 
+static struct vmm_worker_pool *workqueue_pool(struct vmm_workqueue *wq)
+{
+	if (wq->pool) {
+		return wq->pool;
+	}
+
+	return &wqctrl.pools[vmm_smp_processor_id()]
+			    [(wq->flags & VMM_WQ_HIGHPRI) ? 1 : 0];
+}
+
 int vmm_workqueue_schedule_work(struct vmm_workqueue *wq, 
 				struct vmm_work *work)
 {
+	bool wake;
 	irq_flags_t flags, flags1;
+	struct vmm_worker_pool *pool;
 
 	if (!work) {
 		return VMM_EFAIL;
@@ -247,20 +361,34 @@ int vmm_workqueue_schedule_work(struct vmm_workqueue *wq,
 	}
 
 	if (!wq) {
-		wq = wqctrl.syswq[vmm_smp_processor_id()];
+		wq = wqctrl.syswq;
 	}
+	pool = workqueue_pool(wq);
 
 	work->flags &= ~VMM_WORK_STATE_CREATED;
 	work->flags |= VMM_WORK_STATE_SCHEDULED;
 	work->wq = wq;
+	work->pool = pool;
+	work->tstamp = vmm_timer_timestamp();
 
 	vmm_spin_lock_irqsave(&wq->lock, flags1);
-	list_add_tail(&work->head, &wq->work_list);
+	wq->nr_pending++;
+	wq->stats.queued_count++;
 	vmm_spin_unlock_irqrestore(&wq->lock, flags1);
 
+	vmm_spin_lock_irqsave(&pool->lock, flags1);
+	list_add_tail(&work->head, &pool->work_list);
+	wake = (pool->nr_running) ? FALSE : TRUE;
+	vmm_spin_unlock_irqrestore(&pool->lock, flags1);
+
 	vmm_spin_unlock_irqrestore(&work->lock, flags);
 
-	vmm_completion_complete(&wq->work_avail);
+	/* Running worker will pick up the work so only wake idle worker
+	 * when nobody is running in the pool.
+	 */
+	if (wake) {
+		vmm_completion_complete(&pool->work_avail);
+	}
 
 	return VMM_OK;
 }
@@ -277,7 +405,7 @@ int vmm_workqueue_schedule_delayed_work(struct vmm_workqueue *wq,
 					u64 nsecs)
 {
 	if (!wq) {
-		wq = wqctrl.syswq[vmm_smp_processor_id()];
+		wq = wqctrl.syswq;
 	}
 
 	if (!work) {
@@ -294,57 +422,291 @@ int vmm_workqueue_schedule_delayed_work(struct vmm_workqueue *wq,
 	return vmm_timer_event_start(&work->event, nsecs);
 }
 
-static int workqueue_main(void *data)
+void vmm_workqueue_worker_sleeping(struct vmm_vcpu *vcpu)
+{
+	bool wake = FALSE;
+	irq_flags_t flags;
+	struct vmm_worker *worker = vcpu->worker;
+	struct vmm_worker_pool *pool;
+
+	if (!worker) {
+		return;
+	}
+	pool = worker->pool;
+
+	vmm_spin_lock_irqsave(&pool->lock, flags);
+
+	if (worker->running && !worker->sleeping) {
+		worker->sleeping = TRUE;
+		pool->nr_running--;
+		if (!pool->nr_running && pool->nr_idle &&
+		    !list_empty(&pool->work_list)) {
+			wake = TRUE;
+		}
+	}
+
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+
+	/* Let an idle worker continue with remaining works */
+	if (wake) {
+		vmm_completion_complete(&pool->work_avail);
+	}
+}
+
+void vmm_workqueue_worker_waking(struct vmm_vcpu *vcpu)
+{
+	irq_flags_t flags;
+	struct vmm_worker *worker = vcpu->worker;
+	struct vmm_worker_pool *pool;
+
+	if (!worker) {
+		return;
+	}
+	pool = worker->pool;
+
+	vmm_spin_lock_irqsave(&pool->lock, flags);
+
+	if (worker->sleeping) {
+		worker->sleeping = FALSE;
+		pool->nr_running++;
+	}
+
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static void worker_process_work(struct vmm_work *work)
 {
 	bool do_work;
 	irq_flags_t flags;
-	struct vmm_workqueue *wq = data;
-	struct vmm_work *work = NULL;
+	u64 queue_nsecs, exec_nsecs, tstamp;
+	struct vmm_workqueue *wq;
 
-	if (!wq) {
+	do_work = FALSE;
+	vmm_spin_lock_irqsave(&work->lock, flags);
+	wq = work->wq;
+	if (work->flags & VMM_WORK_STATE_SCHEDULED) {
+		work->flags &= ~VMM_WORK_STATE_SCHEDULED;
+		work->flags |= VMM_WORK_STATE_INPROGRESS;
+		do_work = TRUE;
+	}
+	tstamp = work->tstamp;
+	vmm_spin_unlock_irqrestore(&work->lock, flags);
+
+	if (!do_work) {
+		return;
+	}
+
+	exec_nsecs = vmm_timer_timestamp();
+	queue_nsecs = exec_nsecs - tstamp;
+
+	work->func(work);
+
+	exec_nsecs = vmm_timer_timestamp() - exec_nsecs;
+
+	vmm_spin_lock_irqsave(&work->lock, flags);
+	work->flags &= ~VMM_WORK_STATE_INPROGRESS;
+	vmm_spin_unlock_irqrestore(&work->lock, flags);
+
+	vmm_spin_lock_irqsave(&wq->lock, flags);
+	wq->nr_pending--;
+	if (!wq->nr_pending) {
+		vmm_completion_complete_all(&wq->flush_done);
+	}
+	wq->stats.executed_count++;
+	wq->stats.queue_nsecs_total += queue_nsecs;
+	if (wq->stats.queue_nsecs_max < queue_nsecs) {
+		wq->stats.queue_nsecs_max = queue_nsecs;
+	}
+	wq->stats.exec_nsecs_total += exec_nsecs;
+	if (wq->stats.exec_nsecs_max < exec_nsecs) {
+		wq->stats.exec_nsecs_max = exec_nsecs;
+	}
+	vmm_spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+static int worker_create(struct vmm_worker_pool *pool);
+
+static int worker_main(void *data)
+{
+	bool create;
+	irq_flags_t flags;
+	struct vmm_worker *worker = data;
+	struct vmm_worker_pool *pool;
+	struct vmm_work *work;
+
+	if (!worker) {
 		return VMM_EFAIL;
 	}
+	pool = worker->pool;
+
+	vmm_spin_lock_irqsave(&pool->lock, flags);
 
 	while (1) {
-		vmm_completion_wait(&wq->work_avail);
+		/* Sleep when no work or some other worker is running */
+		if (list_empty(&pool->work_list) || pool->nr_running) {
+			pool->nr_idle++;
+			vmm_spin_unlock_irqrestore(&pool->lock, flags);
 
-		vmm_spin_lock_irqsave(&wq->lock, flags);
-		
-		while (!list_empty(&wq->work_list)) {
-			work = list_first_entry(&wq->work_list,
+			vmm_completion_wait(&pool->work_avail);
+
+			vmm_spin_lock_irqsave(&pool->lock, flags);
+			pool->nr_idle--;
+			continue;
+		}
+
+		worker->running = TRUE;
+		pool->nr_running++;
+
+		/* Make sure an idle worker is available if we sleep */
+		create = (!pool->nr_idle &&
+			  (pool->nr_workers < pool->max_workers)) ? TRUE : FALSE;
+		if (create) {
+			vmm_spin_unlock_irqrestore(&pool->lock, flags);
+			worker_create(pool);
+			vmm_spin_lock_irqsave(&pool->lock, flags);
+		}
+
+		while (!list_empty(&pool->work_list)) {
+			work = list_first_entry(&pool->work_list,
 						struct vmm_work, head);
-			list_del(&work->head);
-			vmm_spin_unlock_irqrestore(&wq->lock, flags);
-
-			do_work = FALSE;
-			vmm_spin_lock_irqsave(&work->lock, flags);
-			if (work->flags & VMM_WORK_STATE_SCHEDULED) {
-				work->flags &= ~VMM_WORK_STATE_SCHEDULED;
-				work->flags |= VMM_WORK_STATE_INPROGRESS;
-				do_work = TRUE;
-			}
-			vmm_spin_unlock_irqrestore(&work->lock, flags);
+			list_del_init(&work->head);
+			vmm_spin_unlock_irqrestore(&pool->lock, flags);
+
+			worker_process_work(work);
+
+			vmm_spin_lock_irqsave(&pool->lock, flags);
 
-			if (do_work) {
-				work->func(work);
-				vmm_spin_lock_irqsave(&work->lock, flags);
-				work->flags &= ~VMM_WORK_STATE_INPROGRESS;
-				vmm_spin_unlock_irqrestore(&work->lock, flags);
+			/* Leave remaining works to other running worker */
+			if (pool->nr_running > 1) {
+				break;
 			}
+		}
+
+		worker->running = FALSE;
+		pool->nr_running--;
+	}
 
-			vmm_spin_lock_irqsave(&wq->lock, flags);
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+
+	return VMM_OK;
+}
+
+static int worker_create(struct vmm_worker_pool *pool)
+{
+	int rc;
+	u32 id;
+	irq_flags_t flags;
+	struct vmm_worker *worker;
+	char name[VMM_FIELD_NAME_SIZE];
+
+	vmm_spin_lock_irqsave(&pool->lock, flags);
+	if (pool->max_workers <= pool->nr_workers) {
+		vmm_spin_unlock_irqrestore(&pool->lock, flags);
+		return VMM_ENOSPC;
+	}
+	pool->nr_workers++;
+	id = pool->worker_id++;
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+
+	worker = vmm_zalloc(sizeof(struct vmm_worker));
+	if (!worker) {
+		rc = VMM_ENOMEM;
+		goto fail;
+	}
+	INIT_LIST_HEAD(&worker->head);
+	worker->pool = pool;
+
+	if (pool->name) {
+		strlcpy(name, pool->name, sizeof(name));
+	} else if (pool->cpu == WORKER_POOL_UNBOUND) {
+		vmm_snprintf(name, sizeof(name), "worker/u:%d%s",
+			     id, (pool->highpri) ? "H" : "");
+	} else {
+		vmm_snprintf(name, sizeof(name), "worker/%d:%d%s",
+			     pool->cpu, id, (pool->highpri) ? "H" : "");
+	}
+
+	worker->thread = vmm_threads_create(name, worker_main, worker,
+					    pool->priority,
+					    VMM_THREAD_DEF_TIME_SLICE);
+	if (!worker->thread) {
+		rc = VMM_ENOMEM;
+		goto fail_free_worker;
+	}
+	worker->thread->tvcpu->worker = worker;
+
+	if (pool->cpu != WORKER_POOL_UNBOUND) {
+		rc = vmm_threads_set_affinity(worker->thread,
+					      vmm_cpumask_of(pool->cpu));
+		if (rc) {
+			goto fail_destroy_thread;
 		}
+	}
 
-		vmm_spin_unlock_irqrestore(&wq->lock, flags);
+	vmm_spin_lock_irqsave(&pool->lock, flags);
+	list_add_tail(&worker->head, &pool->worker_list);
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+
+	rc = vmm_threads_start(worker->thread);
+	if (rc) {
+		vmm_spin_lock_irqsave(&pool->lock, flags);
+		list_del(&worker->head);
+		vmm_spin_unlock_irqrestore(&pool->lock, flags);
+		goto fail_destroy_thread;
 	}
 
 	return VMM_OK;
+
+fail_destroy_thread:
+	vmm_threads_destroy(worker->thread);
+fail_free_worker:
+	vmm_free(worker);
+fail:
+	vmm_spin_lock_irqsave(&pool->lock, flags);
+	pool->nr_workers--;
+	vmm_spin_unlock_irqrestore(&pool->lock, flags);
+	return rc;
 }
 
-struct vmm_workqueue *vmm_workqueue_create(const char *name, u8 priority)
+static void worker_pool_init(struct vmm_worker_pool *pool, u32 cpu,
+			     u8 priority, bool highpri, u32 max_workers,
+			     const char *name)
+{
+	INIT_SPIN_LOCK(&pool->lock);
+	pool->cpu = cpu;
+	pool->priority = priority;
+	pool->highpri = highpri;
+	INIT_LIST_HEAD(&pool->work_list);
+	INIT_LIST_HEAD(&pool->worker_list);
+	INIT_COMPLETION(&pool->work_avail);
+	pool->max_workers = max_workers;
+	pool->nr_workers = 0;
+	pool->nr_idle = 0;
+	pool->nr_running = 0;
+	pool->worker_id = 0;
+	pool->name = name;
+}
+
+static void worker_pool_cleanup(struct vmm_worker_pool *pool)
+{
+	struct vmm_worker *worker;
+
+	while (!list_empty(&pool->worker_list)) {
+		worker = list_first_entry(&pool->worker_list,
+					  struct vmm_worker, head);
+		list_del(&worker->head);
+		vmm_threads_stop(worker->thread);
+		vmm_threads_destroy(worker->thread);
+		vmm_free(worker);
+		pool->nr_workers--;
+	}
+}
+
+static struct vmm_workqueue *workqueue_new(const char *name, u32 flags,
+					   struct vmm_worker_pool *pool)
 {
 	struct vmm_workqueue *wq;
-	irq_flags_t flags;
+	irq_flags_t f;
 
 	if (!name) {
 		return NULL;
@@ -357,28 +719,58 @@ struct vmm_workqueue *vmm_workqueue_create(const char *name, u8 priority)
 
 	INIT_SPIN_LOCK(&wq->lock);
 	INIT_LIST_HEAD(&wq->head);
-	INIT_LIST_HEAD(&wq->work_list);
-	INIT_COMPLETION(&wq->work_avail);
+	INIT_COMPLETION(&wq->flush_done);
+	strlcpy(wq->name, name, sizeof(wq->name));
+	wq->flags = flags;
+	if (pool) {
+		wq->pool = pool;
+		wq->private_pool = TRUE;
+	} else if (flags & VMM_WQ_UNBOUND) {
+		wq->pool = &wqctrl.unbound_pools[(flags & VMM_WQ_HIGHPRI) ?
+						 1 : 0];
+	}
+
+	vmm_spin_lock_irqsave(&wqctrl.lock, f);
+
+	list_add_tail(&wq->head, &wqctrl.wq_list);
+	wqctrl.wq_count++;
+
+	vmm_spin_unlock_irqrestore(&wqctrl.lock, f);
+
+	return wq;
+}
 
-	wq->thread = vmm_threads_create(name, workqueue_main, wq, 
-					priority, VMM_THREAD_DEF_TIME_SLICE);
-	if (!wq->thread) {
-		vmm_free(wq);
+struct vmm_workqueue *vmm_workqueue_alloc(const char *name, u32 flags)
+{
+	return workqueue_new(name, flags, NULL);
+}
+
+struct vmm_workqueue *vmm_workqueue_create(const char *name, u8 priority)
+{
+	struct vmm_workqueue *wq;
+	struct vmm_worker_pool *pool;
+
+	if (!name) {
 		return NULL;
 	}
 
-	if (vmm_threads_start(wq->thread)) {
-		vmm_threads_destroy(wq->thread);
-		vmm_free(wq);
+	pool = vmm_zalloc(sizeof(struct vmm_worker_pool));
+	if (!pool) {
 		return NULL;
 	}
 
-	vmm_spin_lock_irqsave(&wqctrl.lock, flags);
-
-	list_add_tail(&wq->head, &wqctrl.wq_list);
-	wqctrl.wq_count++;
+	wq = workqueue_new(name, VMM_WQ_UNBOUND, pool);
+	if (!wq) {
+		vmm_free(pool);
+		return NULL;
+	}
+	worker_pool_init(pool, WORKER_POOL_UNBOUND, priority,
+			 FALSE, 1, wq->name);
 
-	vmm_spin_unlock_irqrestore(&wqctrl.lock, flags);
+	if (worker_create(pool)) {
+		vmm_workqueue_destroy(wq);
+		return NULL;
+	}
 
 	return wq;
 }
@@ -396,10 +788,6 @@ int vmm_workqueue_destroy(struct vmm_workqueue *wq)
 		return rc;
 	}
 
-	if ((rc = vmm_threads_stop(wq->thread))) {
-		return rc;
-	}
-
 	vmm_spin_lock_irqsave(&wqctrl.lock, flags);
 
 	list_del(&wq->head);
@@ -407,6 +795,11 @@ int vmm_workqueue_destroy(struct vmm_workqueue *wq)
 
 	vmm_spin_unlock_irqrestore(&wqctrl.lock, flags);
 
+	if (wq->private_pool) {
+		worker_pool_cleanup(wq->pool);
+		vmm_free(wq->pool);
+	}
+
 	vmm_free(wq);
 
 	return VMM_OK;
@@ -414,8 +807,8 @@ int vmm_workqueue_destroy(struct vmm_workqueue *wq)
 
 int __cpuinit vmm_workqueue_init(void)
 {
-	char syswq_name[VMM_FIELD_NAME_SIZE];
-	u32 cpu = vmm_smp_processor_id();
+	int rc;
+	u32 i, cpu = vmm_smp_processor_id();
 
 	if (vmm_smp_is_bootcpu()) {
 		/* Reset control structure */
@@ -429,18 +822,58 @@ int __cpuinit vmm_workqueue_init(void)
 
 		/* Initialize workqueue count */
 		wqctrl.wq_count = 0;
+
+		/* Initialize per-CPU pools of all possible CPUs
+		 * so that works can be queued before secondary
+		 * CPUs are up.
+		 */
+		for (i = 0; i < CONFIG_CPU_COUNT; i++) {
+			worker_pool_init(&wqctrl.pools[i][0], i,
+					 VMM_THREAD_DEF_PRIORITY, FALSE,
+					 CONFIG_WORKQUEUE_MAX_WORKERS, NULL);
+			worker_pool_init(&wqctrl.pools[i][1], i,
+					 WORKER_POOL_HIGHPRI, TRUE,
+					 CONFIG_WORKQUEUE_MAX_WORKERS, NULL);
+		}
+
+		/* Initialize unbound pools */
+		worker_pool_init(&wqctrl.unbound_pools[0],
+				 WORKER_POOL_UNBOUND,
+				 VMM_THREAD_DEF_PRIORITY, FALSE,
+				 CONFIG_WORKQUEUE_MAX_WORKERS, NULL);
+		worker_pool_init(&wqctrl.unbound_pools[1],
+				 WORKER_POOL_UNBOUND,
+				 WORKER_POOL_HIGHPRI, TRUE,
+				 CONFIG_WORKQUEUE_MAX_WORKERS, NULL);
+		for (i = 0; i < array_size(wqctrl.unbound_pools); i++) {
+			rc = worker_create(&wqctrl.unbound_pools[i]);
+			if (rc) {
+				return rc;
+			}
+		}
+
+		/* Create system workqueues */
+		wqctrl.syswq = vmm_workqueue_alloc("syswq", 0);
+		wqctrl.syswq_highpri = vmm_workqueue_alloc("syswq_highpri",
+							   VMM_WQ_HIGHPRI);
+		wqctrl.syswq_unbound = vmm_workqueue_alloc("syswq_unbound",
+							   VMM_WQ_UNBOUND);
+		wqctrl.syswq_unbound_highpri =
+			vmm_workqueue_alloc("syswq_unbound_highpri",
+					    VMM_WQ_UNBOUND | VMM_WQ_HIGHPRI);
+		if (!wqctrl.syswq || !wqctrl.syswq_highpri ||
+		    !wqctrl.syswq_unbound || !wqctrl.syswq_unbound_highpri) {
+			return VMM_ENOMEM;
+		}
 	}
 
-	/* Create one system workqueue with thread priority
-	 * as default priority.
-	 */
-	vmm_snprintf(syswq_name, sizeof(syswq_name), "syswq/%d", cpu);
-	wqctrl.syswq[cpu] = vmm_workqueue_create(syswq_name,
-						 VMM_THREAD_DEF_PRIORITY);
-	if (!wqctrl.syswq) {
-		return VMM_EFAIL;
+	/* Create first worker of per-CPU pools */
+	for (i = 0; i < array_size(wqctrl.pools[cpu]); i++) {
+		rc = worker_create(&wqctrl.pools[cpu][i]);
+		if (rc) {
+			return rc;
+		}
 	}
 
-	return vmm_threads_set_affinity(wqctrl.syswq[cpu]->thread,
-					vmm_cpumask_of(cpu));
+	return VMM_OK;
 }
@@ -26,6 +26,7 @@
 #include <vmm_spinlocks.h>
 #include <vmm_host_ram.h>
 #include <vmm_host_aspace.h>
+#include <vmm_host_vapool.h>
 #include <vmm_modules.h>
 #include <vmm_devdrv.h>
 #include <libs/mathlib.h>
@@ -48,17 +49,27 @@ static int rbd_make_request(struct vmm_request_queue *rq,
 	struct rbd *d = rq->priv;
 	physical_addr_t pa;
 	physical_size_t sz;
+	void *va;
 
 	pa = d->addr + r->lba * RBD_BLOCK_SIZE;
 	sz = r->bcnt * RBD_BLOCK_SIZE;
+	va = (d->va) ? (void *)(d->va + (pa - d->addr)) : NULL;
 
 	switch (r->type) {
 	case VMM_REQUEST_READ:
-		vmm_host_memory_read(pa, r->data, sz, TRUE);
+		if (va) {
+			memcpy(r->data, va, sz);
+		} else {
+			vmm_host_memory_read(pa, r->data, sz, TRUE);
+		}
 		vmm_blockdev_complete_request(r);
 		break;
 	case VMM_REQUEST_WRITE:
-		vmm_host_memory_write(pa, r->data, sz, TRUE);
+		if (va) {
+			memcpy(va, r->data, sz);
+		} else {
+			vmm_host_memory_write(pa, r->data, sz, TRUE);
+		}
 		vmm_blockdev_complete_request(r);
 		break;
 	default:
@@ -76,6 +87,36 @@ static int rbd_abort_request(struct vmm_request_queue *rq,
 	return VMM_OK;
 }
 
+static int rbd_direct_access(struct vmm_request_queue *rq,
+			     u64 lba, u32 bcnt, void **va)
+{
+	struct rbd *d = rq->priv;
+
+	/* Without persistent mapping we can only do copy IO */
+	if (!d->va) {
+		return VMM_ENOTSUPP;
+	}
+
+	*va = (void *)(d->va + lba * RBD_BLOCK_SIZE);
+
+	return VMM_OK;
+}
+
+static virtual_addr_t rbd_memmap(physical_addr_t pa, physical_size_t sz)
+{
+	/* The vmm_host_memmap() panics when virtual address pool is
+	 * exhausted so check for free space upfront. We don't let one
+	 * RBD instance eat-up more than half of free virtual address
+	 * pool which also leaves room for concurrent mappings. If we
+	 * can't map then IO falls back to temporary per-page mappings.
+	 */
+	if ((vmm_host_vapool_free_page_count() / 2) < VMM_SIZE_TO_PAGE(sz)) {
+		return 0;
+	}
+
+	return vmm_host_memmap(pa, sz, VMM_MEMORY_FLAGS_NORMAL);
+}
+
 static struct rbd *__rbd_create(struct vmm_device *dev,
 				const char *name,
 				physical_addr_t pa,
@@ -120,6 +161,7 @@ static struct rbd *__rbd_create(struct vmm_device *dev,
 	INIT_REQUEST_QUEUE(d->bdev->rq);
 	d->bdev->rq->make_request = rbd_make_request;
 	d->bdev->rq->abort_request = rbd_abort_request;
+	d->bdev->rq->direct_access = rbd_direct_access;
 	d->bdev->rq->priv = d;
 
 	/* Register block device instance */
@@ -145,6 +187,9 @@ static struct rbd *__rbd_create(struct vmm_device *dev,
 		}
 	}
 
+	/* Map RAM space persistently so that IO is a plain memcpy */
+	d->va = rbd_memmap(d->addr, d->size);
+
 	/* Add to list of RBD instances */
 	vmm_spin_lock_irqsave(&rbd_list_lock, flags);
 	list_add_tail(&d->head, &rbd_list);
@@ -187,12 +232,18 @@ void rbd_destroy(struct rbd *d)
 	list_del(&d->head);
 	vmm_spin_unlock_irqrestore(&rbd_list_lock, flags);
 
-	/* Unreserver RAM space */
-	vmm_host_ram_free(d->addr, d->size);
-
 	/* Unregister block device */
 	vmm_blockdev_unregister(d->bdev);
 
+	/* Unmap RAM space */
+	if (d->va) {
+		vmm_host_memunmap(d->va);
+		d->va = 0;
+	}
+
+	/* Unreserver RAM space */
+	vmm_host_ram_free(d->addr, d->size);
+
 	/* Free block device request queue */
 	vmm_free(d->bdev->rq);
 
@@ -37,6 +37,8 @@ struct rbd {
 	struct vmm_blockdev *bdev;
 	physical_addr_t addr;
 	physical_size_t size;
+	/* Persistent host mapping of RAM (zero if not mapped) */
+	virtual_addr_t va;
 };
 
 /** Create RBD instance */
@@ -73,24 +73,22 @@ struct virtio_blk_dev {
 	struct virtio_iovec		iov[VIRTIO_BLK_QUEUE_SIZE];
 	struct virtio_blk_dev_req	reqs[VIRTIO_BLK_QUEUE_SIZE];
 	struct virtio_blk_config 	config;
-	u32 				features;
+	u64 				features;
 
 	struct vmm_vdisk		*vdisk;
 };
 
-static u32 virtio_blk_get_host_features(struct virtio_device *dev)
+static u64 virtio_blk_get_host_features(struct virtio_device *dev)
 {
 	return	1UL << VIRTIO_BLK_F_SEG_MAX
 		| 1UL << VIRTIO_BLK_F_BLK_SIZE
 		| 1UL << VIRTIO_BLK_F_FLUSH
-		| 1UL << VIRTIO_RING_F_EVENT_IDX;
-#if 0
+		| 1UL << VIRTIO_RING_F_EVENT_IDX
 		| 1UL << VIRTIO_RING_F_INDIRECT_DESC;
-#endif
 }
 
 static void virtio_blk_set_guest_features(struct virtio_device *dev,
-					  u32 features)
+					  u64 features)
 {
 	struct virtio_blk_dev *vbdev = dev->emu_data;
 
@@ -134,6 +132,42 @@ static int virtio_blk_get_pfn_vq(struct virtio_device *dev, u32 vq)
 	return rc;
 }
 
+static int virtio_blk_init_vq_rings(struct virtio_device *dev, u32 vq, u32 num,
+				    physical_addr_t desc, physical_addr_t avail,
+				    physical_addr_t used)
+{
+	int rc;
+	struct virtio_blk_dev *vbdev = dev->emu_data;
+
+	switch (vq) {
+	case VIRTIO_BLK_IO_QUEUE:
+		if (VIRTIO_BLK_QUEUE_SIZE < num) {
+			rc = VMM_EINVALID;
+			break;
+		}
+		rc = virtio_queue_setup_rings(&vbdev->vqs[vq], dev->guest,
+				desc, avail, used, num,
+				virtio_has_feature(dev, VIRTIO_F_RING_PACKED));
+		break;
+	default:
+		rc = VMM_EINVALID;
+		break;
+	};
+
+	return rc;
+}
+
+static bool virtio_blk_get_ready_vq(struct virtio_device *dev, u32 vq)
+{
+	struct virtio_blk_dev *vbdev = dev->emu_data;
+
+	if (VIRTIO_BLK_NUM_QUEUES <= vq) {
+		return FALSE;
+	}
+
+	return virtio_queue_setup_done(&vbdev->vqs[vq]);
+}
+
 static int virtio_blk_get_size_vq(struct virtio_device *dev, u32 vq)
 {
 	int rc;
@@ -239,6 +273,56 @@ static void virtio_blk_req_failed(struct vmm_vdisk *vdisk,
 			    VIRTIO_BLK_S_IOERR);
 }
 
+struct virtio_blk_direct {
+	struct virtio_device		*dev;
+	struct virtio_iovec		*iov;
+	u32				iov_cnt;
+};
+
+static u32 virtio_blk_direct_read(void *va, u32 len, void *priv)
+{
+	struct virtio_blk_direct *d = priv;
+
+	return virtio_buf_to_iovec_write(d->dev, d->iov, d->iov_cnt, va, len);
+}
+
+static u32 virtio_blk_direct_write(void *va, u32 len, void *priv)
+{
+	struct virtio_blk_direct *d = priv;
+
+	return virtio_iovec_to_buf_read(d->dev, d->iov, d->iov_cnt, va, len);
+}
+
+/* Try to copy directly between guest IO vectors and memory backing
+ * the virtual disk. Returns FALSE if request must go through the
+ * usual bounce buffer path.
+ */
+static bool virtio_blk_do_direct_io(struct virtio_device *dev,
+				    struct virtio_blk_dev *vbdev,
+				    struct virtio_blk_dev_req *req,
+				    u32 iov_cnt, u64 sector,
+				    enum vmm_vdisk_request_type type)
+{
+	int rc;
+	struct virtio_blk_direct d;
+
+	d.dev = dev;
+	d.iov = &vbdev->iov[1];
+	d.iov_cnt = iov_cnt - 2;
+
+	rc = vmm_vdisk_direct_rw(vbdev->vdisk, type, sector, req->len,
+			(type == VMM_VDISK_REQUEST_READ) ?
+			virtio_blk_direct_read : virtio_blk_direct_write, &d);
+	if (rc == VMM_ENOTSUPP) {
+		return FALSE;
+	}
+
+	virtio_blk_req_done(vbdev, req,
+			    (rc) ? VIRTIO_BLK_S_IOERR : VIRTIO_BLK_S_OK);
+
+	return TRUE;
+}
+
 static void virtio_blk_do_io(struct virtio_device *dev,
 			     struct virtio_blk_dev *vbdev)
 {
@@ -277,6 +361,11 @@ static void virtio_blk_do_io(struct virtio_device *dev,
 		case VIRTIO_BLK_T_IN:
 			vmm_vdisk_set_request_type(&req->r,
 						   VMM_VDISK_REQUEST_READ);
+			if (virtio_blk_do_direct_io(dev, vbdev, req, iov_cnt,
+						hdr.sector,
+						VMM_VDISK_REQUEST_READ)) {
+				continue;
+			}
 			req->data = vmm_malloc(req->len);
 			if (!req->data) {
 				virtio_blk_req_done(vbdev, req,
@@ -309,6 +398,11 @@ static void virtio_blk_do_io(struct virtio_device *dev,
 		case VIRTIO_BLK_T_OUT:
 			vmm_vdisk_set_request_type(&req->r,
 						   VMM_VDISK_REQUEST_WRITE);
+			if (virtio_blk_do_direct_io(dev, vbdev, req, iov_cnt,
+						hdr.sector,
+						VMM_VDISK_REQUEST_WRITE)) {
+				continue;
+			}
 			req->data = vmm_malloc(req->len);
 			if (!req->data) {
 				virtio_blk_req_done(vbdev, req,
@@ -526,6 +620,8 @@ struct virtio_emulator virtio_blk = {
 	.set_guest_features     = virtio_blk_set_guest_features,
 	.init_vq                = virtio_blk_init_vq,
 	.get_pfn_vq             = virtio_blk_get_pfn_vq,
+	.init_vq_rings          = virtio_blk_init_vq_rings,
+	.get_ready_vq           = virtio_blk_get_ready_vq,
 	.get_size_vq            = virtio_blk_get_size_vq,
 	.set_size_vq            = virtio_blk_set_size_vq,
 	.notify_vq              = virtio_blk_notify_vq,
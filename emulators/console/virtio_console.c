@@ -55,21 +55,22 @@ struct virtio_console_dev {
 	struct virtio_iovec rx_iov[VIRTIO_CONSOLE_QUEUE_SIZE];
 	struct virtio_iovec tx_iov[VIRTIO_CONSOLE_QUEUE_SIZE];
 	struct virtio_console_config config;
-	u32 features;
+	u64 features;
 
 	char name[VIRTIO_DEVICE_MAX_NAME_LEN];
 	struct vmm_vserial *vser;
 	struct fifo *emerg_rd;
 };
 
-static u32 virtio_console_get_host_features(struct virtio_device *dev)
+static u64 virtio_console_get_host_features(struct virtio_device *dev)
 {
 	/* We support emergency write. */
-	return 1UL << VIRTIO_CONSOLE_F_EMERG_WRITE;
+	return 1UL << VIRTIO_CONSOLE_F_EMERG_WRITE
+		| 1UL << VIRTIO_RING_F_INDIRECT_DESC;
 }
 
 static void virtio_console_set_guest_features(struct virtio_device *dev,
-					  u32 features)
+					  u64 features)
 {
 	/* No host features so, ignore it. */
 }
@@ -112,6 +113,45 @@ static int virtio_console_get_pfn_vq(struct virtio_device *dev, u32 vq)
 	return rc;
 }
 
+static int virtio_console_init_vq_rings(struct virtio_device *dev,
+					u32 vq, u32 num,
+					physical_addr_t desc,
+					physical_addr_t avail,
+					physical_addr_t used)
+{
+	int rc;
+	struct virtio_console_dev *cdev = dev->emu_data;
+
+	switch (vq) {
+	case VIRTIO_CONSOLE_RX_QUEUE:
+	case VIRTIO_CONSOLE_TX_QUEUE:
+		if (VIRTIO_CONSOLE_QUEUE_SIZE < num) {
+			rc = VMM_EINVALID;
+			break;
+		}
+		rc = virtio_queue_setup_rings(&cdev->vqs[vq], dev->guest,
+				desc, avail, used, num,
+				virtio_has_feature(dev, VIRTIO_F_RING_PACKED));
+		break;
+	default:
+		rc = VMM_EINVALID;
+		break;
+	};
+
+	return rc;
+}
+
+static bool virtio_console_get_ready_vq(struct virtio_device *dev, u32 vq)
+{
+	struct virtio_console_dev *cdev = dev->emu_data;
+
+	if (VIRTIO_CONSOLE_NUM_QUEUES <= vq) {
+		return FALSE;
+	}
+
+	return virtio_queue_setup_done(&cdev->vqs[vq]);
+}
+
 static int virtio_console_get_size_vq(struct virtio_device *dev, u32 vq)
 {
 	int rc;
@@ -135,28 +175,40 @@ static int virtio_console_set_size_vq(struct virtio_device *dev, u32 vq, int siz
 	return size;
 }
 
+struct virtio_console_tx {
+	struct virtio_device *dev;
+	struct virtio_iovec iov;
+};
+
+static u32 virtio_console_tx_fill(void *priv, u8 *dst, u32 len)
+{
+	struct virtio_console_tx *tx = priv;
+
+	/* Read guest buffer into vserial batch buffer */
+	len = virtio_iovec_to_buf_read(tx->dev, &tx->iov, 1, dst, len);
+	tx->iov.addr += len;
+	tx->iov.len -= len;
+
+	return len;
+}
+
 static int virtio_console_do_tx(struct virtio_device *dev,
 				struct virtio_console_dev *cdev)
 {
-	u8 buf[8];
 	u16 head = 0;
-	u32 i, len, iov_cnt = 0, total_len = 0;
+	u32 i, iov_cnt = 0, total_len = 0;
 	struct virtio_queue *vq = &cdev->vqs[VIRTIO_CONSOLE_TX_QUEUE];
 	struct virtio_iovec *iov = cdev->tx_iov;
-	struct virtio_iovec tiov;
+	struct virtio_console_tx tx;
 
+	tx.dev = dev;
 	while (virtio_queue_available(vq)) {
 		head = virtio_queue_get_iovec(vq, iov, &iov_cnt, &total_len);
 
 		for (i = 0; i < iov_cnt; i++) {
-			memcpy(&tiov, &iov[i], sizeof(tiov));
-			while (tiov.len) {
-				len = virtio_iovec_to_buf_read(dev, &tiov, 1,
-								&buf, sizeof(buf));
-				vmm_vserial_receive(cdev->vser, buf, len);
-				tiov.addr += len;
-				tiov.len -= len;
-			}
+			memcpy(&tx.iov, &iov[i], sizeof(tx.iov));
+			vmm_vserial_receive_fill(cdev->vser, tx.iov.len,
+						 virtio_console_tx_fill, &tx);
 		}
 
 		virtio_queue_set_used_elem(vq, head, total_len);
@@ -368,6 +420,8 @@ struct virtio_emulator virtio_console = {
 	.set_guest_features     = virtio_console_set_guest_features,
 	.init_vq                = virtio_console_init_vq,
 	.get_pfn_vq             = virtio_console_get_pfn_vq,
+	.init_vq_rings          = virtio_console_init_vq_rings,
+	.get_ready_vq           = virtio_console_get_ready_vq,
 	.get_size_vq            = virtio_console_get_size_vq,
 	.set_size_vq            = virtio_console_set_size_vq,
 	.notify_vq              = virtio_console_notify_vq,
@@ -25,8 +25,7 @@
 #include <vmm_host_io.h>
 #include <vio/vmm_pixel_ops.h>
 #include <vio/vmm_vdisplay.h>
-
-#include "drawfn.h"
+#include <emu/drawfn.h>
 
 #define SURFACE_BITS 8
 #include "drawfn_template.h"
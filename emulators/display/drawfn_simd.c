@@ -0,0 +1,620 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file drawfn_simd.c
+ * @author agent (agent@local)
+ * @brief Accelerated framebuffer format conversion routines.
+ *
+ * The accelerated routines convert little-endian bytes and pixels
+ * (i.e. DRAWFN_ORDER_LBLP) to 32bpp surfaces on little-endian hosts.
+ * They replace the generic routines in drawfn_surface_fntable_32
+ * when host CPU supports required SIMD instructions.
+ *
+ * The hypervisor does not own SIMD registers hence SIMD registers
+ * are saved and restored around each accelerated routine with local
+ * interrupts disabled.
+ */
+
+#include <vmm_error.h>
+#include <vmm_macros.h>
+#include <vmm_percpu.h>
+#include <vmm_modules.h>
+#include <arch_cpu_irq.h>
+#include <vio/vmm_pixel_ops.h>
+#include <vio/vmm_vdisplay.h>
+#include <emu/drawfn.h>
+
+struct drawfn_simd_isa {
+	const char *name;
+	bool (*probe)(void);
+	struct drawfn_simd *table;
+	u32 table_count;
+	bool available;
+};
+
+#define DRAWFN_SIMD(__name, __isa, __fmt, __bppmode, __fn)	\
+{								\
+	.name = __name,						\
+	.isa = __isa,						\
+	.format = DRAWFN_FORMAT_##__fmt,			\
+	.order = DRAWFN_ORDER_LBLP,				\
+	.bppmode = DRAWFN_BPP_##__bppmode,			\
+	.generic = NULL,					\
+	.fn = __fn,						\
+}
+
+/* Generate drawfn compatible wrapper for accelerated routine
+ * which falls back to generic routine for surfaces having write
+ * operations.
+ */
+#define DRAWFN_SIMD_WRAPPER(__isa, __name, __index)			\
+static void drawfn_##__isa##_##__name(struct vmm_surface *s,		\
+				      void *opaque, u8 *d,		\
+				      const u8 *src,			\
+				      int width, int deststep)		\
+{									\
+	irq_flags_t flags;						\
+	struct drawfn_simd *ds = &drawfn_##__isa##_table[__index];	\
+									\
+	if (s && s->ops && s->ops->write32) {				\
+		ds->generic(s, opaque, d, src, width, deststep);	\
+		return;							\
+	}								\
+									\
+	drawfn_##__isa##_begin(&flags);					\
+	drawfn_simd_##__name##_##__isa((u32 *)d, src, width, opaque);	\
+	drawfn_##__isa##_end(flags);					\
+}
+
+#if defined(CONFIG_CPU_LE) && defined(CONFIG_X86) && defined(CONFIG_64BIT)
+
+/* Enough for legacy, header and AVX state of XSAVE area */
+#define DRAWFN_X86_SAVE_SIZE		1024
+#define DRAWFN_X86_SAVE_ALIGN		64
+#define DRAWFN_X86_XSAVE_MASK		0x7
+
+struct drawfn_x86_save {
+	u8 area[DRAWFN_X86_SAVE_SIZE + DRAWFN_X86_SAVE_ALIGN];
+};
+
+static DEFINE_PER_CPU(struct drawfn_x86_save, dx86_save);
+
+static inline u8 *drawfn_x86_save_area(void)
+{
+	virtual_addr_t va = (virtual_addr_t)&this_cpu(dx86_save).area[0];
+
+	return (u8 *)align(va, DRAWFN_X86_SAVE_ALIGN);
+}
+
+static inline void drawfn_x86_cpuid(u32 leaf, u32 subleaf,
+				    u32 *a, u32 *b, u32 *c, u32 *d)
+{
+	asm volatile("cpuid"
+		     : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+		     : "a"(leaf), "c"(subleaf));
+}
+
+static inline unsigned long drawfn_x86_read_cr0(void)
+{
+	unsigned long val;
+
+	asm volatile("mov %%cr0, %0" : "=r"(val));
+
+	return val;
+}
+
+static inline unsigned long drawfn_x86_read_cr4(void)
+{
+	unsigned long val;
+
+	asm volatile("mov %%cr4, %0" : "=r"(val));
+
+	return val;
+}
+
+static bool drawfn_sse2_probe(void)
+{
+	u32 a, b, c, d;
+
+	/* FPU emulation or lazy FPU switching must be off */
+	if (drawfn_x86_read_cr0() & ((1UL << 2) | (1UL << 3))) {
+		return FALSE;
+	}
+
+	/* CR4.OSFXSR must be set for using SSE instructions */
+	if (!(drawfn_x86_read_cr4() & (1UL << 9))) {
+		return FALSE;
+	}
+
+	/* CPUID.01H:EDX.SSE2 */
+	drawfn_x86_cpuid(0x1, 0x0, &a, &b, &c, &d);
+
+	return (d & (1U << 26)) ? TRUE : FALSE;
+}
+
+static void drawfn_sse2_begin(irq_flags_t *flags)
+{
+	arch_cpu_irq_save(*flags);
+	asm volatile("fxsave64 (%0)"
+		     : : "r"(drawfn_x86_save_area()) : "memory");
+}
+
+static void drawfn_sse2_end(irq_flags_t flags)
+{
+	asm volatile("fxrstor64 (%0)"
+		     : : "r"(drawfn_x86_save_area()) : "memory");
+	arch_cpu_irq_restore(flags);
+}
+
+static bool drawfn_avx2_probe(void)
+{
+	u32 a, b, c, d, lo, hi;
+
+	if (!drawfn_sse2_probe()) {
+		return FALSE;
+	}
+
+	/* CPUID.01H:ECX.OSXSAVE and CPUID.01H:ECX.AVX */
+	drawfn_x86_cpuid(0x1, 0x0, &a, &b, &c, &d);
+	if ((c & ((1U << 27) | (1U << 28))) != ((1U << 27) | (1U << 28))) {
+		return FALSE;
+	}
+
+	/* CPUID.(EAX=07H,ECX=0):EBX.AVX2 */
+	drawfn_x86_cpuid(0x0, 0x0, &a, &b, &c, &d);
+	if (a < 0x7) {
+		return FALSE;
+	}
+	drawfn_x86_cpuid(0x7, 0x0, &a, &b, &c, &d);
+	if (!(b & (1U << 5))) {
+		return FALSE;
+	}
+
+	/* XCR0 must enable SSE and AVX state */
+	asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+	return ((lo & 0x6) == 0x6) ? TRUE : FALSE;
+}
+
+static void drawfn_avx2_begin(irq_flags_t *flags)
+{
+	u32 i;
+	u8 *area;
+
+	arch_cpu_irq_save(*flags);
+
+	/* XRSTOR requires XSAVE header to be zero initialized */
+	area = drawfn_x86_save_area();
+	for (i = 512; i < 576; i++) {
+		area[i] = 0;
+	}
+
+	asm volatile("xsave64 (%0)"
+		     : : "r"(area), "a"(DRAWFN_X86_XSAVE_MASK), "d"(0)
+		     : "memory");
+}
+
+static void drawfn_avx2_end(irq_flags_t flags)
+{
+	asm volatile("xrstor64 (%0)"
+		     : : "r"(drawfn_x86_save_area()),
+			 "a"(DRAWFN_X86_XSAVE_MASK), "d"(0)
+		     : "memory");
+	arch_cpu_irq_restore(flags);
+}
+
+#define SIMD_ISA		sse2
+#define SIMD_WIDTH		4
+#define SIMD_ATTR
+#define SIMD_GATHER(p, idx)	\
+	((typeof(idx)){ (p)[(idx)[0]], (p)[(idx)[1]], \
+			(p)[(idx)[2]], (p)[(idx)[3]] })
+#include "drawfn_simd_template.h"
+
+typedef int drawfn_avx2_v8si __attribute__((vector_size(32)));
+
+#define SIMD_ISA		avx2
+#define SIMD_WIDTH		8
+#define SIMD_ATTR		__attribute__((target("avx2")))
+#define SIMD_GATHER(p, idx)	\
+	((typeof(idx))__builtin_ia32_gathersiv8si(		\
+		(drawfn_avx2_v8si){ 0, 0, 0, 0, 0, 0, 0, 0 },	\
+		(const int *)(p), (drawfn_avx2_v8si)(idx),	\
+		(drawfn_avx2_v8si){ -1, -1, -1, -1, -1, -1, -1, -1 }, 4))
+#include "drawfn_simd_template.h"
+
+#define DRAWFN_X86_TABLE_COUNT		8
+
+static struct drawfn_simd drawfn_sse2_table[DRAWFN_X86_TABLE_COUNT];
+static struct drawfn_simd drawfn_avx2_table[DRAWFN_X86_TABLE_COUNT];
+
+#define drawfn_simd_line8_bgr_sse2	drawfn_simd_line8_sse2
+#define drawfn_simd_line8_rgb_sse2	drawfn_simd_line8_sse2
+#define drawfn_simd_line8_bgr_avx2	drawfn_simd_line8_avx2
+#define drawfn_simd_line8_rgb_avx2	drawfn_simd_line8_avx2
+
+DRAWFN_SIMD_WRAPPER(sse2, line8_bgr, 0)
+DRAWFN_SIMD_WRAPPER(sse2, line8_rgb, 1)
+DRAWFN_SIMD_WRAPPER(sse2, line16_565_bgr, 2)
+DRAWFN_SIMD_WRAPPER(sse2, line16_565_rgb, 3)
+DRAWFN_SIMD_WRAPPER(sse2, line16_555_bgr, 4)
+DRAWFN_SIMD_WRAPPER(sse2, line16_555_rgb, 5)
+DRAWFN_SIMD_WRAPPER(sse2, line32_bgr, 6)
+DRAWFN_SIMD_WRAPPER(sse2, line32_rgb, 7)
+
+DRAWFN_SIMD_WRAPPER(avx2, line8_bgr, 0)
+DRAWFN_SIMD_WRAPPER(avx2, line8_rgb, 1)
+DRAWFN_SIMD_WRAPPER(avx2, line16_565_bgr, 2)
+DRAWFN_SIMD_WRAPPER(avx2, line16_565_rgb, 3)
+DRAWFN_SIMD_WRAPPER(avx2, line16_555_bgr, 4)
+DRAWFN_SIMD_WRAPPER(avx2, line16_555_rgb, 5)
+DRAWFN_SIMD_WRAPPER(avx2, line32_bgr, 6)
+DRAWFN_SIMD_WRAPPER(avx2, line32_rgb, 7)
+
+/* Note: DRAWFN_BPP_16 is 555 and DRAWFN_BPP_16_565 is 565 */
+static struct drawfn_simd drawfn_sse2_table[DRAWFN_X86_TABLE_COUNT] = {
+	DRAWFN_SIMD("line8", "sse2", BGR, 8, drawfn_sse2_line8_bgr),
+	DRAWFN_SIMD("line8", "sse2", RGB, 8, drawfn_sse2_line8_rgb),
+	DRAWFN_SIMD("line16_565", "sse2", BGR, 16_565,
+		    drawfn_sse2_line16_565_bgr),
+	DRAWFN_SIMD("line16_565", "sse2", RGB, 16_565,
+		    drawfn_sse2_line16_565_rgb),
+	DRAWFN_SIMD("line16_555", "sse2", BGR, 16,
+		    drawfn_sse2_line16_555_bgr),
+	DRAWFN_SIMD("line16_555", "sse2", RGB, 16,
+		    drawfn_sse2_line16_555_rgb),
+	DRAWFN_SIMD("line32", "sse2", BGR, 32, drawfn_sse2_line32_bgr),
+	DRAWFN_SIMD("line32", "sse2", RGB, 32, drawfn_sse2_line32_rgb),
+};
+
+static struct drawfn_simd drawfn_avx2_table[DRAWFN_X86_TABLE_COUNT] = {
+	DRAWFN_SIMD("line8", "avx2", BGR, 8, drawfn_avx2_line8_bgr),
+	DRAWFN_SIMD("line8", "avx2", RGB, 8, drawfn_avx2_line8_rgb),
+	DRAWFN_SIMD("line16_565", "avx2", BGR, 16_565,
+		    drawfn_avx2_line16_565_bgr),
+	DRAWFN_SIMD("line16_565", "avx2", RGB, 16_565,
+		    drawfn_avx2_line16_565_rgb),
+	DRAWFN_SIMD("line16_555", "avx2", BGR, 16,
+		    drawfn_avx2_line16_555_bgr),
+	DRAWFN_SIMD("line16_555", "avx2", RGB, 16,
+		    drawfn_avx2_line16_555_rgb),
+	DRAWFN_SIMD("line32", "avx2", BGR, 32, drawfn_avx2_line32_bgr),
+	DRAWFN_SIMD("line32", "avx2", RGB, 32, drawfn_avx2_line32_rgb),
+};
+
+/* Note: Preferred ISA comes first */
+static struct drawfn_simd_isa drawfn_simd_isas[] = {
+	{
+		.name = "avx2",
+		.probe = drawfn_avx2_probe,
+		.table = drawfn_avx2_table,
+		.table_count = array_size(drawfn_avx2_table),
+	},
+	{
+		.name = "sse2",
+		.probe = drawfn_sse2_probe,
+		.table = drawfn_sse2_table,
+		.table_count = array_size(drawfn_sse2_table),
+	},
+};
+
+#elif defined(CONFIG_CPU_LE) && defined(CONFIG_ARM64)
+
+/* Hypervisor is built with -mgeneral-regs-only so NEON routines
+ * are written in inline assembly. Each routine saves and restores
+ * the NEON registers it uses.
+ */
+
+#define DRAWFN_CPTR_TFP			(1UL << 10)
+
+static bool drawfn_neon_probe(void)
+{
+	u64 pfr0;
+
+	asm volatile("mrs %0, id_aa64pfr0_el1" : "=r"(pfr0));
+
+	/* ID_AA64PFR0_EL1.FP and ID_AA64PFR0_EL1.AdvSIMD */
+	if ((((pfr0 >> 16) & 0xf) == 0xf) ||
+	    (((pfr0 >> 20) & 0xf) == 0xf)) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static DEFINE_PER_CPU(u64, dneon_cptr);
+
+static void drawfn_neon_begin(irq_flags_t *flags)
+{
+	u64 cptr;
+
+	arch_cpu_irq_save(*flags);
+
+	/* Current VCPU might not be allowed to use NEON */
+	asm volatile("mrs %0, cptr_el2" : "=r"(cptr));
+	this_cpu(dneon_cptr) = cptr;
+	if (cptr & DRAWFN_CPTR_TFP) {
+		asm volatile("msr cptr_el2, %0\n\t"
+			     "isb\n\t"
+			     : : "r"(cptr & ~DRAWFN_CPTR_TFP) : "memory");
+	}
+}
+
+static void drawfn_neon_end(irq_flags_t flags)
+{
+	u64 cptr = this_cpu(dneon_cptr);
+
+	if (cptr & DRAWFN_CPTR_TFP) {
+		asm volatile("msr cptr_el2, %0\n\t"
+			     "isb\n\t"
+			     : : "r"(cptr) : "memory");
+	}
+
+	arch_cpu_irq_restore(flags);
+}
+
+/* Byte shuffle for 8 pixels at a time using TBL */
+static void drawfn_neon_line32(u32 *d, const u8 *src, int width,
+			       const u8 *shuffle)
+{
+	u8 save[64];
+	long n = width & ~0x7;
+
+	if (!n) {
+		return;
+	}
+
+	asm volatile(
+	"	st1	{v0.16b-v3.16b}, [%[save]]\n"
+	"	ld1	{v2.16b}, [%[shuffle]]\n"
+	"1:	ld1	{v0.16b, v1.16b}, [%[src]], #32\n"
+	"	tbl	v0.16b, {v0.16b}, v2.16b\n"
+	"	tbl	v1.16b, {v1.16b}, v2.16b\n"
+	"	st1	{v0.16b, v1.16b}, [%[d]], #32\n"
+	"	subs	%[n], %[n], #8\n"
+	"	b.ne	1b\n"
+	"	ld1	{v0.16b-v3.16b}, [%[save]]\n"
+	: [d] "+r"(d), [src] "+r"(src), [n] "+r"(n)
+	: [shuffle] "r"(shuffle), [save] "r"(save)
+	: "cc", "memory");
+}
+
+/* Out of range TBL indexes (0xff) give zero byte */
+static const u8 drawfn_neon_line32_bgr_shuffle[16] = {
+	0, 1, 2, 0xff, 4, 5, 6, 0xff, 8, 9, 10, 0xff, 12, 13, 14, 0xff,
+};
+
+static const u8 drawfn_neon_line32_rgb_shuffle[16] = {
+	2, 1, 0, 0xff, 6, 5, 4, 0xff, 10, 9, 8, 0xff, 14, 13, 12, 0xff,
+};
+
+static void drawfn_simd_line32_bgr_neon(u32 *d, const u8 *src,
+					int width, const u32 *p)
+{
+	int n = width & ~0x7;
+
+	drawfn_neon_line32(d, src, n, drawfn_neon_line32_bgr_shuffle);
+	for (d += n, src += n * 4, width -= n; width > 0; width--) {
+		*d++ = *(const u32 *)src & 0x00ffffff;
+		src += 4;
+	}
+}
+
+static void drawfn_simd_line32_rgb_neon(u32 *d, const u8 *src,
+					int width, const u32 *p)
+{
+	u32 data;
+	int n = width & ~0x7;
+
+	drawfn_neon_line32(d, src, n, drawfn_neon_line32_rgb_shuffle);
+	for (d += n, src += n * 4, width -= n; width > 0; width--) {
+		data = *(const u32 *)src;
+		*d++ = ((data & 0xff) << 16) | (data & 0xff00) |
+		       ((data >> 16) & 0xff);
+		src += 4;
+	}
+}
+
+/* Convert 8 pixels at a time where LSB color is bits[4:0],
+ * G color is (pixel >> GS) & GM and MSB color is (pixel >> MS) & 0xf8.
+ * ST4 interleaves B, G, R and zero bytes of 32bpp pixels.
+ */
+#define NEON_LINE16(name, rgb, gs, gm, ms)			\
+static void drawfn_simd_##name##_neon(u32 *d, const u8 *src,		\
+				      int width, const u32 *p)		\
+{									\
+	u32 data, lsb, g, msb;						\
+	u8 save[128], *sp = save;					\
+	long n = width & ~0x7;						\
+									\
+	if (n) {							\
+		asm volatile(						\
+		"	st1	{v0.16b-v3.16b}, [%[save]], #64\n"	\
+		"	st1	{v4.16b-v7.16b}, [%[save]]\n"		\
+		"	sub	%[save], %[save], #64\n"		\
+		"	movi	v4.8b, #0\n"				\
+		"	movi	v5.8b, #" #gm "\n"			\
+		"	movi	v6.8b, #0xf8\n"				\
+		"1:	ld1	{v0.8h}, [%[src]], #16\n"		\
+		"	shl	v7.8h, v0.8h, #3\n"			\
+		"	xtn	" lsbreg ".8b, v7.8h\n"			\
+		"	shrn	v2.8b, v0.8h, #" #gs "\n"		\
+		"	and	v2.8b, v2.8b, v5.8b\n"			\
+		"	shrn	" msbreg ".8b, v0.8h, #" #ms "\n"	\
+		"	and	" msbreg ".8b, " msbreg ".8b, v6.8b\n"	\
+		"	st4	{v1.8b, v2.8b, v3.8b, v4.8b}, [%[d]], #32\n" \
+		"	subs	%[n], %[n], #8\n"			\
+		"	b.ne	1b\n"					\
+		"	ld1	{v0.16b-v3.16b}, [%[save]], #64\n"	\
+		"	ld1	{v4.16b-v7.16b}, [%[save]]\n"		\
+		: [d] "+r"(d), [src] "+r"(src), [n] "+r"(n),		\
+		  [save] "+r"(sp)					\
+		:							\
+		: "cc", "memory");					\
+	}								\
+									\
+	for (width &= 0x7; width > 0; width--) {			\
+		data = *(const u16 *)src;				\
+		lsb = (data & 0x1f) << 3;				\
+		g = (data >> (gs)) & (gm);				\
+		msb = (data >> (ms)) & 0xf8;				\
+		*d++ = (rgb) ? rgb_to_pixel32(lsb, g, msb) :		\
+				rgb_to_pixel32(msb, g, lsb);		\
+		src += 2;						\
+	}								\
+}
+
+#define lsbreg		"v1"
+#define msbreg		"v3"
+NEON_LINE16(line16_565_bgr, 0, 3, 0xfc, 8)
+NEON_LINE16(line16_555_bgr, 0, 2, 0xf8, 7)
+#undef lsbreg
+#undef msbreg
+#define lsbreg		"v3"
+#define msbreg		"v1"
+NEON_LINE16(line16_565_rgb, 1, 3, 0xfc, 8)
+NEON_LINE16(line16_555_rgb, 1, 2, 0xf8, 7)
+#undef lsbreg
+#undef msbreg
+
+#undef NEON_LINE16
+
+#define DRAWFN_NEON_TABLE_COUNT		6
+
+static struct drawfn_simd drawfn_neon_table[DRAWFN_NEON_TABLE_COUNT];
+
+DRAWFN_SIMD_WRAPPER(neon, line16_565_bgr, 0)
+DRAWFN_SIMD_WRAPPER(neon, line16_565_rgb, 1)
+DRAWFN_SIMD_WRAPPER(neon, line16_555_bgr, 2)
+DRAWFN_SIMD_WRAPPER(neon, line16_555_rgb, 3)
+DRAWFN_SIMD_WRAPPER(neon, line32_bgr, 4)
+DRAWFN_SIMD_WRAPPER(neon, line32_rgb, 5)
+
+/* Note: NEON has no gather load so palette lookups stay generic.
+ * Note: DRAWFN_BPP_16 is 555 and DRAWFN_BPP_16_565 is 565.
+ */
+static struct drawfn_simd drawfn_neon_table[DRAWFN_NEON_TABLE_COUNT] = {
+	DRAWFN_SIMD("line16_565", "neon", BGR, 16_565,
+		    drawfn_neon_line16_565_bgr),
+	DRAWFN_SIMD("line16_565", "neon", RGB, 16_565,
+		    drawfn_neon_line16_565_rgb),
+	DRAWFN_SIMD("line16_555", "neon", BGR, 16,
+		    drawfn_neon_line16_555_bgr),
+	DRAWFN_SIMD("line16_555", "neon", RGB, 16,
+		    drawfn_neon_line16_555_rgb),
+	DRAWFN_SIMD("line32", "neon", BGR, 32, drawfn_neon_line32_bgr),
+	DRAWFN_SIMD("line32", "neon", RGB, 32, drawfn_neon_line32_rgb),
+};
+
+static struct drawfn_simd_isa drawfn_simd_isas[] = {
+	{
+		.name = "neon",
+		.probe = drawfn_neon_probe,
+		.table = drawfn_neon_table,
+		.table_count = array_size(drawfn_neon_table),
+	},
+};
+
+#else
+
+/* Generic C routines are used on other architectures */
+static struct drawfn_simd_isa drawfn_simd_isas[] = {
+	{
+		.name = "none",
+		.probe = NULL,
+		.table = NULL,
+		.table_count = 0,
+	},
+};
+
+#endif
+
+static bool drawfn_simd_init_done = FALSE;
+
+void drawfn_simd_init(void)
+{
+	u32 i, j, index;
+	bool installed = FALSE;
+	struct drawfn_simd *ds;
+	struct drawfn_simd_isa *isa;
+
+	if (drawfn_simd_init_done) {
+		return;
+	}
+	drawfn_simd_init_done = TRUE;
+
+	for (i = 0; i < array_size(drawfn_simd_isas); i++) {
+		isa = &drawfn_simd_isas[i];
+		isa->available = (isa->probe) ? isa->probe() : FALSE;
+		if (!isa->available) {
+			continue;
+		}
+
+		for (j = 0; j < isa->table_count; j++) {
+			ds = &isa->table[j];
+			index = DRAWFN_FNTABLE_INDEX(ds->format,
+						     ds->order, ds->bppmode);
+			ds->generic = drawfn_surface_fntable_32[index];
+		}
+
+		/* Install routines of most preferred ISA only */
+		if (installed) {
+			continue;
+		}
+		for (j = 0; j < isa->table_count; j++) {
+			ds = &isa->table[j];
+			index = DRAWFN_FNTABLE_INDEX(ds->format,
+						     ds->order, ds->bppmode);
+			drawfn_surface_fntable_32[index] = ds->fn;
+		}
+		installed = TRUE;
+	}
+}
+VMM_EXPORT_SYMBOL(drawfn_simd_init);
+
+u32 drawfn_simd_count(void)
+{
+	u32 i, ret = 0;
+
+	for (i = 0; i < array_size(drawfn_simd_isas); i++) {
+		if (drawfn_simd_isas[i].available) {
+			ret += drawfn_simd_isas[i].table_count;
+		}
+	}
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(drawfn_simd_count);
+
+struct drawfn_simd *drawfn_simd_get(u32 index)
+{
+	u32 i;
+
+	for (i = 0; i < array_size(drawfn_simd_isas); i++) {
+		if (!drawfn_simd_isas[i].available) {
+			continue;
+		}
+		if (index < drawfn_simd_isas[i].table_count) {
+			return &drawfn_simd_isas[i].table[index];
+		}
+		index -= drawfn_simd_isas[i].table_count;
+	}
+
+	return NULL;
+}
+VMM_EXPORT_SYMBOL(drawfn_simd_get);
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file drawfn_simd_template.h
+ * @author agent (agent@local)
+ * @brief Vectorized framebuffer format conversion template.
+ *
+ * The conversion loops are written using GCC vector extensions
+ * so that same template can be instantiated for different vector
+ * widths. The user of this template has to define following:
+ * SIMD_ISA	- Name suffix of generated routines (e.g. sse2)
+ * SIMD_WIDTH	- Number of 32bpp pixels in one vector
+ * SIMD_ATTR	- Function attributes of generated routines
+ * SIMD_GATHER	- Gather palette entries for vector of indexes
+ *
+ * All generated routines convert little-endian source pixels
+ * to host-endian 32bpp pixels produced by rgb_to_pixel32().
+ */
+
+#ifndef glue
+#define xglue(x, y) x ## y
+#define glue(x, y) xglue(x, y)
+#endif
+
+#define VEC		glue(drawfn_vec_, SIMD_ISA)
+#define VECU		glue(drawfn_vecu_, SIMD_ISA)
+#define VECU16		glue(drawfn_vecu16_, SIMD_ISA)
+#define VECU8		glue(drawfn_vecu8_, SIMD_ISA)
+
+typedef u32 VEC __attribute__((vector_size(SIMD_WIDTH * 4)));
+typedef u32 VECU __attribute__((vector_size(SIMD_WIDTH * 4), aligned(1)));
+typedef u16 VECU16 __attribute__((vector_size(SIMD_WIDTH * 2), aligned(1)));
+typedef u8 VECU8 __attribute__((vector_size(SIMD_WIDTH), aligned(1)));
+
+static SIMD_ATTR void glue(drawfn_simd_line8_, SIMD_ISA)(u32 *d,
+							const u8 *src,
+							int width,
+							const u32 *palette)
+{
+	VEC idx;
+
+	while (width >= SIMD_WIDTH) {
+		idx = __builtin_convertvector(*(const VECU8 *)src, VEC);
+		*(VECU *)d = SIMD_GATHER(palette, idx);
+		width -= SIMD_WIDTH;
+		src += SIMD_WIDTH;
+		d += SIMD_WIDTH;
+	}
+
+	while (width > 0) {
+		*d = palette[*src];
+		width--;
+		src++;
+		d++;
+	}
+}
+
+/* Convert 16bpp pixels where LSB color is bits[4:0], G color is
+ * (pixel >> GS) & GM and MSB color is (pixel >> MS) & 0xf8.
+ */
+#define LINE16_PIXEL(x, lsb_pos, gs, gm, ms, msb_pos)			\
+	((((x) & 0x1f) << 3) << (lsb_pos)) |				\
+	((((x) >> (gs)) & (gm)) << 8) |					\
+	((((x) >> (ms)) & 0xf8) << (msb_pos))
+
+#define LINE16(name, lsb_pos, gs, gm, ms, msb_pos)			\
+static SIMD_ATTR void glue(glue(drawfn_simd_, name), SIMD_ISA)(u32 *d,	\
+							const u8 *src,	\
+							int width,	\
+							const u32 *p)	\
+{									\
+	u32 data;							\
+	VEC v;								\
+									\
+	while (width >= SIMD_WIDTH) {					\
+		v = __builtin_convertvector(*(const VECU16 *)src, VEC);	\
+		*(VECU *)d = LINE16_PIXEL(v, lsb_pos, gs, gm,		\
+					  ms, msb_pos);			\
+		width -= SIMD_WIDTH;					\
+		src += SIMD_WIDTH * 2;					\
+		d += SIMD_WIDTH;					\
+	}								\
+									\
+	while (width > 0) {						\
+		data = *(const u16 *)src;				\
+		*d = LINE16_PIXEL(data, lsb_pos, gs, gm, ms, msb_pos);	\
+		width--;						\
+		src += 2;						\
+		d++;							\
+	}								\
+}
+
+LINE16(line16_565_bgr_, 0, 3, 0xfc, 8, 16)
+LINE16(line16_565_rgb_, 16, 3, 0xfc, 8, 0)
+LINE16(line16_555_bgr_, 0, 2, 0xf8, 7, 16)
+LINE16(line16_555_rgb_, 16, 2, 0xf8, 7, 0)
+
+#undef LINE16
+#undef LINE16_PIXEL
+
+static SIMD_ATTR void glue(drawfn_simd_line32_bgr_, SIMD_ISA)(u32 *d,
+							const u8 *src,
+							int width,
+							const u32 *p)
+{
+	while (width >= SIMD_WIDTH) {
+		*(VECU *)d = *(const VECU *)src & 0x00ffffff;
+		width -= SIMD_WIDTH;
+		src += SIMD_WIDTH * 4;
+		d += SIMD_WIDTH;
+	}
+
+	while (width > 0) {
+		*d = *(const u32 *)src & 0x00ffffff;
+		width--;
+		src += 4;
+		d++;
+	}
+}
+
+static SIMD_ATTR void glue(drawfn_simd_line32_rgb_, SIMD_ISA)(u32 *d,
+							const u8 *src,
+							int width,
+							const u32 *p)
+{
+	u32 data;
+	VEC v;
+
+	while (width >= SIMD_WIDTH) {
+		v = *(const VECU *)src;
+		*(VECU *)d = ((v & 0xff) << 16) | (v & 0xff00) |
+			     ((v >> 16) & 0xff);
+		width -= SIMD_WIDTH;
+		src += SIMD_WIDTH * 4;
+		d += SIMD_WIDTH;
+	}
+
+	while (width > 0) {
+		data = *(const u32 *)src;
+		*d = ((data & 0xff) << 16) | (data & 0xff00) |
+		     ((data >> 16) & 0xff);
+		width--;
+		src += 4;
+		d++;
+	}
+}
+
+#undef VEC
+#undef VECU
+#undef VECU16
+#undef VECU8
+#undef SIMD_ISA
+#undef SIMD_WIDTH
+#undef SIMD_ATTR
+#undef SIMD_GATHER
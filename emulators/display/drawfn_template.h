@@ -392,7 +392,7 @@ static void glue(drawfn_line16_555_,NAME)(struct vmm_surface *s,
 		g = (data & 0x1f) << 3;
 		data >>= 5;
 		MSB = (data & 0x1f) << 3;
-		data >>= 5;
+		data >>= 6;
 		COPY_PIXEL(s, d, glue(rgb_to_pixel,SURFACE_BITS)(r, g, b));
 		LSB = (data & 0x1f) << 3;
 		data >>= 5;
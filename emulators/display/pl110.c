@@ -39,8 +39,7 @@
 #include <vmm_guest_aspace.h>
 #include <vio/vmm_pixel_ops.h>
 #include <vio/vmm_vdisplay.h>
-
-#include "drawfn.h"
+#include <emu/drawfn.h>
 
 #define MODULE_DESC			"PL110 CLCD Emulator"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -791,6 +790,8 @@ static struct vmm_emulator pl110_emulator = {
 
 static int __init pl110_emulator_init(void)
 {
+	drawfn_simd_init();
+
 	return vmm_devemu_register_emulator(&pl110_emulator);
 }
 
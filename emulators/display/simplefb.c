@@ -30,8 +30,7 @@
 #include <vio/vmm_pixel_ops.h>
 #include <vio/vmm_vdisplay.h>
 #include <libs/stringlib.h>
-
-#include "drawfn.h"
+#include <emu/drawfn.h>
 
 #define MODULE_DESC			"Simple Framebuffer Emulator"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -483,6 +482,8 @@ VMM_DECLARE_EMULATOR_SIMPLE(simplefb_emulator,
 
 static int __init simplefb_emulator_init(void)
 {
+	drawfn_simd_init();
+
 	return vmm_devemu_register_emulator(&simplefb_emulator);
 }
 
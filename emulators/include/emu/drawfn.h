@@ -24,6 +24,9 @@
 #ifndef __DRAWFN_H__
 #define __DRAWFN_H__
 
+#include <vmm_types.h>
+#include <vio/vmm_vdisplay.h>
+
 enum drawfn_bppmode {
 	DRAWFN_BPP_1,
 	DRAWFN_BPP_2,
@@ -69,14 +72,40 @@ typedef void (*drawfn)(struct vmm_surface *,
 				 DRAWFN_ORDER_MAX * \
 				 DRAWFN_FORMAT_MAX)
 
-drawfn drawfn_surface_fntable_8[DRAWFN_FNTABLE_SIZE];
+extern drawfn drawfn_surface_fntable_8[DRAWFN_FNTABLE_SIZE];
+
+extern drawfn drawfn_surface_fntable_15[DRAWFN_FNTABLE_SIZE];
+
+extern drawfn drawfn_surface_fntable_16[DRAWFN_FNTABLE_SIZE];
+
+extern drawfn drawfn_surface_fntable_24[DRAWFN_FNTABLE_SIZE];
 
-drawfn drawfn_surface_fntable_15[DRAWFN_FNTABLE_SIZE];
+extern drawfn drawfn_surface_fntable_32[DRAWFN_FNTABLE_SIZE];
 
-drawfn drawfn_surface_fntable_16[DRAWFN_FNTABLE_SIZE];
+/** Representation of accelerated (SIMD) conversion routine
+ *  Note: Accelerated routines only write 32bpp surfaces which
+ *  don't have surface write operations.
+ */
+struct drawfn_simd {
+	const char *name;
+	const char *isa;
+	enum drawfn_format format;
+	enum drawfn_order order;
+	enum drawfn_bppmode bppmode;
+	drawfn generic;
+	drawfn fn;
+};
 
-drawfn drawfn_surface_fntable_24[DRAWFN_FNTABLE_SIZE];
+/** Count of accelerated routines usable on host CPU */
+u32 drawfn_simd_count(void);
 
-drawfn drawfn_surface_fntable_32[DRAWFN_FNTABLE_SIZE];
+/** Get accelerated routine usable on host CPU based on index */
+struct drawfn_simd *drawfn_simd_get(u32 index);
+
+/** Select accelerated routines based on host CPU features
+ *  and install them in drawfn_surface_fntable_32.
+ *  Note: This can be called multiple times.
+ */
+void drawfn_simd_init(void);
 
 #endif
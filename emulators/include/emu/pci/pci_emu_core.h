@@ -34,6 +34,12 @@
 /* PCI HEADER_TYPE */
 #define  PCI_HEADER_TYPE_MULTI_FUNCTION 0x80
 
+/* PCI STATUS: capability list present */
+#define  PCI_STATUS_CAP_LIST		0x10
+
+/* PCI capability IDs */
+#define  PCI_CAP_ID_VNDR		0x09	/* Vendor-Specific */
+
 /* Size of the standard PCI config header */
 #define PCI_CONFIG_HEADER_SIZE 0x40
 /* Size of the standard PCI config space */
@@ -33,6 +33,10 @@
 
 #define VIRTIO_DEVICE_MAX_NAME_LEN			64
 
+/* Feature bits reserved for transport and virtqueue layout */
+#define VIRTIO_F_VERSION_1				32
+#define VIRTIO_F_RING_PACKED				34
+
 enum virtio_id {
 	VIRTIO_ID_NET		=  1, /* Network card */
 	VIRTIO_ID_BLOCK		=  2, /* Block device */
@@ -68,6 +72,9 @@ struct virtio_device {
 	struct virtio_emulator *emu;
 	void *emu_data;
 
+	/* Features accepted by guest driver (updated by transport) */
+	u64 features;
+
 	struct dlist node;
 	struct vmm_guest *guest;
 };
@@ -76,6 +83,7 @@ struct virtio_transport {
 	const char *name;
 
 	int  (*notify)(struct virtio_device *, u32 vq);
+	int  (*notify_config)(struct virtio_device *);
 };
 
 struct virtio_emulator {
@@ -83,11 +91,15 @@ struct virtio_emulator {
 	const struct virtio_device_id *id_table;
 
 	/* VirtIO operations */
-	u32 (*get_host_features) (struct virtio_device *dev);
-	void (*set_guest_features) (struct virtio_device *dev, u32 features);
+	u64 (*get_host_features) (struct virtio_device *dev);
+	void (*set_guest_features) (struct virtio_device *dev, u64 features);
 	int (*init_vq) (struct virtio_device *dev, u32 vq, u32 page_size,
 				u32 align, u32 pfn);
 	int (*get_pfn_vq) (struct virtio_device *dev, u32 vq);
+	int (*init_vq_rings) (struct virtio_device *dev, u32 vq, u32 num,
+				physical_addr_t desc, physical_addr_t avail,
+				physical_addr_t used);
+	bool (*get_ready_vq) (struct virtio_device *dev, u32 vq);
 	int (*get_size_vq) (struct virtio_device *dev, u32 vq);
 	int (*set_size_vq) (struct virtio_device *dev, u32 vq, int size);
 	int (*notify_vq) (struct virtio_device *dev , u32 vq);
@@ -104,6 +116,12 @@ struct virtio_emulator {
 	struct dlist node;
 };
 
+/** Check whether guest driver accepted given feature bit */
+static inline bool virtio_has_feature(struct virtio_device *dev, u32 bit)
+{
+	return (dev->features & (1ULL << bit)) ? TRUE : FALSE;
+}
+
 int virtio_config_read(struct virtio_device *dev,
 			u32 offset, void *dst, u32 dst_len);
 
@@ -72,6 +72,9 @@
 /* Guest's PFN for the currently selected queue - Read Write */
 #define VIRTIO_MMIO_QUEUE_PFN		0x040
 
+/* Ready bit for the currently selected queue - Read Write */
+#define VIRTIO_MMIO_QUEUE_READY		0x044
+
 /* Queue notifier - Write Only */
 #define VIRTIO_MMIO_QUEUE_NOTIFY	0x050
 
@@ -84,6 +87,21 @@
 /* Device status register - Read Write */
 #define VIRTIO_MMIO_STATUS		0x070
 
+/* Selected queue's Descriptor Table address, 64 bits in two halves */
+#define VIRTIO_MMIO_QUEUE_DESC_LOW	0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH	0x084
+
+/* Selected queue's Available Ring address, 64 bits in two halves */
+#define VIRTIO_MMIO_QUEUE_AVAIL_LOW	0x090
+#define VIRTIO_MMIO_QUEUE_AVAIL_HIGH	0x094
+
+/* Selected queue's Used Ring address, 64 bits in two halves */
+#define VIRTIO_MMIO_QUEUE_USED_LOW	0x0a0
+#define VIRTIO_MMIO_QUEUE_USED_HIGH	0x0a4
+
+/* Configuration atomicity value - Read Only */
+#define VIRTIO_MMIO_CONFIG_GENERATION	0x0fc
+
 /* The config space is defined by each driver as
  * the per-driver configuration space - Read Write */
 #define VIRTIO_MMIO_CONFIG		0x100
@@ -96,6 +114,13 @@
 #define VIRTIO_MMIO_INT_VRING		(1 << 0)
 #define VIRTIO_MMIO_INT_CONFIG		(1 << 1)
 
+/*
+ * Register layout versions: legacy (PFN based queues) and virtio 1.x
+ */
+
+#define VIRTIO_MMIO_VERSION_LEGACY	1
+#define VIRTIO_MMIO_VERSION_MODERN	2
+
 #define VIRTIO_MMIO_MAX_VQ      3
 #define VIRTIO_MMIO_MAX_CONFIG  1
 #define VIRTIO_MMIO_IO_SIZE     0x200
@@ -130,6 +155,11 @@ struct virtio_mmio_dev {
 	struct vmm_guest *guest;
 	struct virtio_device dev;
 	struct virtio_mmio_config config;
+	u64 guest_features;
+	u64 queue_desc;
+	u64 queue_avail;
+	u64 queue_used;
+	u32 config_generation;
 	u32 irq;
 	u32 addr;
 };
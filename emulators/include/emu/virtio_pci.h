@@ -74,6 +74,87 @@
 #define VIRTIO_PCI_IO_SIZE		VIRTIO_PCI_REGION_SIZE
 #define VIRTIO_PCI_PAGE_SIZE		(0x1UL << VIRTIO_PCI_QUEUE_ADDR_SHIFT)
 
+/* Register layout versions: legacy IO layout and virtio 1.x capabilities */
+#define VIRTIO_PCI_VERSION_LEGACY	1
+#define VIRTIO_PCI_VERSION_MODERN	2
+
+/* Modern devices use 0x1040 + virtio device type as PCI device ID */
+#define VIRTIO_PCI_VENDOR_ID		0x1af4
+#define VIRTIO_PCI_MODERN_DEVICE_ID	0x1040
+
+/* Vector value used to disable MSI for queue or config */
+#define VIRTIO_MSI_NO_VECTOR		0xffff
+
+/* Vendor specific capability types of virtio 1.x */
+#define VIRTIO_PCI_CAP_COMMON_CFG	1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG	2
+#define VIRTIO_PCI_CAP_ISR_CFG		3
+#define VIRTIO_PCI_CAP_DEVICE_CFG	4
+
+/* Offset of first virtio capability in PCI config space */
+#define VIRTIO_PCI_CAP_OFFSET		0x40
+
+/* Common configuration structure fields */
+#define VIRTIO_PCI_COMMON_DFSELECT	0
+#define VIRTIO_PCI_COMMON_DF		4
+#define VIRTIO_PCI_COMMON_GFSELECT	8
+#define VIRTIO_PCI_COMMON_GF		12
+#define VIRTIO_PCI_COMMON_MSIX		16
+#define VIRTIO_PCI_COMMON_NUMQ		18
+#define VIRTIO_PCI_COMMON_STATUS	20
+#define VIRTIO_PCI_COMMON_CFGGENERATION	21
+#define VIRTIO_PCI_COMMON_Q_SELECT	22
+#define VIRTIO_PCI_COMMON_Q_SIZE	24
+#define VIRTIO_PCI_COMMON_Q_MSIX	26
+#define VIRTIO_PCI_COMMON_Q_ENABLE	28
+#define VIRTIO_PCI_COMMON_Q_NOFF	30
+#define VIRTIO_PCI_COMMON_Q_DESCLO	32
+#define VIRTIO_PCI_COMMON_Q_DESCHI	36
+#define VIRTIO_PCI_COMMON_Q_AVAILLO	40
+#define VIRTIO_PCI_COMMON_Q_AVAILHI	44
+#define VIRTIO_PCI_COMMON_Q_USEDLO	48
+#define VIRTIO_PCI_COMMON_Q_USEDHI	52
+
+/* Placement of virtio 1.x structures in the BAR */
+#define VIRTIO_PCI_MODERN_COMMON_OFFSET	0x000
+#define VIRTIO_PCI_MODERN_COMMON_SIZE	0x038
+#define VIRTIO_PCI_MODERN_ISR_OFFSET	0x040
+#define VIRTIO_PCI_MODERN_ISR_SIZE	0x004
+#define VIRTIO_PCI_MODERN_NOTIFY_OFFSET	0x080
+#define VIRTIO_PCI_MODERN_NOTIFY_SIZE	0x004
+#define VIRTIO_PCI_MODERN_DEVICE_OFFSET	0x100
+#define VIRTIO_PCI_MODERN_DEVICE_SIZE	0x100
+#define VIRTIO_PCI_MODERN_BAR_SIZE	0x200
+
+struct virtio_pci_cap {
+	u8	cap_vndr;	/* Generic PCI field: PCI_CAP_ID_VNDR */
+	u8	cap_next;	/* Generic PCI field: next ptr. */
+	u8	cap_len;	/* Generic PCI field: capability length */
+	u8	cfg_type;	/* Identifies the structure. */
+	u8	bar;		/* Where to find it. */
+	u8	id;		/* Multiple capabilities of the same type */
+	u8	padding[2];	/* Pad to full dword. */
+	u32	offset;		/* Offset within bar. */
+	u32	length;		/* Length of the structure, in bytes. */
+} __attribute__((packed));
+
+struct virtio_pci_notify_cap {
+	struct virtio_pci_cap cap;
+	u32	notify_off_multiplier;	/* Multiplier for queue_notify_off. */
+} __attribute__((packed));
+
+/* Capability list exposed after standard PCI config header */
+struct virtio_pci_caps {
+	struct virtio_pci_cap common;
+	struct virtio_pci_notify_cap notify;
+	struct virtio_pci_cap isr;
+	struct virtio_pci_cap device;
+} __attribute__((packed));
+
+/* Config space offset of given capability in struct virtio_pci_caps */
+#define VIRTIO_PCI_CAP_POS(f)		(VIRTIO_PCI_CAP_OFFSET + \
+					 offsetof(struct virtio_pci_caps, f))
+
 struct virtio_pci_config {
 	u32     host_features;
 	u32	guest_features;
@@ -89,6 +170,15 @@ struct virtio_pci_dev {
 	struct vmm_guest *guest;
 	struct virtio_device dev;
 	struct virtio_pci_config config;
+	u32 version;
+	u32 host_features_sel;
+	u32 guest_features_sel;
+	u64 guest_features;
+	u16 queue_size;
+	u64 queue_desc;
+	u64 queue_avail;
+	u64 queue_used;
+	u8 config_generation;
 	u32 irq;
 	u32 addr;
 };
@@ -33,17 +33,36 @@
 #define VIRTIO_PCI_O_CONFIG     0
 #define VIRTIO_PCI_O_MSIX       1
 
+#define VIRTIO_QUEUE_MAX_MAPS	3
+
 struct vmm_guest;
 struct virtio_device;
 
 struct virtio_queue {
 	/* The last_avail_idx field is an index to ->ring of struct vring_avail.
-	   It's where we assume the next request index is at.  */
+	   It's where we assume the next request index is at.  For packed
+	   ring it is the position of next descriptor in the ring.  */
 	u16			last_avail_idx;
 	u16			last_used_signalled;
 
 	struct vring		vring;
 
+	/* Packed ring state (only valid when packed is TRUE) */
+	bool			packed;
+	bool			avail_wrap;
+	bool			used_wrap;
+	bool			signalled_wrap;
+	u16			used_idx;
+	u16			*packed_pos;
+	u16			*packed_num;
+	struct vring_packed_desc *packed_desc;
+	struct vring_packed_desc_event *driver_event;
+	struct vring_packed_desc_event *device_event;
+
+	/* Host mappings backing the descriptor, driver and device areas */
+	u32			map_count;
+	virtual_addr_t		map_va[VIRTIO_QUEUE_MAX_MAPS];
+
 	void			*addr;
 	struct vmm_guest	*guest;
 	u32			desc_count;
@@ -75,6 +94,11 @@ u32 virtio_queue_desc_count(struct virtio_queue *vq);
  */
 u32 virtio_queue_align(struct virtio_queue *vq);
 
+/** Check whether queue uses packed ring layout
+ *  Note: only available after queue setup is done
+ */
+bool virtio_queue_packed(struct virtio_queue *vq);
+
 /** Get guest page frame number of queue
  *  Note: only available after queue setup is done
  */
@@ -107,6 +131,7 @@ u16 virtio_queue_pop(struct virtio_queue *vq);
 
 /** Retrive vring descriptor at given index
  *  Note: works only after queue setup is done
+ *  Note: returns NULL for packed ring
  */
 struct vring_desc *virtio_queue_get_desc(struct virtio_queue *vq, u16 indx);
 
@@ -122,6 +147,7 @@ bool virtio_queue_should_signal(struct virtio_queue *vq);
 
 /** Update used element in vring
  *  Note: works only after queue setup is done
+ *  Note: packed ring has no used ring so it always returns NULL
  */
 struct vring_used_elem *virtio_queue_set_used_elem(struct virtio_queue *vq,
 						   u32 head, u32 len);
@@ -143,8 +169,24 @@ int virtio_queue_setup(struct virtio_queue *vq,
 			physical_size_t guest_page_size,
 			u32 desc_count, u32 align);
 
+/** Setup or initialize the queue from separate descriptor, driver
+ *  (avail) and device (used) area addresses as done by virtio 1.x
+ *  transports. The packed flag selects packed ring layout in which
+ *  case driver and device areas hold event suppression structures.
+ *  Note: If queue was already setup then it will cleanup first.
+ *  Note: Zero desc_count only does cleanup of the queue.
+ */
+int virtio_queue_setup_rings(struct virtio_queue *vq,
+			     struct vmm_guest *guest,
+			     physical_addr_t desc_addr,
+			     physical_addr_t avail_addr,
+			     physical_addr_t used_addr,
+			     u32 desc_count, bool packed);
+
 /** Get guest IO vectors based on given head
  *  Note: works only after queue setup is done
+ *  Note: indirect descriptors are followed and at most
+ *  desc_count IO vectors are returned
  */
 u16 virtio_queue_get_head_iovec(struct virtio_queue *vq,
 				u16 head, struct virtio_iovec *iov,
@@ -60,6 +60,22 @@
   */
 #define VIRTIO_RING_F_EVENT_IDX		29
 
+/* Packed ring descriptor flags: the driver flips AVAIL to make a
+ * descriptor available and the device sets USED to the same value
+ * once the buffer is consumed.  Both are compared against the
+ * wrap counter of the side reading them.
+ */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Event suppression flags of the packed ring */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/* Wrap counter bit in off_wrap of event suppression structure */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
 /* Virtio ring descriptors: 16 bytes.  These can chain together via "next". */
 struct vring_desc {
 	/* Address (guest-physical). */
@@ -92,6 +108,26 @@ struct vring_used {
 	struct vring_used_elem ring[];
 };
 
+/* Packed ring descriptors: 16 bytes.  Chains are consecutive in the ring. */
+struct vring_packed_desc {
+	/* Buffer address (guest-physical). */
+	u64 addr;
+	/* Buffer length. */
+	u32 len;
+	/* Buffer ID. */
+	u16 id;
+	/* The flags depending on descriptor type. */
+	u16 flags;
+};
+
+/* Packed ring event suppression: one for driver and one for device. */
+struct vring_packed_desc_event {
+	/* Descriptor ring change event offset and wrap counter. */
+	u16 off_wrap;
+	/* Descriptor ring change event flags. */
+	u16 flags;
+};
+
 struct vring {
 	unsigned int num;
 
@@ -157,6 +193,22 @@ static inline unsigned vring_size(unsigned int num, unsigned long align)
 }
 
 
+/* Size of the three areas of a split ring when each is placed separately */
+static inline unsigned vring_desc_size(unsigned int num)
+{
+	return sizeof(struct vring_desc) * num;
+}
+
+static inline unsigned vring_avail_size(unsigned int num)
+{
+	return sizeof(u16) * (3 + num);
+}
+
+static inline unsigned vring_used_size(unsigned int num)
+{
+	return sizeof(u16) * 3 + sizeof(struct vring_used_elem) * num;
+}
+
 static inline int vring_need_event(u16 event_idx, u16 new_idx, u16 old)
 {
 	return (u16)(new_idx - event_idx - 1) < (u16)(new_idx - old);
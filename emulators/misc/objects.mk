@@ -29,3 +29,4 @@ emulators-objs-$(CONFIG_EMU_MISC_FW_CFG)+= misc/fw_cfg.o
 emulators-objs-$(CONFIG_EMU_MISC_IMX6_ANATOP)+= misc/imx_anatop.o
 emulators-objs-$(CONFIG_EMU_MISC_IMX6_CCM)+= misc/imx_ccm.o
 emulators-objs-$(CONFIG_EMU_MISC_IMX6_APBH)+= misc/imx_apbh.o
+emulators-objs-$(CONFIG_EMU_MISC_VIRTIO_BALLOON)+= misc/virtio_balloon.o
@@ -0,0 +1,612 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file virtio_balloon.c
+ * @author agent (agent@local)
+ * @brief VirtIO based memory balloon Emulator.
+ *
+ * Pages inflated into balloon and free pages reported by guest are
+ * discarded from guest RAM so that host RAM backing them is given
+ * back to host. Host RAM is only given back for on-demand guest RAM
+ * regions and pages get populated again upon next guest access.
+ */
+
+#include <vmm_error.h>
+#include <vmm_macros.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_spinlocks.h>
+#include <vmm_modules.h>
+#include <vmm_devemu.h>
+#include <vmm_host_aspace.h>
+#include <vmm_guest_aspace.h>
+#include <libs/stringlib.h>
+
+#include <emu/virtio.h>
+#include <emu/virtio_balloon.h>
+
+#define MODULE_DESC			"VirtIO Balloon Emulator"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(VIRTIO_IPRIORITY + 1)
+#define MODULE_INIT			virtio_balloon_init
+#define MODULE_EXIT			virtio_balloon_exit
+
+#define VIRTIO_BALLOON_QUEUE_SIZE	128
+#define VIRTIO_BALLOON_NUM_QUEUES	4
+
+#define VIRTIO_BALLOON_PFN_BATCH	64
+#define VIRTIO_BALLOON_PAGE_SIZE	(1UL << VIRTIO_BALLOON_PFN_SHIFT)
+
+/* Queue types. Inflate and deflate queues are always present
+ * whereas stats and reporting queues follow them only if the
+ * corresponding feature is negotiated.
+ */
+enum virtio_balloon_vq_type {
+	VIRTIO_BALLOON_VQ_INFLATE = 0,
+	VIRTIO_BALLOON_VQ_DEFLATE,
+	VIRTIO_BALLOON_VQ_STATS,
+	VIRTIO_BALLOON_VQ_REPORTING,
+	VIRTIO_BALLOON_VQ_UNKNOWN,
+};
+
+struct virtio_balloon_dev {
+	struct virtio_device *vdev;
+
+	struct virtio_queue vqs[VIRTIO_BALLOON_NUM_QUEUES];
+	struct virtio_iovec iov[VIRTIO_BALLOON_NUM_QUEUES]
+			       [VIRTIO_BALLOON_QUEUE_SIZE];
+	struct virtio_balloon_config config;
+	u64 features;
+
+	vmm_spinlock_t lock;
+	bool stats_held;
+	u16 stats_head;
+	u64 stats_memfree;
+	u64 stats_memtot;
+
+	struct vmm_guest_balloon bln;
+};
+
+static u64 virtio_balloon_get_host_features(struct virtio_device *dev)
+{
+	/* We don't offer page poisoning so that guest with page
+	 * poisoning enabled does not report free pages to us.
+	 */
+	return (1UL << VIRTIO_BALLOON_F_STATS_VQ) |
+	       (1UL << VIRTIO_BALLOON_F_DEFLATE_ON_OOM) |
+	       (1UL << VIRTIO_BALLOON_F_REPORTING) |
+	       (1UL << VIRTIO_RING_F_INDIRECT_DESC);
+}
+
+static void virtio_balloon_set_guest_features(struct virtio_device *dev,
+					      u64 features)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	bdev->features = features;
+}
+
+static enum virtio_balloon_vq_type virtio_balloon_vq_type(
+					struct virtio_balloon_dev *bdev,
+					u32 vq)
+{
+	if (vq == 0) {
+		return VIRTIO_BALLOON_VQ_INFLATE;
+	} else if (vq == 1) {
+		return VIRTIO_BALLOON_VQ_DEFLATE;
+	}
+
+	vq -= 2;
+	if (bdev->features & (1UL << VIRTIO_BALLOON_F_STATS_VQ)) {
+		if (vq == 0) {
+			return VIRTIO_BALLOON_VQ_STATS;
+		}
+		vq--;
+	}
+	if (bdev->features & (1UL << VIRTIO_BALLOON_F_REPORTING)) {
+		if (vq == 0) {
+			return VIRTIO_BALLOON_VQ_REPORTING;
+		}
+	}
+
+	return VIRTIO_BALLOON_VQ_UNKNOWN;
+}
+
+static int virtio_balloon_init_vq(struct virtio_device *dev,
+				  u32 vq, u32 page_size, u32 align, u32 pfn)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	if (VIRTIO_BALLOON_NUM_QUEUES <= vq) {
+		return VMM_EINVALID;
+	}
+
+	return virtio_queue_setup(&bdev->vqs[vq], dev->guest,
+			pfn, page_size, VIRTIO_BALLOON_QUEUE_SIZE, align);
+}
+
+static int virtio_balloon_get_pfn_vq(struct virtio_device *dev, u32 vq)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	if (VIRTIO_BALLOON_NUM_QUEUES <= vq) {
+		return VMM_EINVALID;
+	}
+
+	return virtio_queue_guest_pfn(&bdev->vqs[vq]);
+}
+
+static int virtio_balloon_init_vq_rings(struct virtio_device *dev,
+					u32 vq, u32 num,
+					physical_addr_t desc,
+					physical_addr_t avail,
+					physical_addr_t used)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	if ((VIRTIO_BALLOON_NUM_QUEUES <= vq) ||
+	    (VIRTIO_BALLOON_QUEUE_SIZE < num)) {
+		return VMM_EINVALID;
+	}
+
+	return virtio_queue_setup_rings(&bdev->vqs[vq], dev->guest,
+				desc, avail, used, num,
+				virtio_has_feature(dev, VIRTIO_F_RING_PACKED));
+}
+
+static bool virtio_balloon_get_ready_vq(struct virtio_device *dev, u32 vq)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	if (VIRTIO_BALLOON_NUM_QUEUES <= vq) {
+		return FALSE;
+	}
+
+	return virtio_queue_setup_done(&bdev->vqs[vq]);
+}
+
+static int virtio_balloon_get_size_vq(struct virtio_device *dev, u32 vq)
+{
+	return (vq < VIRTIO_BALLOON_NUM_QUEUES) ?
+					VIRTIO_BALLOON_QUEUE_SIZE : 0;
+}
+
+static int virtio_balloon_set_size_vq(struct virtio_device *dev,
+				      u32 vq, int size)
+{
+	/* FIXME: dynamic */
+	return size;
+}
+
+static void virtio_balloon_discard(struct virtio_device *dev,
+				   physical_addr_t addr, physical_size_t size)
+{
+	int rc;
+
+	if (!size) {
+		return;
+	}
+
+	rc = vmm_guest_ram_discard(dev->guest, addr, size);
+	if (rc && (rc != VMM_ENOTSUPP)) {
+		vmm_printf("%s: %s: failed to discard 0x%"PRIPADDR
+			   " (error %d)\n", __func__, dev->name, addr, rc);
+	}
+}
+
+static int virtio_balloon_do_pfns(struct virtio_device *dev,
+				  struct virtio_balloon_dev *bdev,
+				  u32 vq_index, bool inflate)
+{
+	u16 head = 0;
+	u32 i, j, len, iov_cnt = 0, total_len = 0;
+	u32 pfns[VIRTIO_BALLOON_PFN_BATCH];
+	physical_addr_t addr, start = 0;
+	physical_size_t size = 0;
+	struct virtio_queue *vq = &bdev->vqs[vq_index];
+	struct virtio_iovec *iov = bdev->iov[vq_index];
+
+	while (virtio_queue_available(vq)) {
+		head = virtio_queue_get_iovec(vq, iov, &iov_cnt, &total_len);
+
+		/* Nothing to do for deflated pages because they get
+		 * populated again upon next guest access.
+		 */
+		for (i = 0; inflate && (i < iov_cnt); i++) {
+			while (sizeof(u32) <= iov[i].len) {
+				len = virtio_iovec_to_buf_read(dev, &iov[i], 1,
+						pfns, min(iov[i].len,
+							  (u32)sizeof(pfns)));
+				len &= ~(sizeof(u32) - 1);
+				if (!len) {
+					break;
+				}
+				iov[i].addr += len;
+				iov[i].len -= len;
+
+				/* Discard contiguous pages together */
+				for (j = 0; j < (len / sizeof(u32)); j++) {
+					addr = (physical_addr_t)pfns[j] <<
+						VIRTIO_BALLOON_PFN_SHIFT;
+					if (size && (addr == (start + size))) {
+						size += VIRTIO_BALLOON_PAGE_SIZE;
+						continue;
+					}
+					virtio_balloon_discard(dev, start, size);
+					start = addr;
+					size = VIRTIO_BALLOON_PAGE_SIZE;
+				}
+			}
+		}
+		virtio_balloon_discard(dev, start, size);
+		size = 0;
+
+		virtio_queue_set_used_elem(vq, head, 0);
+	}
+
+	if (virtio_queue_should_signal(vq)) {
+		dev->tra->notify(dev, vq_index);
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_do_reporting(struct virtio_device *dev,
+				       struct virtio_balloon_dev *bdev,
+				       u32 vq_index)
+{
+	u16 head = 0;
+	u32 i, iov_cnt = 0, total_len = 0;
+	physical_addr_t start, end;
+	struct virtio_queue *vq = &bdev->vqs[vq_index];
+	struct virtio_iovec *iov = bdev->iov[vq_index];
+
+	while (virtio_queue_available(vq)) {
+		head = virtio_queue_get_iovec(vq, iov, &iov_cnt, &total_len);
+
+		/* Each buffer describes a free guest memory range */
+		for (i = 0; i < iov_cnt; i++) {
+			start = round_up(iov[i].addr, VMM_PAGE_SIZE);
+			end = round_down(iov[i].addr + iov[i].len,
+					 VMM_PAGE_SIZE);
+			if (start < end) {
+				virtio_balloon_discard(dev, start,
+						       end - start);
+			}
+		}
+
+		virtio_queue_set_used_elem(vq, head, 0);
+	}
+
+	if (virtio_queue_should_signal(vq)) {
+		dev->tra->notify(dev, vq_index);
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_do_stats(struct virtio_device *dev,
+				   struct virtio_balloon_dev *bdev,
+				   u32 vq_index)
+{
+	u16 head = 0;
+	u32 i, len, iov_cnt = 0, total_len = 0;
+	irq_flags_t flags;
+	struct virtio_balloon_stat stats[VIRTIO_BALLOON_S_NR];
+	struct virtio_queue *vq = &bdev->vqs[vq_index];
+	struct virtio_iovec *iov = bdev->iov[vq_index];
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+
+	/* Guest gives back the stats buffer with fresh stats. We
+	 * hold the buffer until we want guest to update stats again.
+	 */
+	while (virtio_queue_available(vq)) {
+		head = virtio_queue_get_iovec(vq, iov, &iov_cnt, &total_len);
+
+		len = virtio_iovec_to_buf_read(dev, iov, iov_cnt,
+					       stats, sizeof(stats));
+		for (i = 0; i < (len / sizeof(stats[0])); i++) {
+			switch (stats[i].tag) {
+			case VIRTIO_BALLOON_S_MEMFREE:
+				bdev->stats_memfree = stats[i].val;
+				break;
+			case VIRTIO_BALLOON_S_MEMTOT:
+				bdev->stats_memtot = stats[i].val;
+				break;
+			default:
+				break;
+			};
+		}
+
+		if (bdev->stats_held) {
+			virtio_queue_set_used_elem(vq, bdev->stats_head, 0);
+		}
+		bdev->stats_head = head;
+		bdev->stats_held = TRUE;
+	}
+
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	return VMM_OK;
+}
+
+/* Give back stats buffer so that guest updates stats */
+static void virtio_balloon_request_stats(struct virtio_balloon_dev *bdev)
+{
+	u32 vq_index;
+	irq_flags_t flags;
+	bool notify = FALSE;
+	struct virtio_device *dev = bdev->vdev;
+
+	for (vq_index = 0; vq_index < VIRTIO_BALLOON_NUM_QUEUES; vq_index++) {
+		if (virtio_balloon_vq_type(bdev, vq_index) ==
+						VIRTIO_BALLOON_VQ_STATS) {
+			break;
+		}
+	}
+	if (vq_index == VIRTIO_BALLOON_NUM_QUEUES) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	if (bdev->stats_held) {
+		virtio_queue_set_used_elem(&bdev->vqs[vq_index],
+					   bdev->stats_head, 0);
+		bdev->stats_held = FALSE;
+		notify = TRUE;
+	}
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	if (notify) {
+		dev->tra->notify(dev, vq_index);
+	}
+}
+
+static int virtio_balloon_notify_vq(struct virtio_device *dev, u32 vq)
+{
+	int rc = VMM_OK;
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	if (VIRTIO_BALLOON_NUM_QUEUES <= vq) {
+		return VMM_EINVALID;
+	}
+
+	switch (virtio_balloon_vq_type(bdev, vq)) {
+	case VIRTIO_BALLOON_VQ_INFLATE:
+		rc = virtio_balloon_do_pfns(dev, bdev, vq, TRUE);
+		break;
+	case VIRTIO_BALLOON_VQ_DEFLATE:
+		rc = virtio_balloon_do_pfns(dev, bdev, vq, FALSE);
+		break;
+	case VIRTIO_BALLOON_VQ_STATS:
+		rc = virtio_balloon_do_stats(dev, bdev, vq);
+		break;
+	case VIRTIO_BALLOON_VQ_REPORTING:
+		rc = virtio_balloon_do_reporting(dev, bdev, vq);
+		break;
+	default:
+		rc = VMM_EINVALID;
+		break;
+	};
+
+	return rc;
+}
+
+static int virtio_balloon_read_config(struct virtio_device *dev,
+				      u32 offset, void *dst, u32 dst_len)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+	u8 *src = (u8 *)&bdev->config;
+	u32 src_len = sizeof(bdev->config);
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	for (i = 0; (i < dst_len) && ((offset + i) < src_len); i++) {
+		*((u8 *)dst + i) = src[offset + i];
+	}
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_write_config(struct virtio_device *dev,
+				       u32 offset, void *src, u32 src_len)
+{
+	u32 i, pos;
+	irq_flags_t flags;
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+	u8 *dst = (u8 *)&bdev->config;
+
+	/* Only actual and poison_val are writeable by guest */
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	for (i = 0; i < src_len; i++) {
+		pos = offset + i;
+		if (((offsetof(struct virtio_balloon_config, actual) <= pos) &&
+		     (pos < offsetof(struct virtio_balloon_config,
+				     free_page_hint_cmd_id))) ||
+		    ((offsetof(struct virtio_balloon_config,
+			       poison_val) <= pos) &&
+		     (pos < sizeof(bdev->config)))) {
+			dst[pos] = *((u8 *)src + i);
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_reset(struct virtio_device *dev)
+{
+	int rc;
+	u32 i;
+	irq_flags_t flags;
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	bdev->config.actual = 0;
+	bdev->config.poison_val = 0;
+	bdev->stats_held = FALSE;
+	bdev->stats_memfree = 0;
+	bdev->stats_memtot = 0;
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	for (i = 0; i < VIRTIO_BALLOON_NUM_QUEUES; i++) {
+		rc = virtio_queue_cleanup(&bdev->vqs[i]);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_set_target(struct vmm_guest_balloon *bln,
+				     physical_size_t size)
+{
+	irq_flags_t flags;
+	struct virtio_balloon_dev *bdev = bln->priv;
+	struct virtio_device *dev = bdev->vdev;
+	u64 pages = size >> VIRTIO_BALLOON_PFN_SHIFT;
+
+	if (pages > 0xFFFFFFFFULL) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	bdev->config.num_pages = (u32)pages;
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	if (dev->tra->notify_config) {
+		dev->tra->notify_config(dev);
+	}
+
+	virtio_balloon_request_stats(bdev);
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_get_info(struct vmm_guest_balloon *bln,
+				   struct vmm_guest_balloon_info *info)
+{
+	irq_flags_t flags;
+	struct virtio_balloon_dev *bdev = bln->priv;
+
+	vmm_spin_lock_irqsave_lite(&bdev->lock, flags);
+	info->target = (physical_size_t)bdev->config.num_pages <<
+						VIRTIO_BALLOON_PFN_SHIFT;
+	info->actual = (physical_size_t)bdev->config.actual <<
+						VIRTIO_BALLOON_PFN_SHIFT;
+	info->guest_free = bdev->stats_memfree;
+	info->guest_total = bdev->stats_memtot;
+	vmm_spin_unlock_irqrestore_lite(&bdev->lock, flags);
+
+	/* Ask for fresh stats for next time */
+	virtio_balloon_request_stats(bdev);
+
+	return VMM_OK;
+}
+
+static int virtio_balloon_connect(struct virtio_device *dev,
+				  struct virtio_emulator *emu)
+{
+	int rc;
+	struct virtio_balloon_dev *bdev;
+
+	bdev = vmm_zalloc(sizeof(struct virtio_balloon_dev));
+	if (!bdev) {
+		vmm_printf("Failed to allocate virtio balloon device....\n");
+		return VMM_ENOMEM;
+	}
+	bdev->vdev = dev;
+	INIT_SPIN_LOCK(&bdev->lock);
+
+	INIT_LIST_HEAD(&bdev->bln.head);
+	bdev->bln.guest = dev->guest;
+	bdev->bln.set_target = virtio_balloon_set_target;
+	bdev->bln.get_info = virtio_balloon_get_info;
+	bdev->bln.priv = bdev;
+
+	dev->emu_data = bdev;
+
+	rc = vmm_guest_balloon_register(&bdev->bln);
+	if (rc) {
+		vmm_printf("%s: %s: failed to register balloon (error %d)\n",
+			   __func__, dev->name, rc);
+		dev->emu_data = NULL;
+		vmm_free(bdev);
+		return rc;
+	}
+
+	return VMM_OK;
+}
+
+static void virtio_balloon_disconnect(struct virtio_device *dev)
+{
+	struct virtio_balloon_dev *bdev = dev->emu_data;
+
+	vmm_guest_balloon_unregister(&bdev->bln);
+	vmm_free(bdev);
+}
+
+struct virtio_device_id virtio_balloon_emu_id[] = {
+	{.type = VIRTIO_ID_BALLOON},
+	{ },
+};
+
+struct virtio_emulator virtio_balloon = {
+	.name = "virtio_balloon",
+	.id_table = virtio_balloon_emu_id,
+
+	/* VirtIO operations */
+	.get_host_features      = virtio_balloon_get_host_features,
+	.set_guest_features     = virtio_balloon_set_guest_features,
+	.init_vq                = virtio_balloon_init_vq,
+	.get_pfn_vq             = virtio_balloon_get_pfn_vq,
+	.init_vq_rings          = virtio_balloon_init_vq_rings,
+	.get_ready_vq           = virtio_balloon_get_ready_vq,
+	.get_size_vq            = virtio_balloon_get_size_vq,
+	.set_size_vq            = virtio_balloon_set_size_vq,
+	.notify_vq              = virtio_balloon_notify_vq,
+
+	/* Emulator operations */
+	.read_config = virtio_balloon_read_config,
+	.write_config = virtio_balloon_write_config,
+	.reset = virtio_balloon_reset,
+	.connect = virtio_balloon_connect,
+	.disconnect = virtio_balloon_disconnect,
+};
+
+static int __init virtio_balloon_init(void)
+{
+	return virtio_register_emulator(&virtio_balloon);
+}
+
+static void __exit virtio_balloon_exit(void)
+{
+	virtio_unregister_emulator(&virtio_balloon);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
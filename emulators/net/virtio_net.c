@@ -71,14 +71,14 @@ struct virtio_net_dev {
 	u32 max_queues;
 	u32 can_receive;
 	struct virtio_net_config config;
-	u32 features;
+	u64 features;
 
 	int mode;
 	struct vmm_netport *port;
 	char name[VIRTIO_DEVICE_MAX_NAME_LEN];
 };
 
-static u32 virtio_net_get_host_features(struct virtio_device *dev)
+static u64 virtio_net_get_host_features(struct virtio_device *dev)
 {
 	return 1UL << VIRTIO_NET_F_MAC
 #if 0
@@ -91,16 +91,14 @@ static u32 virtio_net_get_host_features(struct virtio_device *dev)
 		| 1UL << VIRTIO_NET_F_GUEST_TSO6
 #endif
 		| 1UL << VIRTIO_RING_F_EVENT_IDX
-#if 0
 		| 1UL << VIRTIO_RING_F_INDIRECT_DESC
-#endif
 		| 1UL << VIRTIO_NET_F_MQ
 		| 1UL << VIRTIO_NET_F_CTRL_VQ
 		;
 }
 
 static void virtio_net_set_guest_features(struct virtio_device *dev,
-					  u32 features)
+					  u64 features)
 {
 	struct virtio_net_dev *ndev = dev->emu_data;
 
@@ -139,6 +137,58 @@ static int virtio_net_get_pfn_vq(struct virtio_device *dev, u32 vq)
 	return rc;
 }
 
+static int virtio_net_init_vq_rings(struct virtio_device *dev, u32 vq, u32 num,
+				    physical_addr_t desc, physical_addr_t avail,
+				    physical_addr_t used)
+{
+	int rc;
+	u32 i;
+	struct virtio_net_dev *ndev = dev->emu_data;
+
+	if ((ndev->max_queues <= vq) || (VIRTIO_NET_QUEUE_SIZE < num)) {
+		return VMM_EINVALID;
+	}
+
+	rc = virtio_queue_setup_rings(&ndev->vqs[vq].vq, dev->guest,
+				desc, avail, used, num,
+				virtio_has_feature(dev, VIRTIO_F_RING_PACKED));
+	if (rc != VMM_OK) {
+		return rc;
+	}
+
+	if (num) {
+		ndev->vqs[vq].valid = 1;
+		if (!ndev->can_receive &&
+		    ndev->vqs[vq].type == VIRTIO_NET_RX_QUEUE)
+			ndev->can_receive = 1;
+		return VMM_OK;
+	}
+
+	/* Queue torn down so receive only if some RX queue remains */
+	ndev->vqs[vq].valid = 0;
+	ndev->can_receive = 0;
+	for (i = 0; i < ndev->max_queues; i++) {
+		if (ndev->vqs[i].valid &&
+		    (ndev->vqs[i].type == VIRTIO_NET_RX_QUEUE)) {
+			ndev->can_receive = 1;
+			break;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static bool virtio_net_get_ready_vq(struct virtio_device *dev, u32 vq)
+{
+	struct virtio_net_dev *ndev = dev->emu_data;
+
+	if (ndev->max_queues <= vq) {
+		return FALSE;
+	}
+
+	return virtio_queue_setup_done(&ndev->vqs[vq].vq);
+}
+
 static int virtio_net_get_size_vq(struct virtio_device *dev, u32 vq)
 {
 	return VIRTIO_NET_QUEUE_SIZE;
@@ -452,6 +502,8 @@ struct virtio_emulator virtio_net = {
 	.set_guest_features     = virtio_net_set_guest_features,
 	.init_vq                = virtio_net_init_vq,
 	.get_pfn_vq             = virtio_net_get_pfn_vq,
+	.init_vq_rings          = virtio_net_init_vq_rings,
+	.get_ready_vq           = virtio_net_get_ready_vq,
 	.get_size_vq            = virtio_net_get_size_vq,
 	.set_size_vq            = virtio_net_set_size_vq,
 	.notify_vq              = virtio_net_notify_vq,
@@ -176,6 +176,10 @@ VMM_EXPORT_SYMBOL(virtio_config_write);
 
 int virtio_reset(struct virtio_device *dev)
 {
+	if (dev) {
+		dev->features = 0;
+	}
+
 	return __virtio_reset_emulator(dev);
 }
 VMM_EXPORT_SYMBOL(virtio_reset);
@@ -25,6 +25,7 @@
 #include <vmm_heap.h>
 #include <vmm_stdio.h>
 #include <vmm_modules.h>
+#include <vmm_trace.h>
 #include <vmm_devemu.h>
 #include <emu/virtio.h>
 #include <emu/virtio_queue.h>
@@ -48,6 +49,42 @@ static int virtio_mmio_notify(struct virtio_device *dev, u32 vq)
 	return VMM_OK;
 }
 
+static int virtio_mmio_notify_config(struct virtio_device *dev)
+{
+	struct virtio_mmio_dev *m = dev->tra_data;
+
+	m->config.interrupt_state |= VIRTIO_MMIO_INT_CONFIG;
+	m->config_generation++;
+
+	vmm_devemu_emulate_irq(m->guest, m->irq, 1);
+
+	return VMM_OK;
+}
+
+static u64 virtio_mmio_host_features(struct virtio_mmio_dev *m)
+{
+	u64 features = m->dev.emu->get_host_features(&m->dev);
+
+	/* Legacy interface can only negotiate first 32 feature bits */
+	if (m->config.version == VIRTIO_MMIO_VERSION_LEGACY) {
+		return features & 0xFFFFFFFFULL;
+	}
+
+	return features | (1ULL << VIRTIO_F_VERSION_1) |
+			  (1ULL << VIRTIO_F_RING_PACKED);
+}
+
+static void virtio_mmio_queue_ready(struct virtio_mmio_dev *m, u32 ready)
+{
+	/* Queue size zero tears down the queue */
+	m->dev.emu->init_vq_rings(&m->dev,
+				  m->config.queue_sel,
+				  (ready & 0x1) ? m->config.queue_num : 0,
+				  m->queue_desc,
+				  m->queue_avail,
+				  m->queue_used);
+}
+
 int virtio_mmio_config_read(struct virtio_mmio_dev *m,
 			    u32 offset, void *dst,
 			    u32 dst_len)
@@ -64,12 +101,30 @@ int virtio_mmio_config_read(struct virtio_mmio_dev *m,
 		*(u32 *)dst = (*(u32 *)(((void *)&m->config) + offset));
 		break;
 	case VIRTIO_MMIO_HOST_FEATURES:
-		*(u32 *)dst = m->dev.emu->get_host_features(&m->dev);
+		if (m->config.host_features_sel < 2) {
+			*(u32 *)dst = (u32)(virtio_mmio_host_features(m) >>
+					    (32 * m->config.host_features_sel));
+		} else {
+			*(u32 *)dst = 0;
+		}
 		break;
 	case VIRTIO_MMIO_QUEUE_PFN:
+		if (m->config.version != VIRTIO_MMIO_VERSION_LEGACY) {
+			break;
+		}
 		*(u32 *)dst = m->dev.emu->get_pfn_vq(&m->dev,
 					     m->config.queue_sel);
 		break;
+	case VIRTIO_MMIO_QUEUE_READY:
+		if (m->config.version == VIRTIO_MMIO_VERSION_LEGACY) {
+			break;
+		}
+		*(u32 *)dst = (m->dev.emu->get_ready_vq(&m->dev,
+					m->config.queue_sel)) ? 1 : 0;
+		break;
+	case VIRTIO_MMIO_CONFIG_GENERATION:
+		*(u32 *)dst = m->config_generation;
+		break;
 	case VIRTIO_MMIO_QUEUE_NUM_MAX:
 		*(u32 *)dst = m->dev.emu->get_size_vq(&m->dev,
 					      m->config.queue_sel);
@@ -103,14 +158,38 @@ static int virtio_mmio_config_write(struct virtio_mmio_dev *m,
 	switch (offset) {
 	case VIRTIO_MMIO_HOST_FEATURES_SEL:
 	case VIRTIO_MMIO_GUEST_FEATURES_SEL:
+		*(u32 *)(((void *)&m->config) + offset) = val;
+		break;
 	case VIRTIO_MMIO_QUEUE_SEL:
+		m->config.queue_sel = val;
+		m->queue_desc = 0;
+		m->queue_avail = 0;
+		m->queue_used = 0;
+		break;
 	case VIRTIO_MMIO_STATUS:
-		*(u32 *)(((void *)&m->config) + offset) = val;
+		m->config.status = val;
+		/* Writing zero resets the device in virtio 1.x */
+		if (!val && (m->config.version != VIRTIO_MMIO_VERSION_LEGACY)) {
+			m->guest_features = 0;
+			m->config.interrupt_state = 0x0;
+			vmm_devemu_emulate_irq(m->guest, m->irq, 0);
+			rc = virtio_reset(&m->dev);
+		}
 		break;
 	case VIRTIO_MMIO_GUEST_FEATURES:
 		if (m->config.guest_features_sel == 0)  {
-			m->dev.emu->set_guest_features(&m->dev, val);
+			m->guest_features &= ~0xFFFFFFFFULL;
+			m->guest_features |= val;
+		} else if ((m->config.guest_features_sel == 1) &&
+			   (m->config.version != VIRTIO_MMIO_VERSION_LEGACY)) {
+			m->guest_features &= 0xFFFFFFFFULL;
+			m->guest_features |= (u64)val << 32;
+		} else {
+			break;
 		}
+		m->guest_features &= virtio_mmio_host_features(m);
+		m->dev.features = m->guest_features;
+		m->dev.emu->set_guest_features(&m->dev, m->guest_features);
 		break;
 	case VIRTIO_MMIO_GUEST_PAGE_SIZE:
 		m->config.guest_page_size = val;
@@ -125,13 +204,43 @@ static int virtio_mmio_config_write(struct virtio_mmio_dev *m,
 		m->config.queue_align = val;
 		break;
 	case VIRTIO_MMIO_QUEUE_PFN:
+		if (m->config.version != VIRTIO_MMIO_VERSION_LEGACY) {
+			break;
+		}
 		m->dev.emu->init_vq(&m->dev, 
 				    m->config.queue_sel,
 				    m->config.guest_page_size,
 				    m->config.queue_align,
 				    val);
 		break;
+	case VIRTIO_MMIO_QUEUE_READY:
+		if (m->config.version != VIRTIO_MMIO_VERSION_LEGACY) {
+			virtio_mmio_queue_ready(m, val);
+		}
+		break;
+	case VIRTIO_MMIO_QUEUE_DESC_LOW:
+		m->queue_desc = (m->queue_desc & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_MMIO_QUEUE_DESC_HIGH:
+		m->queue_desc = (m->queue_desc & 0xFFFFFFFFULL) |
+				((u64)val << 32);
+		break;
+	case VIRTIO_MMIO_QUEUE_AVAIL_LOW:
+		m->queue_avail = (m->queue_avail & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_MMIO_QUEUE_AVAIL_HIGH:
+		m->queue_avail = (m->queue_avail & 0xFFFFFFFFULL) |
+				 ((u64)val << 32);
+		break;
+	case VIRTIO_MMIO_QUEUE_USED_LOW:
+		m->queue_used = (m->queue_used & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_MMIO_QUEUE_USED_HIGH:
+		m->queue_used = (m->queue_used & 0xFFFFFFFFULL) |
+				((u64)val << 32);
+		break;
 	case VIRTIO_MMIO_QUEUE_NOTIFY:
+		trace_virtio_queue_kick(m->guest->id, m->dev.id.type, val);
 		m->dev.emu->notify_vq(&m->dev, val);
 		break;
 	case VIRTIO_MMIO_INTERRUPT_ACK:
@@ -221,6 +330,7 @@ static int virtio_mmio_reset(struct vmm_emudev *edev)
 {
 	struct virtio_mmio_dev *m = edev->priv;
 
+	m->guest_features = 0;
 	m->config.interrupt_state = 0x0;
 	vmm_devemu_emulate_irq(m->guest, m->irq, 0);
 
@@ -230,6 +340,7 @@ static int virtio_mmio_reset(struct vmm_emudev *edev)
 static struct virtio_transport mmio_tra = {
 	.name = "virtio_mmio",
 	.notify = virtio_mmio_notify,
+	.notify_config = virtio_mmio_notify_config,
 };
 
 static int virtio_mmio_probe(struct vmm_guest *guest,
@@ -237,6 +348,7 @@ static int virtio_mmio_probe(struct vmm_guest *guest,
 			     const struct vmm_devtree_nodeid *eid)
 {
 	int rc = VMM_OK;
+	u32 version;
 	struct virtio_mmio_dev *m;
 
 	m = vmm_zalloc(sizeof(struct virtio_mmio_dev));
@@ -256,7 +368,7 @@ static int virtio_mmio_probe(struct vmm_guest *guest,
 
 	m->config = (struct virtio_mmio_config) {
 		     .magic          = {'v', 'i', 'r', 't'},
-		     .version        = 1,
+		     .version        = VIRTIO_MMIO_VERSION_LEGACY,
 		     .vendor_id      = 0x52535658, /* XVSR */
 		     .queue_num_max  = 256,
 	};
@@ -269,6 +381,16 @@ static int virtio_mmio_probe(struct vmm_guest *guest,
 
 	m->dev.id.type = m->config.device_id;
 
+	/* Register layout defaults to legacy for older guests */
+	version = VIRTIO_MMIO_VERSION_LEGACY;
+	vmm_devtree_read_u32(edev->node, "virtio_version", &version);
+	if ((version != VIRTIO_MMIO_VERSION_LEGACY) &&
+	    (version != VIRTIO_MMIO_VERSION_MODERN)) {
+		rc = VMM_EINVALID;
+		goto virtio_mmio_probe_freestate_fail;
+	}
+	m->config.version = version;
+
 	rc = vmm_devtree_irq_get(edev->node, &m->irq, 0);
 	if (rc) {
 		goto virtio_mmio_probe_freestate_fail;
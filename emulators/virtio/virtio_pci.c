@@ -25,7 +25,9 @@
 #include <vmm_stdio.h>
 #include <vmm_heap.h>
 #include <vmm_modules.h>
+#include <vmm_trace.h>
 #include <vmm_devemu.h>
+#include <libs/stringlib.h>
 #include <emu/virtio.h>
 #include <emu/virtio_queue.h>
 #include <emu/virtio_pci.h>
@@ -53,6 +55,253 @@ static int virtio_pci_notify(struct virtio_device *dev, u32 vq)
 	return VMM_OK;
 }
 
+static int virtio_pci_notify_config(struct virtio_device *dev)
+{
+	struct virtio_pci_dev *m = dev->tra_data;
+
+	m->config.interrupt_state |= VIRTIO_PCI_INT_CONFIG;
+	m->config_generation++;
+
+	vmm_devemu_emulate_irq(m->guest, m->irq, 1);
+
+	return VMM_OK;
+}
+
+static u64 virtio_pci_host_features(struct virtio_pci_dev *m)
+{
+	u64 features = m->dev.emu->get_host_features(&m->dev);
+
+	/* Legacy interface can only negotiate first 32 feature bits */
+	if (m->version == VIRTIO_PCI_VERSION_LEGACY) {
+		return features & 0xFFFFFFFFULL;
+	}
+
+	return features | (1ULL << VIRTIO_F_VERSION_1) |
+			  (1ULL << VIRTIO_F_RING_PACKED);
+}
+
+static void virtio_pci_set_guest_features(struct virtio_pci_dev *m)
+{
+	m->guest_features &= virtio_pci_host_features(m);
+	m->dev.features = m->guest_features;
+	m->dev.emu->set_guest_features(&m->dev, m->guest_features);
+}
+
+static int virtio_pci_device_reset(struct virtio_pci_dev *m)
+{
+	m->guest_features = 0;
+	m->config.interrupt_state = 0x0;
+	vmm_devemu_emulate_irq(m->guest, m->irq, 0);
+
+	return virtio_reset(&m->dev);
+}
+
+static u32 virtio_pci_isr_read(struct virtio_pci_dev *m)
+{
+	u32 isr = m->config.interrupt_state;
+
+	/* reading from the ISR also clears it. */
+	m->config.interrupt_state = 0;
+	vmm_devemu_emulate_irq(m->guest, m->irq, 0);
+
+	return isr;
+}
+
+static u32 virtio_pci_common_read(struct virtio_pci_dev *m, u32 offset)
+{
+	switch (offset) {
+	case VIRTIO_PCI_COMMON_DFSELECT:
+		return m->host_features_sel;
+	case VIRTIO_PCI_COMMON_DF:
+		if (m->host_features_sel < 2) {
+			return (u32)(virtio_pci_host_features(m) >>
+				     (32 * m->host_features_sel));
+		}
+		return 0;
+	case VIRTIO_PCI_COMMON_GFSELECT:
+		return m->guest_features_sel;
+	case VIRTIO_PCI_COMMON_GF:
+		if (m->guest_features_sel < 2) {
+			return (u32)(m->guest_features >>
+				     (32 * m->guest_features_sel));
+		}
+		return 0;
+	case VIRTIO_PCI_COMMON_MSIX:
+	case VIRTIO_PCI_COMMON_Q_MSIX:
+		return VIRTIO_MSI_NO_VECTOR;
+	case VIRTIO_PCI_COMMON_NUMQ:
+		return VIRTIO_PCI_QUEUE_MAX;
+	case VIRTIO_PCI_COMMON_STATUS:
+		return m->config.status;
+	case VIRTIO_PCI_COMMON_CFGGENERATION:
+		return m->config_generation;
+	case VIRTIO_PCI_COMMON_Q_SELECT:
+		return m->config.queue_sel;
+	case VIRTIO_PCI_COMMON_Q_SIZE:
+		return m->queue_size;
+	case VIRTIO_PCI_COMMON_Q_ENABLE:
+		return (m->dev.emu->get_ready_vq(&m->dev,
+					m->config.queue_sel)) ? 1 : 0;
+	case VIRTIO_PCI_COMMON_Q_DESCLO:
+		return (u32)m->queue_desc;
+	case VIRTIO_PCI_COMMON_Q_DESCHI:
+		return (u32)(m->queue_desc >> 32);
+	case VIRTIO_PCI_COMMON_Q_AVAILLO:
+		return (u32)m->queue_avail;
+	case VIRTIO_PCI_COMMON_Q_AVAILHI:
+		return (u32)(m->queue_avail >> 32);
+	case VIRTIO_PCI_COMMON_Q_USEDLO:
+		return (u32)m->queue_used;
+	case VIRTIO_PCI_COMMON_Q_USEDHI:
+		return (u32)(m->queue_used >> 32);
+	default:
+		/* Queue notify offset is always zero */
+		break;
+	}
+
+	return 0;
+}
+
+static int virtio_pci_common_write(struct virtio_pci_dev *m,
+				   u32 offset, u32 val)
+{
+	int rc = VMM_OK;
+
+	switch (offset) {
+	case VIRTIO_PCI_COMMON_DFSELECT:
+		m->host_features_sel = val;
+		break;
+	case VIRTIO_PCI_COMMON_GFSELECT:
+		m->guest_features_sel = val;
+		break;
+	case VIRTIO_PCI_COMMON_GF:
+		if (m->guest_features_sel == 0) {
+			m->guest_features &= ~0xFFFFFFFFULL;
+			m->guest_features |= val;
+		} else if (m->guest_features_sel == 1) {
+			m->guest_features &= 0xFFFFFFFFULL;
+			m->guest_features |= (u64)val << 32;
+		} else {
+			break;
+		}
+		virtio_pci_set_guest_features(m);
+		break;
+	case VIRTIO_PCI_COMMON_STATUS:
+		m->config.status = val;
+		if (!val) {
+			rc = virtio_pci_device_reset(m);
+		}
+		break;
+	case VIRTIO_PCI_COMMON_Q_SELECT:
+		m->config.queue_sel = val;
+		m->queue_size = m->dev.emu->get_size_vq(&m->dev, val);
+		m->queue_desc = 0;
+		m->queue_avail = 0;
+		m->queue_used = 0;
+		break;
+	case VIRTIO_PCI_COMMON_Q_SIZE:
+		m->queue_size = val;
+		m->dev.emu->set_size_vq(&m->dev, m->config.queue_sel, val);
+		break;
+	case VIRTIO_PCI_COMMON_Q_ENABLE:
+		if (val & 0x1) {
+			rc = m->dev.emu->init_vq_rings(&m->dev,
+						       m->config.queue_sel,
+						       m->queue_size,
+						       m->queue_desc,
+						       m->queue_avail,
+						       m->queue_used);
+		}
+		break;
+	case VIRTIO_PCI_COMMON_Q_DESCLO:
+		m->queue_desc = (m->queue_desc & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_PCI_COMMON_Q_DESCHI:
+		m->queue_desc = (m->queue_desc & 0xFFFFFFFFULL) |
+				((u64)val << 32);
+		break;
+	case VIRTIO_PCI_COMMON_Q_AVAILLO:
+		m->queue_avail = (m->queue_avail & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_PCI_COMMON_Q_AVAILHI:
+		m->queue_avail = (m->queue_avail & 0xFFFFFFFFULL) |
+				 ((u64)val << 32);
+		break;
+	case VIRTIO_PCI_COMMON_Q_USEDLO:
+		m->queue_used = (m->queue_used & ~0xFFFFFFFFULL) | val;
+		break;
+	case VIRTIO_PCI_COMMON_Q_USEDHI:
+		m->queue_used = (m->queue_used & 0xFFFFFFFFULL) |
+				((u64)val << 32);
+		break;
+	default:
+		/* MSI-X vectors are not supported so ignore them */
+		break;
+	}
+
+	return rc;
+}
+
+static int virtio_pci_modern_read(struct virtio_pci_dev *m,
+				  u32 offset, u32 *dst)
+{
+	if ((VIRTIO_PCI_MODERN_DEVICE_OFFSET <= offset) &&
+	    (offset < (VIRTIO_PCI_MODERN_DEVICE_OFFSET +
+		       VIRTIO_PCI_MODERN_DEVICE_SIZE))) {
+		offset -= VIRTIO_PCI_MODERN_DEVICE_OFFSET;
+		return virtio_config_read(&m->dev, offset, dst, 4);
+	}
+
+	if ((VIRTIO_PCI_MODERN_ISR_OFFSET <= offset) &&
+	    (offset < (VIRTIO_PCI_MODERN_ISR_OFFSET +
+		       VIRTIO_PCI_MODERN_ISR_SIZE))) {
+		*dst = virtio_pci_isr_read(m);
+		return VMM_OK;
+	}
+
+	if (offset < (VIRTIO_PCI_MODERN_COMMON_OFFSET +
+		      VIRTIO_PCI_MODERN_COMMON_SIZE)) {
+		offset -= VIRTIO_PCI_MODERN_COMMON_OFFSET;
+		*dst = virtio_pci_common_read(m, offset);
+		return VMM_OK;
+	}
+
+	*dst = 0;
+
+	return VMM_OK;
+}
+
+static int virtio_pci_modern_write(struct virtio_pci_dev *m,
+				   u32 offset, u32 src)
+{
+	if ((VIRTIO_PCI_MODERN_DEVICE_OFFSET <= offset) &&
+	    (offset < (VIRTIO_PCI_MODERN_DEVICE_OFFSET +
+		       VIRTIO_PCI_MODERN_DEVICE_SIZE))) {
+		offset -= VIRTIO_PCI_MODERN_DEVICE_OFFSET;
+		return virtio_config_write(&m->dev, offset, &src, 4);
+	}
+
+	/* All queues share one notify address and guest writes queue index */
+	if ((VIRTIO_PCI_MODERN_NOTIFY_OFFSET <= offset) &&
+	    (offset < (VIRTIO_PCI_MODERN_NOTIFY_OFFSET +
+		       VIRTIO_PCI_MODERN_NOTIFY_SIZE))) {
+		if (src < VIRTIO_PCI_QUEUE_MAX) {
+			trace_virtio_queue_kick(m->guest->id,
+						m->dev.id.type, src);
+			m->dev.emu->notify_vq(&m->dev, src);
+		}
+		return VMM_OK;
+	}
+
+	if (offset < (VIRTIO_PCI_MODERN_COMMON_OFFSET +
+		      VIRTIO_PCI_MODERN_COMMON_SIZE)) {
+		offset -= VIRTIO_PCI_MODERN_COMMON_OFFSET;
+		return virtio_pci_common_write(m, offset, src);
+	}
+
+	return VMM_OK;
+}
+
 int virtio_pci_config_read(struct virtio_pci_dev *m,
 			   u32 offset, void *dst,
 			   u32 dst_len)
@@ -61,7 +310,7 @@ int virtio_pci_config_read(struct virtio_pci_dev *m,
 
 	switch (offset) {
 	case VIRTIO_PCI_HOST_FEATURES:
-		*(u32 *)dst = m->dev.emu->get_host_features(&m->dev);
+		*(u32 *)dst = (u32)virtio_pci_host_features(m);
 		break;
 	case VIRTIO_PCI_QUEUE_PFN:
 		*(u32 *)dst = m->dev.emu->get_pfn_vq(&m->dev,
@@ -75,10 +324,7 @@ int virtio_pci_config_read(struct virtio_pci_dev *m,
 		*(u32 *)dst = (*(u32 *)(((void *)&m->config) + offset));
 		break;
 	case VIRTIO_PCI_ISR:
-		/* reading from the ISR also clears it. */
-		*(u32 *)dst = m->config.interrupt_state;
-		m->config.interrupt_state = 0;
-		vmm_devemu_emulate_irq(m->guest, m->irq, 0);
+		*(u32 *)dst = virtio_pci_isr_read(m);
 		break;
 	default:
 		rc = VMM_EFAIL;
@@ -91,6 +337,10 @@ int virtio_pci_config_read(struct virtio_pci_dev *m,
 static int virtio_pci_read(struct virtio_pci_dev *m,
 			   u32 offset, u32 *dst)
 {
+	if (m->version == VIRTIO_PCI_VERSION_MODERN) {
+		return virtio_pci_modern_read(m, offset, dst);
+	}
+
 	/* Device specific config write */
 	if (offset >= VIRTIO_PCI_CONFIG) {
 		offset -= VIRTIO_PCI_CONFIG;
@@ -109,7 +359,8 @@ static int virtio_pci_config_write(struct virtio_pci_dev *m,
 
 	switch (offset) {
 	case VIRTIO_PCI_GUEST_FEATURES:
-		m->dev.emu->set_guest_features(&m->dev, val);
+		m->guest_features = val;
+		virtio_pci_set_guest_features(m);
 		break;
 	case VIRTIO_PCI_QUEUE_PFN:
 		m->dev.emu->init_vq(&m->dev,
@@ -124,6 +375,8 @@ static int virtio_pci_config_write(struct virtio_pci_dev *m,
 		break;
 	case VIRTIO_PCI_QUEUE_NOTIFY:
 		if (val < VIRTIO_PCI_QUEUE_MAX) {
+			trace_virtio_queue_kick(m->guest->id,
+						m->dev.id.type, val);
 			m->dev.emu->notify_vq(&m->dev, val);
 		}
 		break;
@@ -146,6 +399,10 @@ static int virtio_pci_write(struct virtio_pci_dev *m,
 {
 	src = src & ~src_mask;
 
+	if (m->version == VIRTIO_PCI_VERSION_MODERN) {
+		return virtio_pci_modern_write(m, offset, src);
+	}
+
 	/* Device specific config write */
 	if (offset >= VIRTIO_PCI_CONFIG) {
 		offset -= VIRTIO_PCI_CONFIG;
@@ -158,6 +415,7 @@ static int virtio_pci_write(struct virtio_pci_dev *m,
 static struct virtio_transport pci_tra = {
 	.name = "virtio_pci",
 	.notify = virtio_pci_notify,
+	.notify_config = virtio_pci_notify_config,
 };
 
 static int virtio_pci_emulator_reset(struct pci_device *pdev)
@@ -165,24 +423,127 @@ static int virtio_pci_emulator_reset(struct pci_device *pdev)
 	return VMM_OK;
 }
 
+static u32 virtio_pci_emulator_config_read(struct pci_class *class,
+					   u16 reg_offset)
+{
+	u32 val = 0, off;
+	struct pci_device *pdev = (struct pci_device *)class;
+	u8 *caps = pdev->priv;
+
+	if (!caps || (reg_offset < VIRTIO_PCI_CAP_OFFSET)) {
+		return 0;
+	}
+
+	off = reg_offset - VIRTIO_PCI_CAP_OFFSET;
+	if (off < sizeof(struct virtio_pci_caps)) {
+		memcpy(&val, &caps[off],
+		       min((u32)sizeof(val),
+			   (u32)(sizeof(struct virtio_pci_caps) - off)));
+	}
+
+	return val;
+}
+
+static int virtio_pci_emulator_config_write(struct pci_class *class,
+					    u16 reg_offset, u32 data)
+{
+	/* Virtio capabilities are read-only */
+	return VMM_OK;
+}
+
+static void virtio_pci_init_cap(struct virtio_pci_cap *cap, u8 len,
+				u8 next, u8 type, u8 bar,
+				u32 offset, u32 length)
+{
+	cap->cap_vndr = PCI_CAP_ID_VNDR;
+	cap->cap_next = next;
+	cap->cap_len = len;
+	cap->cfg_type = type;
+	cap->bar = bar;
+	cap->offset = offset;
+	cap->length = length;
+}
+
+static int virtio_pci_emulator_modern_probe(struct pci_device *pdev)
+{
+	u32 type, bar = 0;
+	struct virtio_pci_caps *caps;
+	struct pci_class *class = (struct pci_class *)pdev;
+
+	if (vmm_devtree_read_u32(pdev->node, "virtio_type", &type)) {
+		return VMM_EINVALID;
+	}
+	vmm_devtree_read_u32(pdev->node, "virtio_bar", &bar);
+	if (bar >= 6) {
+		return VMM_EINVALID;
+	}
+
+	caps = vmm_zalloc(sizeof(*caps));
+	if (!caps) {
+		return VMM_ENOMEM;
+	}
+
+	virtio_pci_init_cap(&caps->common, sizeof(caps->common),
+			    VIRTIO_PCI_CAP_POS(notify), VIRTIO_PCI_CAP_COMMON_CFG,
+			    bar, VIRTIO_PCI_MODERN_COMMON_OFFSET,
+			    VIRTIO_PCI_MODERN_COMMON_SIZE);
+	virtio_pci_init_cap(&caps->notify.cap, sizeof(caps->notify),
+			    VIRTIO_PCI_CAP_POS(isr), VIRTIO_PCI_CAP_NOTIFY_CFG,
+			    bar, VIRTIO_PCI_MODERN_NOTIFY_OFFSET,
+			    VIRTIO_PCI_MODERN_NOTIFY_SIZE);
+	caps->notify.notify_off_multiplier = 0;
+	virtio_pci_init_cap(&caps->isr, sizeof(caps->isr),
+			    VIRTIO_PCI_CAP_POS(device), VIRTIO_PCI_CAP_ISR_CFG,
+			    bar, VIRTIO_PCI_MODERN_ISR_OFFSET,
+			    VIRTIO_PCI_MODERN_ISR_SIZE);
+	virtio_pci_init_cap(&caps->device, sizeof(caps->device),
+			    0, VIRTIO_PCI_CAP_DEVICE_CFG,
+			    bar, VIRTIO_PCI_MODERN_DEVICE_OFFSET,
+			    VIRTIO_PCI_MODERN_DEVICE_SIZE);
+
+	class->conf_header.device_id = VIRTIO_PCI_MODERN_DEVICE_ID + type;
+	class->conf_header.revision = 1;
+	class->conf_header.subsystem_vendor_id = VIRTIO_PCI_VENDOR_ID;
+	class->conf_header.subsystem_device_id = 0x40;
+	class->conf_header.status |= PCI_STATUS_CAP_LIST;
+	class->conf_header.cap_pointer = VIRTIO_PCI_CAP_OFFSET;
+	class->config_read = virtio_pci_emulator_config_read;
+	class->config_write = virtio_pci_emulator_config_write;
+
+	pdev->priv = caps;
+
+	return VMM_OK;
+}
+
 static int virtio_pci_emulator_probe(struct pci_device *pdev,
 				     struct vmm_guest *guest,
 				     const struct vmm_devtree_nodeid *eid)
 {
+	u32 version = VIRTIO_PCI_VERSION_LEGACY;
 	struct pci_class *class = (struct pci_class *)pdev;
 
 	/* Virtio device */
-	class->conf_header.vendor_id = 0x1af4;
+	class->conf_header.vendor_id = VIRTIO_PCI_VENDOR_ID;
 	/* Block Device */
 	class->conf_header.device_id = 0x1001;
 
 	pdev->priv = NULL;
 
+	vmm_devtree_read_u32(pdev->node, "virtio_version", &version);
+	if (version == VIRTIO_PCI_VERSION_MODERN) {
+		return virtio_pci_emulator_modern_probe(pdev);
+	}
+
 	return VMM_OK;
 }
 
 static int virtio_pci_emulator_remove(struct pci_device *pdev)
 {
+	if (pdev->priv) {
+		vmm_free(pdev->priv);
+		pdev->priv = NULL;
+	}
+
 	return VMM_OK;
 }
 
@@ -246,12 +607,7 @@ static int virtio_pci_bar_write32(struct vmm_emudev *edev,
 
 static int virtio_pci_bar_reset(struct vmm_emudev *edev)
 {
-	struct virtio_pci_dev *m = edev->priv;
-
-	m->config.interrupt_state = 0x0;
-	vmm_devemu_emulate_irq(m->guest, m->irq, 0);
-
-	return virtio_reset(&m->dev);
+	return virtio_pci_device_reset(edev->priv);
 }
 
 static int virtio_pci_bar_remove(struct vmm_emudev *edev)
@@ -293,6 +649,22 @@ static int virtio_pci_bar_probe(struct vmm_guest *guest,
 		.queue_num  = 256,
 	};
 
+	/* Register layout defaults to legacy for older guests */
+	vdev->version = VIRTIO_PCI_VERSION_LEGACY;
+	vmm_devtree_read_u32(edev->node, "virtio_version", &vdev->version);
+	if ((vdev->version != VIRTIO_PCI_VERSION_LEGACY) &&
+	    (vdev->version != VIRTIO_PCI_VERSION_MODERN)) {
+		rc = VMM_EINVALID;
+		goto virtio_pci_probe_freestate_fail;
+	}
+
+	/* BAR must cover all virtio 1.x structures */
+	if ((vdev->version == VIRTIO_PCI_VERSION_MODERN) &&
+	    (edev->reg->phys_size < VIRTIO_PCI_MODERN_BAR_SIZE)) {
+		rc = VMM_EINVALID;
+		goto virtio_pci_probe_freestate_fail;
+	}
+
 	rc = vmm_devtree_read_u32(edev->node, "virtio_type",
 				  &vdev->dev.id.type);
 	if (rc) {
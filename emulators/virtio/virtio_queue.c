@@ -28,6 +28,7 @@
 #include <vmm_host_aspace.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_modules.h>
+#include <vmm_trace.h>
 #include <libs/mathlib.h>
 #include <libs/stringlib.h>
 #include <arch_barrier.h>
@@ -88,20 +89,70 @@ physical_size_t virtio_queue_total_size(struct virtio_queue *vq)
 }
 VMM_EXPORT_SYMBOL(virtio_queue_total_size);
 
+bool virtio_queue_packed(struct virtio_queue *vq)
+{
+	return (vq) ? vq->packed : FALSE;
+}
+VMM_EXPORT_SYMBOL(virtio_queue_packed);
+
+/*
+ * Packed ring chains occupy consecutive ring slots and the buffer ID is
+ * carried by last descriptor of the chain. We remember where each buffer
+ * started and how many slots it took because used descriptors have to
+ * skip the same number of slots when written back.
+ */
+static u16 virtio_queue_packed_pop(struct virtio_queue *vq)
+{
+	u16 id, flags, pos = vq->last_avail_idx;
+	u32 slot, num = 0;
+	struct vring_packed_desc *desc;
+
+	/* Read descriptors only after they were seen available */
+	arch_rmb();
+
+	do {
+		desc = &vq->packed_desc[pos];
+		flags = desc->flags;
+		id = desc->id;
+		num++;
+		if (++pos >= vq->desc_count) {
+			pos = 0;
+			vq->avail_wrap = !vq->avail_wrap;
+		}
+	} while ((flags & VRING_DESC_F_NEXT) && (num < vq->desc_count));
+
+	slot = umod32(id, vq->desc_count);
+	vq->packed_pos[slot] = vq->last_avail_idx;
+	vq->packed_num[slot] = num;
+	vq->last_avail_idx = pos;
+
+	return id;
+}
+
 u16 virtio_queue_pop(struct virtio_queue *vq)
 {
+	u16 head;
+
 	if (!vq || !vq->addr) {
 		return 0;
 	}
 
-	return vq->vring.avail->ring[
-			umod32(vq->last_avail_idx++, vq->vring.num)];
+	if (vq->packed) {
+		head = virtio_queue_packed_pop(vq);
+	} else {
+		head = vq->vring.avail->ring[
+				umod32(vq->last_avail_idx++, vq->vring.num)];
+	}
+
+	trace_virtio_queue_pop((virtual_addr_t)vq, head, vq->last_avail_idx);
+
+	return head;
 }
 VMM_EXPORT_SYMBOL(virtio_queue_pop);
 
 struct vring_desc *virtio_queue_get_desc(struct virtio_queue *vq, u16 indx)
 {
-	if (!vq || !vq->addr) {
+	if (!vq || !vq->addr || vq->packed) {
 		return NULL;
 	}
 
@@ -111,7 +162,21 @@ VMM_EXPORT_SYMBOL(virtio_queue_get_desc);
 
 bool virtio_queue_available(struct virtio_queue *vq)
 {
-	if (!vq || !vq->addr || !vq->vring.avail) {
+	u16 flags;
+	bool avail, used;
+
+	if (!vq || !vq->addr) {
+		return FALSE;
+	}
+
+	if (vq->packed) {
+		flags = vq->packed_desc[vq->last_avail_idx].flags;
+		avail = (flags & (1 << VRING_PACKED_DESC_F_AVAIL)) ? TRUE : FALSE;
+		used = (flags & (1 << VRING_PACKED_DESC_F_USED)) ? TRUE : FALSE;
+		return (avail == vq->avail_wrap) && (used != vq->avail_wrap);
+	}
+
+	if (!vq->vring.avail) {
 		return FALSE;
 	}
 
@@ -121,6 +186,45 @@ bool virtio_queue_available(struct virtio_queue *vq)
 }
 VMM_EXPORT_SYMBOL(virtio_queue_available);
 
+static bool virtio_queue_packed_should_signal(struct virtio_queue *vq)
+{
+	u16 flags, off_wrap, old_idx, new_idx, event_idx;
+
+	/* Used descriptors must be visible before reading driver event */
+	arch_mb();
+
+	flags = vq->driver_event->flags;
+	if (flags == VRING_PACKED_EVENT_FLAG_DISABLE) {
+		return FALSE;
+	}
+
+	old_idx = vq->last_used_signalled;
+	new_idx = vq->used_idx;
+
+	if (flags == VRING_PACKED_EVENT_FLAG_DESC) {
+		off_wrap = vq->driver_event->off_wrap;
+		event_idx = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+		/* Bring event and old index on the lap of new index */
+		if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) !=
+		    (vq->used_wrap ? 1 : 0)) {
+			event_idx -= vq->desc_count;
+		}
+		if (vq->signalled_wrap != vq->used_wrap) {
+			old_idx -= vq->desc_count;
+		}
+
+		if (!vring_need_event(event_idx, new_idx, old_idx)) {
+			return FALSE;
+		}
+	}
+
+	vq->last_used_signalled = new_idx;
+	vq->signalled_wrap = vq->used_wrap;
+
+	return TRUE;
+}
+
 bool virtio_queue_should_signal(struct virtio_queue *vq)
 {
 	u16 old_idx, new_idx, event_idx;
@@ -129,6 +233,10 @@ bool virtio_queue_should_signal(struct virtio_queue *vq)
 		return FALSE;
 	}
 
+	if (vq->packed) {
+		return virtio_queue_packed_should_signal(vq);
+	}
+
 	old_idx         = vq->last_used_signalled;
 	new_idx         = vq->vring.used->idx;
 	event_idx       = vring_used_event(&vq->vring);
@@ -142,6 +250,37 @@ bool virtio_queue_should_signal(struct virtio_queue *vq)
 }
 VMM_EXPORT_SYMBOL(virtio_queue_should_signal);
 
+static void virtio_queue_packed_set_used(struct virtio_queue *vq,
+					 u32 head, u32 len)
+{
+	u16 flags = 0;
+	struct vring_packed_desc *desc;
+
+	desc = &vq->packed_desc[vq->used_idx];
+	desc->id = head;
+	desc->len = len;
+
+	if (vq->used_wrap) {
+		flags = (1 << VRING_PACKED_DESC_F_AVAIL) |
+			(1 << VRING_PACKED_DESC_F_USED);
+	}
+
+	/* Guest owns the descriptor as soon as it sees the flags */
+	arch_wmb();
+	desc->flags = flags;
+
+	vq->used_idx += vq->packed_num[umod32(head, vq->desc_count)];
+	if (vq->used_idx >= vq->desc_count) {
+		vq->used_idx -= vq->desc_count;
+		vq->used_wrap = !vq->used_wrap;
+	}
+
+	trace_virtio_queue_used((virtual_addr_t)vq, head, len, vq->used_idx);
+
+	/* Flags must be visible before we signal the guest. */
+	arch_wmb();
+}
+
 struct vring_used_elem *virtio_queue_set_used_elem(struct virtio_queue *vq,
 						   u32 head, u32 len)
 {
@@ -151,6 +290,11 @@ struct vring_used_elem *virtio_queue_set_used_elem(struct virtio_queue *vq,
 		return NULL;
 	}
 
+	if (vq->packed) {
+		virtio_queue_packed_set_used(vq, head, len);
+		return NULL;
+	}
+
 	used_elem       = &vq->vring.used->ring[
 				umod32(vq->vring.used->idx, vq->vring.num)];
 	used_elem->id   = head;
@@ -164,6 +308,9 @@ struct vring_used_elem *virtio_queue_set_used_elem(struct virtio_queue *vq,
 	arch_wmb();
 	vq->vring.used->idx++;
 
+	trace_virtio_queue_used((virtual_addr_t)vq, head, len,
+				vq->vring.used->idx);
+
 	/*
 	 * Use wmb to assure used idx has been increased before we signal the guest.
 	 * Without a wmb here the guest may ignore the queue since it won't see
@@ -183,17 +330,42 @@ VMM_EXPORT_SYMBOL(virtio_queue_setup_done);
 
 int virtio_queue_cleanup(struct virtio_queue *vq)
 {
-	int rc = VMM_OK;
+	u32 i;
+	int rc = VMM_OK, rc1;
 
-	if (!vq || !vq->addr) {
+	if (!vq || (!vq->addr && !vq->map_count)) {
 		goto done;
 	}
 
-	rc = vmm_host_memunmap((virtual_addr_t)vq->addr);
+	for (i = 0; i < vq->map_count; i++) {
+		rc1 = vmm_host_memunmap(vq->map_va[i]);
+		if (rc1 && !rc) {
+			rc = rc1;
+		}
+		vq->map_va[i] = 0;
+	}
+	vq->map_count = 0;
+
+	if (vq->packed_pos) {
+		vmm_free(vq->packed_pos);
+	}
 
 	vq->last_avail_idx = 0;
 	vq->last_used_signalled = 0;
 
+	memset(&vq->vring, 0, sizeof(vq->vring));
+
+	vq->packed = FALSE;
+	vq->avail_wrap = FALSE;
+	vq->used_wrap = FALSE;
+	vq->signalled_wrap = FALSE;
+	vq->used_idx = 0;
+	vq->packed_pos = NULL;
+	vq->packed_num = NULL;
+	vq->packed_desc = NULL;
+	vq->driver_event = NULL;
+	vq->device_event = NULL;
+
 	vq->addr = NULL;
 	vq->guest = NULL;
 
@@ -211,16 +383,93 @@ done:
 }
 VMM_EXPORT_SYMBOL(virtio_queue_cleanup);
 
-int virtio_queue_setup(struct virtio_queue *vq,
-			struct vmm_guest *guest,
-			physical_addr_t guest_pfn,
-			physical_size_t guest_page_size,
-			u32 desc_count, u32 align)
+struct virtio_queue_area {
+	physical_addr_t gphys;
+	physical_size_t size;
+	physical_addr_t hphys;
+	void *ptr;
+};
+
+/*
+ * Map guest areas of a queue into host. Areas sharing guest pages are
+ * covered by a single host mapping because the same host page can't be
+ * mapped twice with different sizes.
+ */
+static int virtio_queue_map_areas(struct virtio_queue *vq,
+				  struct vmm_guest *guest,
+				  struct virtio_queue_area **area, u32 count)
 {
-	int rc = VMM_OK;
-	u32 reg_flags;
-	physical_addr_t gphys_addr, hphys_addr;
-	physical_size_t gphys_size, avail_size;
+	int rc;
+	u32 i, j, reg_flags;
+	virtual_addr_t va;
+	struct virtio_queue_area *t;
+	physical_addr_t start, end, tend, hphys_addr;
+	physical_size_t avail_size;
+
+	/* Sort areas by guest address */
+	for (i = 1; i < count; i++) {
+		for (j = i; j && (area[j]->gphys < area[j - 1]->gphys); j--) {
+			t = area[j];
+			area[j] = area[j - 1];
+			area[j - 1] = t;
+		}
+	}
+
+	i = 0;
+	while (i < count) {
+		start = area[i]->gphys & ~VMM_PAGE_MASK;
+		end = VMM_ROUNDUP2_PAGE_SIZE(area[i]->gphys + area[i]->size);
+		for (j = i + 1; (j < count) && (area[j]->gphys < end); j++) {
+			tend = VMM_ROUNDUP2_PAGE_SIZE(area[j]->gphys +
+						      area[j]->size);
+			if (end < tend) {
+				end = tend;
+			}
+		}
+
+		if ((rc = vmm_guest_physical_map(guest, start, end - start,
+						 &hphys_addr, &avail_size,
+						 &reg_flags))) {
+			vmm_printf("Failed vmm_guest_physical_map\n");
+			return VMM_EFAIL;
+		}
+
+		if (!(reg_flags & VMM_REGION_ISRAM)) {
+			return VMM_EINVALID;
+		}
+
+		if (avail_size < (end - start)) {
+			return VMM_EINVALID;
+		}
+
+		va = vmm_host_memmap(hphys_addr, end - start,
+				     VMM_MEMORY_FLAGS_NORMAL);
+		if (!va) {
+			return VMM_ENOMEM;
+		}
+		vq->map_va[vq->map_count++] = va;
+
+		for (; i < j; i++) {
+			area[i]->hphys = hphys_addr + (area[i]->gphys - start);
+			area[i]->ptr = (void *)(va +
+				(virtual_addr_t)(area[i]->gphys - start));
+		}
+	}
+
+	return VMM_OK;
+}
+
+int virtio_queue_setup_rings(struct virtio_queue *vq,
+			     struct vmm_guest *guest,
+			     physical_addr_t desc_addr,
+			     physical_addr_t avail_addr,
+			     physical_addr_t used_addr,
+			     u32 desc_count, bool packed)
+{
+	int rc;
+	struct virtio_queue_area desc, avail, used;
+	struct virtio_queue_area *areas[VIRTIO_QUEUE_MAX_MAPS] =
+						{ &desc, &avail, &used };
 
 	if (!vq || !guest) {
 		return VMM_EFAIL;
@@ -230,41 +479,100 @@ int virtio_queue_setup(struct virtio_queue *vq,
 		return rc;
 	}
 
-	gphys_addr = guest_pfn * guest_page_size;
-	gphys_size = vring_size(desc_count, align);
-
-	if ((rc = vmm_guest_physical_map(guest, gphys_addr, gphys_size,
-					 &hphys_addr, &avail_size,
-					 &reg_flags))) {
-		vmm_printf("Failed vmm_guest_physical_map\n");
-		return VMM_EFAIL;
+	if (!desc_count) {
+		return VMM_OK;
 	}
 
-	if (!(reg_flags & VMM_REGION_ISRAM)) {
+	/* Split ring uses free running indexes so size must be power of 2
+	 * whereas packed ring positions and event offsets are 15-bit.
+	 */
+	if (packed) {
+		if (desc_count > (1 << VRING_PACKED_EVENT_F_WRAP_CTR)) {
+			return VMM_EINVALID;
+		}
+	} else if (desc_count & (desc_count - 1)) {
 		return VMM_EINVALID;
 	}
 
-	if (avail_size < gphys_size) {
-		return VMM_EINVALID;
+	desc.gphys = desc_addr;
+	avail.gphys = avail_addr;
+	used.gphys = used_addr;
+	if (packed) {
+		desc.size = sizeof(struct vring_packed_desc) * desc_count;
+		avail.size = sizeof(struct vring_packed_desc_event);
+		used.size = sizeof(struct vring_packed_desc_event);
+	} else {
+		desc.size = vring_desc_size(desc_count);
+		avail.size = vring_avail_size(desc_count);
+		used.size = vring_used_size(desc_count);
 	}
 
-	vq->addr = (void *)vmm_host_memmap(hphys_addr, gphys_size, 
-					   VMM_MEMORY_FLAGS_NORMAL);
-	if (!vq->addr) {
-		return VMM_ENOMEM;
+	rc = virtio_queue_map_areas(vq, guest, areas, VIRTIO_QUEUE_MAX_MAPS);
+	if (rc) {
+		virtio_queue_cleanup(vq);
+		return rc;
 	}
 
-	vring_init(&vq->vring, desc_count, vq->addr, align);
+	vq->vring.num = desc_count;
+	if (packed) {
+		vq->packed_pos = vmm_zalloc(2 * desc_count * sizeof(u16));
+		if (!vq->packed_pos) {
+			virtio_queue_cleanup(vq);
+			return VMM_ENOMEM;
+		}
+		vq->packed_num = &vq->packed_pos[desc_count];
+
+		vq->packed = TRUE;
+		vq->avail_wrap = TRUE;
+		vq->used_wrap = TRUE;
+		vq->signalled_wrap = TRUE;
+		vq->packed_desc = desc.ptr;
+		vq->driver_event = avail.ptr;
+		vq->device_event = used.ptr;
+		vq->device_event->flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+	} else {
+		vq->vring.desc = desc.ptr;
+		vq->vring.avail = avail.ptr;
+		vq->vring.used = used.ptr;
+	}
 
+	vq->addr = desc.ptr;
 	vq->guest = guest;
 	vq->desc_count = desc_count;
+
+	vq->guest_addr = desc_addr;
+	vq->host_addr = desc.hphys;
+	vq->total_size = desc.size + avail.size + used.size;
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(virtio_queue_setup_rings);
+
+int virtio_queue_setup(struct virtio_queue *vq,
+			struct vmm_guest *guest,
+			physical_addr_t guest_pfn,
+			physical_size_t guest_page_size,
+			u32 desc_count, u32 align)
+{
+	int rc;
+	physical_addr_t desc_addr, avail_addr, used_addr;
+
+	/* Legacy layout is same as computed by vring_init() */
+	desc_addr = guest_pfn * guest_page_size;
+	avail_addr = desc_addr + vring_desc_size(desc_count);
+	used_addr = (avail_addr + sizeof(u16) * (2 + desc_count) +
+		     align - 1) & ~((physical_addr_t)align - 1);
+
+	rc = virtio_queue_setup_rings(vq, guest, desc_addr, avail_addr,
+				      used_addr, desc_count, FALSE);
+	if (rc) {
+		return rc;
+	}
+
 	vq->align = align;
 	vq->guest_pfn = guest_pfn;
 	vq->guest_page_size = guest_page_size;
-
-	vq->guest_addr = gphys_addr;
-	vq->host_addr = hphys_addr;
-	vq->total_size = gphys_size;
+	vq->total_size = vring_size(desc_count, align);
 
 	return VMM_OK;
 }
@@ -288,51 +596,136 @@ static unsigned next_desc(struct vring_desc *desc, u32 i, u32 max)
 	return next;
 }
 
+static void virtio_queue_fill_iovec(struct virtio_iovec *iov,
+				    u64 addr, u32 len, u16 flags,
+				    u32 *ret_total_len)
+{
+	iov->addr = addr;
+	iov->len = len;
+
+	*ret_total_len += len;
+
+	if (flags & VRING_DESC_F_WRITE) {
+		iov->flags = 1;  /* Write */
+	} else {
+		iov->flags = 0; /* Read */
+	}
+}
+
+/*
+ * Indirect descriptor tables live in guest memory outside the ring so
+ * we read them one descriptor at a time. Split ring tables are chained
+ * using next field whereas packed ring tables are sequential.
+ */
+static u32 virtio_queue_indirect_iovec(struct virtio_queue *vq,
+				       u64 table, u32 table_len,
+				       struct virtio_iovec *iov, u32 i,
+				       u32 *ret_total_len)
+{
+	u32 idx = 0, max;
+	struct vring_desc d;
+	struct vring_packed_desc pd;
+
+	max = table_len / sizeof(struct vring_desc);
+
+	while ((idx < max) && (i < vq->desc_count)) {
+		if (vq->packed) {
+			if (vmm_guest_memory_read(vq->guest,
+					table + idx * sizeof(pd),
+					&pd, sizeof(pd), TRUE) != sizeof(pd)) {
+				break;
+			}
+			virtio_queue_fill_iovec(&iov[i++], pd.addr, pd.len,
+						pd.flags, ret_total_len);
+			idx++;
+		} else {
+			if (vmm_guest_memory_read(vq->guest,
+					table + idx * sizeof(d),
+					&d, sizeof(d), TRUE) != sizeof(d)) {
+				break;
+			}
+			virtio_queue_fill_iovec(&iov[i++], d.addr, d.len,
+						d.flags, ret_total_len);
+			idx = (d.flags & VRING_DESC_F_NEXT) ? d.next : max;
+		}
+	}
+
+	return i;
+}
+
+static u32 virtio_queue_packed_head_iovec(struct virtio_queue *vq, u16 head,
+					  struct virtio_iovec *iov,
+					  u32 *ret_total_len)
+{
+	u32 i = 0, n, num, pos, slot;
+	struct vring_packed_desc *desc;
+
+	slot = umod32(head, vq->desc_count);
+	pos = vq->packed_pos[slot];
+	num = vq->packed_num[slot];
+
+	for (n = 0; (n < num) && (i < vq->desc_count); n++) {
+		desc = &vq->packed_desc[pos];
+		if (desc->flags & VRING_DESC_F_INDIRECT) {
+			i = virtio_queue_indirect_iovec(vq, desc->addr,
+						desc->len, iov, i,
+						ret_total_len);
+		} else {
+			virtio_queue_fill_iovec(&iov[i++], desc->addr,
+						desc->len, desc->flags,
+						ret_total_len);
+		}
+		if (++pos >= vq->desc_count) {
+			pos = 0;
+		}
+	}
+
+	return i;
+}
+
 u16 virtio_queue_get_head_iovec(struct virtio_queue *vq,
 				u16 head, struct virtio_iovec *iov,
 				u32 *ret_iov_cnt, u32 *ret_total_len)
 {
-	int i;
+	u32 i;
 	u16 idx, max;
 	struct vring_desc *desc;
 
+	*ret_iov_cnt = 0;
+	*ret_total_len = 0;
+
 	if (!vq || !vq->addr) {
-		*ret_iov_cnt = 0;
-		*ret_total_len = 0;
 		return 0;
 	}
 
-	idx = head;
+	if (vq->packed) {
+		*ret_iov_cnt = virtio_queue_packed_head_iovec(vq, head, iov,
+							      ret_total_len);
+		return head;
+	}
 
-	*ret_iov_cnt = 0;
-	*ret_total_len = 0;
+	idx = head;
 	max = vq->vring.num;
 	desc = vq->vring.desc;
 
+	if (max <= idx) {
+		return head;
+	}
+
 	if (desc[idx].flags & VRING_DESC_F_INDIRECT) {
-#if 0
-		max = desc[idx].len / sizeof(struct vring_desc);
-		desc = guest_flat_to_host(kvm, desc[idx].addr);
-		idx = 0;
-#endif
+		*ret_iov_cnt = virtio_queue_indirect_iovec(vq, desc[idx].addr,
+							   desc[idx].len, iov,
+							   0, ret_total_len);
+		return head;
 	}
 
 	i = 0;
 	do {
-		iov[i].addr = desc[idx].addr;
-		iov[i].len = desc[idx].len;
-
-		*ret_total_len += desc[idx].len;
-
-		if (desc[idx].flags & VRING_DESC_F_WRITE) {
-			iov[i].flags = 1;  /* Write */
-		} else {
-			iov[i].flags = 0; /* Read */
-		}
-
+		virtio_queue_fill_iovec(&iov[i], desc[idx].addr,
+					desc[idx].len, desc[idx].flags,
+					ret_total_len);
 		i++;
-
-	} while ((idx = next_desc(desc, idx, max)) != max);
+	} while ((i < max) && ((idx = next_desc(desc, idx, max)) < max));
 
 	*ret_iov_cnt = i;
 
@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file rculist.h
+ * @author agent (agent@local)
+ * @brief RCU-protected variants of common list handling.
+ *
+ * The source has been largely adapted from Linux 3.x or higher:
+ * include/linux/rculist.h
+ *
+ * The original code is licensed under the GPL.
+ */
+
+#ifndef __RCULIST_H__
+#define __RCULIST_H__
+
+#include <vmm_rcu.h>
+#include <libs/list.h>
+
+/*
+ * Updaters of RCU-protected lists must still serialize among
+ * themselves (using spinlock or mutex) whereas readers only need
+ * to be within vmm_rcu_read_lock() and vmm_rcu_read_unlock().
+ *
+ * An entry removed using list_del_rcu() or hlist_del_rcu() can
+ * only be freed (or re-used) after a grace period, which means
+ * after vmm_synchronize_rcu() returns or from callback passed to
+ * vmm_call_rcu().
+ */
+
+#define list_next_rcu(list)	(*((struct dlist **)(&(list)->next)))
+
+static inline void __list_add_rcu(struct dlist *new,
+				  struct dlist *prev,
+				  struct dlist *next)
+{
+	new->next = next;
+	new->prev = prev;
+	vmm_rcu_assign_pointer(list_next_rcu(prev), new);
+	next->prev = new;
+}
+
+/**
+ * Adds the new node after the given head for RCU-protected list.
+ * @param new: New node that needs to be added to list.
+ * @param head: List head after which the "new" node should be added.
+ */
+static inline void list_add_rcu(struct dlist *new, struct dlist *head)
+{
+	__list_add_rcu(new, head, head->next);
+}
+
+/**
+ * Adds a node at the tail of RCU-protected list.
+ * @param new: The new node to be added before tail.
+ * @param head: The list head.
+ */
+static inline void list_add_tail_rcu(struct dlist *new, struct dlist *head)
+{
+	__list_add_rcu(new, head->prev, head);
+}
+
+/**
+ * Deletes a given node from RCU-protected list.
+ * @param entry: Node to be deleted.
+ * @note The next pointer of deleted node is left intact so that
+ * readers currently traversing the node can move forward.
+ */
+static inline void list_del_rcu(struct dlist *entry)
+{
+	__list_del(entry->prev, entry->next);
+	entry->prev = (void *)LIST_POISON_PREV;
+}
+
+/**
+ * Replace old entry by new one in RCU-protected list.
+ * @param old: The element to be replaced.
+ * @param new: The new element to insert.
+ */
+static inline void list_replace_rcu(struct dlist *old, struct dlist *new)
+{
+	new->next = old->next;
+	new->prev = old->prev;
+	vmm_rcu_assign_pointer(list_next_rcu(new->prev), new);
+	new->next->prev = new;
+	old->prev = (void *)LIST_POISON_PREV;
+}
+
+/**
+ * Gets the struct containing given RCU-protected list node.
+ * @param ptr: Pointer to node (struct dlist) embedded in the struct.
+ * @param type: Type of the struct the node is embedded in.
+ * @param member: Name of the node member within the struct.
+ */
+#define list_entry_rcu(ptr, type, member) \
+	container_of(vmm_rcu_dereference(ptr), type, member)
+
+/**
+ * Gets the struct containing first node of RCU-protected list.
+ * @param ptr: List head to take the first node from.
+ * @param type: Type of the struct the node is embedded in.
+ * @param member: Name of the node member within the struct.
+ * @note Returns NULL if the list is empty.
+ */
+#define list_first_or_null_rcu(ptr, type, member) \
+({ \
+	struct dlist *__ptr = (ptr); \
+	struct dlist *__next = vmm_rcu_dereference(__ptr->next); \
+	(__ptr != __next) ? list_entry(__next, type, member) : NULL; \
+})
+
+/**
+ * Iterates over structs of RCU-protected list.
+ * @param pos: Pointer to struct used as loop cursor.
+ * @param head: List head to iterate over.
+ * @param member: Name of the node member within the struct.
+ * @note Must be used within vmm_rcu_read_lock() section.
+ */
+#define list_for_each_entry_rcu(pos, head, member) \
+	for (pos = list_entry_rcu((head)->next, typeof(*pos), member); \
+	     &pos->member != (head); \
+	     pos = list_entry_rcu(pos->member.next, typeof(*pos), member))
+
+#define hlist_first_rcu(head)	(*((struct hlist_node **)(&(head)->first)))
+#define hlist_next_rcu(node)	(*((struct hlist_node **)(&(node)->next)))
+
+/**
+ * Adds the new node at head of RCU-protected hlist.
+ * @param n: New node that needs to be added to hlist.
+ * @param h: The hlist head.
+ */
+static inline void hlist_add_head_rcu(struct hlist_node *n,
+				      struct hlist_head *h)
+{
+	struct hlist_node *first = h->first;
+
+	n->next = first;
+	n->pprev = &h->first;
+	vmm_rcu_assign_pointer(hlist_first_rcu(h), n);
+	if (first) {
+		first->pprev = &n->next;
+	}
+}
+
+/**
+ * Deletes a given node from RCU-protected hlist.
+ * @param n: Node to be deleted.
+ * @note The next pointer of deleted node is left intact so that
+ * readers currently traversing the node can move forward.
+ */
+static inline void hlist_del_rcu(struct hlist_node *n)
+{
+	__hlist_del(n);
+	n->pprev = LIST_POISON2;
+}
+
+/**
+ * Iterates over structs of RCU-protected hlist.
+ * @param pos: Pointer to struct used as loop cursor.
+ * @param head: Hlist head to iterate over.
+ * @param member: Name of the hlist node member within the struct.
+ * @note Must be used within vmm_rcu_read_lock() section.
+ */
+#define hlist_for_each_entry_rcu(pos, head, member) \
+	for (pos = hlist_entry_safe(vmm_rcu_dereference(hlist_first_rcu(head)),\
+				    typeof(*(pos)), member); \
+	     pos; \
+	     pos = hlist_entry_safe(vmm_rcu_dereference(hlist_next_rcu( \
+				    &(pos)->member)), typeof(*(pos)), member))
+
+#endif /* __RCULIST_H__ */
@@ -50,6 +50,7 @@ int vscreen_bind(bool is_hard,
 		 struct vmm_vkeyboard *vkbd,
 		 struct vmm_vmouse *vmou);
 
+/** Unbind most recent virtual screen capturing on frame buffer device */
 int vscreen_unbind(struct fb_info *info);
 
 /** Software emulated virtual screen capturing on frame buffer device */
@@ -30,6 +30,8 @@
 #include <vmm_completion.h>
 #include <vmm_threads.h>
 #include <vmm_workqueue.h>
+#include <vmm_timer.h>
+#include <vmm_host_aspace.h>
 #include <arch_atomic.h>
 #include <vio/vmm_keymaps.h>
 #include <libs/list.h>
@@ -74,6 +76,12 @@ struct vscreen_work {
 	u32 type;
 };
 
+#define VSCREEN_SOFT_MAX_DAMAGE		8
+
+struct vscreen_rect {
+	int x, y, w, h;
+};
+
 struct vscreen_context {
 	/* Parameters */
 	bool is_hard;
@@ -109,6 +117,15 @@ struct vscreen_context {
 	struct fb_var_screeninfo hard_var;
 	physical_addr_t hard_smem_start;
 	u32 hard_smem_len;
+	/* Soft bind state */
+	vmm_spinlock_t soft_lock;
+	struct vmm_surface *soft_sf;
+	struct vmm_pixelformat soft_pf;
+	bool soft_direct;
+	bool soft_resize;
+	u32 soft_damage_count;
+	struct vscreen_rect soft_damage[VSCREEN_SOFT_MAX_DAMAGE];
+	u32 soft_rate;
 	/* Work queue */
 	u64 work_timeout;
 	vmm_spinlock_t work_list_lock;
@@ -749,22 +766,417 @@ done:
 	return VMM_OK;
 }
 
+static void __vscreen_soft_damage_full(struct vscreen_context *cntx)
+{
+	cntx->soft_damage_count = 0;
+	if (cntx->soft_sf) {
+		cntx->soft_damage[0].x = 0;
+		cntx->soft_damage[0].y = 0;
+		cntx->soft_damage[0].w = vmm_surface_width(cntx->soft_sf);
+		cntx->soft_damage[0].h = vmm_surface_height(cntx->soft_sf);
+		cntx->soft_damage_count = 1;
+	}
+}
+
+static void vscreen_soft_damage_full(struct vscreen_context *cntx)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	__vscreen_soft_damage_full(cntx);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static bool vscreen_rect_touch(const struct vscreen_rect *a,
+			       const struct vscreen_rect *b)
+{
+	return (a->x <= (b->x + b->w)) && (b->x <= (a->x + a->w)) &&
+	       (a->y <= (b->y + b->h)) && (b->y <= (a->y + a->h));
+}
+
+static void vscreen_rect_union(struct vscreen_rect *r,
+			       const struct vscreen_rect *a)
+{
+	int x2 = max(r->x + r->w, a->x + a->w);
+	int y2 = max(r->y + r->h, a->y + a->h);
+
+	r->x = min(r->x, a->x);
+	r->y = min(r->y, a->y);
+	r->w = x2 - r->x;
+	r->h = y2 - r->y;
+}
+
+/* Note: This function must be called with soft_lock held */
+static void __vscreen_soft_damage_add(struct vscreen_context *cntx,
+				      struct vmm_surface *s,
+				      int x, int y, int w, int h)
+{
+	u32 i, best;
+	u64 area, best_area;
+	struct vscreen_rect r, t;
+
+	/* Clip damage rectangle to surface */
+	r.x = max(x, 0);
+	r.y = max(y, 0);
+	r.w = min(x + w, vmm_surface_width(s)) - r.x;
+	r.h = min(y + h, vmm_surface_height(s)) - r.y;
+	if ((r.w <= 0) || (r.h <= 0)) {
+		return;
+	}
+
+	/* Merge with overlapping or adjacent damage rectangle */
+	for (i = 0; i < cntx->soft_damage_count; i++) {
+		if (vscreen_rect_touch(&cntx->soft_damage[i], &r)) {
+			vscreen_rect_union(&cntx->soft_damage[i], &r);
+			return;
+		}
+	}
+
+	/* Use free slot if available */
+	if (cntx->soft_damage_count < VSCREEN_SOFT_MAX_DAMAGE) {
+		cntx->soft_damage[cntx->soft_damage_count++] = r;
+		return;
+	}
+
+	/* Otherwise, merge with rectangle which grows the least */
+	best = 0;
+	best_area = ~0ULL;
+	for (i = 0; i < cntx->soft_damage_count; i++) {
+		t = cntx->soft_damage[i];
+		vscreen_rect_union(&t, &r);
+		area = (u64)t.w * t.h - (u64)cntx->soft_damage[i].w *
+					cntx->soft_damage[i].h;
+		if (area < best_area) {
+			best = i;
+			best_area = area;
+		}
+	}
+	vscreen_rect_union(&cntx->soft_damage[best], &r);
+}
+
+static void vscreen_surface_refresh(struct vmm_surface *s)
+{
+	irq_flags_t flags;
+	struct vscreen_context *cntx = vmm_surface_priv(s);
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	__vscreen_soft_damage_full(cntx);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static void vscreen_surface_gfx_clear(struct vmm_surface *s)
+{
+	irq_flags_t flags;
+	struct vscreen_context *cntx = vmm_surface_priv(s);
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	__vscreen_soft_damage_full(cntx);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static void vscreen_surface_gfx_update(struct vmm_surface *s,
+				       int x, int y, int w, int h)
+{
+	irq_flags_t flags;
+	struct vscreen_context *cntx = vmm_surface_priv(s);
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	__vscreen_soft_damage_add(cntx, s, x, y, w, h);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static void vscreen_surface_gfx_resize(struct vmm_surface *s, int w, int h)
+{
+	irq_flags_t flags;
+	struct vscreen_context *cntx = vmm_surface_priv(s);
+
+	/* Shadow surface is re-created by next soft refresh */
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	cntx->soft_resize = TRUE;
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static void vscreen_surface_gfx_copy(struct vmm_surface *s,
+				     int src_x, int src_y,
+				     int dst_x, int dst_y,
+				     int w, int h)
+{
+	irq_flags_t flags;
+	struct vscreen_context *cntx = vmm_surface_priv(s);
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	__vscreen_soft_damage_add(cntx, s, dst_x, dst_y, w, h);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+}
+
+static const struct vmm_surface_ops vscreen_surface_ops = {
+	.refresh = vscreen_surface_refresh,
+	.gfx_clear = vscreen_surface_gfx_clear,
+	.gfx_update = vscreen_surface_gfx_update,
+	.gfx_resize = vscreen_surface_gfx_resize,
+	.gfx_copy = vscreen_surface_gfx_copy,
+};
+
+static void vscreen_soft_surface_cleanup(struct vscreen_context *cntx,
+					 struct vmm_vdisplay *vdis)
+{
+	u32 size;
+	void *data;
+	irq_flags_t flags;
+	struct vmm_surface *sf = cntx->soft_sf;
+
+	if (!sf) {
+		return;
+	}
+
+	/* Once deleted, vdisplay won't call surface operations */
+	if (vdis) {
+		vmm_vdisplay_del_surface(vdis, sf);
+	}
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	cntx->soft_sf = NULL;
+	cntx->soft_damage_count = 0;
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+
+	data = vmm_surface_data(sf);
+	size = sf->data_size;
+	vmm_surface_free(sf);
+	vmm_host_free_pages((virtual_addr_t)data, VMM_SIZE_TO_PAGE(size));
+}
+
+static int vscreen_soft_surface_setup(struct vscreen_context *cntx,
+				      struct vmm_vdisplay *vdis,
+				      u32 rows, u32 cols)
+{
+	int rc;
+	u32 size;
+	virtual_addr_t va;
+	irq_flags_t flags;
+	struct vmm_surface *sf;
+
+	/* Remove old shadow surface */
+	vscreen_soft_surface_cleanup(cntx, vdis);
+
+	/* Shadow surface has same geometry as virtual display
+	 * because display emulators assume row pitch based on
+	 * their own resolution.
+	 */
+	size = rows * cols * cntx->soft_pf.bytes_per_pixel;
+	va = vmm_host_alloc_pages(VMM_SIZE_TO_PAGE(size),
+				  VMM_MEMORY_FLAGS_NORMAL);
+	if (!va) {
+		return VMM_ENOMEM;
+	}
+
+	sf = vmm_surface_alloc(cntx->name, (void *)va, size, rows, cols, 0,
+			       &cntx->soft_pf, &vscreen_surface_ops, cntx);
+	if (!sf) {
+		vmm_host_free_pages(va, VMM_SIZE_TO_PAGE(size));
+		return VMM_ENOMEM;
+	}
+
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	cntx->soft_sf = sf;
+	cntx->soft_resize = FALSE;
+	__vscreen_soft_damage_full(cntx);
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+
+	rc = vmm_vdisplay_add_surface(vdis, sf);
+	if (rc) {
+		vscreen_soft_surface_cleanup(cntx, NULL);
+		return rc;
+	}
+
+	/* Erase display area not covered by new surface */
+	vscreen_blank_display(cntx);
+
+	return VMM_OK;
+}
+
+static u32 vscreen_soft_scale(u32 c, u32 from_bits, u32 to_bits)
+{
+	if (from_bits < to_bits) {
+		return c << (to_bits - from_bits);
+	}
+
+	return c >> (from_bits - to_bits);
+}
+
+static void vscreen_soft_convert_line(struct vscreen_context *cntx,
+				      u8 *dst, const u8 *src, int width)
+{
+	u32 p, r, g, b;
+	struct vmm_pixelformat *pf = &cntx->soft_pf;
+	struct fb_var_screeninfo *var = &cntx->info->var;
+
+	while (width > 0) {
+		switch (pf->bytes_per_pixel) {
+		case 2:
+			p = *(const u16 *)src;
+			break;
+		case 3:
+			p = src[0] | (src[1] << 8) | (src[2] << 16);
+			break;
+		default:
+			p = *(const u32 *)src;
+			break;
+		};
+		src += pf->bytes_per_pixel;
+
+		r = vscreen_soft_scale((p & pf->rmask) >> pf->rshift,
+				       pf->rbits, var->red.length);
+		g = vscreen_soft_scale((p & pf->gmask) >> pf->gshift,
+				       pf->gbits, var->green.length);
+		b = vscreen_soft_scale((p & pf->bmask) >> pf->bshift,
+				       pf->bbits, var->blue.length);
+		p = (r << var->red.offset) |
+		    (g << var->green.offset) |
+		    (b << var->blue.offset);
+
+		switch (var->bits_per_pixel) {
+		case 16:
+			*(u16 *)dst = p;
+			dst += 2;
+			break;
+		case 24:
+			dst[0] = p & 0xff;
+			dst[1] = (p >> 8) & 0xff;
+			dst[2] = (p >> 16) & 0xff;
+			dst += 3;
+			break;
+		default:
+			*(u32 *)dst = p;
+			dst += 4;
+			break;
+		};
+
+		width--;
+	}
+}
+
+static void vscreen_soft_composite(struct vscreen_context *cntx,
+				   struct vmm_surface *sf,
+				   struct vscreen_rect *r)
+{
+	int x1, y1, x2, y2, i;
+	u32 src_bpp, dst_bpp, line_length;
+	u8 *src, *dst;
+	struct fb_info *info = cntx->info;
+
+	/* Clip damage rectangle to visible area of frame buffer */
+	x1 = max(r->x, 0);
+	y1 = max(r->y, 0);
+	x2 = min(r->x + r->w, min(vmm_surface_width(sf),
+				  (int)info->var.xres));
+	y2 = min(r->y + r->h, min(vmm_surface_height(sf),
+				  (int)info->var.yres));
+	if ((x2 <= x1) || (y2 <= y1)) {
+		return;
+	}
+
+	src_bpp = vmm_surface_bytes_per_pixel(sf);
+	dst_bpp = DIV_ROUND_UP(info->var.bits_per_pixel, 8);
+	line_length = info->fix.line_length;
+
+	src = (u8 *)vmm_surface_data(sf) +
+		y1 * vmm_surface_stride(sf) + x1 * src_bpp;
+	dst = (u8 *)info->screen_base + y1 * line_length + x1 * dst_bpp;
+	for (i = y1; i < y2; i++) {
+		if (cntx->soft_direct) {
+			memcpy(dst, src, (x2 - x1) * src_bpp);
+		} else {
+			vscreen_soft_convert_line(cntx, dst, src, x2 - x1);
+		}
+		src += vmm_surface_stride(sf);
+		dst += line_length;
+	}
+}
+
 static int vscreen_soft_refresh(struct vscreen_context *cntx)
 {
+	int rc;
+	bool resize;
+	u32 i, count, rows, cols;
+	u64 tstamp, timeout;
+	irq_flags_t flags;
+	physical_addr_t pa;
+	struct vmm_pixelformat pf;
+	struct vmm_surface *sf;
+	struct vmm_vdisplay *vdis = cntx->vdis;
+	struct vscreen_rect damage[VSCREEN_SOFT_MAX_DAMAGE];
+
 	/* Do nothing if freezed */
 	if (cntx->freeze) {
 		return VMM_OK;
 	}
 
 	/* Do nothing if vdisplay is NULL */
-	if (!cntx->vdis) {
+	if (!vdis) {
 		return VMM_OK;
 	}
 
-	/* TODO: work in progress */
-	vmm_printf("%s: not available\n", __func__);
+	tstamp = vmm_timer_timestamp();
+
+	/* Try to get current geometry of virtual display */
+	rc = vmm_vdisplay_get_pixeldata(vdis, &pf, &rows, &cols, &pa);
+	if (rc || !rows || !cols) {
+		count = 0;
+		goto update_rate;
+	}
+
+	/* Re-create shadow surface if geometry changed */
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	sf = cntx->soft_sf;
+	resize = cntx->soft_resize;
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
+	if (!sf || resize ||
+	    (vmm_surface_width(sf) != cols) ||
+	    (vmm_surface_height(sf) != rows)) {
+		rc = vscreen_soft_surface_setup(cntx, vdis, rows, cols);
+		if (rc) {
+			vmm_printf("%s: %s: surface setup failed error %d\n",
+				   __func__, cntx->name, rc);
+			return rc;
+		}
+		sf = cntx->soft_sf;
+	}
+
+	/* Let virtual display update shadow surface */
+	vmm_vdisplay_one_update(vdis, sf);
+
+	/* Take damage rectangles accumulated so far */
+	vmm_spin_lock_irqsave(&cntx->soft_lock, flags);
+	count = cntx->soft_damage_count;
+	for (i = 0; i < count; i++) {
+		damage[i] = cntx->soft_damage[i];
+	}
+	cntx->soft_damage_count = 0;
+	vmm_spin_unlock_irqrestore(&cntx->soft_lock, flags);
 
-	return VMM_EFAIL;
+	/* Composite only damaged areas to frame buffer */
+	for (i = 0; i < count; i++) {
+		vscreen_soft_composite(cntx, sf, &damage[i]);
+	}
+
+update_rate:
+	tstamp = vmm_timer_timestamp() - tstamp;
+
+	/* Refresh at requested rate when virtual display is changing
+	 * and gradually back-off to minimum rate when it is idle.
+	 */
+	if (count) {
+		cntx->soft_rate = cntx->refresh_rate;
+	} else {
+		cntx->soft_rate = max(cntx->soft_rate >> 1,
+				      (u32)VSCREEN_REFRESH_RATE_MIN);
+	}
+
+	/* Don't spend more than half of the time in refreshing */
+	timeout = udiv64(1000000000ULL, cntx->soft_rate);
+	cntx->work_timeout = max(timeout, tstamp << 1);
+
+	return VMM_OK;
 }
 
 static void vscreen_hard_switch_back(struct vscreen_context *cntx)
@@ -995,6 +1407,9 @@ static void vscreen_restore(struct fb_info *info, void *priv)
 	/* Erase display */
 	vscreen_blank_display(cntx);
 
+	/* Redraw complete shadow surface for soft bind */
+	vscreen_soft_damage_full(cntx);
+
 	/* Connect input handler */
 	input_connect_handler(&cntx->hndl);
 
@@ -1072,6 +1487,51 @@ static void vscreen_process(struct vscreen_context *cntx)
 	vmm_spin_unlock_irqrestore(&cntx->work_list_lock, flags);
 }
 
+static int vscreen_soft_setup(struct vscreen_context *cntx)
+{
+	u32 bpp;
+	struct vmm_pixelformat *pf = &cntx->soft_pf;
+	struct fb_var_screeninfo *var = &cntx->info->var;
+
+	INIT_SPIN_LOCK(&cntx->soft_lock);
+	cntx->soft_sf = NULL;
+	cntx->soft_resize = FALSE;
+	cntx->soft_damage_count = 0;
+	cntx->soft_rate = cntx->refresh_rate;
+
+	/* Nothing more to do for hard bind */
+	if (cntx->is_hard) {
+		return VMM_OK;
+	}
+
+	/* Shadow surface pixel format closest to frame buffer */
+	switch (var->bits_per_pixel) {
+	case 16:
+		bpp = (var->green.length == 5) ? 15 : 16;
+		break;
+	case 24:
+	case 32:
+		bpp = var->bits_per_pixel;
+		break;
+	default:
+		vmm_printf("%s: %s: unsupported bits_per_pixel=%d\n",
+			   __func__, cntx->name, var->bits_per_pixel);
+		return VMM_ENOTSUPP;
+	};
+	vmm_pixelformat_init_default(pf, bpp);
+
+	/* Damaged areas can be copied as-is if formats match */
+	cntx->soft_direct = (pf->bits_per_pixel == var->bits_per_pixel) &&
+			    (pf->rshift == var->red.offset) &&
+			    (pf->rbits == var->red.length) &&
+			    (pf->gshift == var->green.offset) &&
+			    (pf->gbits == var->green.length) &&
+			    (pf->bshift == var->blue.offset) &&
+			    (pf->bbits == var->blue.length);
+
+	return VMM_OK;
+}
+
 static int vscreen_setup(struct vscreen_context *cntx)
 {
 	int rc;
@@ -1195,6 +1655,12 @@ static int vscreen_setup(struct vscreen_context *cntx)
 	/* Make sure hard bind state is off */
 	cntx->hard_vdis = FALSE;
 
+	/* Setup soft bind state */
+	rc = vscreen_soft_setup(cntx);
+	if (rc) {
+		goto dealloc_cmap;
+	}
+
 	/* Setup work queue */
 	cntx->work_timeout = udiv64(1000000000ULL, cntx->refresh_rate);
 	INIT_SPIN_LOCK(&cntx->work_list_lock);
@@ -1240,6 +1706,9 @@ static int vscreen_cleanup(struct vscreen_context *cntx)
 	/* Switch back to original settings for hard bind */
 	vscreen_hard_switch_back(cntx);
 
+	/* Remove shadow surface for soft bind */
+	vscreen_soft_surface_cleanup(cntx, cntx->vdis);
+
 	/* Unregister vinput notifier client */
 	vmm_vinput_unregister_client(&cntx->vinp_client);
 
@@ -1356,8 +1825,12 @@ int vscreen_bind(bool is_hard,
 		return VMM_EINVALID;
 	}
 
-	/* Ensure this framebuffer is not already binded */
-	if (NULL != vscreen_fb_info_find(info)) {
+	/* Hard bind owns the framebuffer whereas several soft binds
+	 * can share it because fb_open() saves the previous user and
+	 * fb_release() restores it.
+	 */
+	velt = vscreen_fb_info_find(info);
+	if (velt && (is_hard || velt->cntx->is_hard)) {
 		return VMM_EALREADY;
 	}
 
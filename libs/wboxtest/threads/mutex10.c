@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file mutex10.c
+ * @author agent (agent@local)
+ * @brief mutex10 test implementation
+ *
+ * This tests priority inheritance of a mutex. Three threads are
+ * created on the same host CPU:
+ *
+ * Thread 0: x-1 priority (high)
+ * Thread 1: x-2 priority (medium)
+ * Thread 2: x-3 priority (low)
+ *
+ * The low priority thread takes the mutex and sleeps for a while
+ * holding it. Meanwhile, the medium priority thread starts burning
+ * CPU without sleeping and the high priority thread blocks on the
+ * mutex. Without priority inheritance the low priority thread never
+ * gets CPU to release the mutex until the medium priority thread is
+ * done. With priority inheritance the low priority thread runs at
+ * high priority so the high priority thread gets the mutex while
+ * the medium priority thread is still running.
+ *
+ * We also check that low priority thread gets back its priority
+ * after releasing the mutex.
+ */
+
+#include <vmm_error.h>
+#include <vmm_delay.h>
+#include <vmm_mutex.h>
+#include <vmm_smp.h>
+#include <vmm_stdio.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"mutex10 test"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			mutex10_init
+#define MODULE_EXIT			mutex10_exit
+
+/* Number of threads */
+#define NUM_THREADS			3
+
+/* Sleep delay in milliseconds */
+#define SLEEP_MSECS			(VMM_THREAD_DEF_TIME_SLICE/1000000ULL)
+
+/* Global data */
+static struct vmm_thread *workers[NUM_THREADS];
+static DEFINE_MUTEX(pi_mutex);
+static volatile int low_locked;
+static volatile int low_boosted;
+static volatile int low_priority_after;
+static volatile int high_locked;
+static volatile int high_locked_first;
+static volatile int medium_stop;
+static volatile int medium_done;
+
+static int mutex10_high_thread_main(void *data)
+{
+	/* Acquire mutex held by low priority thread */
+	vmm_mutex_lock(&pi_mutex);
+
+	/*
+	 * Medium priority thread should still be running
+	 * if low priority thread inherited our priority.
+	 */
+	high_locked_first = (medium_done) ? 0 : 1;
+	high_locked = 1;
+
+	/* Release mutex */
+	vmm_mutex_unlock(&pi_mutex);
+
+	return 0;
+}
+
+static int mutex10_medium_thread_main(void *data)
+{
+	u32 i;
+
+	/* Burn CPU without sleeping for a bounded time */
+	for (i = 0; (i < (SLEEP_MSECS * 100 * 1000)) && !medium_stop; i++) {
+		vmm_udelay(1);
+	}
+
+	medium_done = 1;
+
+	return 0;
+}
+
+static int mutex10_low_thread_main(void *data)
+{
+	u8 base_priority = vmm_scheduler_current_priority();
+
+	/* Acquire mutex */
+	vmm_mutex_lock(&pi_mutex);
+	low_locked = 1;
+
+	/* Hold mutex for a while */
+	vmm_msleep(SLEEP_MSECS*4);
+
+	/* We should be running with inherited priority */
+	low_boosted = (base_priority < vmm_scheduler_current_priority()) ?
+								1 : 0;
+
+	/* Release mutex */
+	vmm_mutex_unlock(&pi_mutex);
+
+	/* We should be back to our own priority */
+	low_priority_after = vmm_scheduler_current_priority();
+
+	return 0;
+}
+
+static int mutex10_do_test(struct vmm_chardev *cdev, u8 low_priority)
+{
+	int failures = 0;
+
+	/* Initialise global data */
+	low_locked = 0;
+	low_boosted = 0;
+	low_priority_after = 0;
+	high_locked = 0;
+	high_locked_first = 0;
+	medium_stop = 0;
+	medium_done = 0;
+
+	/* Start low priority worker and let it take the mutex */
+	vmm_threads_start(workers[2]);
+	vmm_msleep(SLEEP_MSECS);
+	if (!low_locked) {
+		vmm_cprintf(cdev, "error: low priority thread not locked\n");
+		failures++;
+	}
+
+	/* Start medium and high priority workers */
+	vmm_threads_start(workers[1]);
+	vmm_threads_start(workers[0]);
+
+	/* Give low priority thread enough time to release mutex */
+	vmm_msleep(SLEEP_MSECS*40);
+
+	/* Stop medium priority thread */
+	medium_stop = 1;
+	vmm_msleep(SLEEP_MSECS*4);
+
+	/* Check results */
+	if (!high_locked) {
+		vmm_cprintf(cdev, "error: high priority thread not locked\n");
+		failures++;
+	} else if (!high_locked_first) {
+		vmm_cprintf(cdev, "error: priority inversion not avoided\n");
+		failures++;
+	}
+	if (!low_boosted) {
+		vmm_cprintf(cdev, "error: low priority thread not boosted\n");
+		failures++;
+	}
+	if (low_priority_after != low_priority) {
+		vmm_cprintf(cdev, "error: low priority thread priority %d "
+			    "instead of %d after unlock\n",
+			    low_priority_after, low_priority);
+		failures++;
+	}
+
+	/* Stop workers */
+	vmm_threads_stop(workers[2]);
+	vmm_threads_stop(workers[1]);
+	vmm_threads_stop(workers[0]);
+
+	return (failures) ? VMM_EFAIL : 0;
+}
+
+static int mutex10_run(struct wboxtest *test, struct vmm_chardev *cdev,
+		       u32 test_hcpu)
+{
+	int i, ret = VMM_OK;
+	char wname[VMM_FIELD_NAME_SIZE];
+	u8 current_priority = vmm_scheduler_current_priority();
+	const struct vmm_cpumask *cpu_mask = vmm_cpumask_of(test_hcpu);
+	int (*thread_main[NUM_THREADS])(void *) = {
+		mutex10_high_thread_main,
+		mutex10_medium_thread_main,
+		mutex10_low_thread_main,
+	};
+
+	/* Ensure we have sufficiently higher priority */
+	if ((current_priority - VMM_THREAD_MIN_PRIORITY) <= NUM_THREADS) {
+		vmm_cprintf(cdev, "Current priority %d non-sufficient to "
+			    "create %d threads of lower priority\n",
+			    (unsigned int)current_priority, NUM_THREADS);
+		return VMM_EINVALID;
+	}
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+
+	/* Create worker threads */
+	for (i = 0; i < NUM_THREADS; i++) {
+		vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+			     "mutex10_worker%d", i);
+		workers[i] = vmm_threads_create(wname,
+						thread_main[i],
+						(void *)(unsigned long)i,
+						current_priority - 1 - i,
+						VMM_THREAD_DEF_TIME_SLICE);
+		if (workers[i] == NULL) {
+			ret = VMM_EFAIL;
+			goto destroy_workers;
+		}
+		vmm_threads_set_affinity(workers[i], cpu_mask);
+	}
+
+	/* Do the test */
+	ret = mutex10_do_test(cdev, current_priority - NUM_THREADS);
+
+	/* Destroy worker threads */
+destroy_workers:
+	for (i = 0; i < NUM_THREADS; i++) {
+		if (workers[i]) {
+			vmm_threads_destroy(workers[i]);
+			workers[i] = NULL;
+		}
+	}
+
+	return ret;
+}
+
+static struct wboxtest mutex10 = {
+	.name = "mutex10",
+	.run = mutex10_run,
+};
+
+static int __init mutex10_init(void)
+{
+	return wboxtest_register("threads", &mutex10);
+}
+
+static void __exit mutex10_exit(void)
+{
+	wboxtest_unregister(&mutex10);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file mutex11.c
+ * @author agent (agent@local)
+ * @brief mutex11 test implementation
+ *
+ * This tests statistics and adaptive spinning of a mutex.
+ *
+ * First, the main thread locks and unlocks the mutex few times
+ * without contention and checks lock count and hold time.
+ *
+ * Next, a worker thread on the same host CPU blocks on the mutex
+ * held by main thread. The test checks that contention and wait
+ * time are recorded.
+ *
+ * Finally, if more than one host CPU is online, a worker thread on
+ * some other host CPU tries to lock the mutex while main thread is
+ * holding it without sleeping. The worker should get the mutex by
+ * spinning at least once.
+ */
+
+#include <vmm_error.h>
+#include <vmm_delay.h>
+#include <vmm_mutex.h>
+#include <vmm_smp.h>
+#include <vmm_stdio.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"mutex11 test"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			mutex11_init
+#define MODULE_EXIT			mutex11_exit
+
+/* Number of uncontended and spinning iterations */
+#define NUM_LOOPS			10
+
+/* Sleep delay in milliseconds */
+#define SLEEP_MSECS			(VMM_THREAD_DEF_TIME_SLICE/1000000ULL)
+
+/* Mutex hold time in microseconds while worker spins */
+#define SPIN_HOLD_USECS			((CONFIG_MUTEX_SPIN_NSECS / 2000) + 1)
+
+/* Global data */
+static struct vmm_thread *worker;
+static struct vmm_mutex mutex1;
+static volatile int worker_go;
+static volatile int worker_count;
+
+static int mutex11_block_thread_main(void *data)
+{
+	/* Block on mutex held by main thread */
+	vmm_mutex_lock(&mutex1);
+	worker_count++;
+	vmm_mutex_unlock(&mutex1);
+
+	return 0;
+}
+
+static int mutex11_spin_thread_main(void *data)
+{
+	int i;
+
+	for (i = 0; i < NUM_LOOPS; i++) {
+		/* Wait for main thread to lock the mutex */
+		while (worker_go <= i) {
+			vmm_udelay(1);
+		}
+
+		/* Main thread is holding mutex without sleeping */
+		vmm_mutex_lock(&mutex1);
+		worker_count++;
+		vmm_mutex_unlock(&mutex1);
+	}
+
+	return 0;
+}
+
+static int mutex11_create_worker(u8 priority, u32 hcpu,
+				 int (*fn)(void *))
+{
+	worker = vmm_threads_create("mutex11_worker", fn, NULL,
+				    priority, VMM_THREAD_DEF_TIME_SLICE);
+	if (!worker) {
+		return VMM_EFAIL;
+	}
+	vmm_threads_set_affinity(worker, vmm_cpumask_of(hcpu));
+
+	return VMM_OK;
+}
+
+static void mutex11_destroy_worker(void)
+{
+	if (worker) {
+		vmm_threads_stop(worker);
+		vmm_threads_destroy(worker);
+		worker = NULL;
+	}
+}
+
+static int mutex11_run(struct wboxtest *test, struct vmm_chardev *cdev,
+		       u32 test_hcpu)
+{
+	int i, failures = 0;
+	u32 cpu, spin_hcpu = test_hcpu;
+	struct vmm_mutex_stats stats;
+	u8 current_priority = vmm_scheduler_current_priority();
+
+	/* Initialise global data */
+	INIT_MUTEX(&mutex1);
+	worker = NULL;
+	worker_go = 0;
+	worker_count = 0;
+
+	/* Uncontended lock and unlock */
+	for (i = 0; i < NUM_LOOPS; i++) {
+		vmm_mutex_lock(&mutex1);
+		vmm_udelay(10);
+		vmm_mutex_unlock(&mutex1);
+	}
+	vmm_mutex_get_stats(&mutex1, &stats);
+	if ((stats.lock_count != NUM_LOOPS) || stats.contended_count) {
+		vmm_cprintf(cdev, "error: lock_count=%"PRIu64" "
+			    "contended_count=%"PRIu64" after uncontended "
+			    "locking\n", stats.lock_count,
+			    stats.contended_count);
+		failures++;
+	}
+	if (stats.hold_nsecs_max < 10000) {
+		vmm_cprintf(cdev, "error: hold_nsecs_max=%"PRIu64" less "
+			    "than hold time\n", stats.hold_nsecs_max);
+		failures++;
+	}
+
+	/* Contended lock with worker sleeping on same host CPU */
+	if (mutex11_create_worker(current_priority, test_hcpu,
+				  mutex11_block_thread_main)) {
+		return VMM_EFAIL;
+	}
+	vmm_mutex_lock(&mutex1);
+	vmm_threads_start(worker);
+	vmm_msleep(SLEEP_MSECS*4);
+	vmm_mutex_unlock(&mutex1);
+	vmm_msleep(SLEEP_MSECS*4);
+	mutex11_destroy_worker();
+
+	vmm_mutex_get_stats(&mutex1, &stats);
+	if (worker_count != 1) {
+		vmm_cprintf(cdev, "error: worker did not get mutex\n");
+		failures++;
+	}
+	if (stats.contended_count != 1) {
+		vmm_cprintf(cdev, "error: contended_count=%"PRIu64" instead "
+			    "of 1\n", stats.contended_count);
+		failures++;
+	}
+	if (stats.wait_nsecs_max < (SLEEP_MSECS * 1000000ULL)) {
+		vmm_cprintf(cdev, "error: wait_nsecs_max=%"PRIu64" less "
+			    "than wait time\n", stats.wait_nsecs_max);
+		failures++;
+	}
+
+	/* Adaptive spinning needs another online host CPU */
+	for_each_online_cpu(cpu) {
+		if (cpu != test_hcpu) {
+			spin_hcpu = cpu;
+			break;
+		}
+	}
+	if (!CONFIG_MUTEX_SPIN_NSECS || (spin_hcpu == test_hcpu)) {
+		goto done;
+	}
+
+	worker_count = 0;
+	if (mutex11_create_worker(current_priority, spin_hcpu,
+				  mutex11_spin_thread_main)) {
+		return VMM_EFAIL;
+	}
+	vmm_threads_start(worker);
+	for (i = 0; i < NUM_LOOPS; i++) {
+		vmm_mutex_lock(&mutex1);
+		worker_go = i + 1;
+		vmm_udelay(SPIN_HOLD_USECS);
+		vmm_mutex_unlock(&mutex1);
+		vmm_msleep(SLEEP_MSECS);
+	}
+	mutex11_destroy_worker();
+
+	vmm_mutex_get_stats(&mutex1, &stats);
+	if (worker_count != NUM_LOOPS) {
+		vmm_cprintf(cdev, "error: spinning worker got mutex %d "
+			    "times instead of %d\n", worker_count, NUM_LOOPS);
+		failures++;
+	}
+	if (!stats.spin_count) {
+		vmm_cprintf(cdev, "error: worker never got mutex by "
+			    "spinning\n");
+		failures++;
+	}
+
+done:
+	return (failures) ? VMM_EFAIL : 0;
+}
+
+static struct wboxtest mutex11 = {
+	.name = "mutex11",
+	.run = mutex11_run,
+};
+
+static int __init mutex11_init(void)
+{
+	return wboxtest_register("threads", &mutex11);
+}
+
+static void __exit mutex11_exit(void)
+{
+	wboxtest_unregister(&mutex11);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -33,6 +33,8 @@ libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex6.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex7.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex8.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex9.o
+libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex10.o
+libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/mutex11.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/semaphore1.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/semaphore2.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/semaphore3.o
@@ -41,3 +43,4 @@ libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/semaphore5.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/waitqueue1.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/waitqueue2.o
 libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/waitqueue3.o
+libs-objs-$(CONFIG_WBOXTEST_THREADS) += wboxtest/threads/workqueue1.o
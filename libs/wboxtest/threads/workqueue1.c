@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2026 agent.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file workqueue1.c
+ * @author agent (agent@local)
+ * @brief workqueue1 test implementation
+ *
+ * This tests flushing of workqueues sharing worker pools.
+ *
+ * First, the main thread schedules few sleeping works on a workqueue
+ * allocated using vmm_workqueue_alloc() and flushes it. All works
+ * should be done when flush returns.
+ *
+ * Next, a work of one workqueue schedules a sleeping work on another
+ * workqueue sharing the same worker pool and flushes it. The flush
+ * should neither deadlock nor return before the other work is done.
+ */
+
+#include <vmm_error.h>
+#include <vmm_delay.h>
+#include <vmm_stdio.h>
+#include <vmm_completion.h>
+#include <vmm_workqueue.h>
+#include <vmm_modules.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"workqueue1 test"
+#define MODULE_AUTHOR			"agent"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			workqueue1_init
+#define MODULE_EXIT			workqueue1_exit
+
+/* Number of works flushed by main thread */
+#define NUM_WORKS			4
+
+/* Sleep delay in milliseconds */
+#define SLEEP_MSECS			(VMM_THREAD_DEF_TIME_SLICE/1000000ULL)
+
+/* Timeout for nested flush in nanoseconds */
+#define FLUSH_TIMEOUT_NSECS		(SLEEP_MSECS * 100 * 1000000ULL)
+
+/* Global data */
+static struct vmm_workqueue *wq1;
+static struct vmm_workqueue *wq2;
+static struct vmm_work sleep_works[NUM_WORKS];
+static struct vmm_work flush_work;
+static struct vmm_completion flush_done;
+static volatile int sleep_count;
+static volatile int flush_seen;
+
+static void workqueue1_sleep_work(struct vmm_work *work)
+{
+	vmm_msleep(SLEEP_MSECS);
+	sleep_count++;
+}
+
+static void workqueue1_flush_work(struct vmm_work *work)
+{
+	/* Other workqueue shares worker pool of this work */
+	vmm_workqueue_schedule_work(wq2, &sleep_works[0]);
+	vmm_workqueue_flush(wq2);
+	flush_seen = sleep_count;
+
+	vmm_completion_complete(&flush_done);
+}
+
+static int workqueue1_run(struct wboxtest *test, struct vmm_chardev *cdev,
+			  u32 test_hcpu)
+{
+	int i, rc, failures = 0;
+	u64 timeout = FLUSH_TIMEOUT_NSECS;
+
+	/* Initialise global data */
+	for (i = 0; i < NUM_WORKS; i++) {
+		INIT_WORK(&sleep_works[i], workqueue1_sleep_work);
+	}
+	INIT_WORK(&flush_work, workqueue1_flush_work);
+	INIT_COMPLETION(&flush_done);
+	sleep_count = 0;
+	flush_seen = 0;
+
+	wq1 = vmm_workqueue_alloc("workqueue1_wq1", 0);
+	if (!wq1) {
+		return VMM_ENOMEM;
+	}
+	wq2 = vmm_workqueue_alloc("workqueue1_wq2", 0);
+	if (!wq2) {
+		vmm_workqueue_destroy(wq1);
+		return VMM_ENOMEM;
+	}
+
+	/* Flush from main thread */
+	for (i = 0; i < NUM_WORKS; i++) {
+		vmm_workqueue_schedule_work(wq2, &sleep_works[i]);
+	}
+	vmm_workqueue_flush(wq2);
+	if (sleep_count != NUM_WORKS) {
+		vmm_cprintf(cdev, "error: %d of %d works done after flush\n",
+			    sleep_count, NUM_WORKS);
+		failures++;
+	}
+
+	/* Flush from work of another workqueue on same worker pool */
+	sleep_count = 0;
+	vmm_workqueue_schedule_work(wq1, &flush_work);
+	rc = vmm_completion_wait_timeout(&flush_done, &timeout);
+	if (rc) {
+		/* Works are stuck so workqueues cannot be destroyed */
+		vmm_cprintf(cdev, "error: flush from work did not finish\n");
+		return VMM_EFAIL;
+	}
+	if (flush_seen != 1) {
+		vmm_cprintf(cdev, "error: flush from work returned before "
+			    "work was done\n");
+		failures++;
+	}
+
+	vmm_workqueue_destroy(wq2);
+	vmm_workqueue_destroy(wq1);
+
+	return (failures) ? VMM_EFAIL : 0;
+}
+
+static struct wboxtest workqueue1 = {
+	.name = "workqueue1",
+	.run = workqueue1_run,
+};
+
+static int __init workqueue1_init(void)
+{
+	return wboxtest_register("threads", &workqueue1);
+}
+
+static void __exit workqueue1_exit(void)
+{
+	wboxtest_unregister(&workqueue1);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);